@@ -0,0 +1,220 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <stdlib.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "bitmap-atlas.h"
+#include "ctx-stack.h"
+#include "gl-state.h"
+#include "vdpau-trace.h"
+
+static
+bitmap_atlas_page_t *
+page_create(VdpRGBAFormat rgba_format, GLenum internal_format, GLenum format, GLenum type)
+{
+    bitmap_atlas_page_t *page = calloc(1, sizeof(bitmap_atlas_page_t));
+    if (NULL == page)
+        return NULL;
+    page->rgba_format = rgba_format;
+
+    // gaps between bitmaps should be transparent, so texture is cleared. Buffer is large
+    // enough for any of formats, as none takes more than four bytes per texel
+    void *zeros = calloc(BITMAP_ATLAS_PAGE_SIZE * BITMAP_ATLAS_PAGE_SIZE, 4);
+    if (NULL == zeros) {
+        traceError("error (bitmap_atlas page_create): calloc returned NULL\n");
+        free(page);
+        return NULL;
+    }
+
+    glx_context_clear_errors();
+    glGenTextures(1, &page->tex_id);
+    gl_state_bind_texture(page->tex_id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, BITMAP_ATLAS_PAGE_SIZE,
+                 BITMAP_ATLAS_PAGE_SIZE, 0, format, type, zeros);
+    free(zeros);
+
+    GLenum gl_error = glGetError();
+    if (GL_NO_ERROR != gl_error) {
+        traceError("error (bitmap_atlas page_create): gl error %d\n", gl_error);
+        gl_state_delete_textures(1, &page->tex_id);
+        free(page);
+        return NULL;
+    }
+
+    return page;
+}
+
+static
+void
+page_destroy(bitmap_atlas_page_t *page)
+{
+    gl_state_delete_textures(1, &page->tex_id);
+    free(page);
+}
+
+/** @brief Find place for w by h texels in page
+ *
+ *  Shelf with the least height that fits is preferred. Shelves more than twice as high as
+ *  needed are used only if there is no room for new shelf.
+ *
+ *  @retval 0 on success
+ *  @retval -1 if page is full
+ */
+static
+int
+page_alloc(bitmap_atlas_page_t *page, uint32_t w, uint32_t h, bitmap_atlas_slot_t *slot)
+{
+    int best = -1;
+    for (uint32_t k = 0; k < page->shelf_count; k ++) {
+        const bitmap_atlas_shelf_t *shelf = &page->shelves[k];
+        if (shelf->height < h || BITMAP_ATLAS_PAGE_SIZE - shelf->x < w)
+            continue;
+        if (best < 0 || shelf->height < page->shelves[best].height)
+            best = k;
+    }
+
+    const int have_room = page->shelf_count < BITMAP_ATLAS_MAX_SHELVES &&
+                          page->used_height + h <= BITMAP_ATLAS_PAGE_SIZE;
+    if ((best < 0 || page->shelves[best].height >= 2 * h) && have_room) {
+        bitmap_atlas_shelf_t *shelf = &page->shelves[page->shelf_count];
+        shelf->y = page->used_height;
+        shelf->height = h;
+        shelf->x = 0;
+        shelf->slot_count = 0;
+        best = page->shelf_count;
+        page->shelf_count ++;
+        page->used_height += h;
+    }
+    if (best < 0)
+        return -1;
+
+    bitmap_atlas_shelf_t *shelf = &page->shelves[best];
+    slot->page = page;
+    slot->shelf = best;
+    slot->x = shelf->x;
+    slot->y = shelf->y;
+    slot->width = w;
+    shelf->x += w;
+    shelf->slot_count ++;
+    page->slot_count ++;
+    return 0;
+}
+
+/** @brief Fill place of bitmap and its gaps with transparent texels
+ *
+ *  Space could have been used by another bitmap before, and its leftovers in gaps would
+ *  be picked up by linear filtering at bitmap edges.
+ *
+ *  @retval 0 on success
+ *  @retval -1 if memory for zeros can't be allocated
+ */
+static
+int
+page_clear_slot(const bitmap_atlas_slot_t *slot, uint32_t h, GLenum format, GLenum type)
+{
+    // rows are at most four bytes per texel, which is already aligned
+    void *zeros = calloc(slot->width * h, 4);
+    if (NULL == zeros) {
+        traceError("error (bitmap_atlas page_clear_slot): calloc returned NULL\n");
+        return -1;
+    }
+    gl_state_bind_texture(slot->page->tex_id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, slot->x, slot->y, slot->width, h, format, type, zeros);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    free(zeros);
+    return 0;
+}
+
+int
+bitmap_atlas_alloc(bitmap_atlas_t *atlas, VdpRGBAFormat rgba_format, GLenum internal_format,
+                   GLenum format, GLenum type, uint32_t width, uint32_t height,
+                   bitmap_atlas_slot_t *slot)
+{
+    if (width > BITMAP_ATLAS_MAX_SIZE || height > BITMAP_ATLAS_MAX_SIZE)
+        return -1;
+
+    // one texel gap to the right and below
+    const uint32_t w = width + 1;
+    const uint32_t h = (height + BITMAP_ATLAS_SHELF_ALIGN) & ~(BITMAP_ATLAS_SHELF_ALIGN - 1);
+
+    for (bitmap_atlas_page_t *page = atlas->pages; page; page = page->next) {
+        if (page->rgba_format == rgba_format && 0 == page_alloc(page, w, h, slot))
+            goto clear;
+    }
+
+    bitmap_atlas_page_t *page = page_create(rgba_format, internal_format, format, type);
+    if (NULL == page)
+        return -1;
+    page->next = atlas->pages;
+    atlas->pages = page;
+    if (0 != page_alloc(page, w, h, slot))
+        return -1;
+
+clear:
+    if (0 != page_clear_slot(slot, h, format, type)) {
+        bitmap_atlas_free(atlas, slot);
+        return -1;
+    }
+    return 0;
+}
+
+void
+bitmap_atlas_free(bitmap_atlas_t *atlas, bitmap_atlas_slot_t *slot)
+{
+    bitmap_atlas_page_t *page = slot->page;
+    if (NULL == page)
+        return;
+    slot->page = NULL;
+
+    bitmap_atlas_shelf_t *shelf = &page->shelves[slot->shelf];
+    shelf->slot_count --;
+    if (0 == shelf->slot_count)
+        shelf->x = 0;
+    else if (slot->x + slot->width == shelf->x)
+        shelf->x = slot->x;     // rightmost bitmap, its space could be reused
+
+    // empty shelves on top could be given to bitmaps of any height
+    while (page->shelf_count > 0 && 0 == page->shelves[page->shelf_count - 1].slot_count) {
+        page->shelf_count --;
+        page->used_height = page->shelves[page->shelf_count].y;
+    }
+
+    page->slot_count --;
+    if (page->slot_count > 0)
+        return;
+
+    // keep last page of format, to not recreate texture each time subtitles change
+    int format_pages = 0;
+    for (bitmap_atlas_page_t *p = atlas->pages; p; p = p->next)
+        format_pages += (p->rgba_format == page->rgba_format);
+    if (format_pages < 2)
+        return;
+
+    bitmap_atlas_page_t **pp = &atlas->pages;
+    while (*pp != page)
+        pp = &(*pp)->next;
+    *pp = page->next;
+    page_destroy(page);
+}
+
+void
+bitmap_atlas_destroy(bitmap_atlas_t *atlas)
+{
+    while (atlas->pages) {
+        bitmap_atlas_page_t *page = atlas->pages;
+        atlas->pages = page->next;
+        page_destroy(page);
+    }
+}
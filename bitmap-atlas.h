@@ -0,0 +1,91 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __BITMAP_ATLAS_H
+#define __BITMAP_ATLAS_H
+
+#include <stdint.h>
+#include <GL/gl.h>
+#include <vdpau/vdpau.h>
+
+/** @brief Width and height of atlas page texture */
+#define BITMAP_ATLAS_PAGE_SIZE      1024
+
+/** @brief Bitmaps with larger width or height get their own textures */
+#define BITMAP_ATLAS_MAX_SIZE       128
+
+/** @brief Shelf heights are rounded up to multiple of this, so shelves could be reused by
+ *  bitmaps of slightly different heights */
+#define BITMAP_ATLAS_SHELF_ALIGN    8
+
+#define BITMAP_ATLAS_MAX_SHELVES    (BITMAP_ATLAS_PAGE_SIZE / BITMAP_ATLAS_SHELF_ALIGN)
+
+/** @brief Horizontal strip of atlas page, filled from left to right */
+typedef struct {
+    uint32_t    y;
+    uint32_t    height;
+    uint32_t    x;                  ///< left edge of free space
+    uint32_t    slot_count;         ///< number of bitmaps allocated in shelf
+} bitmap_atlas_shelf_t;
+
+/** @brief Atlas texture holding bitmaps of one format */
+typedef struct bitmap_atlas_page {
+    GLuint      tex_id;
+    VdpRGBAFormat rgba_format;
+    uint32_t    used_height;        ///< top of topmost shelf
+    uint32_t    shelf_count;
+    uint32_t    slot_count;         ///< number of bitmaps allocated in page
+    bitmap_atlas_shelf_t shelves[BITMAP_ATLAS_MAX_SHELVES];
+    struct bitmap_atlas_page *next;
+} bitmap_atlas_page_t;
+
+/** @brief Place of bitmap in atlas */
+typedef struct {
+    bitmap_atlas_page_t *page;      ///< NULL if bitmap is not in atlas
+    uint32_t    shelf;              ///< shelf index in page
+    uint32_t    x;                  ///< offset of bitmap in page texture
+    uint32_t    y;
+    uint32_t    width;              ///< occupied width, including gap to the next bitmap
+} bitmap_atlas_slot_t;
+
+/** @brief Atlas pages of all formats, one set per device
+ *
+ *  Small bitmaps, like subtitle glyphs, are sub-allocated from shared textures, so they
+ *  don't need texture object each and could be drawn in one batch. Adjacent bitmaps are
+ *  separated by one texel gap, so linear filtering at bitmap edges doesn't pick up
+ *  neighbours.
+ */
+typedef struct {
+    bitmap_atlas_page_t *pages;
+} bitmap_atlas_t;
+
+/** @brief Allocate space for bitmap. GL context must be current
+ *
+ *  New page texture is created with given GL formats if no existing page of that format
+ *  has enough space. Allocated place and gaps around it are cleared to transparent.
+ *
+ *  @retval 0 on success
+ *  @retval -1 if bitmap is too large for atlas or page texture can't be created
+ */
+int
+bitmap_atlas_alloc(bitmap_atlas_t *atlas, VdpRGBAFormat rgba_format, GLenum internal_format,
+                   GLenum format, GLenum type, uint32_t width, uint32_t height,
+                   bitmap_atlas_slot_t *slot);
+
+/** @brief Return space to atlas. GL context must be current
+ *
+ *  Empty page is deleted unless it's the only one of its format.
+ */
+void
+bitmap_atlas_free(bitmap_atlas_t *atlas, bitmap_atlas_slot_t *slot);
+
+/** @brief Delete all pages. GL context must be current */
+void
+bitmap_atlas_destroy(bitmap_atlas_t *atlas);
+
+#endif /* __BITMAP_ATLAS_H */
@@ -20,6 +20,15 @@ rbsp_attach_buffer(rbsp_state_t *state, const uint8_t *buf, size_t byte_count)
     state->bit_ptr      = 7;
     state->zeros_in_row = 0;
     state->bits_eaten   = 0;
+    state->emulation_prevention = 1;
+}
+
+inline
+void
+rbsp_set_emulation_prevention(rbsp_state_t *state, int enabled)
+{
+    state->emulation_prevention = enabled;
+    state->zeros_in_row = 0;
 }
 
 rbsp_state_t
@@ -66,6 +75,9 @@ rbsp_consume_byte(rbsp_state_t *state)
         return -1;
 
     uint8_t c = *state->cur_ptr++;
+    if (!state->emulation_prevention)
+        return c;
+
     if (0 == c) state->zeros_in_row ++;
     else state->zeros_in_row = 0;
 
@@ -20,6 +20,7 @@ typedef struct _rbsp_state_struct {
     int             bit_ptr;        ///< pointer to currently processed bit
     int             zeros_in_row;   ///< number of consequetive zero bytes so far
     int             bits_eaten;     ///< bit offset of current position not including EPB
+    int             emulation_prevention;   ///< 1 if 0x000003 sequences should be unescaped
 } rbsp_state_t;
 
 
@@ -43,6 +44,13 @@ int rbsp_consume_byte(rbsp_state_t *state);
 
 rbsp_state_t rbsp_copy_state(rbsp_state_t *state);
 
+/** @brief Enable or disable emulation prevention bytes handling
+ *
+ *  H.264 payloads contain emulation prevention bytes, which should be skipped, while
+ *  MPEG-4 Part 2 streams are not escaped at all. Handling is enabled by default.
+ */
+void rbsp_set_emulation_prevention(rbsp_state_t *state, int enabled);
+
 int rbsp_navigate_to_nal_unit(rbsp_state_t *state);
 
 void rbsp_reset_bit_counter(rbsp_state_t *state);
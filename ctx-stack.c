@@ -11,9 +11,13 @@
  */
 
 #define _GNU_SOURCE
+#define GL_GLEXT_PROTOTYPES
 #include "ctx-stack.h"
 #include "globals.h"
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/glext.h>
 #include "vdpau-trace.h"
 #include "vdpau-locking.h"
 #include <sys/syscall.h>
@@ -24,10 +28,25 @@ static __thread Drawable glx_ctx_stack_wnd;
 static __thread GLXContext glx_ctx_stack_glc;
 static __thread int glx_ctx_stack_same;
 static __thread int glx_ctx_stack_element_count = 0;
+static __thread gl_state_t *glx_ctx_stack_gl_state = NULL;
+// Contexts passed to glx_context_push_global belong to callers, which could share them
+// between threads. State is forgotten on every push.
+static __thread gl_state_t glx_ctx_stack_global_gl_state;
+static __thread int glx_ctx_stack_debug_output = 0;
 GHashTable     *glc_hash_table = NULL;
 int             glc_hash_table_ref_count = 0;
 GLXContext      root_glc;
 XVisualInfo    *root_vi;
+static int      debug_probe_hit;    ///< set by debug callback while probe is in progress
+static int      debug_probe_active = 0;
+
+/** @brief thread-local context with its shadow state, kept in glc_hash_table */
+struct thread_local_glc {
+    GLXContext  glc;
+    gl_state_t  gl_state;
+    int         debug_output;           ///< 1 if errors are reported by debug callback,
+                                        ///< 0 if not, -1 if that is not known yet
+};
 
 void
 glx_context_push_global(Display *dpy, Drawable wnd, GLXContext glc)
@@ -49,6 +68,11 @@ glx_context_push_global(Display *dpy, Drawable wnd, GLXContext glc)
         locked_glXMakeCurrent(dpy, wnd, glc);
     }
 
+    gl_state_invalidate(&glx_ctx_stack_global_gl_state);
+    glx_ctx_stack_gl_state = &glx_ctx_stack_global_gl_state;
+    // caller's context doesn't have debug callback
+    glx_ctx_stack_debug_output = 0;
+
     pthread_mutex_unlock(&global.glx_ctx_stack_mutex);
 }
 
@@ -60,12 +84,18 @@ glx_context_push_thread_local(VdpDeviceData *deviceData)
     const Window wnd = deviceData->root;
     const gint thread_id = (gint) syscall(__NR_gettid);
 
-    GLXContext glc = g_hash_table_lookup(glc_hash_table, GINT_TO_POINTER(thread_id));
-    if (!glc) {
-        glc = glXCreateContext(dpy, root_vi, root_glc, GL_TRUE);
-        assert(glc);
-        g_hash_table_insert(glc_hash_table, GINT_TO_POINTER(thread_id), glc);
+    struct thread_local_glc *tl_glc =
+        g_hash_table_lookup(glc_hash_table, GINT_TO_POINTER(thread_id));
+    if (!tl_glc) {
+        tl_glc = malloc(sizeof(*tl_glc));
+        assert(tl_glc);
+        tl_glc->glc = glXCreateContext(dpy, root_vi, root_glc, GL_TRUE);
+        assert(tl_glc->glc);
+        gl_state_invalidate(&tl_glc->gl_state);
+        tl_glc->debug_output = -1;
+        g_hash_table_insert(glc_hash_table, GINT_TO_POINTER(thread_id), tl_glc);
     }
+    GLXContext glc = tl_glc->glc;
 
     glx_ctx_stack_display = glXGetCurrentDisplay();
     glx_ctx_stack_wnd =     glXGetCurrentDrawable();
@@ -80,6 +110,14 @@ glx_context_push_thread_local(VdpDeviceData *deviceData)
         locked_glXMakeCurrent(dpy, wnd, glc);
     }
 
+    gl_state_revalidate(&tl_glc->gl_state);
+    glx_ctx_stack_gl_state = &tl_glc->gl_state;
+    if (tl_glc->debug_output < 0) {
+        // context should be current for that
+        tl_glc->debug_output = glx_context_enable_debug_output();
+    }
+    glx_ctx_stack_debug_output = tl_glc->debug_output;
+
     pthread_mutex_unlock(&global.glx_ctx_stack_mutex);
 }
 
@@ -95,6 +133,8 @@ glx_context_pop()
     }
 
     glx_ctx_stack_element_count --;
+    glx_ctx_stack_gl_state = NULL;
+    glx_ctx_stack_debug_output = 0;
 
     pthread_mutex_unlock(&global.glx_ctx_stack_mutex);
 }
@@ -128,9 +168,10 @@ void
 glc_hash_destroy_func(gpointer key, gpointer value, gpointer user_data)
 {
     (void)key;
-    GLXContext glc = value;
+    struct thread_local_glc *tl_glc = value;
     Display *dpy = user_data;
-    glXDestroyContext(dpy, glc);
+    glXDestroyContext(dpy, tl_glc->glc);
+    free(tl_glc);
 }
 
 void
@@ -156,3 +197,80 @@ glx_context_get_root_context(void)
 {
     return root_glc;
 }
+
+gl_state_t *
+glx_context_get_gl_state(void)
+{
+    return glx_ctx_stack_gl_state;
+}
+
+static
+void
+GLAPIENTRY
+gl_debug_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+                  const GLchar *message, const void *user_param)
+{
+    (void)source; (void)id; (void)severity; (void)length; (void)user_param;
+    if (GL_DEBUG_TYPE_ERROR != type)
+        return;
+    if (debug_probe_active)
+        debug_probe_hit = 1;
+    else
+        traceError("error (GL): %s\n", message);
+}
+
+int
+glx_context_enable_debug_output(void)
+{
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if (NULL == extensions || NULL == strstr(extensions, "GL_KHR_debug"))
+        return 0;
+
+    // only errors are of interest, other messages are filtered out by driver
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    glDebugMessageCallback(gl_debug_callback, NULL);
+    glEnable(GL_DEBUG_OUTPUT);
+
+    // Contexts are created without debug flag, and some drivers report nothing for such
+    // contexts. So an error is provoked to see whether callback actually gets called.
+    glx_context_clear_errors();
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    debug_probe_hit = 0;
+    debug_probe_active = 1;
+    glEnable(GL_NONE);      // GL_INVALID_ENUM
+    debug_probe_active = 0;
+    glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glx_context_clear_errors();
+
+    if (!debug_probe_hit) {
+        glDisable(GL_DEBUG_OUTPUT);
+        glDebugMessageCallback(NULL, NULL);
+        return 0;
+    }
+    return 1;
+}
+
+void
+glx_context_set_debug_output(int enabled)
+{
+    glx_ctx_stack_debug_output = enabled;
+}
+
+void
+glx_context_clear_errors(void)
+{
+    // bounded, as lost context could keep reporting error
+    for (int k = 0; k < 16; k ++) {
+        if (GL_NO_ERROR == glGetError())
+            break;
+    }
+}
+
+GLenum
+glx_context_check_error(void)
+{
+    if (!global.quirks.check_gl_errors && glx_ctx_stack_debug_output)
+        return GL_NO_ERROR;
+    return glGetError();
+}
@@ -9,6 +9,7 @@
 #ifndef __CTX_STACK_H
 #define __CTX_STACK_H
 
+#include "gl-state.h"
 #include "vdpau-soft.h"
 
 void glx_context_push_global(Display *dpy, Drawable wnd, GLXContext glc);
@@ -17,4 +18,37 @@ void glx_context_pop(void);
 void glx_context_ref_glc_hash_table(Display *dpy, int screen);
 void glx_context_unref_glc_hash_table(Display *dpy);
 GLXContext  glx_context_get_root_context(void);
+
+/** @brief Shadow state of context made current by last push, NULL if there is none */
+gl_state_t *glx_context_get_gl_state(void);
+
+/** @brief Make current context report GL errors via GL_KHR_debug callback
+ *
+ *  Thread-local contexts get it on creation. Callback prints errors with traceError.
+ *
+ *  @retval 1 if callback was seen to work
+ *  @retval 0 if errors should be checked with glGetError
+ */
+int glx_context_enable_debug_output(void);
+
+/** @brief Tell whether context made current by glx_context_push_global reports errors via
+ *  debug callback. It's assumed it doesn't otherwise.
+ */
+void glx_context_set_debug_output(int enabled);
+
+/** @brief Reset GL error flags of current context
+ *
+ *  Errors of earlier calls are not checked synchronously, so they should be cleared
+ *  before glGetError is used to check success of particular calls.
+ */
+void glx_context_clear_errors(void);
+
+/** @brief Check current context for GL errors
+ *
+ *  glGetError makes driver wait for GPU, so it's only called with CheckGLErrors quirk
+ *  enabled or if current context can't report errors by GL_KHR_debug callback.
+ *
+ *  @retval GL error code, or GL_NO_ERROR if there were no errors or check was skipped
+ */
+GLenum glx_context_check_error(void);
 #endif /* __CTX_STACK_H */
@@ -0,0 +1,150 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#define _FILE_OFFSET_BITS   64
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include "decoder-capture.h"
+#include "vdpau-trace.h"
+
+static FILE    *capture_file = NULL;
+static GArray  *capture_index = NULL;   ///< offsets of records written so far
+static uint64_t capture_offset = 0;     ///< current write position
+
+static
+int
+write_padded(const void *data, uint64_t size)
+{
+    static const char zeros[8] = { 0 };
+    const uint64_t padding = DECODER_CAPTURE_ALIGN(size) - size;
+
+    if (size > 0 && 1 != fwrite(data, size, 1, capture_file))
+        return 0;
+    if (padding > 0 && 1 != fwrite(zeros, padding, 1, capture_file))
+        return 0;
+    capture_offset += size + padding;
+    return 1;
+}
+
+int
+decoder_capture_open(const char *fname)
+{
+    if (capture_file)
+        return 1;
+
+    capture_file = fopen(fname, "wb");
+    if (NULL == capture_file) {
+        traceError("error (decoder_capture_open): can't open %s\n", fname);
+        return 0;
+    }
+
+    decoder_capture_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DECODER_CAPTURE_MAGIC, sizeof(header.magic));
+    header.version = DECODER_CAPTURE_VERSION;
+
+    capture_offset = 0;
+    if (!write_padded(&header, sizeof(header))) {
+        traceError("error (decoder_capture_open): can't write to %s\n", fname);
+        fclose(capture_file);
+        capture_file = NULL;
+        return 0;
+    }
+
+    capture_index = g_array_new(FALSE, FALSE, sizeof(uint64_t));
+    return 1;
+}
+
+void
+decoder_capture_close(void)
+{
+    if (NULL == capture_file)
+        return;
+
+    decoder_capture_trailer_t trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    memcpy(trailer.magic, DECODER_CAPTURE_INDEX_MAGIC, sizeof(trailer.magic));
+    trailer.index_offset = capture_offset;
+    trailer.record_count = capture_index->len;
+
+    if (!write_padded(capture_index->data, capture_index->len * sizeof(uint64_t)) ||
+        !write_padded(&trailer, sizeof(trailer)))
+    {
+        traceError("error (decoder_capture_close): can't write index\n");
+    }
+
+    fclose(capture_file);
+    capture_file = NULL;
+    g_array_free(capture_index, TRUE);
+    capture_index = NULL;
+}
+
+void
+decoder_capture_render(VdpDecoder decoder, VdpDecoderProfile profile, uint32_t width,
+                       uint32_t height, uint32_t max_references, VdpVideoSurface target,
+                       VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+                       VdpBitstreamBuffer const *bitstream_buffers)
+{
+    if (NULL == capture_file)
+        return;
+
+    switch (profile) {
+    case VDP_DECODER_PROFILE_H264_BASELINE:
+    case VDP_DECODER_PROFILE_H264_MAIN:
+    case VDP_DECODER_PROFILE_H264_HIGH:
+        break;
+    default:
+        return;
+    }
+
+    decoder_capture_record_t record;
+    memset(&record, 0, sizeof(record));
+    record.decoder = decoder;
+    record.profile = profile;
+    record.width = width;
+    record.height = height;
+    record.max_references = max_references;
+    record.target = target;
+    record.picture_info_size = sizeof(VdpPictureInfoH264);
+    record.bitstream_buffer_count = bitstream_buffer_count;
+
+    uint64_t record_size = sizeof(record) + DECODER_CAPTURE_ALIGN(record.picture_info_size) +
+                           DECODER_CAPTURE_ALIGN(bitstream_buffer_count * sizeof(uint32_t));
+    for (uint32_t k = 0; k < bitstream_buffer_count; k ++)
+        record_size += DECODER_CAPTURE_ALIGN(bitstream_buffers[k].bitstream_bytes);
+    if (record_size > UINT32_MAX) {
+        traceError("error (decoder_capture_render): record is too large, skipping\n");
+        return;
+    }
+    record.record_size = record_size;
+
+    uint32_t *sizes = g_new(uint32_t, bitstream_buffer_count + 1);
+    for (uint32_t k = 0; k < bitstream_buffer_count; k ++)
+        sizes[k] = bitstream_buffers[k].bitstream_bytes;
+
+    const uint64_t record_offset = capture_offset;
+    int ok = write_padded(&record, sizeof(record)) &&
+             write_padded(picture_info, record.picture_info_size) &&
+             write_padded(sizes, bitstream_buffer_count * sizeof(uint32_t));
+    for (uint32_t k = 0; k < bitstream_buffer_count && ok; k ++)
+        ok = write_padded(bitstream_buffers[k].bitstream, bitstream_buffers[k].bitstream_bytes);
+    g_free(sizes);
+
+    // flush every record, so capture remains usable even if application crashes
+    if (!ok || 0 != fflush(capture_file)) {
+        traceError("error (decoder_capture_render): write failed, capture stopped\n");
+        fclose(capture_file);
+        capture_file = NULL;
+        g_array_free(capture_index, TRUE);
+        capture_index = NULL;
+        return;
+    }
+
+    g_array_append_val(capture_index, record_offset);
+}
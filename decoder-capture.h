@@ -0,0 +1,86 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __DECODER_CAPTURE_H
+#define __DECODER_CAPTURE_H
+
+#include <stdint.h>
+#include <vdpau/vdpau.h>
+
+/*  Capture file layout. All fields are in host byte order, every part of file starts
+ *  at 8-byte boundary, so file could be mmap'ed and read in place.
+ *
+ *      decoder_capture_file_header_t
+ *      record 0
+ *      ...
+ *      record N-1
+ *      uint64_t offsets[N]                 index, offsets of records from file start
+ *      decoder_capture_trailer_t
+ *
+ *  Each record is:
+ *      decoder_capture_record_t
+ *      picture info                        picture_info_size bytes
+ *      uint32_t bitstream_bytes[bitstream_buffer_count]
+ *      bitstream buffer 0 ... bitstream buffer K-1
+ *
+ *  Index and trailer are written on library unload. If they are missing (i.e. application
+ *  crashed), records still can be read sequentially.
+ */
+
+#define DECODER_CAPTURE_MAGIC           "VAGLCAP1"
+#define DECODER_CAPTURE_INDEX_MAGIC     "VAGLIDX1"
+#define DECODER_CAPTURE_VERSION         1
+
+/** @brief round size up to 8-byte boundary */
+#define DECODER_CAPTURE_ALIGN(size)     (((size) + 7) & ~(uint64_t)7)
+
+typedef struct {
+    char        magic[8];           ///< DECODER_CAPTURE_MAGIC
+    uint32_t    version;            ///< DECODER_CAPTURE_VERSION
+    uint32_t    reserved;
+} decoder_capture_file_header_t;
+
+/** @brief one VdpDecoderRender call */
+typedef struct {
+    uint32_t    record_size;        ///< whole record size, including this header and padding
+    uint32_t    decoder;            ///< VdpDecoder handle at capture time
+    uint32_t    profile;            ///< VdpDecoderProfile
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    max_references;
+    uint32_t    target;             ///< target VdpVideoSurface handle at capture time
+    uint32_t    picture_info_size;
+    uint32_t    bitstream_buffer_count;
+    uint32_t    reserved;
+} decoder_capture_record_t;
+
+typedef struct {
+    char        magic[8];           ///< DECODER_CAPTURE_INDEX_MAGIC
+    uint64_t    index_offset;       ///< file offset of index
+    uint64_t    record_count;
+} decoder_capture_trailer_t;
+
+/** @brief Open capture file. Subsequent decoder_capture_render calls append records to it */
+int
+decoder_capture_open(const char *fname);
+
+/** @brief Write index and close capture file */
+void
+decoder_capture_close(void);
+
+/** @brief Append record for VdpDecoderRender call. Does nothing if capture is not active
+ *
+ *  Only H.264 profiles are captured.
+ */
+void
+decoder_capture_render(VdpDecoder decoder, VdpDecoderProfile profile, uint32_t width,
+                       uint32_t height, uint32_t max_references, VdpVideoSurface target,
+                       VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+                       VdpBitstreamBuffer const *bitstream_buffers);
+
+#endif /* __DECODER_CAPTURE_H */
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "decoder-stats.h"
+#include "reverse-constant.h"
+
+static const char *stage_names[VDP_DECODER_STAGE_COUNT] = {
+    [VDP_DECODER_STAGE_TOTAL] =     "total",
+    [VDP_DECODER_STAGE_MERGE] =     "merge",
+    [VDP_DECODER_STAGE_PARSE] =     "parse",
+    [VDP_DECODER_STAGE_BUFFERS] =   "buffers",
+    [VDP_DECODER_STAGE_SUBMIT] =    "submit",
+};
+
+uint64_t
+decoder_stats_timestamp(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void
+decoder_stats_init(VdpDecoderStatsVaGl *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->struct_version = VDP_DECODER_STATS_VA_GL_VERSION;
+}
+
+void
+decoder_stats_add_time(VdpDecoderStatsVaGl *stats, VdpDecoderStageVaGl stage,
+                       uint64_t duration_ns)
+{
+    uint64_t us = duration_ns / 1000;
+    int bucket = 0;
+    while (us > 1 && bucket < VDP_DECODER_STATS_LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket ++;
+    }
+
+    stats->stage_samples[stage] ++;
+    stats->stage_time_ns[stage] += duration_ns;
+    stats->stage_latency[stage][bucket] ++;
+}
+
+void
+decoder_stats_add_frame(VdpDecoderStatsVaGl *stats, uint32_t bitstream_buffer_count,
+                        VdpBitstreamBuffer const *bitstream_buffers)
+{
+    stats->frames ++;
+    for (uint32_t k = 0; k < bitstream_buffer_count; k ++)
+        stats->bytes += bitstream_buffers[k].bitstream_bytes;
+}
+
+void
+decoder_stats_add_slices(VdpDecoderStatsVaGl *stats, uint32_t slice_count)
+{
+    stats->slices += slice_count;
+    if (slice_count >= VDP_DECODER_STATS_SLICE_BUCKETS)
+        slice_count = VDP_DECODER_STATS_SLICE_BUCKETS - 1;
+    stats->slices_per_frame[slice_count] ++;
+}
+
+/** @brief Upper bound of latency bucket containing given fraction of samples, in us */
+static
+uint64_t
+latency_percentile(const VdpDecoderStatsVaGl *stats, int stage, double fraction)
+{
+    const uint64_t threshold = stats->stage_samples[stage] * fraction;
+    uint64_t accumulated = 0;
+    for (int k = 0; k < VDP_DECODER_STATS_LATENCY_BUCKETS; k ++) {
+        accumulated += stats->stage_latency[stage][k];
+        if (accumulated > threshold)
+            return (uint64_t)2 << k;
+    }
+    return (uint64_t)2 << (VDP_DECODER_STATS_LATENCY_BUCKETS - 1);
+}
+
+void
+decoder_stats_dump(const VdpDecoderStatsVaGl *stats, VdpDecoder decoder,
+                   VdpDecoderProfile profile)
+{
+    FILE *f = stderr;
+    fprintf(f, "[VS] decoder %d (%s): %llu frames, %llu bytes, %llu slices",
+            decoder, reverse_decoder_profile(profile), (unsigned long long)stats->frames,
+            (unsigned long long)stats->bytes, (unsigned long long)stats->slices);
+    if (stats->frames > 0 && stats->slices > 0)
+        fprintf(f, ", %.2f slices per frame", (double)stats->slices / stats->frames);
+    fprintf(f, "\n");
+
+    if (stats->slices > 0) {
+        fprintf(f, "[VS]   slices per frame:");
+        for (int k = 0; k < VDP_DECODER_STATS_SLICE_BUCKETS; k ++) {
+            if (0 == stats->slices_per_frame[k])
+                continue;
+            fprintf(f, " %d%s:%llu", k, k == VDP_DECODER_STATS_SLICE_BUCKETS - 1 ? "+" : "",
+                    (unsigned long long)stats->slices_per_frame[k]);
+        }
+        fprintf(f, "\n");
+    }
+
+    for (int s = 0; s < VDP_DECODER_STAGE_COUNT; s ++) {
+        const uint64_t samples = stats->stage_samples[s];
+        if (0 == samples)
+            continue;
+        fprintf(f, "[VS]   %-8s %8llu samples, avg %9.1f us, p50 < %llu us, p99 < %llu us |",
+                stage_names[s], (unsigned long long)samples,
+                stats->stage_time_ns[s] / 1000.0 / samples,
+                (unsigned long long)latency_percentile(stats, s, 0.5),
+                (unsigned long long)latency_percentile(stats, s, 0.99));
+        for (int k = 0; k < VDP_DECODER_STATS_LATENCY_BUCKETS; k ++) {
+            if (0 == stats->stage_latency[s][k])
+                continue;
+            fprintf(f, " <%llu:%llu", (unsigned long long)2 << k,
+                    (unsigned long long)stats->stage_latency[s][k]);
+        }
+        fprintf(f, "\n");
+    }
+}
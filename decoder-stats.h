@@ -0,0 +1,94 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __DECODER_STATS_H
+#define __DECODER_STATS_H
+
+#include <stdint.h>
+#include <vdpau/vdpau.h>
+
+/*  Per-decoder performance counters.
+ *
+ *  Counters are available to applications through driver-specific VdpGetProcAddress
+ *  function id VDP_FUNC_ID_DECODER_GET_STATS_VA_GL. This header depends on VDPAU headers
+ *  only and could be copied to application source tree.
+ */
+
+#define VDP_FUNC_ID_DECODER_GET_STATS_VA_GL     (VDP_FUNC_ID_BASE_DRIVER + 0)
+
+#define VDP_DECODER_STATS_VA_GL_VERSION         1
+
+/** @brief number of buckets in latency histograms
+ *
+ *  Bucket 0 counts samples shorter than 2 us, bucket k counts samples from 2^k to
+ *  2^(k+1) us, last one counts everything longer.
+ */
+#define VDP_DECODER_STATS_LATENCY_BUCKETS       24
+
+/** @brief number of buckets in slices per frame histogram. Last one counts frames
+ *  with that many slices or more */
+#define VDP_DECODER_STATS_SLICE_BUCKETS         32
+
+/** @brief decoding stages being timed */
+typedef enum {
+    VDP_DECODER_STAGE_TOTAL = 0,    ///< whole VdpDecoderRender call
+    VDP_DECODER_STAGE_MERGE,        ///< concatenation of bitstream buffers
+    VDP_DECODER_STAGE_PARSE,        ///< slice header parsing
+    VDP_DECODER_STAGE_BUFFERS,      ///< VA buffer creation and filling
+    VDP_DECODER_STAGE_SUBMIT,       ///< from vaBeginPicture to vaEndPicture, or libavcodec
+                                    ///< decoding in software decoder
+    VDP_DECODER_STAGE_COUNT
+} VdpDecoderStageVaGl;
+
+typedef struct {
+    uint32_t    struct_version;     ///< VDP_DECODER_STATS_VA_GL_VERSION
+    uint32_t    reserved;
+    uint64_t    frames;             ///< VdpDecoderRender calls
+    uint64_t    slices;             ///< slices submitted to VA-API or software decoder
+    uint64_t    bytes;              ///< bitstream bytes passed to VdpDecoderRender
+    uint64_t    slices_per_frame[VDP_DECODER_STATS_SLICE_BUCKETS];
+    uint64_t    stage_samples[VDP_DECODER_STAGE_COUNT];     ///< number of timed samples
+    uint64_t    stage_time_ns[VDP_DECODER_STAGE_COUNT];     ///< accumulated time
+    uint64_t    stage_latency[VDP_DECODER_STAGE_COUNT][VDP_DECODER_STATS_LATENCY_BUCKETS];
+} VdpDecoderStatsVaGl;
+
+/** @brief Copy counters of decoder
+ *
+ *  Stages which are not applicable to decoder profile, or to decoding backend, have
+ *  zero samples.
+ */
+typedef VdpStatus VdpDecoderGetStatsVaGl(VdpDecoder decoder, VdpDecoderStatsVaGl *stats);
+
+/** @brief Monotonic time in nanoseconds */
+uint64_t
+decoder_stats_timestamp(void);
+
+/** @brief Reset counters */
+void
+decoder_stats_init(VdpDecoderStatsVaGl *stats);
+
+/** @brief Account one sample of stage duration */
+void
+decoder_stats_add_time(VdpDecoderStatsVaGl *stats, VdpDecoderStageVaGl stage,
+                       uint64_t duration_ns);
+
+/** @brief Account one frame */
+void
+decoder_stats_add_frame(VdpDecoderStatsVaGl *stats, uint32_t bitstream_buffer_count,
+                        VdpBitstreamBuffer const *bitstream_buffers);
+
+/** @brief Account slices submitted for one frame */
+void
+decoder_stats_add_slices(VdpDecoderStatsVaGl *stats, uint32_t slice_count);
+
+/** @brief Print counters to stderr */
+void
+decoder_stats_dump(const VdpDecoderStatsVaGl *stats, VdpDecoder decoder,
+                   VdpDecoderProfile profile);
+
+#endif /* __DECODER_STATS_H */
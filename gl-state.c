@@ -0,0 +1,219 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "ctx-stack.h"
+#include "gl-state.h"
+
+// All callers hold global mutex, so plain counters are enough
+static uint32_t deletion_epoch = 0;
+static uint64_t skipped_calls = 0;
+
+void
+gl_state_invalidate(gl_state_t *state)
+{
+    memset(state, 0xff, sizeof(*state));
+    state->epoch = deletion_epoch;
+}
+
+void
+gl_state_invalidate_current(void)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state)
+        gl_state_invalidate(state);
+}
+
+void
+gl_state_revalidate(gl_state_t *state)
+{
+    if (state->epoch != deletion_epoch)
+        gl_state_invalidate(state);
+}
+
+void
+gl_state_bind_framebuffer(GLuint framebuffer)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state && state->framebuffer == framebuffer) {
+        skipped_calls ++;
+        return;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (state)
+        state->framebuffer = framebuffer;
+}
+
+void
+gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state && state->viewport[0] == x && state->viewport[1] == y &&
+        state->viewport[2] == width && state->viewport[3] == height)
+    {
+        skipped_calls ++;
+        return;
+    }
+    glViewport(x, y, width, height);
+    if (state) {
+        state->viewport[0] = x;
+        state->viewport[1] = y;
+        state->viewport[2] = width;
+        state->viewport[3] = height;
+    }
+}
+
+void
+gl_state_active_texture(GLenum texture)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state && state->active_texture == texture) {
+        skipped_calls ++;
+        return;
+    }
+    glActiveTexture(texture);
+    if (state)
+        state->active_texture = texture;
+}
+
+void
+gl_state_bind_texture(GLuint texture)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    const GLuint unit = state ? state->active_texture - GL_TEXTURE0 : 0;
+    if (NULL == state || unit >= GL_STATE_TEXTURE_UNITS) {
+        // active unit is either unknown or not tracked
+        glBindTexture(GL_TEXTURE_2D, texture);
+        return;
+    }
+    if (state->texture[unit] == texture) {
+        skipped_calls ++;
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    state->texture[unit] = texture;
+}
+
+void
+gl_state_use_program(GLuint program)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state && state->program == program) {
+        skipped_calls ++;
+        return;
+    }
+    glUseProgram(program);
+    if (state)
+        state->program = program;
+}
+
+void
+gl_state_blend(int enabled)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    enabled = !!enabled;
+    if (state && state->blend == enabled) {
+        skipped_calls ++;
+        return;
+    }
+    if (enabled)
+        glEnable(GL_BLEND);
+    else
+        glDisable(GL_BLEND);
+    if (state)
+        state->blend = enabled;
+}
+
+void
+gl_state_blend_func(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state && state->blend_func[0] == src_rgb && state->blend_func[1] == dst_rgb &&
+        state->blend_func[2] == src_alpha && state->blend_func[3] == dst_alpha)
+    {
+        skipped_calls ++;
+        return;
+    }
+    glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+    if (state) {
+        state->blend_func[0] = src_rgb;
+        state->blend_func[1] = dst_rgb;
+        state->blend_func[2] = src_alpha;
+        state->blend_func[3] = dst_alpha;
+    }
+}
+
+void
+gl_state_blend_equation(GLenum mode_rgb, GLenum mode_alpha)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    if (state && state->blend_equation[0] == mode_rgb &&
+        state->blend_equation[1] == mode_alpha)
+    {
+        skipped_calls ++;
+        return;
+    }
+    glBlendEquationSeparate(mode_rgb, mode_alpha);
+    if (state) {
+        state->blend_equation[0] = mode_rgb;
+        state->blend_equation[1] = mode_alpha;
+    }
+}
+
+/** @brief Make other contexts drop their bindings, as deleted names could be reused */
+static
+void
+note_deletion(gl_state_t *state)
+{
+    const int up_to_date = state && state->epoch == deletion_epoch;
+    deletion_epoch ++;
+    if (up_to_date)
+        state->epoch = deletion_epoch;
+    else if (state)
+        gl_state_invalidate(state);
+}
+
+void
+gl_state_delete_textures(GLsizei n, const GLuint *textures)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    glDeleteTextures(n, textures);
+    if (state) {
+        // deleted textures are unbound in current context
+        for (GLsizei k = 0; k < n; k ++) {
+            for (int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit ++) {
+                if (state->texture[unit] == textures[k])
+                    state->texture[unit] = 0;
+            }
+        }
+    }
+    note_deletion(state);
+}
+
+void
+gl_state_delete_framebuffers(GLsizei n, const GLuint *framebuffers)
+{
+    gl_state_t *state = glx_context_get_gl_state();
+    glDeleteFramebuffers(n, framebuffers);
+    if (state) {
+        for (GLsizei k = 0; k < n; k ++) {
+            if (state->framebuffer == framebuffers[k])
+                state->framebuffer = 0;
+        }
+    }
+    note_deletion(state);
+}
+
+uint64_t
+gl_state_get_skipped_calls(void)
+{
+    return skipped_calls;
+}
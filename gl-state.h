@@ -0,0 +1,96 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __GL_STATE_H
+#define __GL_STATE_H
+
+#include <stdint.h>
+#include <GL/gl.h>
+
+/** @brief number of texture units which bindings are tracked */
+#define GL_STATE_TEXTURE_UNITS      4
+
+/** @brief Shadow copy of GL context state, used to skip redundant state changes
+ *
+ *  There is one for each context driver makes current. Values of all ones mean state
+ *  is unknown, so next change is always passed to GL.
+ */
+typedef struct {
+    uint32_t    epoch;              ///< value of deletion counter bindings are valid for
+    GLuint      framebuffer;
+    GLint       viewport[4];
+    GLenum      active_texture;
+    GLuint      texture[GL_STATE_TEXTURE_UNITS];    ///< GL_TEXTURE_2D bindings
+    GLuint      program;
+    GLint       blend;              ///< 1 if GL_BLEND is enabled
+    GLenum      blend_func[4];      ///< src rgb, dst rgb, src alpha, dst alpha
+    GLenum      blend_equation[2];  ///< rgb, alpha
+} gl_state_t;
+
+/** @brief Forget everything about context state */
+void
+gl_state_invalidate(gl_state_t *state);
+
+/** @brief Forget everything about state of current context
+ *
+ *  Should be called after something not tracked, like VA-API GLX functions, have used
+ *  context.
+ */
+void
+gl_state_invalidate_current(void);
+
+/** @brief Invalidate bindings if objects were deleted since state was last used
+ *
+ *  Object names could be reused after deletion, so cached bindings in contexts other than
+ *  one where deletion was done can't be trusted anymore.
+ */
+void
+gl_state_revalidate(gl_state_t *state);
+
+/* Replacements for GL functions, working with state of context made current by
+ * glx_context_push_* functions. They fall through to GL if there is no such context.
+ * Deletion functions are needed for objects which bindings are tracked. Programs stay
+ * reserved while they are in use, so glDeleteProgram is fine. */
+
+void
+gl_state_bind_framebuffer(GLuint framebuffer);
+
+void
+gl_state_viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+void
+gl_state_active_texture(GLenum texture);
+
+/** @brief Bind GL_TEXTURE_2D texture to active texture unit */
+void
+gl_state_bind_texture(GLuint texture);
+
+void
+gl_state_use_program(GLuint program);
+
+/** @brief Enable or disable GL_BLEND */
+void
+gl_state_blend(int enabled);
+
+void
+gl_state_blend_func(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha);
+
+void
+gl_state_blend_equation(GLenum mode_rgb, GLenum mode_alpha);
+
+void
+gl_state_delete_textures(GLsizei n, const GLuint *textures);
+
+void
+gl_state_delete_framebuffers(GLsizei n, const GLuint *framebuffers);
+
+/** @brief Number of state changes skipped as redundant, over all contexts */
+uint64_t
+gl_state_get_skipped_calls(void);
+
+#endif /* __GL_STATE_H */
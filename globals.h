@@ -15,6 +15,7 @@
 struct global_data {
     pthread_mutex_t     mutex;
     pthread_mutex_t     glx_ctx_stack_mutex;    ///< mutex for GLX context management functions
+    int                 sw_decoder_threads;     ///< thread count for software decoder, 0 for auto
 
     /** @brief tunables */
     struct {
@@ -23,6 +24,9 @@ struct global_data {
         int log_thread_id;
         int log_call_duration;
         int avoid_va;
+        int dump_decoder_stats;
+        int use_va_vpp;
+        int check_gl_errors;
     } quirks;
 };
 
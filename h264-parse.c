@@ -172,6 +172,212 @@ comparison_function_1(const void *p1, const void *p2, void *context)
     return result;
 }
 
+/** @brief Parity of current picture, VA_PICTURE_H264_TOP_FIELD or VA_PICTURE_H264_BOTTOM_FIELD */
+static
+unsigned int
+current_field_parity(const VAPictureParameterBufferH264 *vapp)
+{
+    return (vapp->CurrPic.flags & VA_PICTURE_H264_BOTTOM_FIELD) ? VA_PICTURE_H264_BOTTOM_FIELD
+                                                                 : VA_PICTURE_H264_TOP_FIELD;
+}
+
+static
+unsigned int
+opposite_parity(unsigned int parity)
+{
+    return (VA_PICTURE_H264_TOP_FIELD == parity) ? VA_PICTURE_H264_BOTTOM_FIELD
+                                                 : VA_PICTURE_H264_TOP_FIELD;
+}
+
+/** @brief Check whether field of given parity is used for reference
+ *
+ *  Reference frames with both fields marked have no field flags set.
+ */
+static
+int
+ref_has_field(const VAPictureH264 *ref, unsigned int parity)
+{
+    const unsigned int field_flags = VA_PICTURE_H264_TOP_FIELD | VA_PICTURE_H264_BOTTOM_FIELD;
+    return 0 == (ref->flags & field_flags) || (ref->flags & parity);
+}
+
+/** @brief Make field reference out of reference frame entry */
+static
+VAPictureH264
+field_of_ref(const VAPictureH264 *ref, unsigned int parity)
+{
+    VAPictureH264 field = *ref;
+    field.flags &= ~(VA_PICTURE_H264_TOP_FIELD | VA_PICTURE_H264_BOTTOM_FIELD);
+    field.flags |= parity;
+    if (VA_PICTURE_H264_TOP_FIELD == parity)
+        field.BottomFieldOrderCnt = 0;
+    else
+        field.TopFieldOrderCnt = 0;
+    return field;
+}
+
+/** @brief PicOrderCnt() of reference entry, only fields used for reference are counted */
+static
+int
+ref_entry_poc(const VAPictureH264 *ref)
+{
+    const int has_top = ref_has_field(ref, VA_PICTURE_H264_TOP_FIELD);
+    const int has_bottom = ref_has_field(ref, VA_PICTURE_H264_BOTTOM_FIELD);
+    if (has_top && has_bottom) {
+        return (ref->TopFieldOrderCnt < ref->BottomFieldOrderCnt) ? ref->TopFieldOrderCnt
+                                                                  : ref->BottomFieldOrderCnt;
+    }
+    return has_top ? ref->TopFieldOrderCnt : ref->BottomFieldOrderCnt;
+}
+
+static
+int
+frame_num_wrap(const VAPictureH264 *ref, const VAPictureParameterBufferH264 *vapp)
+{
+    const int MaxFrameNum = 1 << (vapp->seq_fields.bits.log2_max_frame_num_minus4 + 4);
+    if (ref->frame_idx > vapp->frame_num)
+        return (int)ref->frame_idx - MaxFrameNum;
+    return ref->frame_idx;
+}
+
+/** @brief Stable sort of indices by keys[index]. There are 16 entries at most */
+static
+void
+sort_indices(int *idcs, int count, const int *keys, int descending)
+{
+    for (int k = 1; k < count; k ++) {
+        const int idx = idcs[k];
+        int j = k - 1;
+        while (j >= 0 && (descending ? keys[idcs[j]] < keys[idx] : keys[idcs[j]] > keys[idx])) {
+            idcs[j + 1] = idcs[j];
+            j --;
+        }
+        idcs[j + 1] = idx;
+    }
+}
+
+/** @brief Append fields of reference frames to list, alternating parity (8.2.4.2.5)
+ *
+ *  Fields are taken in order of idcs, starting with parity of the current field. When
+ *  fields of one parity are exhausted, remaining fields of the other one are appended.
+ */
+static
+int
+append_alternating_fields(VAPictureH264 *list, int list_len, const VAPictureH264 *ref_frames,
+                          const int *idcs, int count, unsigned int parity)
+{
+    const unsigned int parities[2] = { parity, opposite_parity(parity) };
+    int pos[2] = { 0, 0 };
+    int cur = 0;
+
+    while (list_len < 32) {
+        while (pos[cur] < count && !ref_has_field(&ref_frames[idcs[pos[cur]]], parities[cur]))
+            pos[cur] ++;
+        if (pos[cur] >= count) {
+            if (pos[1 - cur] >= count)
+                break;
+            cur = 1 - cur;
+            continue;
+        }
+        list[list_len ++] = field_of_ref(&ref_frames[idcs[pos[cur]]], parities[cur]);
+        pos[cur] ++;
+        cur = 1 - cur;
+    }
+
+    return list_len;
+}
+
+/** @brief Initialize reference picture lists for field decoding (8.2.4.2.2, 8.2.4.2.4) */
+static
+void
+fill_ref_pic_list_field(struct slice_parameters *sp, const VAPictureParameterBufferH264 *vapp)
+{
+    const VAPictureH264 *ref_frames = vapp->ReferenceFrames;
+    const unsigned int parity = current_field_parity(vapp);
+    int short_term[16], long_term[16];
+    int short_count = 0, long_count = 0;
+    int keys[16];
+
+    // First field of the current frame is listed amongst reference frames too, so
+    // second field can refer to it.
+    for (int k = 0; k < 16; k ++) {
+        if (ref_frames[k].flags & VA_PICTURE_H264_INVALID)
+            continue;
+        if (ref_frames[k].flags & VA_PICTURE_H264_LONG_TERM_REFERENCE)
+            long_term[long_count ++] = k;
+        else if (ref_frames[k].flags & VA_PICTURE_H264_SHORT_TERM_REFERENCE)
+            short_term[short_count ++] = k;
+    }
+
+    // long-term frames go in LongTermFrameIdx order in both lists
+    for (int k = 0; k < long_count; k ++)
+        keys[long_term[k]] = ref_frames[long_term[k]].frame_idx;
+    sort_indices(long_term, long_count, keys, 0);
+
+    if (SLICE_TYPE_P == sp->slice_type || SLICE_TYPE_SP == sp->slice_type) {
+        for (int k = 0; k < short_count; k ++)
+            keys[short_term[k]] = frame_num_wrap(&ref_frames[short_term[k]], vapp);
+        sort_indices(short_term, short_count, keys, 1);
+
+        int len = append_alternating_fields(sp->RefPicList0, 0, ref_frames, short_term,
+                                            short_count, parity);
+        append_alternating_fields(sp->RefPicList0, len, ref_frames, long_term, long_count,
+                                  parity);
+        return;
+    }
+
+    // B slices. Frames preceding current field in output order go first to list 0,
+    // and following ones go first to list 1.
+    const int cur_poc = (VA_PICTURE_H264_BOTTOM_FIELD == parity)
+                        ? vapp->CurrPic.BottomFieldOrderCnt : vapp->CurrPic.TopFieldOrderCnt;
+    int before[16], after[16];
+    int before_count = 0, after_count = 0;
+    for (int k = 0; k < short_count; k ++) {
+        const int idx = short_term[k];
+        keys[idx] = ref_entry_poc(&ref_frames[idx]);
+        if (keys[idx] <= cur_poc)
+            before[before_count ++] = idx;
+        else
+            after[after_count ++] = idx;
+    }
+    sort_indices(before, before_count, keys, 1);
+    sort_indices(after, after_count, keys, 0);
+
+    int list0[16], list1[16];
+    for (int k = 0; k < before_count; k ++) {
+        list0[k] = before[k];
+        list1[after_count + k] = before[k];
+    }
+    for (int k = 0; k < after_count; k ++) {
+        list0[before_count + k] = after[k];
+        list1[k] = after[k];
+    }
+
+    int len0 = append_alternating_fields(sp->RefPicList0, 0, ref_frames, list0, short_count,
+                                         parity);
+    len0 = append_alternating_fields(sp->RefPicList0, len0, ref_frames, long_term, long_count,
+                                     parity);
+    int len1 = append_alternating_fields(sp->RefPicList1, 0, ref_frames, list1, short_count,
+                                         parity);
+    len1 = append_alternating_fields(sp->RefPicList1, len1, ref_frames, long_term, long_count,
+                                     parity);
+
+    // if list 1 has more than one entry and equals to list 0, its first two entries
+    // are swapped
+    if (len1 > 1 && len0 == len1) {
+        int same = 1;
+        for (int k = 0; k < len0 && same; k ++) {
+            same = sp->RefPicList0[k].picture_id == sp->RefPicList1[k].picture_id &&
+                   sp->RefPicList0[k].flags == sp->RefPicList1[k].flags;
+        }
+        if (same) {
+            VAPictureH264 tmp = sp->RefPicList1[0];
+            sp->RefPicList1[0] = sp->RefPicList1[1];
+            sp->RefPicList1[1] = tmp;
+        }
+    }
+}
+
 static
 void
 fill_ref_pic_list(struct slice_parameters *sp, const VAPictureParameterBufferH264 *vapp)
@@ -186,19 +392,29 @@ fill_ref_pic_list(struct slice_parameters *sp, const VAPictureParameterBufferH26
     if (SLICE_TYPE_I == sp->slice_type || SLICE_TYPE_SI == sp->slice_type)
         return;
 
+    if (vapp->pic_fields.bits.field_pic_flag) {
+        fill_ref_pic_list_field(sp, vapp);
+        return;
+    }
+
     ctx.ReferenceFrames = vapp->ReferenceFrames;
 
     int frame_count = 0;
     for (int k = 0; k < vapp->num_ref_frames; k ++) {
         if (vapp->ReferenceFrames[k].flags & VA_PICTURE_H264_INVALID)
             continue;
+        // frames can only refer to frames with both fields marked as reference
+        if (vapp->ReferenceFrames[k].flags &
+            (VA_PICTURE_H264_TOP_FIELD | VA_PICTURE_H264_BOTTOM_FIELD))
+        {
+            continue;
+        }
         sp->RefPicList0[frame_count] = vapp->ReferenceFrames[k];
         idcs_asc[frame_count] = idcs_desc[frame_count] = k;
         frame_count ++;
     }
 
     if (SLICE_TYPE_P == sp->slice_type || SLICE_TYPE_SP == sp->slice_type) {
-        // TODO: implement interlaced P slices
         ctx.what = 1;
         ctx.descending = 0;
         qsort_r(idcs_asc, frame_count, sizeof(idcs_asc[0]), &comparison_function_1, &ctx);
@@ -214,7 +430,7 @@ fill_ref_pic_list(struct slice_parameters *sp, const VAPictureParameterBufferH26
             if (vapp->ReferenceFrames[idcs_asc[k]].flags & VA_PICTURE_H264_LONG_TERM_REFERENCE)
                 sp->RefPicList0[ptr++] = vapp->ReferenceFrames[idcs_asc[k]];
 
-    } else if (SLICE_TYPE_B == sp->slice_type && !vapp->pic_fields.bits.field_pic_flag) {
+    } else if (SLICE_TYPE_B == sp->slice_type) {
         ctx.what = 1;
         ctx.descending = 0;
         qsort_r(idcs_asc, frame_count, sizeof(idcs_asc[0]), &comparison_function_1, &ctx);
@@ -252,9 +468,6 @@ fill_ref_pic_list(struct slice_parameters *sp, const VAPictureParameterBufferH26
                 sp->RefPicList1[ptr1++] = *rf;
             }
         }
-    } else {
-        // TODO: implement interlaced B slices
-        assert(0 && "not implemeted: interlaced SLICE_TYPE_B sorting");
     }
 }
 
@@ -287,8 +500,9 @@ parse_slice_header(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
 
     sp.pic_parameter_set_id = rbsp_get_uev(st);
 
-    // TODO: separate_colour_plane_flag is 0 for all but YUV444. Now ok, but should detect properly.
-    // See 7.3.3
+    // ChromaArrayType is 0 for 4:4:4 only when colour planes are coded separately
+    if (3 == vapp->seq_fields.bits.chroma_format_idc && 0 == ChromaArrayType)
+        rbsp_get_u(st, 2);  // colour_plane_id
 
     sp.frame_num = rbsp_get_u(st, vapp->seq_fields.bits.log2_max_frame_num_minus4 + 4);
     sp.field_pic_flag = 0;
@@ -340,6 +554,11 @@ parse_slice_header(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
     {
         sp.num_ref_idx_l0_active_minus1 = p_num_ref_idx_l0_active_minus1;
         sp.num_ref_idx_l1_active_minus1 = p_num_ref_idx_l1_active_minus1;
+        if (sp.field_pic_flag) {
+            // each frame gives two fields, so default list sizes are doubled (7.4.3)
+            sp.num_ref_idx_l0_active_minus1 = 2 * p_num_ref_idx_l0_active_minus1 + 1;
+            sp.num_ref_idx_l1_active_minus1 = 2 * p_num_ref_idx_l1_active_minus1 + 1;
+        }
 
         sp.num_ref_idx_active_override_flag = rbsp_get_u(st, 1);
         if (sp.num_ref_idx_active_override_flag) {
@@ -409,81 +628,147 @@ parse_slice_header(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
 }
 
 
+/** @brief Picture number of list entry as used in ref_pic_list_modification (8.2.4.1)
+ *
+ *  Returns -1 if entry's kind (short-term or long-term) doesn't match.
+ */
 static
-void
-parse_ref_pic_list_modification(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
-                                struct slice_parameters *sp)
+int
+ref_pic_num(const VAPictureH264 *ref, const VAPictureParameterBufferH264 *vapp, int long_term)
 {
-    const int MaxFrameNum = 1 << (vapp->seq_fields.bits.log2_max_frame_num_minus4 + 4);
-    const int MaxPicNum = (vapp->pic_fields.bits.field_pic_flag) ? 2*MaxFrameNum : MaxFrameNum;
+    if (ref->flags & VA_PICTURE_H264_INVALID)
+        return -1;
+    if (!!(ref->flags & VA_PICTURE_H264_LONG_TERM_REFERENCE) != !!long_term)
+        return -1;
+
+    // there is no need to use FrameNumWrap here since picNumLX gets wrapped too
+    if (!vapp->pic_fields.bits.field_pic_flag)
+        return ref->frame_idx;
+    return 2 * ref->frame_idx + !!(ref->flags & current_field_parity(vapp));
+}
 
-    if (2 != sp->slice_type && 4 != sp->slice_type) {
-        int ref_pic_list_modification_flag_l0 = rbsp_get_u(st, 1);
-        if (ref_pic_list_modification_flag_l0) {
-            int modification_of_pic_nums_idc;
-            int refIdxL0 = 0;
-            unsigned int picNumL0 = vapp->frame_num;
-            do {
-                modification_of_pic_nums_idc = rbsp_get_uev(st);
-                if (modification_of_pic_nums_idc < 2) {
-                    int abs_diff_pic_num_minus1 = rbsp_get_uev(st);
-                    if (0 == modification_of_pic_nums_idc) {
-                        picNumL0 -= (abs_diff_pic_num_minus1 + 1);
-                    } else { // 1 == modification_of_pic_nums_idc
-                        picNumL0 += (abs_diff_pic_num_minus1 + 1);
-                    }
+/** @brief Find reference picture by its picture number, as frame or as field */
+static
+int
+find_ref_pic(const VAPictureParameterBufferH264 *vapp, int pic_num, int long_term,
+             VAPictureH264 *found)
+{
+    for (int j = 0; j < 16; j ++) {
+        const VAPictureH264 *ref = &vapp->ReferenceFrames[j];
+        if (!vapp->pic_fields.bits.field_pic_flag) {
+            if (!ref_has_field(ref, VA_PICTURE_H264_TOP_FIELD) ||
+                !ref_has_field(ref, VA_PICTURE_H264_BOTTOM_FIELD))
+            {
+                continue;
+            }
+            if (ref_pic_num(ref, vapp, long_term) == pic_num) {
+                *found = *ref;
+                return 1;
+            }
+            continue;
+        }
+        const unsigned int parities[2] = { VA_PICTURE_H264_TOP_FIELD,
+                                           VA_PICTURE_H264_BOTTOM_FIELD };
+        for (int k = 0; k < 2; k ++) {
+            if (!ref_has_field(ref, parities[k]))
+                continue;
+            VAPictureH264 field = field_of_ref(ref, parities[k]);
+            if (ref_pic_num(&field, vapp, long_term) == pic_num) {
+                *found = field;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
 
-                    // wrap picNumL0
-                    picNumL0 &= (MaxPicNum - 1);
+/** @brief Modify single reference picture list (8.2.4.3) */
+static
+void
+modify_ref_pic_list(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
+                    VAPictureH264 *RefPicList, int num_ref_idx_active_minus1)
+{
+    const int field_pic_flag = vapp->pic_fields.bits.field_pic_flag;
+    const int MaxFrameNum = 1 << (vapp->seq_fields.bits.log2_max_frame_num_minus4 + 4);
+    const int MaxPicNum = field_pic_flag ? 2*MaxFrameNum : MaxFrameNum;
+    const int CurrPicNum = field_pic_flag ? 2*vapp->frame_num + 1 : vapp->frame_num;
+
+    // one extra entry, list is temporarily one element longer during modification
+    VAPictureH264 list[33];
+    for (int k = 0; k < 32; k ++)
+        list[k] = RefPicList[k];
+    reset_va_picture_h264(&list[32]);
+
+    int modification_of_pic_nums_idc;
+    int refIdx = 0;
+    unsigned int picNumPred = CurrPicNum;
+    do {
+        modification_of_pic_nums_idc = rbsp_get_uev(st);
+        if (3 == modification_of_pic_nums_idc)
+            break;
+
+        int pic_num;
+        int long_term = 0;
+        if (modification_of_pic_nums_idc < 2) {
+            int abs_diff_pic_num_minus1 = rbsp_get_uev(st);
+            if (0 == modification_of_pic_nums_idc) {
+                picNumPred -= (abs_diff_pic_num_minus1 + 1);
+            } else { // 1 == modification_of_pic_nums_idc
+                picNumPred += (abs_diff_pic_num_minus1 + 1);
+            }
+            // wrap picNumPred. There is no need to subtract MaxPicNum as in (8-36)
+            // because ref_pic_num() doesn't wrap frame_num either
+            picNumPred &= (MaxPicNum - 1);
+            pic_num = picNumPred;
+        } else if (2 == modification_of_pic_nums_idc) {
+            pic_num = rbsp_get_uev(st);   // long_term_pic_num
+            long_term = 1;
+        } else {
+            // values 4 and 5 are for MVC, which is not supported
+            NOT_IMPLEMENTED("modification_of_pic_nums_idc");
+            break;
+        }
 
-                    // there is no need to subtract MaxPicNum as in (8-36) in 8.2.4.3.1
-                    // because frame_num already wrapped
+        if (refIdx > num_ref_idx_active_minus1 || refIdx >= 32)
+            continue;
 
-                    int j;
-                    for (j = 0; j < vapp->num_ref_frames; j ++) {
-                        if (vapp->ReferenceFrames[j].flags & VA_PICTURE_H264_INVALID)
-                            continue;
-                        if (vapp->ReferenceFrames[j].frame_idx == picNumL0 &&
-                            (vapp->ReferenceFrames[j].flags & VA_PICTURE_H264_SHORT_TERM_REFERENCE))
-                                break;
-                    }
-                    assert (j < vapp->num_ref_frames);
-                    VAPictureH264 swp = vapp->ReferenceFrames[j];
-                    for (int k = sp->num_ref_idx_l0_active_minus1; k > refIdxL0; k --)
-                        sp->RefPicList0[k] = sp->RefPicList0[k-1];
-                    sp->RefPicList0[refIdxL0 ++] = swp;
-                    j = refIdxL0;
-                    for (int k = refIdxL0; k <= sp->num_ref_idx_l0_active_minus1 + 1; k ++) {
-                        if (sp->RefPicList0[k].frame_idx != picNumL0 &&
-                            (sp->RefPicList0[k].flags & VA_PICTURE_H264_SHORT_TERM_REFERENCE))
-                                sp->RefPicList0[j++] = sp->RefPicList0[k];
-                    }
+        VAPictureH264 pic;
+        if (!find_ref_pic(vapp, pic_num, long_term, &pic)) {
+            fprintf(stderr, "error (modify_ref_pic_list): no reference picture with number %d\n",
+                    pic_num);
+            continue;
+        }
 
-                } else if (2 == modification_of_pic_nums_idc) {
-                    NOT_IMPLEMENTED("long");
-                    fprintf(stderr, "long_term_pic_num = %d\n", rbsp_get_uev(st));
-                }
+        for (int k = num_ref_idx_active_minus1 + 1; k > refIdx; k --)
+            list[k] = list[k-1];
+        list[refIdx ++] = pic;
+        int nIdx = refIdx;
+        for (int k = refIdx; k <= num_ref_idx_active_minus1 + 1; k ++) {
+            if (ref_pic_num(&list[k], vapp, long_term) != pic_num)
+                list[nIdx++] = list[k];
+        }
+    } while (1);
 
-            } while (modification_of_pic_nums_idc != 3);
+    for (int k = 0; k < 32; k ++)
+        RefPicList[k] = list[k];
+}
 
+static
+void
+parse_ref_pic_list_modification(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
+                                struct slice_parameters *sp)
+{
+    if (SLICE_TYPE_I != sp->slice_type && SLICE_TYPE_SI != sp->slice_type) {
+        int ref_pic_list_modification_flag_l0 = rbsp_get_u(st, 1);
+        if (ref_pic_list_modification_flag_l0) {
+            modify_ref_pic_list(st, vapp, sp->RefPicList0, sp->num_ref_idx_l0_active_minus1);
         }
     }
 
-    if (1 == sp->slice_type) {
+    if (SLICE_TYPE_B == sp->slice_type) {
         int ref_pic_list_modification_flag_l1 = rbsp_get_u(st, 1);
         if (ref_pic_list_modification_flag_l1) {
-            NOT_IMPLEMENTED("ref pic list modification 1"); // TODO: implement this
-            int modification_of_pic_nums_idc;
-            do {
-                modification_of_pic_nums_idc = rbsp_get_uev(st);
-                if (0 == modification_of_pic_nums_idc ||
-                    1 == modification_of_pic_nums_idc)
-                {
-                    fprintf(stderr, "abs_diff_pic_num_minus1 = %d\n", rbsp_get_uev(st));
-                } else if (2 == modification_of_pic_nums_idc) {
-                    fprintf(stderr, "long_term_pic_num = %d\n", rbsp_get_uev(st));
-                }
-            } while (modification_of_pic_nums_idc != 3);
+            modify_ref_pic_list(st, vapp, sp->RefPicList1, sp->num_ref_idx_l1_active_minus1);
         }
     }
 }
@@ -602,3 +887,35 @@ parse_dec_ref_pic_marking(rbsp_state_t *st, struct slice_parameters *sp)
         }
     }
 }
+
+void
+parse_seq_parameter_set(rbsp_state_t *st, h264_sps_t *sps)
+{
+    rbsp_get_u(st, 1); // forbidden_zero_bit
+    rbsp_get_u(st, 2); // nal_ref_idc
+    rbsp_get_u(st, 5); // nal_unit_type
+
+    sps->profile_idc = rbsp_get_u(st, 8);
+    rbsp_get_u(st, 8); // constraint_set flags and reserved_zero_2bits
+    sps->level_idc = rbsp_get_u(st, 8);
+    rbsp_get_uev(st);  // seq_parameter_set_id
+
+    // defaults for profiles without chroma format and bit depth fields
+    sps->chroma_format_idc = 1;
+    sps->separate_colour_plane_flag = 0;
+    sps->bit_depth_luma_minus8 = 0;
+    sps->bit_depth_chroma_minus8 = 0;
+
+    switch (sps->profile_idc) {
+    case 100: case 110: case 122: case 244: case 44:
+    case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+        sps->chroma_format_idc = rbsp_get_uev(st);
+        if (3 == sps->chroma_format_idc)
+            sps->separate_colour_plane_flag = rbsp_get_u(st, 1);
+        sps->bit_depth_luma_minus8 = rbsp_get_uev(st);
+        sps->bit_depth_chroma_minus8 = rbsp_get_uev(st);
+        break;
+    default:
+        break;
+    }
+}
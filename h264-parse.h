@@ -24,6 +24,19 @@
 #define NAL_SLICE_DATA_B    3
 #define NAL_SLICE_DATA_C    4
 #define NAL_IDR_SLICE       5
+#define NAL_SEI             6
+#define NAL_SEQ_PARAM       7
+#define NAL_PIC_PARAM       8
+
+/** @brief Sequence parameter set fields which VDPAU doesn't pass to driver */
+typedef struct {
+    int profile_idc;
+    int level_idc;
+    int chroma_format_idc;
+    int separate_colour_plane_flag;
+    int bit_depth_luma_minus8;
+    int bit_depth_chroma_minus8;
+} h264_sps_t;
 
 void
 parse_slice_header(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
@@ -33,4 +46,11 @@ parse_slice_header(rbsp_state_t *st, const VAPictureParameterBufferH264 *vapp,
 void
 reset_va_picture_h264(VAPictureH264 *p);
 
+/** @brief Parse beginning of sequence parameter set NAL unit, up to bit depth fields
+ *
+ *  @param st should point to NAL unit header
+ */
+void
+parse_seq_parameter_set(rbsp_state_t *st, h264_sps_t *sps);
+
 #endif
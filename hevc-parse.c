@@ -0,0 +1,336 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#include <string.h>
+#include "hevc-parse.h"
+
+#if VA_CHECK_VERSION(0, 37, 0)
+
+static
+int
+ceil_log2(unsigned int x)
+{
+    int bits = 0;
+    while ((1u << bits) < x)
+        bits ++;
+    return bits;
+}
+
+static
+void
+skip_bits(rbsp_state_t *st, int bitcount)
+{
+    for (int k = 0; k < bitcount; k ++)
+        rbsp_consume_bit(st);
+}
+
+static
+int
+clip3(int lo, int hi, int value)
+{
+    if (value < lo) return lo;
+    if (value > hi) return hi;
+    return value;
+}
+
+static
+void
+build_ref_pic_lists(const hevc_ref_pic_set_t *rps, VASliceParameterBufferHEVC *vasp,
+                    const int list_entry[2][16], const int modification_flag[2])
+{
+    const int num_active[2] = { vasp->num_ref_idx_l0_active_minus1 + 1,
+                                vasp->num_ref_idx_l1_active_minus1 + 1 };
+
+    memset(vasp->RefPicList, 0xff, sizeof(vasp->RefPicList));
+    if (0 == rps->NumPocTotalCurr)
+        return;
+
+    // 8.3.4. List 0 starts with pictures preceding current one, list 1 with following ones
+    for (int list = 0; list < 2; list ++) {
+        if (HEVC_SLICE_TYPE_P == vasp->LongSliceFlags.fields.slice_type && 1 == list)
+            break;
+
+        const int *first  = list ? rps->RefPicSetStCurrAfter  : rps->RefPicSetStCurrBefore;
+        const int *second = list ? rps->RefPicSetStCurrBefore : rps->RefPicSetStCurrAfter;
+        const int first_cnt  = list ? rps->NumPocStCurrAfter  : rps->NumPocStCurrBefore;
+        const int second_cnt = list ? rps->NumPocStCurrBefore : rps->NumPocStCurrAfter;
+
+        int temp_list[16];
+        const int num_rps_curr_temp = num_active[list] > rps->NumPocTotalCurr
+                                      ? num_active[list] : rps->NumPocTotalCurr;
+        int r_idx = 0;
+        while (r_idx < num_rps_curr_temp && r_idx < 16) {
+            for (int k = 0; k < first_cnt && r_idx < num_rps_curr_temp; k ++)
+                temp_list[r_idx++] = first[k];
+            for (int k = 0; k < second_cnt && r_idx < num_rps_curr_temp; k ++)
+                temp_list[r_idx++] = second[k];
+            for (int k = 0; k < rps->NumPocLtCurr && r_idx < num_rps_curr_temp; k ++)
+                temp_list[r_idx++] = rps->RefPicSetLtCurr[k];
+        }
+
+        for (int k = 0; k < num_active[list] && k < 15; k ++) {
+            const int idx = modification_flag[list] ? list_entry[list][k] : k;
+            vasp->RefPicList[list][k] = temp_list[idx];
+        }
+    }
+}
+
+static
+void
+parse_pred_weight_table(rbsp_state_t *st, const int ChromaArrayType,
+                        VASliceParameterBufferHEVC *vasp)
+{
+    vasp->luma_log2_weight_denom = rbsp_get_uev(st);
+    int chroma_log2_weight_denom = vasp->luma_log2_weight_denom;
+    if (0 != ChromaArrayType) {
+        vasp->delta_chroma_log2_weight_denom = rbsp_get_sev(st);
+        chroma_log2_weight_denom += vasp->delta_chroma_log2_weight_denom;
+    }
+
+    // offsets are limited to 8 bit range unless high_precision_offsets_enabled_flag is set,
+    // which is not the case for Main and Main10 profiles
+    const int half_range = 1 << 7;
+
+    const int num_lists = (HEVC_SLICE_TYPE_B == vasp->LongSliceFlags.fields.slice_type) ? 2 : 1;
+    for (int list = 0; list < num_lists; list ++) {
+        const int num_active = list ? vasp->num_ref_idx_l1_active_minus1 + 1
+                                    : vasp->num_ref_idx_l0_active_minus1 + 1;
+        int8_t *delta_luma_weight = list ? vasp->delta_luma_weight_l1 : vasp->delta_luma_weight_l0;
+        int8_t *luma_offset = list ? vasp->luma_offset_l1 : vasp->luma_offset_l0;
+        int8_t (*delta_chroma_weight)[2] = list ? vasp->delta_chroma_weight_l1
+                                                : vasp->delta_chroma_weight_l0;
+        int8_t (*chroma_offset)[2] = list ? vasp->ChromaOffsetL1 : vasp->ChromaOffsetL0;
+        int luma_weight_flag[16] = {0};
+        int chroma_weight_flag[16] = {0};
+
+        for (int k = 0; k < num_active; k ++)
+            luma_weight_flag[k] = rbsp_get_u(st, 1);
+        if (0 != ChromaArrayType) {
+            for (int k = 0; k < num_active; k ++)
+                chroma_weight_flag[k] = rbsp_get_u(st, 1);
+        }
+
+        for (int k = 0; k < num_active; k ++) {
+            delta_luma_weight[k] = 0;
+            luma_offset[k] = 0;
+            if (luma_weight_flag[k]) {
+                delta_luma_weight[k] = rbsp_get_sev(st);
+                luma_offset[k] = rbsp_get_sev(st);
+            }
+
+            for (int j = 0; j < 2; j ++) {
+                delta_chroma_weight[k][j] = 0;
+                chroma_offset[k][j] = 0;
+                if (!chroma_weight_flag[k])
+                    continue;
+                delta_chroma_weight[k][j] = rbsp_get_sev(st);
+                const int delta_chroma_offset = rbsp_get_sev(st);
+                const int chroma_weight = (1 << chroma_log2_weight_denom) +
+                                          delta_chroma_weight[k][j];
+                chroma_offset[k][j] = clip3(-half_range, half_range - 1,
+                    (half_range + delta_chroma_offset -
+                     ((half_range * chroma_weight) >> chroma_log2_weight_denom)));
+            }
+        }
+    }
+}
+
+int
+parse_slice_segment_header(rbsp_state_t *st, const VAPictureParameterBufferHEVC *vapp,
+                           const hevc_ref_pic_set_t *rps, VASliceParameterBufferHEVC *vasp)
+{
+#define SLICE_FIELDS(fieldname) vasp->LongSliceFlags.fields.fieldname
+
+    rbsp_get_u(st, 1);          // forbidden_zero_bit
+    const int nal_unit_type = rbsp_get_u(st, 6);
+    rbsp_get_u(st, 6);          // nuh_layer_id
+    rbsp_get_u(st, 3);          // nuh_temporal_id_plus1
+
+    const int ChromaArrayType = vapp->pic_fields.bits.separate_colour_plane_flag
+                                ? 0 : vapp->pic_fields.bits.chroma_format_idc;
+    const int log2_ctb_size = vapp->log2_min_luma_coding_block_size_minus3 + 3 +
+                              vapp->log2_diff_max_min_luma_coding_block_size;
+    const int ctb_size = 1 << log2_ctb_size;
+    const int pic_width_in_ctbs = (vapp->pic_width_in_luma_samples + ctb_size - 1) / ctb_size;
+    const int pic_height_in_ctbs = (vapp->pic_height_in_luma_samples + ctb_size - 1) / ctb_size;
+
+    const int first_slice_segment_in_pic_flag = rbsp_get_u(st, 1);
+    if (nal_unit_type >= HEVC_NAL_BLA_W_LP && nal_unit_type <= HEVC_NAL_RSV_IRAP_23)
+        rbsp_get_u(st, 1);      // no_output_of_prior_pics_flag
+    rbsp_get_uev(st);           // slice_pic_parameter_set_id
+
+    int dependent_slice_segment_flag = 0;
+    vasp->slice_segment_address = 0;
+    if (!first_slice_segment_in_pic_flag) {
+        if (vapp->slice_parsing_fields.bits.dependent_slice_segments_enabled_flag)
+            dependent_slice_segment_flag = rbsp_get_u(st, 1);
+        vasp->slice_segment_address =
+            rbsp_get_u(st, ceil_log2(pic_width_in_ctbs * pic_height_in_ctbs));
+    }
+    SLICE_FIELDS(dependent_slice_segment_flag) = dependent_slice_segment_flag;
+
+    if (!dependent_slice_segment_flag) {
+        int slice_temporal_mvp_enabled_flag = 0;
+        int slice_sao_luma_flag = 0;
+        int slice_sao_chroma_flag = 0;
+
+        skip_bits(st, vapp->num_extra_slice_header_bits);   // slice_reserved_flag
+        const int slice_type = rbsp_get_uev(st);
+        SLICE_FIELDS(slice_type) = slice_type;
+        if (vapp->slice_parsing_fields.bits.output_flag_present_flag)
+            rbsp_get_u(st, 1);  // pic_output_flag
+        SLICE_FIELDS(color_plane_id) = 0;
+        if (vapp->pic_fields.bits.separate_colour_plane_flag)
+            SLICE_FIELDS(color_plane_id) = rbsp_get_u(st, 2);
+
+        if (HEVC_NAL_IDR_W_RADL != nal_unit_type && HEVC_NAL_IDR_N_LP != nal_unit_type) {
+            rbsp_get_u(st, vapp->log2_max_pic_order_cnt_lsb_minus4 + 4);    // POC lsb
+            rbsp_get_u(st, 1);  // short_term_ref_pic_set_sps_flag
+            // Application already parsed reference picture sets, here they are only skipped
+            skip_bits(st, rps->NumShortTermPictureSliceHeaderBits);
+            skip_bits(st, rps->NumLongTermPictureSliceHeaderBits);
+            if (vapp->slice_parsing_fields.bits.sps_temporal_mvp_enabled_flag)
+                slice_temporal_mvp_enabled_flag = rbsp_get_u(st, 1);
+        }
+        SLICE_FIELDS(slice_temporal_mvp_enabled_flag) = slice_temporal_mvp_enabled_flag;
+
+        if (vapp->slice_parsing_fields.bits.sample_adaptive_offset_enabled_flag) {
+            slice_sao_luma_flag = rbsp_get_u(st, 1);
+            if (0 != ChromaArrayType)
+                slice_sao_chroma_flag = rbsp_get_u(st, 1);
+        }
+        SLICE_FIELDS(slice_sao_luma_flag) = slice_sao_luma_flag;
+        SLICE_FIELDS(slice_sao_chroma_flag) = slice_sao_chroma_flag;
+
+        vasp->num_ref_idx_l0_active_minus1 = 0;
+        vasp->num_ref_idx_l1_active_minus1 = 0;
+        SLICE_FIELDS(mvd_l1_zero_flag) = 0;
+        SLICE_FIELDS(cabac_init_flag) = 0;
+        SLICE_FIELDS(collocated_from_l0_flag) = 1;
+        vasp->collocated_ref_idx = 0xff;
+        vasp->five_minus_max_num_merge_cand = 0;
+        memset(vasp->RefPicList, 0xff, sizeof(vasp->RefPicList));
+
+        if (HEVC_SLICE_TYPE_P == slice_type || HEVC_SLICE_TYPE_B == slice_type) {
+            vasp->num_ref_idx_l0_active_minus1 = vapp->num_ref_idx_l0_default_active_minus1;
+            if (HEVC_SLICE_TYPE_B == slice_type)
+                vasp->num_ref_idx_l1_active_minus1 = vapp->num_ref_idx_l1_default_active_minus1;
+            if (rbsp_get_u(st, 1)) {    // num_ref_idx_active_override_flag
+                vasp->num_ref_idx_l0_active_minus1 = rbsp_get_uev(st);
+                if (HEVC_SLICE_TYPE_B == slice_type)
+                    vasp->num_ref_idx_l1_active_minus1 = rbsp_get_uev(st);
+            }
+
+            int modification_flag[2] = {0, 0};
+            int list_entry[2][16];
+            if (vapp->slice_parsing_fields.bits.lists_modification_present_flag &&
+                rps->NumPocTotalCurr > 1)
+            {
+                const int entry_bits = ceil_log2(rps->NumPocTotalCurr);
+                modification_flag[0] = rbsp_get_u(st, 1);
+                if (modification_flag[0]) {
+                    for (int k = 0; k <= vasp->num_ref_idx_l0_active_minus1; k ++)
+                        list_entry[0][k] = rbsp_get_u(st, entry_bits);
+                }
+                if (HEVC_SLICE_TYPE_B == slice_type) {
+                    modification_flag[1] = rbsp_get_u(st, 1);
+                    if (modification_flag[1]) {
+                        for (int k = 0; k <= vasp->num_ref_idx_l1_active_minus1; k ++)
+                            list_entry[1][k] = rbsp_get_u(st, entry_bits);
+                    }
+                }
+            }
+            build_ref_pic_lists(rps, vasp, (const int (*)[16])list_entry, modification_flag);
+
+            if (HEVC_SLICE_TYPE_B == slice_type)
+                SLICE_FIELDS(mvd_l1_zero_flag) = rbsp_get_u(st, 1);
+            if (vapp->slice_parsing_fields.bits.cabac_init_present_flag)
+                SLICE_FIELDS(cabac_init_flag) = rbsp_get_u(st, 1);
+
+            if (slice_temporal_mvp_enabled_flag) {
+                if (HEVC_SLICE_TYPE_B == slice_type)
+                    SLICE_FIELDS(collocated_from_l0_flag) = rbsp_get_u(st, 1);
+                vasp->collocated_ref_idx = 0;
+                if ((SLICE_FIELDS(collocated_from_l0_flag) &&
+                        vasp->num_ref_idx_l0_active_minus1 > 0) ||
+                    (!SLICE_FIELDS(collocated_from_l0_flag) &&
+                        vasp->num_ref_idx_l1_active_minus1 > 0))
+                {
+                    vasp->collocated_ref_idx = rbsp_get_uev(st);
+                }
+            }
+
+            if ((vapp->pic_fields.bits.weighted_pred_flag && HEVC_SLICE_TYPE_P == slice_type) ||
+                (vapp->pic_fields.bits.weighted_bipred_flag && HEVC_SLICE_TYPE_B == slice_type))
+            {
+                parse_pred_weight_table(st, ChromaArrayType, vasp);
+            }
+
+            vasp->five_minus_max_num_merge_cand = rbsp_get_uev(st);
+        }
+
+        vasp->slice_qp_delta = rbsp_get_sev(st);
+        vasp->slice_cb_qp_offset = 0;
+        vasp->slice_cr_qp_offset = 0;
+        if (vapp->slice_parsing_fields.bits.pps_slice_chroma_qp_offsets_present_flag) {
+            vasp->slice_cb_qp_offset = rbsp_get_sev(st);
+            vasp->slice_cr_qp_offset = rbsp_get_sev(st);
+        }
+
+        int deblocking_filter_override_flag = 0;
+        if (vapp->slice_parsing_fields.bits.deblocking_filter_override_enabled_flag)
+            deblocking_filter_override_flag = rbsp_get_u(st, 1);
+
+        SLICE_FIELDS(slice_deblocking_filter_disabled_flag) =
+            vapp->slice_parsing_fields.bits.pps_disable_deblocking_filter_flag;
+        vasp->slice_beta_offset_div2 = vapp->pps_beta_offset_div2;
+        vasp->slice_tc_offset_div2 = vapp->pps_tc_offset_div2;
+        if (deblocking_filter_override_flag) {
+            SLICE_FIELDS(slice_deblocking_filter_disabled_flag) = rbsp_get_u(st, 1);
+            if (!SLICE_FIELDS(slice_deblocking_filter_disabled_flag)) {
+                vasp->slice_beta_offset_div2 = rbsp_get_sev(st);
+                vasp->slice_tc_offset_div2 = rbsp_get_sev(st);
+            }
+        }
+
+        SLICE_FIELDS(slice_loop_filter_across_slices_enabled_flag) =
+            vapp->pic_fields.bits.pps_loop_filter_across_slices_enabled_flag;
+        if (vapp->pic_fields.bits.pps_loop_filter_across_slices_enabled_flag &&
+            (slice_sao_luma_flag || slice_sao_chroma_flag ||
+             !SLICE_FIELDS(slice_deblocking_filter_disabled_flag)))
+        {
+            SLICE_FIELDS(slice_loop_filter_across_slices_enabled_flag) = rbsp_get_u(st, 1);
+        }
+    }
+
+    if (vapp->pic_fields.bits.tiles_enabled_flag ||
+        vapp->pic_fields.bits.entropy_coding_sync_enabled_flag)
+    {
+        const int num_entry_point_offsets = rbsp_get_uev(st);
+        if (num_entry_point_offsets > 0) {
+            const int offset_len_minus1 = rbsp_get_uev(st);
+            for (int k = 0; k < num_entry_point_offsets; k ++)
+                skip_bits(st, offset_len_minus1 + 1);   // entry_point_offset_minus1
+        }
+    }
+
+    if (vapp->slice_parsing_fields.bits.slice_segment_header_extension_present_flag) {
+        const int slice_segment_header_extension_length = rbsp_get_uev(st);
+        skip_bits(st, 8 * slice_segment_header_extension_length);
+    }
+
+    // byte_alignment()
+    rbsp_get_u(st, 1);          // alignment_bit_equal_to_one
+    while (7 != st->bit_ptr)
+        rbsp_get_u(st, 1);      // alignment_bit_equal_to_zero
+
+#undef SLICE_FIELDS
+    return nal_unit_type;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __HEVC_PARSE_H
+#define __HEVC_PARSE_H
+
+#include <va/va.h>
+#include "bitstream.h"
+
+#if VA_CHECK_VERSION(0, 37, 0)
+
+#define HEVC_SLICE_TYPE_B   0
+#define HEVC_SLICE_TYPE_P   1
+#define HEVC_SLICE_TYPE_I   2
+
+#define HEVC_NAL_BLA_W_LP       16
+#define HEVC_NAL_IDR_W_RADL     19
+#define HEVC_NAL_IDR_N_LP       20
+#define HEVC_NAL_RSV_IRAP_23    23
+#define HEVC_NAL_VPS            32
+
+/** @brief Current picture reference picture set, as computed by application
+ *
+ *  Entries of RefPicSet* arrays are indices into VAPictureParameterBufferHEVC::ReferenceFrames.
+ */
+typedef struct {
+    int     NumPocTotalCurr;
+    int     NumShortTermPictureSliceHeaderBits;
+    int     NumLongTermPictureSliceHeaderBits;
+    int     NumPocStCurrBefore;
+    int     NumPocStCurrAfter;
+    int     NumPocLtCurr;
+    int     RefPicSetStCurrBefore[8];
+    int     RefPicSetStCurrAfter[8];
+    int     RefPicSetLtCurr[8];
+} hevc_ref_pic_set_t;
+
+/** @brief Parse slice segment header
+ *
+ *  @param st should point to NAL unit header. On return it points to the first byte
+ *  of slice segment data.
+ *  @param vasp for dependent slice segments fields not present in the bitstream are
+ *  left intact, so it should contain parameters of the previous slice segment.
+ *
+ *  @return nal_unit_type
+ */
+int
+parse_slice_segment_header(rbsp_state_t *st, const VAPictureParameterBufferHEVC *vapp,
+                           const hevc_ref_pic_set_t *rps, VASliceParameterBufferHEVC *vasp);
+
+#endif
+
+#endif
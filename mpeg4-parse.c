@@ -0,0 +1,57 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#include "mpeg4-parse.h"
+
+static
+int
+time_increment_bits(unsigned int vop_time_increment_resolution)
+{
+    // number of bits needed to represent values in range [0, resolution - 1], but at least 1
+    int bits = 1;
+    while (bits < 16 && (1u << bits) < vop_time_increment_resolution)
+        bits ++;
+    return bits;
+}
+
+int
+parse_vop_header(rbsp_state_t *st, VAPictureParameterBufferMPEG4 *vapp,
+                 VASliceParameterBufferMPEG4 *vasp)
+{
+    // Only rectangular VOLs without sprites, newpred and reduced resolution VOPs are
+    // handled here. VDPAU have no means to pass such parameters anyway.
+    const int vop_coding_type = rbsp_get_u(st, 2);
+    vapp->vop_fields.bits.vop_coding_type = vop_coding_type;
+
+    while (rbsp_get_u(st, 1))   // modulo_time_base
+        ;
+    rbsp_get_u(st, 1);          // marker_bit
+    rbsp_get_u(st, time_increment_bits(vapp->vop_time_increment_resolution));
+    rbsp_get_u(st, 1);          // marker_bit
+
+    const int vop_coded = rbsp_get_u(st, 1);
+    if (!vop_coded)
+        return 0;
+
+    if (VOP_TYPE_P == vop_coding_type)
+        vapp->vop_fields.bits.vop_rounding_type = rbsp_get_u(st, 1);
+
+    vapp->vop_fields.bits.intra_dc_vlc_thr = rbsp_get_u(st, 3);
+    if (vapp->vol_fields.bits.interlaced) {
+        vapp->vop_fields.bits.top_field_first = rbsp_get_u(st, 1);
+        vapp->vop_fields.bits.alternate_vertical_scan_flag = rbsp_get_u(st, 1);
+    }
+
+    vasp->quant_scale = rbsp_get_u(st, vapp->quant_precision);
+    if (VOP_TYPE_I != vop_coding_type)
+        vapp->vop_fcode_forward = rbsp_get_u(st, 3);
+    if (VOP_TYPE_B == vop_coding_type)
+        vapp->vop_fcode_backward = rbsp_get_u(st, 3);
+
+    return 1;
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __MPEG4_PARSE_H
+#define __MPEG4_PARSE_H
+
+#include <va/va.h>
+#include "bitstream.h"
+
+#define MPEG4_VOP_START_CODE    0xb6
+
+#define VOP_TYPE_I      0
+#define VOP_TYPE_P      1
+#define VOP_TYPE_B      2
+#define VOP_TYPE_S      3
+
+/** @brief Parse VOP header
+ *
+ *  Reads VOP header from @param st, which should point to the first bit after
+ *  vop_start_code. Fields VDPAU doesn't provide are stored to @param vapp and @param vasp.
+ *  On return @param st points to the first bit of macroblock data.
+ *
+ *  @return value of vop_coded flag. Zero means VOP have no data and should not be decoded.
+ */
+int
+parse_vop_header(rbsp_state_t *st, VAPictureParameterBufferMPEG4 *vapp,
+                 VASliceParameterBufferMPEG4 *vasp);
+
+#endif
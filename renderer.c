@@ -0,0 +1,289 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "gl-state.h"
+#include "renderer.h"
+#include "shaders.h"
+#include "vdpau-trace.h"
+
+int
+renderer_init(renderer_t *renderer)
+{
+    // shaders are written in GLSL 1.20, which comes with OpenGL 2.1
+    const char *gl_version = (const char *)glGetString(GL_VERSION);
+    int major = 0;
+    int minor = 0;
+    if (NULL == gl_version || 2 != sscanf(gl_version, "%d.%d", &major, &minor) ||
+        major < 2 || (2 == major && minor < 1))
+    {
+        traceError("error (renderer_init): OpenGL 2.1 is required, driver provides %s\n",
+                   gl_version ? gl_version : "unknown version");
+        return -1;
+    }
+
+    renderer->textured_program = shader_program_create("textured quad", shader_textured);
+    renderer->solid_program = shader_program_create("solid quad", shader_solid);
+    if (0 == renderer->textured_program || 0 == renderer->solid_program) {
+        traceError("error (renderer_init): can't create shader programs\n");
+        goto error;
+    }
+
+    gl_state_use_program(renderer->textured_program);
+    glUniform1i(glGetUniformLocation(renderer->textured_program, "tex"), 0);
+    gl_state_use_program(0);
+
+    glGenBuffers(1, &renderer->vbo);
+    if (0 == renderer->vbo) {
+        traceError("error (renderer_init): can't create vertex buffer object\n");
+        goto error;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    glBufferData(GL_ARRAY_BUFFER, RENDERER_VBO_SIZE, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    renderer->vbo_offset = 0;
+
+    renderer->batch = malloc(RENDERER_BATCH_QUADS * 6 * sizeof(renderer_vertex_t));
+    if (NULL == renderer->batch) {
+        traceError("error (renderer_init): can't allocate memory for batch\n");
+        goto error;
+    }
+    renderer->batch_count = 0;
+    renderer->batch_serial = 0;
+
+    renderer_set_texture_size(renderer, 1, 1);
+    return 0;
+
+error:
+    renderer_destroy(renderer);
+    return -1;
+}
+
+void
+renderer_destroy(renderer_t *renderer)
+{
+    if (renderer->textured_program)
+        glDeleteProgram(renderer->textured_program);
+    if (renderer->solid_program)
+        glDeleteProgram(renderer->solid_program);
+    if (renderer->vbo)
+        glDeleteBuffers(1, &renderer->vbo);
+    free(renderer->batch);
+    renderer->textured_program = 0;
+    renderer->solid_program = 0;
+    renderer->vbo = 0;
+    renderer->batch = NULL;
+    renderer->batch_count = 0;
+}
+
+void
+renderer_set_target(renderer_t *renderer, GLuint fbo, uint32_t width, uint32_t height,
+                    int y_down)
+{
+    gl_state_bind_framebuffer(fbo);
+    gl_state_viewport(0, 0, width, height);
+
+    renderer->dst_scale[0] = 2.0f / width;
+    renderer->dst_offset[0] = -1.0f;
+    if (y_down) {
+        renderer->dst_scale[1] = -2.0f / height;
+        renderer->dst_offset[1] = 1.0f;
+    } else {
+        renderer->dst_scale[1] = 2.0f / height;
+        renderer->dst_offset[1] = -1.0f;
+    }
+}
+
+void
+renderer_set_texture_size(renderer_t *renderer, uint32_t width, uint32_t height)
+{
+    renderer->tex_scale[0] = 1.0f / width;
+    renderer->tex_scale[1] = 1.0f / height;
+}
+
+/** @brief Copy count vertices to vertex buffer
+ *
+ *  Buffer is filled sequentially, so already written parts, which could still be in use by
+ *  pending draws, are never overwritten. When buffer is full, its storage is orphaned, so
+ *  driver can allocate new one while draws from old storage are still in flight. Writes
+ *  are small, so glBufferSubData is cheaper than mapping buffer for each of them.
+ *
+ *  Buffer is left bound to GL_ARRAY_BUFFER.
+ *
+ *  @retval index of the first written vertex
+ */
+static
+GLint
+renderer_upload(renderer_t *renderer, const renderer_vertex_t *vertices, GLsizeiptr count)
+{
+    const GLsizeiptr size = count * sizeof(renderer_vertex_t);
+
+    glBindBuffer(GL_ARRAY_BUFFER, renderer->vbo);
+    if (renderer->vbo_offset + size > RENDERER_VBO_SIZE) {
+        glBufferData(GL_ARRAY_BUFFER, RENDERER_VBO_SIZE, NULL, GL_STREAM_DRAW);
+        renderer->vbo_offset = 0;
+    }
+
+    glBufferSubData(GL_ARRAY_BUFFER, renderer->vbo_offset, size, vertices);
+    const GLint first = renderer->vbo_offset / sizeof(renderer_vertex_t);
+    renderer->vbo_offset += size;
+    return first;
+}
+
+/** @brief Point vertex attributes to vertex buffer
+ *
+ *  Attribute arrays are per-context state, so that is done before every draw.
+ */
+static
+void
+renderer_bind_attributes(void)
+{
+    const GLsizei stride = sizeof(renderer_vertex_t);
+    glEnableVertexAttribArray(SHADER_ATTRIB_POSITION);
+    glEnableVertexAttribArray(SHADER_ATTRIB_TEX_COORD);
+    glEnableVertexAttribArray(SHADER_ATTRIB_COLOR);
+    glVertexAttribPointer(SHADER_ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, stride,
+                          (const void *)offsetof(renderer_vertex_t, x));
+    glVertexAttribPointer(SHADER_ATTRIB_TEX_COORD, 2, GL_FLOAT, GL_FALSE, stride,
+                          (const void *)offsetof(renderer_vertex_t, s));
+    glVertexAttribPointer(SHADER_ATTRIB_COLOR, 4, GL_FLOAT, GL_FALSE, stride,
+                          (const void *)offsetof(renderer_vertex_t, r));
+}
+
+/** @brief Write quad as two triangles, as quads are not available in core profile
+ *
+ *  dst_scale and dst_offset transform pixels to clip space, tex_scale transforms texels to
+ *  normalized texture coordinates. Source rectangle is shrunk by src_inset texels on each
+ *  side.
+ */
+static
+void
+renderer_fill_quad(renderer_vertex_t *v, const GLfloat dst_scale[2], const GLfloat dst_offset[2],
+                   const GLfloat tex_scale[2], const VdpRect *src, GLfloat src_inset,
+                   const VdpRect *dst, const VdpColor *color)
+{
+    static const VdpColor white = {1.0f, 1.0f, 1.0f, 1.0f};
+    static const int corners[6][2] = { {0, 0}, {1, 0}, {1, 1}, {0, 0}, {1, 1}, {0, 1} };
+    const VdpRect no_src = {0, 0, 0, 0};
+    if (NULL == src)
+        src = &no_src;
+    if (NULL == color)
+        color = &white;
+
+    const GLfloat x[2] = { dst->x0 * dst_scale[0] + dst_offset[0],
+                           dst->x1 * dst_scale[0] + dst_offset[0] };
+    const GLfloat y[2] = { dst->y0 * dst_scale[1] + dst_offset[1],
+                           dst->y1 * dst_scale[1] + dst_offset[1] };
+    // mirrored rectangles have edges swapped, inset should still go inwards
+    const GLfloat inset_x = (src->x0 <= src->x1) ? src_inset : -src_inset;
+    const GLfloat inset_y = (src->y0 <= src->y1) ? src_inset : -src_inset;
+    const GLfloat s[2] = { (src->x0 + inset_x) * tex_scale[0],
+                           (src->x1 - inset_x) * tex_scale[0] };
+    const GLfloat t[2] = { (src->y0 + inset_y) * tex_scale[1],
+                           (src->y1 - inset_y) * tex_scale[1] };
+
+    for (int k = 0; k < 6; k ++) {
+        v[k].x = x[corners[k][0]];
+        v[k].y = y[corners[k][1]];
+        v[k].s = s[corners[k][0]];
+        v[k].t = t[corners[k][1]];
+        v[k].r = color->red;
+        v[k].g = color->green;
+        v[k].b = color->blue;
+        v[k].a = color->alpha;
+    }
+}
+
+/** @brief Copy vertices to vertex buffer and draw them as triangles */
+static
+void
+renderer_draw_vertices(renderer_t *renderer, const renderer_vertex_t *vertices, GLsizei count)
+{
+    const GLint first = renderer_upload(renderer, vertices, count);
+    renderer_bind_attributes();
+    glDrawArrays(GL_TRIANGLES, first, count);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void
+renderer_draw_quad(renderer_t *renderer, const VdpRect *src, const VdpRect *dst,
+                   const VdpColor *color)
+{
+    renderer_vertex_t v[6];
+    renderer_fill_quad(v, renderer->dst_scale, renderer->dst_offset, renderer->tex_scale,
+                       src, 0.0f, dst, color);
+    renderer_draw_vertices(renderer, v, 6);
+}
+
+void
+renderer_batch_quad(renderer_t *renderer, const renderer_batch_state_t *state,
+                    const VdpRect *src, GLfloat src_inset, const VdpRect *dst,
+                    const VdpColor *color)
+{
+    if (renderer->batch_count > 0 &&
+        (RENDERER_BATCH_QUADS == renderer->batch_count ||
+         0 != memcmp(state, &renderer->batch_state, sizeof(*state))))
+    {
+        renderer_flush(renderer);
+    }
+    if (0 == renderer->batch_count)
+        renderer->batch_state = *state;
+
+    const GLfloat dst_scale[2] = { 2.0f / state->dst_width, 2.0f / state->dst_height };
+    const GLfloat dst_offset[2] = { -1.0f, -1.0f };
+    const GLfloat tex_scale[2] = { 1.0f / state->tex_width, 1.0f / state->tex_height };
+    renderer_fill_quad(renderer->batch + 6 * renderer->batch_count, dst_scale, dst_offset,
+                       tex_scale, src, src_inset, dst, color);
+    renderer->batch_count ++;
+}
+
+void
+renderer_flush(renderer_t *renderer)
+{
+    if (0 == renderer->batch_count)
+        return;
+
+    const renderer_batch_state_t *state = &renderer->batch_state;
+    gl_state_bind_framebuffer(state->fbo);
+    gl_state_viewport(0, 0, state->dst_width, state->dst_height);
+    gl_state_use_program(renderer->textured_program);
+    gl_state_bind_texture(state->tex_id);
+    gl_state_blend(1);
+    gl_state_blend_func(state->blend_src_rgb, state->blend_dst_rgb, state->blend_src_alpha,
+                        state->blend_dst_alpha);
+    gl_state_blend_equation(state->blend_eq_rgb, state->blend_eq_alpha);
+
+    renderer_draw_vertices(renderer, renderer->batch, 6 * renderer->batch_count);
+    renderer->batch_count = 0;
+    renderer->batch_serial ++;
+
+    gl_state_use_program(0);
+}
+
+void
+renderer_flush_texture(renderer_t *renderer, GLuint tex_id)
+{
+    if (renderer->batch_count > 0 &&
+        (renderer->batch_state.tex_id == tex_id || renderer->batch_state.dst_tex_id == tex_id))
+    {
+        renderer_flush(renderer);
+    }
+}
+
+void
+renderer_flush_serial(renderer_t *renderer, uint32_t batch_serial)
+{
+    if (renderer->batch_count > 0 && renderer->batch_serial == batch_serial)
+        renderer_flush(renderer);
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __RENDERER_H
+#define __RENDERER_H
+
+#include <stdint.h>
+#include <GL/gl.h>
+#include <vdpau/vdpau.h>
+
+/** @brief Size of streaming vertex buffer, in bytes */
+#define RENDERER_VBO_SIZE       (256 * 1024)
+
+/** @brief Maximum number of quads in one batch. Batch must fit into vertex buffer */
+#define RENDERER_BATCH_QUADS    1024
+
+/** @brief Vertex as stored in streaming vertex buffer */
+typedef struct {
+    GLfloat     x, y;               ///< clip space position
+    GLfloat     s, t;               ///< normalized texture coordinates
+    GLfloat     r, g, b, a;         ///< color
+} renderer_vertex_t;
+
+/** @brief Everything batched quads should share to be drawn at once
+ *
+ *  Compared with memcmp, so it should be fully initialized.
+ */
+typedef struct {
+    GLuint      fbo;                ///< destination framebuffer
+    GLuint      dst_tex_id;         ///< texture attached to destination framebuffer
+    uint32_t    dst_width;
+    uint32_t    dst_height;
+    GLuint      tex_id;             ///< source texture
+    uint32_t    tex_width;
+    uint32_t    tex_height;
+    GLenum      blend_src_rgb;      ///< blend functions and equations
+    GLenum      blend_dst_rgb;
+    GLenum      blend_src_alpha;
+    GLenum      blend_dst_alpha;
+    GLenum      blend_eq_rgb;
+    GLenum      blend_eq_alpha;
+} renderer_batch_state_t;
+
+/** @brief Quad drawing with shader programs and streaming vertex buffer
+ *
+ *  Replaces immediate mode drawing and fixed function matrix stacks. Programs and buffer
+ *  are created once per device and shared by all its GL contexts.
+ */
+typedef struct {
+    GLuint      textured_program;   ///< texture modulated by vertex color
+    GLuint      solid_program;      ///< vertex color only
+    GLuint      vbo;                ///< streaming vertex buffer
+    GLintptr    vbo_offset;         ///< where next vertices will be written
+    GLfloat     dst_scale[2];       ///< pixel to clip space transform of current target
+    GLfloat     dst_offset[2];
+    GLfloat     tex_scale[2];       ///< texel to normalized texture coordinates transform
+    renderer_batch_state_t batch_state; ///< state shared by pending quads
+    renderer_vertex_t *batch;       ///< vertices of pending quads
+    uint32_t    batch_count;        ///< number of pending quads
+    uint32_t    batch_serial;       ///< identifies pending batch, changes every flush
+} renderer_t;
+
+/** @brief Create shader programs and vertex buffer. GL context must be current
+ *
+ *  @retval 0 on success
+ *  @retval -1 if shaders or buffer objects are not available
+ */
+int
+renderer_init(renderer_t *renderer);
+
+/** @brief Free resources allocated by renderer_init */
+void
+renderer_destroy(renderer_t *renderer);
+
+/** @brief Bind framebuffer and set it as a target for following draws
+ *
+ *  @param fbo          framebuffer, 0 for window
+ *  @param y_down       1 if y axis goes from top to bottom, as in window coordinates.
+ *                      Otherwise it goes upward, as in texture coordinates.
+ */
+void
+renderer_set_target(renderer_t *renderer, GLuint fbo, uint32_t width, uint32_t height,
+                    int y_down);
+
+/** @brief Set size of source texture, so source rectangles could be given in texels */
+void
+renderer_set_texture_size(renderer_t *renderer, uint32_t width, uint32_t height);
+
+/** @brief Draw quad with currently used program
+ *
+ *  @param src          source rectangle in texels, may be NULL if program doesn't sample
+ *                      textures
+ *  @param dst          destination rectangle in target pixels
+ *  @param color        vertex color, NULL for opaque white
+ */
+void
+renderer_draw_quad(renderer_t *renderer, const VdpRect *src, const VdpRect *dst,
+                   const VdpColor *color);
+
+/** @brief Queue textured quad for drawing with blending
+ *
+ *  Quad is drawn later by renderer_flush, along with other quads having the same state.
+ *  Batch is flushed here if state differs from that of pending quads.
+ *
+ *  @param src          source rectangle in texels
+ *  @param src_inset    number of texels source rectangle is shrunk by on each side. Half a
+ *                      texel keeps linear filtering from reaching outside of rectangle
+ *  @param dst          destination rectangle in pixels, y axis goes upward
+ *  @param color        vertex color, NULL for opaque white
+ */
+void
+renderer_batch_quad(renderer_t *renderer, const renderer_batch_state_t *state,
+                    const VdpRect *src, GLfloat src_inset, const VdpRect *dst,
+                    const VdpColor *color);
+
+/** @brief Draw pending quads, if any. GL context must be current */
+void
+renderer_flush(renderer_t *renderer);
+
+/** @brief Draw pending quads if they read from or draw to texture tex_id
+ *
+ *  Should be called before texture is changed, read back or deleted.
+ */
+void
+renderer_flush_texture(renderer_t *renderer, GLuint tex_id);
+
+/** @brief Draw pending quads if they were queued in batch with given serial
+ *
+ *  Finer-grained variant of renderer_flush_texture, for textures shared by several
+ *  objects. Object should remember value of batch_serial after queueing its quads and
+ *  call this before its part of texture is changed or reused.
+ */
+void
+renderer_flush_serial(renderer_t *renderer, uint32_t batch_serial);
+
+#endif /* __RENDERER_H */
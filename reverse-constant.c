@@ -7,6 +7,7 @@
  */
 
 #include "reverse-constant.h"
+#include "decoder-stats.h"
 #include <vdpau/vdpau.h>
 #include <vdpau/vdpau_x11.h>
 
@@ -138,6 +139,8 @@ reverse_func_id(VdpFuncId func_id)
         return "VDP_FUNC_ID_PREEMPTION_CALLBACK_REGISTER";
     case VDP_FUNC_ID_PRESENTATION_QUEUE_TARGET_CREATE_X11:
         return "VDP_FUNC_ID_PRESENTATION_QUEUE_TARGET_CREATE_X11";
+    case VDP_FUNC_ID_DECODER_GET_STATS_VA_GL:
+        return "VDP_FUNC_ID_DECODER_GET_STATS_VA_GL";
     default:
         return "Unknown";
     }
@@ -234,6 +237,14 @@ reverse_chroma_type(VdpChromaType chroma_type)
         return "VDP_CHROMA_TYPE_422";
     case VDP_CHROMA_TYPE_444:
         return "VDP_CHROMA_TYPE_444";
+#ifdef VDP_CHROMA_TYPE_420_16
+    case VDP_CHROMA_TYPE_420_16:
+        return "VDP_CHROMA_TYPE_420_16";
+    case VDP_CHROMA_TYPE_422_16:
+        return "VDP_CHROMA_TYPE_422_16";
+    case VDP_CHROMA_TYPE_444_16:
+        return "VDP_CHROMA_TYPE_444_16";
+#endif
     default:
         return "Unknown chroma type";
     }
@@ -255,6 +266,10 @@ reverse_ycbcr_format(VdpYCbCrFormat ycbcr_format)
         return "VDP_YCBCR_FORMAT_Y8U8V8A8";
     case VDP_YCBCR_FORMAT_V8U8Y8A8:
         return "VDP_YCBCR_FORMAT_V8U8Y8A8";
+#ifdef VDP_YCBCR_FORMAT_P010
+    case VDP_YCBCR_FORMAT_P010:
+        return "VDP_YCBCR_FORMAT_P010";
+#endif
     default:
         return "Unknown YCbCr format";
     }
@@ -375,6 +390,14 @@ reverse_decoder_profile(VdpDecoderProfile profile)
         return "VDP_DECODER_PROFILE_DIVX5_HOME_THEATER";
     case VDP_DECODER_PROFILE_DIVX5_HD_1080P:
         return "VDP_DECODER_PROFILE_DIVX5_HD_1080P";
+#ifdef VDP_DECODER_PROFILE_HEVC_MAIN
+    case VDP_DECODER_PROFILE_HEVC_MAIN:
+        return "VDP_DECODER_PROFILE_HEVC_MAIN";
+    case VDP_DECODER_PROFILE_HEVC_MAIN_10:
+        return "VDP_DECODER_PROFILE_HEVC_MAIN_10";
+    case VDP_DECODER_PROFILE_HEVC_MAIN_STILL:
+        return "VDP_DECODER_PROFILE_HEVC_MAIN_STILL";
+#endif
     default:
         return "Unknown decoder profile";
     }
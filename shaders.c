@@ -0,0 +1,241 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "shaders.h"
+#include "vdpau-trace.h"
+
+static const char *shader_vertex_quad =
+    "#version 120\n"
+    "attribute vec2 position;\n"
+    "attribute vec2 tex_coord;\n"
+    "attribute vec4 color;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "    gl_TexCoord[0] = vec4(tex_coord, 0.0, 1.0);\n"
+    "    gl_FrontColor = color;\n"
+    "}\n";
+
+const char *shader_textured =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = gl_Color * texture2D(tex, gl_TexCoord[0].st);\n"
+    "}\n";
+
+const char *shader_solid =
+    "#version 120\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+const char *shader_ycbcr_to_rgb =
+    "#version 120\n"
+    "uniform sampler2D tex_y;\n"
+    "uniform sampler2D tex_cb;\n"
+    "uniform sampler2D tex_cr;\n"
+    "uniform vec4 csc[3];\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 ycbcr = vec4(texture2D(tex_y, gl_TexCoord[0].st).r,\n"
+    "                      texture2D(tex_cb, gl_TexCoord[0].st).r,\n"
+    "                      texture2D(tex_cr, gl_TexCoord[0].st).r, 1.0);\n"
+    "    gl_FragColor = vec4(dot(csc[0], ycbcr), dot(csc[1], ycbcr), dot(csc[2], ycbcr), 1.0);\n"
+    "}\n";
+
+const char *shader_rgb_transform =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "uniform vec4 transform[3];\n"
+    "void main()\n"
+    "{\n"
+    "    vec4 rgb = vec4(texture2D(tex, gl_TexCoord[0].st).rgb, 1.0);\n"
+    "    gl_FragColor = vec4(dot(transform[0], rgb), dot(transform[1], rgb),\n"
+    "                        dot(transform[2], rgb), 1.0);\n"
+    "}\n";
+
+const char *shader_rgb_filter =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "uniform vec4 transform[3];\n"
+    "uniform vec2 tex_size;\n"
+    "uniform float denoise;\n"
+    "uniform float sharpness;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 st = gl_TexCoord[0].st;\n"
+    "    vec3 c = texture2D(tex, st).rgb;\n"
+    "    float sigma = 0.02 + 0.2 * denoise;\n"
+    "    vec3 blur = vec3(0.0);\n"
+    "    vec3 bilateral = vec3(0.0);\n"
+    "    float bilateral_weight = 0.0;\n"
+    "    for (int dy = -1; dy <= 1; dy ++) {\n"
+    "        for (int dx = -1; dx <= 1; dx ++) {\n"
+    "            vec3 s = texture2D(tex, st + vec2(dx, dy) / tex_size).rgb;\n"
+    "            float g = (0 == dx ? 2.0 : 1.0) * (0 == dy ? 2.0 : 1.0);\n"
+    "            vec3 d = s - c;\n"
+    "            float w = g * exp(-dot(d, d) / (2.0 * sigma * sigma));\n"
+    "            blur += g * s;\n"
+    "            bilateral += w * s;\n"
+    "            bilateral_weight += w;\n"
+    "        }\n"
+    "    }\n"
+    "    vec3 filtered = mix(c, bilateral / bilateral_weight, denoise);\n"
+    "    vec4 rgb = vec4(filtered + sharpness * (c - blur / 16.0), 1.0);\n"
+    "    gl_FragColor = vec4(dot(transform[0], rgb), dot(transform[1], rgb),\n"
+    "                        dot(transform[2], rgb), 1.0);\n"
+    "}\n";
+
+const char *shader_deinterlace_bob =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "uniform vec4 transform[3];\n"
+    "uniform float tex_height;\n"
+    "uniform float field;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 st = gl_TexCoord[0].st;\n"
+    "    float row = floor(st.t * tex_height);\n"
+    "    vec4 rgb;\n"
+    "    if (mod(row, 2.0) == field) {\n"
+    "        rgb = texture2D(tex, vec2(st.s, (row + 0.5) / tex_height));\n"
+    "    } else {\n"
+    "        rgb = 0.5 * (texture2D(tex, vec2(st.s, (row - 0.5) / tex_height)) +\n"
+    "                     texture2D(tex, vec2(st.s, (row + 1.5) / tex_height)));\n"
+    "    }\n"
+    "    rgb = vec4(rgb.rgb, 1.0);\n"
+    "    gl_FragColor = vec4(dot(transform[0], rgb), dot(transform[1], rgb),\n"
+    "                        dot(transform[2], rgb), 1.0);\n"
+    "}\n";
+
+const char *shader_deinterlace_temporal =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "uniform sampler2D tex_past;\n"
+    "uniform sampler2D tex_future;\n"
+    "uniform vec4 transform[3];\n"
+    "uniform float tex_height;\n"
+    "uniform float field;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 st = gl_TexCoord[0].st;\n"
+    "    float row = floor(st.t * tex_height);\n"
+    "    vec2 pos = vec2(st.s, (row + 0.5) / tex_height);\n"
+    "    vec4 rgb;\n"
+    "    if (mod(row, 2.0) == field) {\n"
+    "        rgb = texture2D(tex, pos);\n"
+    "    } else {\n"
+    "        vec4 spatial = 0.5 * (texture2D(tex, vec2(st.s, (row - 0.5) / tex_height)) +\n"
+    "                              texture2D(tex, vec2(st.s, (row + 1.5) / tex_height)));\n"
+    "        vec4 past = texture2D(tex_past, pos);\n"
+    "        vec4 future = texture2D(tex_future, pos);\n"
+    "        vec3 diff = abs(past.rgb - future.rgb);\n"
+    "        float motion = max(diff.r, max(diff.g, diff.b));\n"
+    "        rgb = mix(0.5 * (past + future), spatial, smoothstep(0.02, 0.1, motion));\n"
+    "    }\n"
+    "    rgb = vec4(rgb.rgb, 1.0);\n"
+    "    gl_FragColor = vec4(dot(transform[0], rgb), dot(transform[1], rgb),\n"
+    "                        dot(transform[2], rgb), 1.0);\n"
+    "}\n";
+
+const char *shader_scale_separable =
+    "#version 120\n"
+    "uniform sampler2D tex;\n"
+    "uniform sampler2D weights;\n"
+    "uniform vec4 transform[3];\n"
+    "uniform vec2 tex_size;\n"
+    "uniform vec2 direction;\n"
+    "uniform float support;\n"
+    "uniform float scale;\n"
+    "void main()\n"
+    "{\n"
+    "    vec2 st = gl_TexCoord[0].st;\n"
+    "    float p = dot(st * tex_size, direction) - 0.5;\n"
+    "    float radius = support * scale;\n"
+    "    float first = ceil(p - radius);\n"
+    "    vec2 step = direction / tex_size;\n"
+    "    vec2 c = mix(st, vec2(first + 0.5) / tex_size, direction);\n"
+    "    vec4 sum = vec4(0.0);\n"
+    "    float weight_sum = 0.0;\n"
+    "    for (int k = 0; k < 32; k ++) {\n"
+    "        float x = abs(first + float(k) - p) / scale;\n"
+    "        if (x > support)\n"
+    "            break;\n"
+    "        float w = texture2D(weights, vec2(x * (255.0 / 768.0) + 0.5 / 256.0, 0.5)).r;\n"
+    "        sum += w * texture2D(tex, c + float(k) * step);\n"
+    "        weight_sum += w;\n"
+    "    }\n"
+    "    vec4 rgb = vec4(sum.rgb / weight_sum, 1.0);\n"
+    "    gl_FragColor = vec4(dot(transform[0], rgb), dot(transform[1], rgb),\n"
+    "                        dot(transform[2], rgb), 1.0);\n"
+    "}\n";
+
+static
+GLuint
+compile_shader(const char *name, GLenum type, const char *source)
+{
+    char log[1024];
+    GLint ok;
+
+    GLuint shader = glCreateShader(type);
+    if (0 == shader) {
+        traceError("error (compile_shader): can't create shader for %s\n", name);
+        return 0;
+    }
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (!ok) {
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        traceError("error (compile_shader): compilation of %s failed: %s\n", name, log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+GLuint
+shader_program_create(const char *name, const char *source)
+{
+    char log[1024];
+    GLint ok;
+
+    GLuint vertex_shader = compile_shader(name, GL_VERTEX_SHADER, shader_vertex_quad);
+    if (0 == vertex_shader)
+        return 0;
+    GLuint shader = compile_shader(name, GL_FRAGMENT_SHADER, source);
+    if (0 == shader) {
+        glDeleteShader(vertex_shader);
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vertex_shader);
+    glAttachShader(program, shader);
+    glBindAttribLocation(program, SHADER_ATTRIB_POSITION, "position");
+    glBindAttribLocation(program, SHADER_ATTRIB_TEX_COORD, "tex_coord");
+    glBindAttribLocation(program, SHADER_ATTRIB_COLOR, "color");
+    glLinkProgram(program);
+    // program keeps shaders alive as long as they are attached
+    glDeleteShader(vertex_shader);
+    glDeleteShader(shader);
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (!ok) {
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        traceError("error (shader_program_create): linking of %s failed: %s\n", name, log);
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
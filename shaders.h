@@ -0,0 +1,91 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __SHADERS_H
+#define __SHADERS_H
+
+#include <GL/gl.h>
+
+/** @brief Vertex attribute locations, same for every program made by shader_program_create
+ *
+ *  Position is in clip space, texture coordinates are normalized.
+ */
+enum {
+    SHADER_ATTRIB_POSITION = 0,
+    SHADER_ATTRIB_TEX_COORD = 1,
+    SHADER_ATTRIB_COLOR = 2,
+};
+
+/** @brief Fragment shader drawing texture tex modulated by vertex color */
+extern const char *shader_textured;
+
+/** @brief Fragment shader filling with vertex color */
+extern const char *shader_solid;
+
+/** @brief Fragment shader converting planar YCbCr to RGB
+ *
+ *  Uniforms: tex_y, tex_cb, tex_cr are single-channel plane textures sampled with
+ *  gl_TexCoord[0]; csc[3] are rows of 3x4 color space conversion matrix, applied to
+ *  (Y, Cb, Cr, 1) vector with components in [0, 1] range.
+ */
+extern const char *shader_ycbcr_to_rgb;
+
+/** @brief Fragment shader applying affine transform to RGB texture
+ *
+ *  Uniforms: tex is sampled with gl_TexCoord[0]; transform[3] are rows of 3x4 matrix,
+ *  applied to (R, G, B, 1) vector.
+ */
+extern const char *shader_rgb_transform;
+
+/** @brief Fragment shader doing noise reduction and sharpening of RGB texture
+ *
+ *  denoise in [0, 1] blends pixel with edge preserving average of its 3x3 neighborhood,
+ *  sharpness in [-1, 1] adds (or subtracts, blurring picture) difference between pixel and
+ *  its gaussian blurred value. tex_size is texture size in pixels. Result is passed through
+ *  transform, as in shader_rgb_transform.
+ */
+extern const char *shader_rgb_filter;
+
+/** @brief Fragment shader doing bob deinterlacing of RGB texture
+ *
+ *  Lines of the field selected by field uniform (0 for top, 1 for bottom) are taken as is,
+ *  others are interpolated from neighbors. tex_height is texture height in pixels.
+ *  Result is passed through transform, as in shader_rgb_transform.
+ */
+extern const char *shader_deinterlace_bob;
+
+/** @brief Fragment shader doing motion adaptive temporal deinterlacing of RGB texture
+ *
+ *  Same as shader_deinterlace_bob, but missing lines are taken from tex_past and tex_future,
+ *  which hold adjacent fields, unless difference between them indicates motion.
+ */
+extern const char *shader_deinterlace_temporal;
+
+/** @brief Fragment shader doing one pass of separable scaling of RGB texture
+ *
+ *  direction is (1, 0) for horizontal pass and (0, 1) for vertical one, tex_size is source
+ *  texture size in pixels. weights is 256x1 texture with kernel values for distances 0..3
+ *  in its red channel, support is kernel radius. scale is source to destination size ratio,
+ *  or 1 for upscaling; kernel is stretched by it, so downscaling doesn't alias. Result is
+ *  passed through transform, as in shader_rgb_transform.
+ */
+extern const char *shader_scale_separable;
+
+/** @brief Compile fragment shader and link it into program
+ *
+ *  Program gets common vertex shader, which passes vertex attributes through. Fragment
+ *  shaders get texture coordinates in gl_TexCoord[0] and vertex color in gl_Color.
+ *
+ *  @param name         used in error messages
+ *  @param source       fragment shader source
+ *  @retval program id, or 0 on failure
+ */
+GLuint
+shader_program_create(const char *name, const char *source);
+
+#endif /* __SHADERS_H */
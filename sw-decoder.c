@@ -0,0 +1,491 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#include <libavcodec/avcodec.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitstream.h"
+#include "decoder-stats.h"
+#include "sw-decoder.h"
+#include "vdpau-trace.h"
+
+/* VDPAU passes slices only, while libavcodec needs parameter sets to decode them. So
+ * SPS and PPS are reconstructed from VdpPictureInfoH264 and prepended to bitstream
+ * whenever they change.
+ *
+ * libavcodec returns pictures in output order, and could drop or delay them, while VDPAU
+ * wants each picture in its own target surface when VdpDecoderRender returns. So output
+ * frames are not used. Instead, buffer libavcodec allocates for picture being decoded is
+ * remembered in get_buffer2 callback and copied to target right after decoding.
+ */
+
+#define PARAM_SETS_MAX_SIZE     2048
+
+struct _sw_decoder_struct {
+    AVCodecContext     *avctx;
+    AVFrame            *frame;
+    AVFrame            *current;        ///< buffer of the most recently started picture
+    uint64_t            buffer_count;   ///< number of get_buffer2 calls so far
+    AVPacket           *packet;
+    int                 profile_idc;
+    int                 level_idc;
+    uint32_t            width;
+    uint32_t            height;
+    uint8_t             param_sets[PARAM_SETS_MAX_SIZE];    ///< last sent SPS and PPS
+    size_t              param_sets_size;
+    uint8_t            *buf;            ///< packet buffer
+    size_t              buf_size;
+};
+
+typedef struct {
+    uint8_t     data[PARAM_SETS_MAX_SIZE / 2];
+    int         bit_pos;
+} bit_writer_t;
+
+static const uint8_t zigzag_4x4[16] = {
+    0, 1, 4, 8, 5, 2, 3, 6, 9, 12, 13, 10, 7, 11, 14, 15
+};
+
+static const uint8_t zigzag_8x8[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static
+void
+put_bits(bit_writer_t *bw, unsigned int value, int bitcount)
+{
+    for (int k = bitcount - 1; k >= 0; k --) {
+        const int byte = bw->bit_pos / 8;
+        if (byte >= (int)sizeof(bw->data))
+            return;
+        if (value & (1u << k))
+            bw->data[byte] |= 0x80 >> (bw->bit_pos % 8);
+        else
+            bw->data[byte] &= ~(0x80 >> (bw->bit_pos % 8));
+        bw->bit_pos ++;
+    }
+}
+
+static
+void
+put_ue(bit_writer_t *bw, unsigned int value)
+{
+    int len = 0;
+    while ((value + 1) >> (len + 1))
+        len ++;
+    put_bits(bw, 0, len);
+    put_bits(bw, value + 1, len + 1);
+}
+
+static
+void
+put_se(bit_writer_t *bw, int value)
+{
+    put_ue(bw, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+static
+void
+put_rbsp_trailing_bits(bit_writer_t *bw)
+{
+    put_bits(bw, 1, 1);
+    while (bw->bit_pos % 8)
+        put_bits(bw, 0, 1);
+}
+
+/** @brief Append NAL unit with start code, inserting emulation prevention bytes */
+static
+size_t
+append_nal_unit(uint8_t *dst, const bit_writer_t *bw)
+{
+    size_t pos = 0;
+    int zeros = 0;
+    dst[pos++] = 0; dst[pos++] = 0; dst[pos++] = 0; dst[pos++] = 1;
+    for (int k = 0; k < bw->bit_pos / 8; k ++) {
+        if (zeros >= 2 && bw->data[k] <= 3) {
+            dst[pos++] = 3;
+            zeros = 0;
+        }
+        dst[pos++] = bw->data[k];
+        zeros = (0 == bw->data[k]) ? zeros + 1 : 0;
+    }
+    return pos;
+}
+
+static
+void
+put_scaling_list(bit_writer_t *bw, const uint8_t *list, const uint8_t *zigzag, int size)
+{
+    int last_scale = 8;
+    for (int k = 0; k < size; k ++) {
+        const int next_scale = list[zigzag[k]];
+        int delta = next_scale - last_scale;
+        // delta_scale is limited to [-128, 127] and applied modulo 256
+        if (delta > 127) delta -= 256;
+        if (delta < -128) delta += 256;
+        put_se(bw, delta);
+        last_scale = next_scale;
+    }
+}
+
+static
+void
+write_sps(bit_writer_t *bw, const sw_decoder_t *decoder, const VdpPictureInfoH264 *vdppi)
+{
+    const uint32_t width_mbs = (decoder->width + 15) / 16;
+    const uint32_t map_units = vdppi->frame_mbs_only_flag ? (decoder->height + 15) / 16
+                                                          : (decoder->height + 31) / 32;
+    const uint32_t crop_right = width_mbs * 16 - decoder->width;
+    const uint32_t crop_bottom = map_units * 16 * (2 - vdppi->frame_mbs_only_flag) - decoder->height;
+
+    put_bits(bw, 0x67, 8);      // nal_ref_idc = 3, nal_unit_type = 7
+    put_bits(bw, decoder->profile_idc, 8);
+    put_bits(bw, 0, 8);         // constraint flags
+    put_bits(bw, decoder->level_idc, 8);
+    put_ue(bw, 0);              // seq_parameter_set_id
+    if (100 == decoder->profile_idc) {
+        put_ue(bw, 1);          // chroma_format_idc
+        put_ue(bw, 0);          // bit_depth_luma_minus8
+        put_ue(bw, 0);          // bit_depth_chroma_minus8
+        put_bits(bw, 0, 1);     // qpprime_y_zero_transform_bypass_flag
+        put_bits(bw, 0, 1);     // seq_scaling_matrix_present_flag, matrices are sent in PPS
+    }
+    put_ue(bw, vdppi->log2_max_frame_num_minus4);
+    put_ue(bw, vdppi->pic_order_cnt_type);
+    if (0 == vdppi->pic_order_cnt_type) {
+        put_ue(bw, vdppi->log2_max_pic_order_cnt_lsb_minus4);
+    } else if (1 == vdppi->pic_order_cnt_type) {
+        // VDPAU doesn't pass POC type 1 offsets, so POC computed by decoder is wrong.
+        // Only B slices depend on it, and those are refused in sw_decoder_render_h264
+        put_bits(bw, vdppi->delta_pic_order_always_zero_flag, 1);
+        put_se(bw, 0);          // offset_for_non_ref_pic
+        put_se(bw, 0);          // offset_for_top_to_bottom_field
+        put_ue(bw, 0);          // num_ref_frames_in_pic_order_cnt_cycle
+    }
+    put_ue(bw, vdppi->num_ref_frames);
+    put_bits(bw, 1, 1);         // gaps_in_frame_num_value_allowed_flag
+    put_ue(bw, width_mbs - 1);
+    put_ue(bw, map_units - 1);
+    put_bits(bw, vdppi->frame_mbs_only_flag, 1);
+    if (!vdppi->frame_mbs_only_flag)
+        put_bits(bw, vdppi->mb_adaptive_frame_field_flag, 1);
+    put_bits(bw, vdppi->direct_8x8_inference_flag, 1);
+    if (crop_right || crop_bottom) {
+        put_bits(bw, 1, 1);     // frame_cropping_flag
+        put_ue(bw, 0);
+        put_ue(bw, crop_right / 2);
+        put_ue(bw, 0);
+        put_ue(bw, crop_bottom / (2 * (2 - vdppi->frame_mbs_only_flag)));
+    } else {
+        put_bits(bw, 0, 1);
+    }
+    put_bits(bw, 0, 1);         // vui_parameters_present_flag
+    put_rbsp_trailing_bits(bw);
+}
+
+static
+void
+write_pps(bit_writer_t *bw, const sw_decoder_t *decoder, const VdpPictureInfoH264 *vdppi,
+          int pic_parameter_set_id)
+{
+    put_bits(bw, 0x68, 8);      // nal_ref_idc = 3, nal_unit_type = 8
+    put_ue(bw, pic_parameter_set_id);
+    put_ue(bw, 0);              // seq_parameter_set_id
+    put_bits(bw, vdppi->entropy_coding_mode_flag, 1);
+    put_bits(bw, vdppi->pic_order_present_flag, 1);
+    put_ue(bw, 0);              // num_slice_groups_minus1
+    put_ue(bw, vdppi->num_ref_idx_l0_active_minus1);
+    put_ue(bw, vdppi->num_ref_idx_l1_active_minus1);
+    put_bits(bw, vdppi->weighted_pred_flag, 1);
+    put_bits(bw, vdppi->weighted_bipred_idc, 2);
+    put_se(bw, vdppi->pic_init_qp_minus26);
+    put_se(bw, 0);              // pic_init_qs_minus26
+    put_se(bw, vdppi->chroma_qp_index_offset);
+    put_bits(bw, vdppi->deblocking_filter_control_present_flag, 1);
+    put_bits(bw, vdppi->constrained_intra_pred_flag, 1);
+    put_bits(bw, vdppi->redundant_pic_cnt_present_flag, 1);
+
+    if (100 == decoder->profile_idc) {
+        put_bits(bw, vdppi->transform_8x8_mode_flag, 1);
+        put_bits(bw, 1, 1);     // pic_scaling_matrix_present_flag
+        for (int k = 0; k < 6; k ++) {
+            put_bits(bw, 1, 1);
+            put_scaling_list(bw, vdppi->scaling_lists_4x4[k], zigzag_4x4, 16);
+        }
+        if (vdppi->transform_8x8_mode_flag) {
+            for (int k = 0; k < 2; k ++) {
+                put_bits(bw, 1, 1);
+                put_scaling_list(bw, vdppi->scaling_lists_8x8[k], zigzag_8x8, 64);
+            }
+        }
+        put_se(bw, vdppi->second_chroma_qp_index_offset);
+    }
+    put_rbsp_trailing_bits(bw);
+}
+
+/** @brief Find pic_parameter_set_id referenced by the first slice
+ *
+ *  @param has_b_slices     set to 1 if any of slices is B slice
+ *  @param slice_count      set to number of slice NAL units found
+ */
+static
+int
+scan_slices(const uint8_t *buf, size_t size, int *has_b_slices, uint32_t *slice_count)
+{
+    int pic_parameter_set_id = -1;
+    rbsp_state_t st;
+    rbsp_attach_buffer(&st, buf, size);
+    *has_b_slices = 0;
+    *slice_count = 0;
+    while (1) {
+        const int nal_offset = rbsp_navigate_to_nal_unit(&st);
+        if (nal_offset < 0 || (size_t)nal_offset + 4 > size)
+            break;
+        const int nal_unit_type = buf[nal_offset] & 0x1f;
+        if (1 == nal_unit_type || 5 == nal_unit_type) {
+            rbsp_state_t st_slice = rbsp_copy_state(&st);
+            rbsp_get_u(&st_slice, 8);   // NAL unit header
+            rbsp_get_uev(&st_slice);    // first_mb_in_slice
+            const int slice_type = rbsp_get_uev(&st_slice) % 5;
+            const int pps_id = rbsp_get_uev(&st_slice);
+            if (pic_parameter_set_id < 0)
+                pic_parameter_set_id = pps_id;
+            if (1 == slice_type)
+                *has_b_slices = 1;
+            *slice_count += 1;
+        }
+    }
+    return pic_parameter_set_id < 0 ? 0 : pic_parameter_set_id;
+}
+
+/** @brief Allocate picture buffer as usual, but remember it for copying to target surface */
+static
+int
+get_buffer(AVCodecContext *avctx, AVFrame *frame, int flags)
+{
+    sw_decoder_t *decoder = avctx->opaque;
+    int ret = avcodec_default_get_buffer2(avctx, frame, flags);
+    if (ret < 0)
+        return ret;
+
+    av_frame_unref(decoder->current);
+    ret = av_frame_ref(decoder->current, frame);
+    if (ret < 0)
+        return ret;
+    decoder->buffer_count ++;
+    return 0;
+}
+
+int
+sw_decoder_profile_supported(VdpDecoderProfile profile)
+{
+    switch (profile) {
+    case VDP_DECODER_PROFILE_H264_BASELINE:
+    case VDP_DECODER_PROFILE_H264_MAIN:
+    case VDP_DECODER_PROFILE_H264_HIGH:
+        return NULL != avcodec_find_decoder(AV_CODEC_ID_H264);
+    default:
+        return 0;
+    }
+}
+
+sw_decoder_t *
+sw_decoder_create(VdpDecoderProfile profile, uint32_t width, uint32_t height, uint32_t level,
+                  int thread_count)
+{
+#if LIBAVCODEC_VERSION_INT < AV_VERSION_INT(58, 10, 100)
+    avcodec_register_all();
+#endif
+
+    if (!sw_decoder_profile_supported(profile))
+        return NULL;
+
+    sw_decoder_t *decoder = calloc(1, sizeof(sw_decoder_t));
+    if (NULL == decoder)
+        return NULL;
+
+    switch (profile) {
+    case VDP_DECODER_PROFILE_H264_BASELINE: decoder->profile_idc = 66; break;
+    case VDP_DECODER_PROFILE_H264_MAIN:     decoder->profile_idc = 77; break;
+    default:                                decoder->profile_idc = 100; break;
+    }
+    decoder->level_idc = level;
+    decoder->width = width;
+    decoder->height = height;
+
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    decoder->avctx = avcodec_alloc_context3(codec);
+    decoder->frame = av_frame_alloc();
+    decoder->current = av_frame_alloc();
+    decoder->packet = av_packet_alloc();
+    if (NULL == decoder->avctx || NULL == decoder->frame || NULL == decoder->current ||
+        NULL == decoder->packet)
+    {
+        goto error;
+    }
+
+    // VDPAU requires picture to be in target surface when VdpDecoderRender returns.
+    // Frame threading finishes pictures several calls later, so only slice threading is
+    // used. Pictures are taken from get_buffer2 buffers, so output delay doesn't matter,
+    // but low delay mode keeps decoder from holding extra buffers.
+    decoder->avctx->width = width;
+    decoder->avctx->height = height;
+    decoder->avctx->thread_count = thread_count;
+    decoder->avctx->thread_type = FF_THREAD_SLICE;
+    decoder->avctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    decoder->avctx->opaque = decoder;
+    decoder->avctx->get_buffer2 = get_buffer;
+
+    if (avcodec_open2(decoder->avctx, codec, NULL) < 0)
+        goto error;
+
+    return decoder;
+
+error:
+    traceError("error (sw_decoder_create): can't initialize libavcodec decoder\n");
+    sw_decoder_destroy(decoder);
+    return NULL;
+}
+
+void
+sw_decoder_destroy(sw_decoder_t *decoder)
+{
+    if (NULL == decoder)
+        return;
+    avcodec_free_context(&decoder->avctx);
+    av_frame_free(&decoder->frame);
+    av_frame_free(&decoder->current);
+    av_packet_free(&decoder->packet);
+    free(decoder->buf);
+    free(decoder);
+}
+
+static
+VdpStatus
+copy_frame_to_planes(const AVFrame *frame, uint32_t width, uint32_t height,
+                     uint8_t *const planes[3], const uint32_t pitches[3])
+{
+    if (AV_PIX_FMT_YUV420P != frame->format && AV_PIX_FMT_YUVJ420P != frame->format) {
+        traceError("error (sw_decoder_render_h264): unsupported pixel format %d\n",
+                   frame->format);
+        return VDP_STATUS_ERROR;
+    }
+
+    for (int p = 0; p < 3; p ++) {
+        const uint32_t plane_width = p ? width / 2 : width;
+        const uint32_t plane_height = p ? height / 2 : height;
+        const uint8_t *src = frame->data[p];
+        uint8_t *dst = planes[p];
+        for (uint32_t y = 0; y < plane_height; y ++) {
+            memcpy(dst, src, plane_width);
+            src += frame->linesize[p];
+            dst += pitches[p];
+        }
+    }
+
+    return VDP_STATUS_OK;
+}
+
+VdpStatus
+sw_decoder_render_h264(sw_decoder_t *decoder, const VdpPictureInfoH264 *vdppi,
+                       uint32_t bitstream_buffer_count, VdpBitstreamBuffer const *bitstream_buffers,
+                       uint8_t *const planes[3], const uint32_t pitches[3],
+                       VdpDecoderStatsVaGl *stats)
+{
+    uint64_t t_start = decoder_stats_timestamp();
+    size_t slices_size = 0;
+    for (uint32_t k = 0; k < bitstream_buffer_count; k ++)
+        slices_size += bitstream_buffers[k].bitstream_bytes;
+
+    const size_t required_size = PARAM_SETS_MAX_SIZE + slices_size + AV_INPUT_BUFFER_PADDING_SIZE;
+    if (required_size > decoder->buf_size) {
+        uint8_t *new_buf = realloc(decoder->buf, required_size);
+        if (NULL == new_buf)
+            return VDP_STATUS_RESOURCES;
+        decoder->buf = new_buf;
+        decoder->buf_size = required_size;
+    }
+
+    // slices are placed after space reserved for parameter sets
+    uint8_t *slices = decoder->buf + PARAM_SETS_MAX_SIZE;
+    uint8_t *ptr = slices;
+    for (uint32_t k = 0; k < bitstream_buffer_count; k ++) {
+        memcpy(ptr, bitstream_buffers[k].bitstream, bitstream_buffers[k].bitstream_bytes);
+        ptr += bitstream_buffers[k].bitstream_bytes;
+    }
+    memset(ptr, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_MERGE, decoder_stats_timestamp() - t_start);
+
+    t_start = decoder_stats_timestamp();
+    int has_b_slices;
+    uint32_t slice_count;
+    const int pic_parameter_set_id = scan_slices(slices, slices_size, &has_b_slices,
+                                                 &slice_count);
+    if (1 == vdppi->pic_order_cnt_type && has_b_slices) {
+        traceError("error (sw_decoder_render_h264): B slices with pic_order_cnt_type 1 "
+                   "are not supported\n");
+        return VDP_STATUS_ERROR;
+    }
+
+    uint8_t param_sets[PARAM_SETS_MAX_SIZE];
+    size_t param_sets_size = 0;
+    bit_writer_t bw;
+    memset(&bw, 0, sizeof(bw));
+    write_sps(&bw, decoder, vdppi);
+    param_sets_size += append_nal_unit(param_sets, &bw);
+    memset(&bw, 0, sizeof(bw));
+    write_pps(&bw, decoder, vdppi, pic_parameter_set_id);
+    param_sets_size += append_nal_unit(param_sets + param_sets_size, &bw);
+
+    // resend parameter sets only if they have changed
+    uint8_t *packet_start = slices;
+    if (param_sets_size != decoder->param_sets_size ||
+        0 != memcmp(param_sets, decoder->param_sets, param_sets_size))
+    {
+        packet_start = slices - param_sets_size;
+        memcpy(packet_start, param_sets, param_sets_size);
+        memcpy(decoder->param_sets, param_sets, param_sets_size);
+        decoder->param_sets_size = param_sets_size;
+    }
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_PARSE, decoder_stats_timestamp() - t_start);
+
+    t_start = decoder_stats_timestamp();
+    const uint64_t buffer_count = decoder->buffer_count;
+    decoder->packet->data = packet_start;
+    decoder->packet->size = ptr - packet_start;
+    int ret = avcodec_send_packet(decoder->avctx, decoder->packet);
+    decoder->packet->data = NULL;
+    decoder->packet->size = 0;
+    if (ret < 0) {
+        traceError("error (sw_decoder_render_h264): avcodec_send_packet failed, %d\n", ret);
+        return VDP_STATUS_ERROR;
+    }
+
+    // output frames are in display order and are not needed, see comment at the top
+    while (0 == (ret = avcodec_receive_frame(decoder->avctx, decoder->frame)))
+        av_frame_unref(decoder->frame);
+    if (AVERROR(EAGAIN) != ret && AVERROR_EOF != ret) {
+        traceError("error (sw_decoder_render_h264): avcodec_receive_frame failed, %d\n", ret);
+        return VDP_STATUS_ERROR;
+    }
+
+    // second field of a pair is decoded into buffer started by the first one
+    const int new_picture = (buffer_count != decoder->buffer_count);
+    if (!new_picture && (!vdppi->field_pic_flag || NULL == decoder->current->buf[0])) {
+        traceError("error (sw_decoder_render_h264): no picture was decoded\n");
+        return VDP_STATUS_ERROR;
+    }
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_SUBMIT, decoder_stats_timestamp() - t_start);
+    decoder_stats_add_slices(stats, slice_count);
+
+    return copy_frame_to_planes(decoder->current, decoder->width, decoder->height, planes,
+                                pitches);
+}
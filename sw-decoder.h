@@ -0,0 +1,54 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __SW_DECODER_H
+#define __SW_DECODER_H
+
+#include <stdint.h>
+#include <vdpau/vdpau.h>
+#include "decoder-stats.h"
+
+#define SW_DECODER_MAX_WIDTH    4096
+#define SW_DECODER_MAX_HEIGHT   4096
+
+/** @brief libavcodec-based decoder, used when VA-API is not available */
+typedef struct _sw_decoder_struct sw_decoder_t;
+
+/** @brief Check whether software decoder can handle given profile */
+int
+sw_decoder_profile_supported(VdpDecoderProfile profile);
+
+/** @brief Create software decoder
+ *
+ *  @param thread_count number of threads for slice threading. 0 means autodetect.
+ *  @return NULL on failure
+ */
+sw_decoder_t *
+sw_decoder_create(VdpDecoderProfile profile, uint32_t width, uint32_t height, uint32_t level,
+                  int thread_count);
+
+void
+sw_decoder_destroy(sw_decoder_t *decoder);
+
+/** @brief Decode H.264 picture into YCbCr 4:2:0 planes
+ *
+ *  Planes order is Y, Cb, Cr. Picture is written in decoding order, regardless of when
+ *  libavcodec would output it. For field pairs, the second field call writes the whole frame.
+ *
+ *  Merge, parse and submit stages and slice count are accounted in stats. Submit stage
+ *  covers libavcodec decoding, buffers stage is not applicable.
+ *
+ *  @retval VDP_STATUS_ERROR if decoder produced no picture
+ */
+VdpStatus
+sw_decoder_render_h264(sw_decoder_t *decoder, const VdpPictureInfoH264 *vdppi,
+                       uint32_t bitstream_buffer_count, VdpBitstreamBuffer const *bitstream_buffers,
+                       uint8_t *const planes[3], const uint32_t pitches[3],
+                       VdpDecoderStatsVaGl *stats);
+
+#endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#include <string.h>
+#include "sws-cache.h"
+
+struct SwsContext *
+sws_cache_get(sws_cache_t *cache, int src_width, int src_height, int src_format,
+              int dst_width, int dst_height, int dst_format, int flags)
+{
+    sws_cache_entry_t *victim = &cache->entries[0];
+
+    cache->use_counter ++;
+    for (int k = 0; k < SWS_CACHE_SIZE; k ++) {
+        sws_cache_entry_t *entry = &cache->entries[k];
+        if (entry->ctx && entry->src_width == src_width && entry->src_height == src_height &&
+            entry->src_format == src_format && entry->dst_width == dst_width &&
+            entry->dst_height == dst_height && entry->dst_format == dst_format &&
+            entry->flags == flags)
+        {
+            entry->last_used = cache->use_counter;
+            return entry->ctx;
+        }
+
+        // empty slots are preferred, then least recently used ones
+        if (NULL == victim->ctx)
+            continue;
+        if (NULL == entry->ctx || entry->last_used < victim->last_used)
+            victim = entry;
+    }
+
+    if (victim->ctx)
+        sws_freeContext(victim->ctx);
+    memset(victim, 0, sizeof(*victim));
+
+    victim->ctx = sws_getContext(src_width, src_height, src_format, dst_width, dst_height,
+                                 dst_format, flags, NULL, NULL, NULL);
+    if (NULL == victim->ctx)
+        return NULL;
+
+    victim->src_width = src_width;
+    victim->src_height = src_height;
+    victim->src_format = src_format;
+    victim->dst_width = dst_width;
+    victim->dst_height = dst_height;
+    victim->dst_format = dst_format;
+    victim->flags = flags;
+    victim->last_used = cache->use_counter;
+    return victim->ctx;
+}
+
+void
+sws_cache_clear(sws_cache_t *cache)
+{
+    for (int k = 0; k < SWS_CACHE_SIZE; k ++) {
+        if (cache->entries[k].ctx)
+            sws_freeContext(cache->entries[k].ctx);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __SWS_CACHE_H
+#define __SWS_CACHE_H
+
+#include <stdint.h>
+#include <libswscale/swscale.h>
+
+#define SWS_CACHE_SIZE      4
+
+/** @brief cached scaler context along with parameters it was created for */
+typedef struct {
+    struct SwsContext  *ctx;
+    int                 src_width;
+    int                 src_height;
+    int                 src_format;
+    int                 dst_width;
+    int                 dst_height;
+    int                 dst_format;
+    int                 flags;
+    uint64_t            last_used;      ///< value of use_counter at last lookup
+} sws_cache_entry_t;
+
+/** @brief small LRU cache of SwsContext objects
+ *
+ *  Creating SwsContext involves filter table computation, which is too expensive
+ *  to be done for every frame.
+ */
+typedef struct {
+    sws_cache_entry_t   entries[SWS_CACHE_SIZE];
+    uint64_t            use_counter;
+} sws_cache_t;
+
+/** @brief Find or create scaler context with given parameters
+ *
+ *  Least recently used context is evicted if cache is full. Returned context remains
+ *  owned by cache and is valid until next sws_cache_get or sws_cache_clear call.
+ *
+ *  @retval NULL if libswscale failed to create context
+ */
+struct SwsContext *
+sws_cache_get(sws_cache_t *cache, int src_width, int src_height, int src_format,
+              int dst_width, int dst_height, int dst_format, int flags);
+
+/** @brief Free all cached contexts */
+void
+sws_cache_clear(sws_cache_t *cache);
+
+#endif /* __SWS_CACHE_H */
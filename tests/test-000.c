@@ -61,5 +61,14 @@ int main(void)
     for (int k = 0; k < 24; k ++) assert (0 == rbsp_get_u(&st, 1));
     for (int k = 0; k < 8; k ++) assert (1 == rbsp_get_u(&st, 1));
 
+    // same data, but without emulation prevention (MPEG-4 Part 2 style)
+    unsigned char buf5[] = {0x00, 0x00, 0x03, 0x80};
+    rbsp_attach_buffer(&st, buf5, 4);
+    rbsp_set_emulation_prevention(&st, 0);
+    assert (0x0000 == rbsp_get_u(&st, 16));
+    assert (0x03 == rbsp_get_u(&st, 8));
+    assert (1 == rbsp_get_u(&st, 1));
+    assert (25 == st.bits_eaten);
+
     printf ("pass\n");
 }
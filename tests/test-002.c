@@ -5,7 +5,11 @@
 // compares. Buffers should contain identical data.
 //
 // Bitmap surfaces checked too. But since there is no way to download data directly from
-// bitmap surface, we doing this via rendering to output surface.
+// bitmap surface, we doing this via rendering to output surface. Both frequently and rarely
+// accessed bitmaps are checked, as they are uploaded differently.
+//
+// A8 surfaces are stored with one byte per pixel, so download into buffer with row pitch
+// larger than width is checked as well.
 
 #include <stdio.h>
 #include <string.h>
@@ -90,6 +94,37 @@ int main(void)
         return 2;
     }
 
+    // download with padded rows
+    uint8_t padded_buf[5 * 8];
+    void * const padded_data[] = { padded_buf };
+    uint32_t padded_pitches[] = { 8 };
+    memset(padded_buf, 0, sizeof(padded_buf));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, padded_data, padded_pitches));
+    for (int y = 0; y < 5; y ++) {
+        if (memcmp(padded_buf + y * 8, twenty_five + y * 5, 5)) {
+            printf("failure, padded row %d\n", y);
+            return 3;
+        }
+    }
+
+    // rarely accessed bitmap surface
+    VdpBitmapSurface bmp_surface_2;
+    uint8_t zeros[25];
+    const void * const zero_data[] = { zeros };
+    memset(zeros, 0, sizeof(zeros));
+    ASSERT_OK(vdp_output_surface_put_bits_native(out_surface, zero_data, source_pitches, NULL));
+    ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_A8, 5, 5, 0, &bmp_surface_2));
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface_2, source_data, source_pitches,
+                                                 NULL));
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, NULL, bmp_surface_2, NULL,
+                NULL, &blend_state, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, destination_data, destination_pitches));
+
+    if (memcmp(out_buf, twenty_five, 25)) {
+        printf("failure, rarely accessed bitmap\n");
+        return 4;
+    }
+
     printf("pass\n");
     return 0;
 }
@@ -8,6 +8,8 @@
 // target surface filled with {0, 0, 0, 1}
 //
 // coloring with color {0, 1, 0, 1}. This should be green with alpha == 1.
+//
+// Done for both frequently and rarely accessed bitmap surfaces.
 
 #include <stdio.h>
 #include <string.h>
@@ -89,6 +91,27 @@ int main(void)
         return 1;
     }
 
+    // the same with rarely accessed bitmap surface
+    VdpBitmapSurface bmp_surface_2;
+    ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_A8, 4, 4, 0, &bmp_surface_2));
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface_2, source_data_bmp, source_pitches_bmp, NULL));
+    ASSERT_OK(vdp_output_surface_put_bits_native(out_surface, source_data_black, source_pitches_black, NULL));
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, NULL, bmp_surface_2, NULL,
+                color, &blend_state, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, source_pitches_black));
+
+    printf("--- actual, rarely accessed ---\n");
+    for (int k = 0; k < 16; k ++) {
+        printf(" %08x", result[k]);
+        if (k % 4 == 3) printf("\n");
+    }
+    printf("==========\n");
+
+    if (memcmp(expected_result, result, sizeof(expected_result))) {
+        printf("fail\n");
+        return 2;
+    }
+
     printf("pass\n");
     return 0;
 }
@@ -8,12 +8,37 @@
 // target surface filled with {1, 0, 0, 1}
 //
 // coloring with color {0, 1, 0, 1}. This should be green with alpha == 1.
+//
+// Done for both frequently and rarely accessed bitmap surfaces.
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "vdpau-init.h"
 
+static
+uint32_t
+max_difference(const uint32_t *expected, const uint32_t *result_buf)
+{
+    printf("--- difference --- \n");
+    uint32_t max_diff = 0;
+    for (int k = 0; k < 7 * 7; k ++) {
+        uint32_t diff_a = abs(((expected[k] >> 24) & 0xff) - ((result_buf[k] >> 24) & 0xff));
+        uint32_t diff_r = abs(((expected[k] >> 16) & 0xff) - ((result_buf[k] >> 16) & 0xff));
+        uint32_t diff_g = abs(((expected[k] >>  8) & 0xff) - ((result_buf[k] >>  8) & 0xff));
+        uint32_t diff_b = abs(((expected[k] >>  0) & 0xff) - ((result_buf[k] >>  0) & 0xff));
+
+        printf(" %08x", (diff_a << 24) + (diff_r << 16) + (diff_g << 8) + (diff_b));
+        if (k % 7 == 7 - 1) printf("\n");
+
+        if (diff_a > max_diff) max_diff = diff_a;
+        if (diff_r > max_diff) max_diff = diff_r;
+        if (diff_g > max_diff) max_diff = diff_g;
+        if (diff_b > max_diff) max_diff = diff_b;
+    }
+    printf("=================\n");
+    return max_diff;
+}
 
 int main(void)
 {
@@ -112,27 +137,24 @@ int main(void)
         if (k % 7 == 7 - 1) printf("\n");
     }
     printf("=================\n");
-    printf("--- difference --- \n");
-    uint32_t max_diff = 0;
-    for (int k = 0; k < 7 * 7; k ++) {
-        uint32_t diff_a = abs(((expected[k] >> 24) & 0xff) - ((result_buf[k] >> 24) & 0xff));
-        uint32_t diff_r = abs(((expected[k] >> 16) & 0xff) - ((result_buf[k] >> 16) & 0xff));
-        uint32_t diff_g = abs(((expected[k] >>  8) & 0xff) - ((result_buf[k] >>  8) & 0xff));
-        uint32_t diff_b = abs(((expected[k] >>  0) & 0xff) - ((result_buf[k] >>  0) & 0xff));
 
-        printf(" %08x", (diff_a << 24) + (diff_r << 16) + (diff_g << 8) + (diff_b));
-        if (k % 7 == 7 - 1) printf("\n");
-
-        if (diff_a > max_diff) max_diff = diff_a;
-        if (diff_r > max_diff) max_diff = diff_r;
-        if (diff_g > max_diff) max_diff = diff_g;
-        if (diff_b > max_diff) max_diff = diff_b;
+    if (max_difference(expected, result_buf) > 1) {
+        printf("fail\n");
+        return 1;
     }
-    printf("=================\n");
 
-    if (max_diff > 1) {
+    // the same with rarely accessed bitmap surface
+    VdpBitmapSurface bmp_surface_2;
+    ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_A8, 5, 5, 0, &bmp_surface_2));
+    ASSERT_OK(vdp_output_surface_put_bits_native(out_surface, source_data, source_pitches, NULL));
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface_2, source_data_bmp, source_pitches_bmp, NULL));
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, &dest_rect, bmp_surface_2, NULL,
+                color, &blend_state, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, source_pitches));
+
+    if (max_difference(expected, result_buf) > 1) {
         printf("fail\n");
-        return 1;
+        return 2;
     }
 
     printf("pass\n");
@@ -0,0 +1,71 @@
+// test-011
+
+// Reference picture list initialization for P field slice. Second field of a frame
+// should refer to the first one, and fields should alternate in parity.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "h264-parse.h"
+#include <assert.h>
+#include <string.h>
+
+static
+void
+set_ref(VAPictureH264 *ref, VASurfaceID surface, unsigned int frame_idx, unsigned int field_flags)
+{
+    ref->picture_id = surface;
+    ref->frame_idx = frame_idx;
+    ref->flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE | field_flags;
+    ref->TopFieldOrderCnt = 2 * frame_idx;
+    ref->BottomFieldOrderCnt = 2 * frame_idx + 1;
+}
+
+int main(void)
+{
+    // non-reference P slice of bottom field, frame_num = 2
+    unsigned char buf[] = {0x01, 0xe5, 0xa9, 0x80, 0x00, 0x00};
+    VAPictureParameterBufferH264 vapp;
+    VASliceParameterBufferH264 vasp;
+    rbsp_state_t st;
+
+    memset(&vapp, 0, sizeof(vapp));
+    memset(&vasp, 0, sizeof(vasp));
+    vapp.seq_fields.bits.chroma_format_idc = 1;
+    vapp.seq_fields.bits.frame_mbs_only_flag = 0;
+    vapp.seq_fields.bits.log2_max_frame_num_minus4 = 0;
+    vapp.seq_fields.bits.pic_order_cnt_type = 0;
+    vapp.seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 = 0;
+    vapp.pic_fields.bits.field_pic_flag = 1;
+    vapp.frame_num = 2;
+    vapp.num_ref_frames = 3;
+    vapp.CurrPic.picture_id = 12;
+    vapp.CurrPic.flags = VA_PICTURE_H264_BOTTOM_FIELD;
+    for (int k = 0; k < 16; k ++)
+        reset_va_picture_h264(&vapp.ReferenceFrames[k]);
+    set_ref(&vapp.ReferenceFrames[0], 10, 0, 0);
+    set_ref(&vapp.ReferenceFrames[1], 11, 1, 0);
+    // top field of current frame, decoded just before
+    set_ref(&vapp.ReferenceFrames[2], 12, 2, VA_PICTURE_H264_TOP_FIELD);
+
+    rbsp_attach_buffer(&st, buf, sizeof(buf));
+    parse_slice_header(&st, &vapp, 1, 1, 0, &vasp);
+
+    // default list size is doubled for fields
+    assert (3 == vasp.num_ref_idx_l0_active_minus1);
+
+    const VASurfaceID expected_surfaces[] = {11, 12, 10, 11, 10};
+    const unsigned int expected_parity[] = {
+        VA_PICTURE_H264_BOTTOM_FIELD, VA_PICTURE_H264_TOP_FIELD, VA_PICTURE_H264_BOTTOM_FIELD,
+        VA_PICTURE_H264_TOP_FIELD, VA_PICTURE_H264_TOP_FIELD
+    };
+    const unsigned int field_flags = VA_PICTURE_H264_TOP_FIELD | VA_PICTURE_H264_BOTTOM_FIELD;
+    for (int k = 0; k < 5; k ++) {
+        assert (expected_surfaces[k] == vasp.RefPicList0[k].picture_id);
+        assert (expected_parity[k] == (vasp.RefPicList0[k].flags & field_flags));
+    }
+    assert (vasp.RefPicList0[5].flags & VA_PICTURE_H264_INVALID);
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+// test-012
+//
+// Small bitmap surfaces share atlas textures. Rendering several of them side by side should
+// give exactly their contents, without picking up neighbours. Rightmost surface of a shelf
+// gives its space back, so its replacement takes the same place. Replacement should start
+// transparent, not with leftovers of destroyed surface, and should not disturb surfaces left
+// in atlas. Scaled surface should have its edges clamped, as if it had its own texture.
+
+#include <stdio.h>
+#include <string.h>
+#include "vdpau-init.h"
+
+
+static
+int
+check(const uint32_t *expected, const uint32_t *result, int count)
+{
+    printf("=== expected ===\n");
+    for (int k = 0; k < count; k ++) {
+        printf(" %08x", expected[k]);
+        if (k % 6 == 5) printf("\n");
+    }
+    printf("--- actual ---\n");
+    for (int k = 0; k < count; k ++) {
+        printf(" %08x", result[k]);
+        if (k % 6 == 5) printf("\n");
+    }
+    printf("==========\n");
+
+    return memcmp(expected, result, count * sizeof(uint32_t));
+}
+
+int main(void)
+{
+    VdpDevice device;
+    VdpBitmapSurface bmp[3];
+    VdpOutputSurface out_surface;
+    const uint32_t colors[4] = { 0xff0000ff, 0xff00ff00, 0xffff0000, 0x80808080 };
+
+    ASSERT_OK(vdpau_init_functions(&device, NULL, 0));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 6, 2, &out_surface));
+
+    // both frequently and rarely accessed surfaces, as they are uploaded differently
+    for (int k = 0; k < 3; k ++) {
+        const uint32_t src[4] = { colors[k], colors[k], colors[k], colors[k] };
+        const void * const source_data[] = { src };
+        uint32_t source_pitches[] = { 2 * 4 };
+        ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 2, 2, k & 1,
+                                            &bmp[k]));
+        ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp[k], source_data, source_pitches, NULL));
+    }
+
+    uint32_t result[12];
+    void * const dest_data[] = { result };
+    uint32_t dest_pitches[] = { 6 * 4 };
+
+    for (int k = 0; k < 3; k ++) {
+        VdpRect dst_rect = { 2 * k, 0, 2 * k + 2, 2 };
+        ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, &dst_rect, bmp[k], NULL,
+                  NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+    }
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+
+    const uint32_t expected_1[] = {
+        0xff0000ff, 0xff0000ff, 0xff00ff00, 0xff00ff00, 0xffff0000, 0xffff0000,
+        0xff0000ff, 0xff0000ff, 0xff00ff00, 0xff00ff00, 0xffff0000, 0xffff0000
+    };
+    if (check(expected_1, result, 12)) {
+        printf("fail\n");
+        return 1;
+    }
+
+    // replace rightmost surface, only left column of replacement is filled
+    ASSERT_OK(vdp_bitmap_surface_destroy(bmp[2]));
+    ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 2, 2, 0, &bmp[2]));
+    {
+        const uint32_t src[4] = { colors[3], 0, colors[3], 0 };
+        const void * const source_data[] = { src };
+        uint32_t source_pitches[] = { 2 * 4 };
+        VdpRect left_column = { 0, 0, 1, 2 };
+        VdpRect too_wide = { 0, 0, 3, 2 };
+        ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp[2], source_data, source_pitches,
+                                                     &left_column));
+        // rect outside of surface would overwrite neighbours in atlas
+        if (VDP_STATUS_INVALID_VALUE != vdp_bitmap_surface_put_bits_native(bmp[2], source_data,
+                                                                           source_pitches,
+                                                                           &too_wide))
+        {
+            printf("fail\n");
+            return 2;
+        }
+    }
+
+    for (int k = 0; k < 3; k ++) {
+        VdpRect dst_rect = { 2 * k, 0, 2 * k + 2, 2 };
+        ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, &dst_rect, bmp[k], NULL,
+                  NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+    }
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+
+    // right column of replacement is where red pixels of destroyed surface were
+    const uint32_t expected_2[] = {
+        0xff0000ff, 0xff0000ff, 0xff00ff00, 0xff00ff00, 0x80808080, 0x00000000,
+        0xff0000ff, 0xff0000ff, 0xff00ff00, 0xff00ff00, 0x80808080, 0x00000000
+    };
+    if (check(expected_2, result, 12)) {
+        printf("fail\n");
+        return 3;
+    }
+
+    // stretch reused slot over whole output, filter shouldn't reach gaps or neighbours
+    {
+        const uint32_t src[4] = { colors[3], colors[3], colors[3], colors[3] };
+        const void * const source_data[] = { src };
+        uint32_t source_pitches[] = { 2 * 4 };
+        ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp[2], source_data, source_pitches, NULL));
+    }
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, NULL, bmp[2], NULL,
+              NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+
+    uint32_t expected_3[12];
+    for (int k = 0; k < 12; k ++)
+        expected_3[k] = colors[3];
+    if (check(expected_3, result, 12)) {
+        printf("fail\n");
+        return 4;
+    }
+
+    printf("pass\n");
+    return 0;
+}
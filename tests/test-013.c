@@ -0,0 +1,133 @@
+// test-013
+//
+// Frequently accessed bitmap surfaces upload only changed areas. Several separate partial
+// updates between renders should all reach the output, and untouched pixels should keep
+// previous contents. Second part makes more separated updates than dirty rectangle list
+// holds, so some of them get merged with others.
+
+#include <stdio.h>
+#include <string.h>
+#include "vdpau-init.h"
+
+
+int main(void)
+{
+    VdpDevice device;
+    VdpBitmapSurface bmp_surface;
+    VdpOutputSurface out_surface;
+
+    uint32_t black_4x4[16];
+    for (int k = 0; k < 16; k ++)
+        black_4x4[k] = 0xff000000;
+    const void * const source_data_black[] = { black_4x4 };
+    uint32_t source_pitches[] = { 4 * 4 };
+
+    ASSERT_OK(vdpau_init_functions(&device, NULL, 0));
+    ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 4, 4, 1, &bmp_surface));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 4, 4, &out_surface));
+
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface, source_data_black, source_pitches,
+                                                 NULL));
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, NULL, bmp_surface, NULL,
+              NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+
+    // three separate changes: single pixel, part of row, and column
+    const uint32_t red[] = { 0xffff0000, 0xffff0000, 0xffff0000, 0xffff0000 };
+    const void * const source_data_red[] = { red };
+    uint32_t pitch_row[] = { 4 * 4 };
+    uint32_t pitch_column[] = { 4 };
+    VdpRect pixel = { 0, 0, 1, 1 };
+    VdpRect row_part = { 1, 3, 3, 4 };
+    VdpRect column = { 3, 0, 4, 3 };
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface, source_data_red, pitch_row, &pixel));
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface, source_data_red, pitch_row,
+                                                 &row_part));
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface, source_data_red, pitch_column,
+                                                 &column));
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface, NULL, bmp_surface, NULL,
+              NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+
+    const uint32_t expected_result[] = {
+        0xffff0000, 0xff000000, 0xff000000, 0xffff0000,
+        0xff000000, 0xff000000, 0xff000000, 0xffff0000,
+        0xff000000, 0xff000000, 0xff000000, 0xffff0000,
+        0xff000000, 0xffff0000, 0xffff0000, 0xff000000
+    };
+
+    uint32_t result[16];
+    void * const dest_data[] = { result };
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, source_pitches));
+
+    printf("=== expected ===\n");
+    for (int k = 0; k < 16; k ++) {
+        printf(" %08x", expected_result[k]);
+        if (k % 4 == 3) printf("\n");
+    }
+    printf("--- actual ---\n");
+    for (int k = 0; k < 16; k ++) {
+        printf(" %08x", result[k]);
+        if (k % 4 == 3) printf("\n");
+    }
+    printf("==========\n");
+
+    if (memcmp(expected_result, result, sizeof(expected_result))) {
+        printf("fail\n");
+        return 1;
+    }
+
+    // six separated pixels on 8x8 surface, none of them touch each other
+    VdpBitmapSurface bmp_surface_8x8;
+    VdpOutputSurface out_surface_8x8;
+    uint32_t black_8x8[64];
+    for (int k = 0; k < 64; k ++)
+        black_8x8[k] = 0xff000000;
+    const void * const source_data_black_8x8[] = { black_8x8 };
+    uint32_t pitches_8x8[] = { 8 * 4 };
+
+    ASSERT_OK(vdp_bitmap_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 8, 8, 1,
+                                        &bmp_surface_8x8));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 8, 8, &out_surface_8x8));
+    ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface_8x8, source_data_black_8x8,
+                                                 pitches_8x8, NULL));
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface_8x8, NULL, bmp_surface_8x8,
+              NULL, NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+
+    const VdpRect pixels[] = {
+        { 0, 0, 1, 1 }, { 7, 0, 8, 1 }, { 0, 7, 1, 8 },
+        { 7, 7, 8, 8 }, { 3, 3, 4, 4 }, { 5, 1, 6, 2 },
+    };
+    uint32_t expected_8x8[64];
+    memcpy(expected_8x8, black_8x8, sizeof(expected_8x8));
+    for (uint32_t k = 0; k < sizeof(pixels) / sizeof(pixels[0]); k ++) {
+        ASSERT_OK(vdp_bitmap_surface_put_bits_native(bmp_surface_8x8, source_data_red, pitch_row,
+                                                     &pixels[k]));
+        expected_8x8[pixels[k].y0 * 8 + pixels[k].x0] = 0xffff0000;
+    }
+    ASSERT_OK(vdp_output_surface_render_bitmap_surface(out_surface_8x8, NULL, bmp_surface_8x8,
+              NULL, NULL, NULL, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+
+    uint32_t result_8x8[64];
+    void * const dest_data_8x8[] = { result_8x8 };
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface_8x8, NULL, dest_data_8x8,
+                                                 pitches_8x8));
+
+    printf("=== expected ===\n");
+    for (int k = 0; k < 64; k ++) {
+        printf(" %08x", expected_8x8[k]);
+        if (k % 8 == 7) printf("\n");
+    }
+    printf("--- actual ---\n");
+    for (int k = 0; k < 64; k ++) {
+        printf(" %08x", result_8x8[k]);
+        if (k % 8 == 7) printf("\n");
+    }
+    printf("==========\n");
+
+    if (memcmp(expected_8x8, result_8x8, sizeof(expected_8x8))) {
+        printf("fail\n");
+        return 2;
+    }
+
+    printf("pass\n");
+    return 0;
+}
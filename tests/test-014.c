@@ -0,0 +1,59 @@
+// test-014
+
+// VOP header parsing. Header fields VDPAU doesn't provide should be taken from bitstream,
+// and parsing should stop at first bit of macroblock data. Not coded VOP should be reported
+// as such.
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "mpeg4-parse.h"
+#include <assert.h>
+#include <string.h>
+
+int main(void)
+{
+    // interlaced P-VOP: modulo_time_base = 2, vop_time_increment = 21, vop_rounding_type = 1,
+    // intra_dc_vlc_thr = 2, top_field_first = 1, alternate_vertical_scan_flag = 0,
+    // vop_quant = 12, vop_fcode_forward = 3
+    unsigned char buf_p[] = {0x76, 0xbd, 0x4c, 0x60, 0x00, 0x00};
+    VAPictureParameterBufferMPEG4 vapp;
+    VASliceParameterBufferMPEG4 vasp;
+    rbsp_state_t st;
+
+    memset(&vapp, 0, sizeof(vapp));
+    memset(&vasp, 0, sizeof(vasp));
+    vapp.vop_time_increment_resolution = 30;    // 5 bits for vop_time_increment
+    vapp.quant_precision = 5;
+    vapp.vol_fields.bits.interlaced = 1;
+
+    rbsp_attach_buffer(&st, buf_p, sizeof(buf_p));
+    rbsp_set_emulation_prevention(&st, 0);
+    assert (1 == parse_vop_header(&st, &vapp, &vasp));
+
+    assert (VOP_TYPE_P == vapp.vop_fields.bits.vop_coding_type);
+    assert (1 == vapp.vop_fields.bits.vop_rounding_type);
+    assert (2 == vapp.vop_fields.bits.intra_dc_vlc_thr);
+    assert (1 == vapp.vop_fields.bits.top_field_first);
+    assert (0 == vapp.vop_fields.bits.alternate_vertical_scan_flag);
+    assert (12 == vasp.quant_scale);
+    assert (3 == vapp.vop_fcode_forward);
+    assert (27 == st.bits_eaten);
+
+    // not coded progressive B-VOP, vop_time_increment = 0
+    unsigned char buf_b[] = {0x90, 0x40, 0x00, 0x00};
+
+    memset(&vapp, 0, sizeof(vapp));
+    memset(&vasp, 0, sizeof(vasp));
+    vapp.vop_time_increment_resolution = 30;
+    vapp.quant_precision = 5;
+
+    rbsp_attach_buffer(&st, buf_b, sizeof(buf_b));
+    rbsp_set_emulation_prevention(&st, 0);
+    assert (0 == parse_vop_header(&st, &vapp, &vasp));
+    assert (VOP_TYPE_B == vapp.vop_fields.bits.vop_coding_type);
+    assert (11 == st.bits_eaten);
+
+    return 0;
+}
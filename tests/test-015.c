@@ -0,0 +1,80 @@
+// test-015
+//
+// Decode smoke test, run against stub VA driver (see tools/stub-va-driver.c). Stub decodes
+// nothing, but records every submitted picture, so single H.264 IDR slice should reach the
+// driver as exactly one picture.
+
+// TOUCHES: VdpDecoderCreate
+// TOUCHES: VdpDecoderDestroy
+// TOUCHES: VdpDecoderRender
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vdpau-init.h"
+
+
+int main(void)
+{
+    VdpDevice device;
+    VdpDecoder decoder;
+    VdpVideoSurface surface;
+    VdpBool is_supported;
+    uint32_t max_level, max_macroblocks, max_width, max_height;
+
+    ASSERT_OK(vdpau_init_functions(&device, NULL, 0));
+    ASSERT_OK(vdp_decoder_query_capabilities(device, VDP_DECODER_PROFILE_H264_MAIN, &is_supported,
+              &max_level, &max_macroblocks, &max_width, &max_height));
+    assert (is_supported);
+
+    ASSERT_OK(vdp_decoder_create(device, VDP_DECODER_PROFILE_H264_MAIN, 64, 64, 1, &decoder));
+    ASSERT_OK(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, 64, 64, &surface));
+
+    VdpPictureInfoH264 pi;
+    memset(&pi, 0, sizeof(pi));
+    pi.slice_count = 1;
+    pi.is_reference = 1;
+    pi.frame_mbs_only_flag = 1;
+    pi.num_ref_frames = 1;
+    pi.direct_8x8_inference_flag = 1;
+    for (int k = 0; k < 16; k ++)
+        pi.referenceFrames[k].surface = VDP_INVALID_HANDLE;
+    memset(pi.scaling_lists_4x4, 16, sizeof(pi.scaling_lists_4x4));     // flat
+    memset(pi.scaling_lists_8x8, 16, sizeof(pi.scaling_lists_8x8));
+
+    // IDR I slice: first_mb_in_slice = 0, pic_parameter_set_id = 0, frame_num = 0,
+    // idr_pic_id = 0, pic_order_cnt_lsb = 0, slice_qp_delta = 0, followed by arbitrary
+    // macroblock data
+    static const uint8_t slice[] = {
+        0x00, 0x00, 0x01, 0x65, 0x88, 0x84, 0x04, 0x5a, 0xa5, 0x80
+    };
+    VdpBitstreamBuffer bitstream = {
+        .struct_version = VDP_BITSTREAM_BUFFER_VERSION,
+        .bitstream = slice,
+        .bitstream_bytes = sizeof(slice),
+    };
+    ASSERT_OK(vdp_decoder_render(decoder, surface, (void *)&pi, 1, &bitstream));
+
+    ASSERT_OK(vdp_video_surface_destroy(surface));
+    ASSERT_OK(vdp_decoder_destroy(decoder));
+    ASSERT_OK(vdp_device_destroy(device));
+
+    // stub driver closes its log on vaTerminate, which happens on device destruction
+    const char *log_name = getenv("STUB_VA_LOG");
+    if (log_name) {
+        FILE *fp = fopen(log_name, "r");
+        assert (fp);
+        char line[1024];
+        int pictures = 0;
+        while (fgets(line, sizeof(line), fp)) {
+            if (0 == strncmp(line, "picture ", 8))
+                pictures ++;
+        }
+        fclose(fp);
+        printf("%d pictures submitted\n", pictures);
+        assert (1 == pictures);
+    }
+
+    printf("pass\n");
+    return 0;
+}
@@ -0,0 +1,48 @@
+// test-016
+//
+// Output surface download honours destination pitch. Rows are written destination_pitches[0]
+// bytes apart, and bytes between them are left intact. Checked for four-byte format, as
+// one-byte one is covered by test-002.
+
+#include <stdio.h>
+#include <string.h>
+#include "vdpau-init.h"
+
+
+int main(void)
+{
+    VdpDevice device;
+    VdpOutputSurface out_surface;
+    const uint32_t src[] = {
+        0xff000001, 0xff000002, 0xff000003,
+        0xff000004, 0xff000005, 0xff000006
+    };
+    const void * const source_data[] = { src };
+    uint32_t source_pitches[] = { 3 * 4 };
+
+    ASSERT_OK(vdpau_init_functions(&device, NULL, 0));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 3, 2, &out_surface));
+    ASSERT_OK(vdp_output_surface_put_bits_native(out_surface, source_data, source_pitches, NULL));
+
+    // whole surface, two pixels of padding after each row
+    uint32_t result[2 * 5];
+    void * const dest_data[] = { result };
+    uint32_t dest_pitches[] = { 5 * 4 };
+    for (int k = 0; k < 10; k ++)
+        result[k] = 0xeeeeeeee;
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+
+    const uint32_t expected[] = {
+        0xff000001, 0xff000002, 0xff000003, 0xeeeeeeee, 0xeeeeeeee,
+        0xff000004, 0xff000005, 0xff000006, 0xeeeeeeee, 0xeeeeeeee
+    };
+    for (int k = 0; k < 10; k ++)
+        printf(" %08x/%08x%s", expected[k], result[k], (k % 5 == 4) ? "\n" : "");
+    if (memcmp(expected, result, sizeof(expected))) {
+        printf("fail\n");
+        return 1;
+    }
+
+    printf("pass\n");
+    return 0;
+}
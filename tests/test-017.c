@@ -0,0 +1,61 @@
+// test-017
+//
+// Destination alpha of A8 output surface is its value. A8 surfaces have no other channels,
+// so blend factors using destination alpha should see what was stored, not one.
+//
+// White opaque surface is rendered over A8 one with source factor being destination alpha
+// and destination factor being zero, which should leave A8 surface intact.
+
+#include <stdio.h>
+#include <string.h>
+#include "vdpau-init.h"
+
+
+int main(void)
+{
+    VdpDevice device;
+    VdpOutputSurface a8_surface;
+    VdpOutputSurface white_surface;
+
+    const uint8_t values[] = { 0x00, 0x40, 0x80, 0xff };
+    const void * const a8_data[] = { values };
+    uint32_t a8_pitches[] = { 4 };
+
+    const uint32_t white[] = { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff };
+    const void * const white_data[] = { white };
+    uint32_t white_pitches[] = { 4 * 4 };
+
+    ASSERT_OK(vdpau_init_functions(&device, NULL, 0));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_A8, 4, 1, &a8_surface));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 4, 1, &white_surface));
+    ASSERT_OK(vdp_output_surface_put_bits_native(a8_surface, a8_data, a8_pitches, NULL));
+    ASSERT_OK(vdp_output_surface_put_bits_native(white_surface, white_data, white_pitches, NULL));
+
+    VdpOutputSurfaceRenderBlendState blend_state = {
+        .struct_version = VDP_OUTPUT_SURFACE_RENDER_BLEND_STATE_VERSION,
+        .blend_factor_source_color = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_DST_ALPHA,
+        .blend_factor_source_alpha = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_DST_ALPHA,
+        .blend_factor_destination_color = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO,
+        .blend_factor_destination_alpha = VDP_OUTPUT_SURFACE_RENDER_BLEND_FACTOR_ZERO,
+        .blend_equation_color = VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD,
+        .blend_equation_alpha = VDP_OUTPUT_SURFACE_RENDER_BLEND_EQUATION_ADD,
+        .blend_constant = {0, 0, 0, 0}
+    };
+    ASSERT_OK(vdp_output_surface_render_output_surface(a8_surface, NULL, white_surface, NULL,
+              NULL, &blend_state, VDP_OUTPUT_SURFACE_RENDER_ROTATE_0));
+
+    uint8_t result[4];
+    void * const dest_data[] = { result };
+    ASSERT_OK(vdp_output_surface_get_bits_native(a8_surface, NULL, dest_data, a8_pitches));
+
+    for (int k = 0; k < 4; k ++)
+        printf(" %02x/%02x", values[k], result[k]);
+    printf("\n");
+    if (memcmp(values, result, sizeof(values))) {
+        printf("fail\n");
+        return 1;
+    }
+
+    printf("pass\n");
+    return 0;
+}
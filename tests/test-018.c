@@ -0,0 +1,74 @@
+// test-018
+
+// sws_cache_get should reuse context with matching parameters, including flags, and evict
+// least recently used one when all SWS_CACHE_SIZE entries are taken
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include "sws-cache.h"
+#include <assert.h>
+#include <string.h>
+
+static
+struct SwsContext *
+get(sws_cache_t *cache, int width, int flags)
+{
+    struct SwsContext *ctx = sws_cache_get(cache, width, 16, PIX_FMT_YUV420P, 32, 32,
+                                           PIX_FMT_BGRA, flags);
+    assert (NULL != ctx);
+    return ctx;
+}
+
+static
+int
+cached(sws_cache_t *cache, int width, int flags)
+{
+    for (int k = 0; k < SWS_CACHE_SIZE; k ++) {
+        sws_cache_entry_t *entry = &cache->entries[k];
+        if (entry->ctx && entry->src_width == width && entry->flags == flags)
+            return 1;
+    }
+    return 0;
+}
+
+int main(void)
+{
+    sws_cache_t cache;
+    memset(&cache, 0, sizeof(cache));
+
+    // hit returns the same context
+    struct SwsContext *ctx16 = get(&cache, 16, SWS_BILINEAR);
+    assert (get(&cache, 16, SWS_BILINEAR) == ctx16);
+
+    // flags are part of the key
+    struct SwsContext *ctx16_point = get(&cache, 16, SWS_POINT);
+    assert (ctx16_point != ctx16);
+    assert (cached(&cache, 16, SWS_BILINEAR));
+    assert (cached(&cache, 16, SWS_POINT));
+
+    // fill the cache, then touch the oldest entry, so the second oldest becomes LRU
+    get(&cache, 24, SWS_BILINEAR);
+    get(&cache, 32, SWS_BILINEAR);
+    assert (get(&cache, 16, SWS_BILINEAR) == ctx16);
+
+    get(&cache, 48, SWS_BILINEAR);
+    assert (!cached(&cache, 16, SWS_POINT));
+    assert (cached(&cache, 16, SWS_BILINEAR));
+    assert (cached(&cache, 24, SWS_BILINEAR));
+    assert (cached(&cache, 32, SWS_BILINEAR));
+    assert (cached(&cache, 48, SWS_BILINEAR));
+    assert (get(&cache, 16, SWS_BILINEAR) == ctx16);
+
+    // next eviction takes the entry created first among remaining ones
+    get(&cache, 64, SWS_BILINEAR);
+    assert (!cached(&cache, 24, SWS_BILINEAR));
+    assert (cached(&cache, 16, SWS_BILINEAR));
+
+    sws_cache_clear(&cache);
+    for (int k = 0; k < SWS_CACHE_SIZE; k ++)
+        assert (NULL == cache.entries[k].ctx);
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+// test-019
+
+// Render uniformly colored 8x8 video surface with video mixer into top half of 8x8 output
+// surface, using CSC matrix that maps (Y, Cb, Cr) directly to (G, B, R). Bottom half
+// should be filled with background color, and its right part covered by opaque layer.
+// Then check that brightness set through VdpGenerateCSCMatrix shifts all channels.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vdpau/vdpau.h>
+#include "vdpau-init.h"
+
+#define Y_VALUE     128
+#define CB_VALUE    100
+#define CR_VALUE    150
+
+// tolerance for values passed through color conversion
+#define TOLERANCE   3
+
+static
+int
+channel(uint32_t pixel, int shift)
+{
+    return (pixel >> shift) & 0xff;
+}
+
+static
+int
+pixel_matches(uint32_t actual, uint32_t expected)
+{
+    for (int shift = 0; shift < 32; shift += 8)
+        if (abs(channel(actual, shift) - channel(expected, shift)) > TOLERANCE)
+            return 0;
+    return 1;
+}
+
+int main(void)
+{
+    VdpDevice device;
+    VdpStatus st = vdpau_init_functions(&device, NULL, 0);
+    assert (VDP_STATUS_OK == st);
+
+    VdpVideoSurface video_surface;
+    VdpOutputSurface out_surface;
+    VdpOutputSurface layer_surface;
+    VdpVideoMixer mixer;
+
+    ASSERT_OK(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, 8, 8, &video_surface));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 8, 8, &out_surface));
+    ASSERT_OK(vdp_output_surface_create(device, VDP_RGBA_FORMAT_B8G8R8A8, 4, 4, &layer_surface));
+    ASSERT_OK(vdp_video_mixer_create(device, 0, NULL, 0, NULL, NULL, &mixer));
+
+    uint8_t y_plane[8 * 8];
+    uint8_t cb_plane[4 * 4];
+    uint8_t cr_plane[4 * 4];
+    memset(y_plane, Y_VALUE, sizeof(y_plane));
+    memset(cb_plane, CB_VALUE, sizeof(cb_plane));
+    memset(cr_plane, CR_VALUE, sizeof(cr_plane));
+    const void * const video_data[] = {y_plane, cr_plane, cb_plane};
+    uint32_t video_pitches[] = {8, 4, 4};
+    ASSERT_OK(vdp_video_surface_put_bits_y_cb_cr(video_surface, VDP_YCBCR_FORMAT_YV12, video_data,
+                                                 video_pitches));
+
+    uint32_t green_box[4 * 4];
+    for (int k = 0; k < 4 * 4; k ++)
+        green_box[k] = 0xff00ff00;
+    const void * const layer_data[] = {green_box};
+    uint32_t layer_pitches[] = {4 * 4};
+    ASSERT_OK(vdp_output_surface_put_bits_native(layer_surface, layer_data, layer_pitches, NULL));
+
+    VdpCSCMatrix direct_matrix = {
+        {0.0f, 0.0f, 1.0f, 0.0f},
+        {1.0f, 0.0f, 0.0f, 0.0f},
+        {0.0f, 1.0f, 0.0f, 0.0f},
+    };
+    VdpColor blue = {0.0f, 0.0f, 1.0f, 1.0f};
+    VdpVideoMixerAttribute attributes[] = {VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX,
+                                           VDP_VIDEO_MIXER_ATTRIBUTE_BACKGROUND_COLOR};
+    const void * attribute_values[] = {&direct_matrix, &blue};
+    ASSERT_OK(vdp_video_mixer_set_attribute_values(mixer, 2, attributes, attribute_values));
+
+    VdpRect video_rect = {0, 0, 8, 4};
+    VdpRect layer_rect = {4, 4, 8, 8};
+    VdpLayer layer = {
+        .struct_version = VDP_LAYER_VERSION,
+        .source_surface = layer_surface,
+        .source_rect = NULL,
+        .destination_rect = &layer_rect
+    };
+    ASSERT_OK(vdp_video_mixer_render(mixer, VDP_INVALID_HANDLE, NULL,
+                                     VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME, 0, NULL,
+                                     video_surface, 0, NULL, NULL, out_surface, NULL,
+                                     &video_rect, 1, &layer));
+
+    uint32_t receive_buf[8 * 8];
+    void * const dest_data[] = {receive_buf};
+    uint32_t dest_pitches[] = {8 * 4};
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+
+    const uint32_t video_color = 0xff000000 | (CR_VALUE << 16) | (Y_VALUE << 8) | CB_VALUE;
+    uint32_t expected[8 * 8];
+    for (int y = 0; y < 8; y ++) {
+        for (int x = 0; x < 8; x ++) {
+            if (y < 4)
+                expected[y * 8 + x] = video_color;
+            else if (x < 4)
+                expected[y * 8 + x] = 0xff0000ff;
+            else
+                expected[y * 8 + x] = 0xff00ff00;
+        }
+    }
+
+    printf("output surface\n");
+    for (int k = 0; k < 8 * 8; k ++) {
+        printf("%08x ", receive_buf[k]);
+        if (7 == k % 8) printf("\n");
+    }
+    printf("----------\n");
+    for (int k = 0; k < 8 * 8; k ++) {
+        printf("%08x ", expected[k]);
+        if (7 == k % 8) printf("\n");
+    }
+
+    for (int k = 0; k < 8 * 8; k ++) {
+        if (!pixel_matches(receive_buf[k], expected[k])) {
+            printf("fail\n");
+            return 1;
+        }
+    }
+
+    // procamp reaches mixer through CSC matrix. Brightness is added to luma, so each of
+    // channels should increase by 1.16438 * brightness.
+    VdpProcamp procamp = {
+        .struct_version = VDP_PROCAMP_VERSION,
+        .brightness = 0.1f,
+        .contrast = 1.0f,
+        .saturation = 1.0f,
+        .hue = 0.0f
+    };
+    VdpCSCMatrix bright_matrix;
+    ASSERT_OK(vdp_generate_csc_matrix(&procamp, VDP_COLOR_STANDARD_ITUR_BT_601, &bright_matrix));
+
+    const void * default_value[] = {NULL};
+    ASSERT_OK(vdp_video_mixer_set_attribute_values(mixer, 1, attributes, default_value));
+    ASSERT_OK(vdp_video_mixer_render(mixer, VDP_INVALID_HANDLE, NULL,
+                                     VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME, 0, NULL,
+                                     video_surface, 0, NULL, NULL, out_surface, NULL, NULL,
+                                     0, NULL));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+    const uint32_t default_color = receive_buf[0];
+
+    const void * bright_value[] = {&bright_matrix};
+    ASSERT_OK(vdp_video_mixer_set_attribute_values(mixer, 1, attributes, bright_value));
+    ASSERT_OK(vdp_video_mixer_render(mixer, VDP_INVALID_HANDLE, NULL,
+                                     VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME, 0, NULL,
+                                     video_surface, 0, NULL, NULL, out_surface, NULL, NULL,
+                                     0, NULL));
+    ASSERT_OK(vdp_output_surface_get_bits_native(out_surface, NULL, dest_data, dest_pitches));
+    const uint32_t bright_color = receive_buf[0];
+
+    printf("default %08x, brightness 0.1 %08x\n", default_color, bright_color);
+    const int shift = (int)(1.16438f * 0.1f * 255.0f + 0.5f);
+    for (int k = 0; k < 24; k += 8) {
+        const int delta = channel(bright_color, k) - channel(default_color, k);
+        if (abs(delta - shift) > TOLERANCE) {
+            printf("fail\n");
+            return 2;
+        }
+    }
+
+    ASSERT_OK(vdp_video_mixer_destroy(mixer));
+    ASSERT_OK(vdp_output_surface_destroy(layer_surface));
+    ASSERT_OK(vdp_output_surface_destroy(out_surface));
+    ASSERT_OK(vdp_video_surface_destroy(video_surface));
+    ASSERT_OK(vdp_device_destroy(device));
+
+    printf("pass\n");
+    return 0;
+}
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+// decoder-replay
+//
+// Feeds VdpDecoderRender calls recorded with VDPAU_DECODER_CAPTURE back to decoder
+// as fast as possible, and reports decoding speed and per-stage timings.
+//
+// Usage: decoder-replay [-r] [-l loops] capture-file
+//     -r          read back every decoded picture with VdpVideoSurfaceGetBitsYCbCr
+//     -l loops    replay capture given number of times
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "decoder-capture.h"
+#include "vdpau-init.h"
+
+/** @brief accumulated timings of one stage */
+struct stage_stats {
+    const char *name;
+    uint64_t    count;
+    double      total;      ///< seconds
+    double      min;
+    double      max;
+};
+
+/** @brief mapping from handle at capture time to handle in replay */
+struct handle_map {
+    uint32_t   *from;
+    uint32_t   *to;
+    uint32_t    count;
+    uint32_t    allocated;
+};
+
+enum {
+    STAGE_DECODER_CREATE,
+    STAGE_SURFACE_CREATE,
+    STAGE_RENDER,
+    STAGE_READBACK,
+    STAGE_COUNT
+};
+
+static struct stage_stats stats[STAGE_COUNT] = {
+    { "decoder create", 0, 0, 0, 0 },
+    { "surface create", 0, 0, 0, 0 },
+    { "render",         0, 0, 0, 0 },
+    { "readback",       0, 0, 0, 0 },
+};
+
+static
+double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static
+void
+stage_account(int stage, double start)
+{
+    const double duration = get_time() - start;
+    struct stage_stats *s = &stats[stage];
+    if (0 == s->count || duration < s->min) s->min = duration;
+    if (0 == s->count || duration > s->max) s->max = duration;
+    s->total += duration;
+    s->count ++;
+}
+
+static
+int
+handle_map_find(const struct handle_map *map, uint32_t from, uint32_t *to)
+{
+    for (uint32_t k = 0; k < map->count; k ++) {
+        if (map->from[k] == from) {
+            *to = map->to[k];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static
+void
+handle_map_add(struct handle_map *map, uint32_t from, uint32_t to)
+{
+    if (map->count == map->allocated) {
+        map->allocated = map->allocated ? 2 * map->allocated : 64;
+        map->from = realloc(map->from, map->allocated * sizeof(uint32_t));
+        map->to = realloc(map->to, map->allocated * sizeof(uint32_t));
+        assert (NULL != map->from && NULL != map->to);
+    }
+    map->from[map->count] = from;
+    map->to[map->count] = to;
+    map->count ++;
+}
+
+/** @brief Collect record offsets, either from index or by scanning records one by one */
+static
+uint64_t *
+build_index(const uint8_t *data, uint64_t size, uint64_t *record_count)
+{
+    decoder_capture_trailer_t trailer;
+    if (size >= sizeof(decoder_capture_file_header_t) + sizeof(trailer)) {
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        if (0 == memcmp(trailer.magic, DECODER_CAPTURE_INDEX_MAGIC, sizeof(trailer.magic)) &&
+            trailer.index_offset + trailer.record_count * sizeof(uint64_t) <= size)
+        {
+            uint64_t *offsets = malloc((trailer.record_count + 1) * sizeof(uint64_t));
+            assert (NULL != offsets);
+            memcpy(offsets, data + trailer.index_offset, trailer.record_count * sizeof(uint64_t));
+            *record_count = trailer.record_count;
+            return offsets;
+        }
+    }
+
+    // no index, file is probably truncated
+    fprintf(stderr, "no index found, scanning records\n");
+    uint64_t allocated = 1024;
+    uint64_t count = 0;
+    uint64_t *offsets = malloc(allocated * sizeof(uint64_t));
+    uint64_t pos = sizeof(decoder_capture_file_header_t);
+    assert (NULL != offsets);
+    while (pos + sizeof(decoder_capture_record_t) <= size) {
+        const decoder_capture_record_t *record = (const void *)(data + pos);
+        if (record->record_size < sizeof(*record) || pos + record->record_size > size)
+            break;
+        if (count == allocated) {
+            allocated *= 2;
+            offsets = realloc(offsets, allocated * sizeof(uint64_t));
+            assert (NULL != offsets);
+        }
+        offsets[count ++] = pos;
+        pos += record->record_size;
+    }
+    *record_count = count;
+    return offsets;
+}
+
+static
+VdpVideoSurface
+map_surface(VdpDevice device, struct handle_map *surfaces, uint32_t captured,
+            uint32_t width, uint32_t height)
+{
+    uint32_t surface;
+    if (handle_map_find(surfaces, captured, &surface))
+        return surface;
+
+    const double t_start = get_time();
+    ASSERT_OK(vdp_video_surface_create(device, VDP_CHROMA_TYPE_420, width, height, &surface));
+    stage_account(STAGE_SURFACE_CREATE, t_start);
+    handle_map_add(surfaces, captured, surface);
+    return surface;
+}
+
+static
+void
+usage(void)
+{
+    fprintf(stderr, "Usage: decoder-replay [-r] [-l loops] capture-file\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    int readback = 0;
+    int loops = 1;
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "rl:"))) {
+        switch (opt) {
+        case 'r': readback = 1; break;
+        case 'l': loops = atoi(optarg); break;
+        default:  usage();
+        }
+    }
+    if (optind >= argc || loops < 1)
+        usage();
+
+    int fd = open(argv[optind], O_RDONLY);
+    if (fd < 0) {
+        perror("can't open capture file");
+        return 1;
+    }
+    struct stat sb;
+    fstat(fd, &sb);
+    const uint64_t file_size = sb.st_size;
+    if (file_size < sizeof(decoder_capture_file_header_t)) {
+        fprintf(stderr, "capture file is too short\n");
+        return 1;
+    }
+    const uint8_t *data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == data) {
+        perror("can't mmap capture file");
+        return 1;
+    }
+
+    const decoder_capture_file_header_t *header = (const void *)data;
+    if (0 != memcmp(header->magic, DECODER_CAPTURE_MAGIC, sizeof(header->magic)) ||
+        DECODER_CAPTURE_VERSION != header->version)
+    {
+        fprintf(stderr, "not a capture file, or unsupported version\n");
+        return 1;
+    }
+
+    uint64_t record_count;
+    uint64_t *offsets = build_index(data, file_size, &record_count);
+    printf("%llu records\n", (unsigned long long)record_count);
+
+    VdpDevice device;
+    ASSERT_OK(vdpau_init_functions(&device, NULL, 0));
+
+    uint8_t *readback_buf = NULL;
+    uint32_t readback_buf_size = 0;
+    uint64_t bitstream_bytes = 0;
+    const double t_replay_start = get_time();
+
+    for (int loop = 0; loop < loops; loop ++) {
+        // decoders and surfaces are recreated on each loop, so each pass starts afresh
+        struct handle_map decoders = { NULL, NULL, 0, 0 };
+        struct handle_map surfaces = { NULL, NULL, 0, 0 };
+
+        for (uint64_t r = 0; r < record_count; r ++) {
+            const uint8_t *ptr = data + offsets[r];
+            const decoder_capture_record_t *record = (const void *)ptr;
+            ptr += sizeof(*record);
+
+            if (sizeof(VdpPictureInfoH264) != record->picture_info_size) {
+                fprintf(stderr, "record %llu: unexpected picture info size, skipping\n",
+                        (unsigned long long)r);
+                continue;
+            }
+
+            VdpDecoder decoder;
+            if (!handle_map_find(&decoders, record->decoder, &decoder)) {
+                const double t_start = get_time();
+                ASSERT_OK(vdp_decoder_create(device, record->profile, record->width,
+                          record->height, record->max_references, &decoder));
+                stage_account(STAGE_DECODER_CREATE, t_start);
+                handle_map_add(&decoders, record->decoder, decoder);
+            }
+
+            // surface handles inside picture info belong to capturing process
+            VdpPictureInfoH264 pi;
+            memcpy(&pi, ptr, sizeof(pi));
+            ptr += DECODER_CAPTURE_ALIGN(record->picture_info_size);
+            for (int k = 0; k < 16; k ++) {
+                if (VDP_INVALID_HANDLE != pi.referenceFrames[k].surface) {
+                    pi.referenceFrames[k].surface =
+                        map_surface(device, &surfaces, pi.referenceFrames[k].surface,
+                                    record->width, record->height);
+                }
+            }
+            VdpVideoSurface target = map_surface(device, &surfaces, record->target,
+                                                 record->width, record->height);
+
+            const uint32_t *sizes = (const void *)ptr;
+            ptr += DECODER_CAPTURE_ALIGN(record->bitstream_buffer_count * sizeof(uint32_t));
+            VdpBitstreamBuffer *buffers =
+                calloc(record->bitstream_buffer_count + 1, sizeof(VdpBitstreamBuffer));
+            assert (NULL != buffers);
+            for (uint32_t k = 0; k < record->bitstream_buffer_count; k ++) {
+                buffers[k].struct_version = VDP_BITSTREAM_BUFFER_VERSION;
+                buffers[k].bitstream = ptr;
+                buffers[k].bitstream_bytes = sizes[k];
+                bitstream_bytes += sizes[k];
+                ptr += DECODER_CAPTURE_ALIGN(sizes[k]);
+            }
+
+            const double t_start = get_time();
+            VdpStatus st = vdp_decoder_render(decoder, target, (void *)&pi,
+                                              record->bitstream_buffer_count, buffers);
+            stage_account(STAGE_RENDER, t_start);
+            free(buffers);
+            if (VDP_STATUS_OK != st) {
+                fprintf(stderr, "record %llu: VdpDecoderRender failed, %s\n",
+                        (unsigned long long)r, vdp_get_error_string(st));
+            }
+
+            if (readback) {
+                const uint32_t size = record->width * record->height * 3 / 2;
+                if (size > readback_buf_size) {
+                    free(readback_buf);
+                    readback_buf = malloc(size);
+                    assert (NULL != readback_buf);
+                    readback_buf_size = size;
+                }
+                void *planes[3] = { readback_buf,
+                                    readback_buf + record->width * record->height,
+                                    readback_buf + record->width * record->height * 5 / 4 };
+                uint32_t pitches[3] = { record->width, record->width / 2, record->width / 2 };
+                const double t_rb_start = get_time();
+                ASSERT_OK(vdp_video_surface_get_bits_y_cb_cr(target, VDP_YCBCR_FORMAT_YV12,
+                                                             planes, pitches));
+                stage_account(STAGE_READBACK, t_rb_start);
+            }
+        }
+
+        for (uint32_t k = 0; k < surfaces.count; k ++)
+            ASSERT_OK(vdp_video_surface_destroy(surfaces.to[k]));
+        for (uint32_t k = 0; k < decoders.count; k ++)
+            ASSERT_OK(vdp_decoder_destroy(decoders.to[k]));
+        free(surfaces.from); free(surfaces.to);
+        free(decoders.from); free(decoders.to);
+    }
+
+    const double elapsed = get_time() - t_replay_start;
+    const uint64_t frames = stats[STAGE_RENDER].count;
+    printf("%llu pictures, %.3f s, %.1f pictures/s, %.2f Mbit/s of bitstream\n",
+           (unsigned long long)frames, elapsed, elapsed > 0 ? frames / elapsed : 0.0,
+           elapsed > 0 ? bitstream_bytes * 8 / elapsed / 1.0e6 : 0.0);
+    printf("%-16s %10s %12s %10s %10s %10s\n", "stage", "count", "total, ms", "avg, ms",
+           "min, ms", "max, ms");
+    for (int k = 0; k < STAGE_COUNT; k ++) {
+        const struct stage_stats *s = &stats[k];
+        if (0 == s->count)
+            continue;
+        printf("%-16s %10llu %12.3f %10.3f %10.3f %10.3f\n", s->name,
+               (unsigned long long)s->count, s->total * 1e3, s->total * 1e3 / s->count,
+               s->min * 1e3, s->max * 1e3);
+    }
+
+    ASSERT_OK(vdp_device_destroy(device));
+    free(readback_buf);
+    free(offsets);
+    munmap((void *)data, file_size);
+    close(fd);
+    return 0;
+}
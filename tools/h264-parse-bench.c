@@ -0,0 +1,422 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+// h264-parse-bench
+//
+// Generates synthetic H.264 stream of P and B slices and measures throughput of
+// NAL unit search, slice header parser and Exp-Golomb reader. Slice payloads are random,
+// with adjustable share of zero bytes, which controls emulation prevention byte density.
+//
+// Usage: h264-parse-bench [-n slices] [-l loops] [-m modifications] [-w] [-s payload]
+//                         [-z zero-percent]
+//     -n slices           number of slices in generated stream, default 2000
+//     -l loops            number of passes over stream, default 20
+//     -m modifications    ref_pic_list_modification entries per list, default 0
+//     -w                  enable explicit weighted prediction tables
+//     -s payload          slice payload size in bytes, default 1000
+//     -z zero-percent     share of zero bytes in payload, default 10
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "h264-parse.h"
+
+#define NUM_REFERENCES  4
+#define FRAME_NUM       NUM_REFERENCES  ///< frame_num of every generated slice
+
+/** @brief growing buffer with bit-level writer */
+struct bit_writer {
+    uint8_t    *buf;
+    size_t      size;           ///< bytes used, including partially filled one
+    size_t      allocated;
+    int         bit_ptr;        ///< bits left in last byte
+};
+
+struct bench_params {
+    int         slice_count;
+    int         loops;
+    int         modifications;
+    int         weighted;
+    int         payload_size;
+    int         zero_percent;
+};
+
+static uint32_t rng_state = 1;
+
+static
+uint32_t
+rng_next(void)
+{
+    rng_state = rng_state * 1103515245 + 12345;
+    return rng_state >> 8;
+}
+
+static
+double
+get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1.0e9;
+}
+
+static
+void
+bw_put_byte(struct bit_writer *bw, uint8_t byte)
+{
+    if (bw->size == bw->allocated) {
+        bw->allocated = bw->allocated * 2 + 4096;
+        bw->buf = realloc(bw->buf, bw->allocated);
+        if (NULL == bw->buf) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    bw->buf[bw->size ++] = byte;
+    bw->bit_ptr = 0;
+}
+
+static
+void
+bw_put_bits(struct bit_writer *bw, int bitcount, uint32_t value)
+{
+    for (int k = bitcount - 1; k >= 0; k --) {
+        if (0 == bw->bit_ptr) {
+            bw_put_byte(bw, 0);
+            bw->bit_ptr = 8;
+        }
+        bw->bit_ptr --;
+        if (value & (1u << k))
+            bw->buf[bw->size - 1] |= 1 << bw->bit_ptr;
+    }
+}
+
+static
+void
+bw_put_ue(struct bit_writer *bw, uint32_t value)
+{
+    int bitcount = 0;
+    while ((value + 1) >> (bitcount + 1))
+        bitcount ++;
+    bw_put_bits(bw, bitcount, 0);
+    bw_put_bits(bw, bitcount + 1, value + 1);
+}
+
+static
+void
+bw_put_se(struct bit_writer *bw, int32_t value)
+{
+    bw_put_ue(bw, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+/** @brief Append NAL unit payload to Annex B stream, inserting emulation prevention bytes */
+static
+void
+append_nal_unit(struct bit_writer *stream, const uint8_t *rbsp, size_t size)
+{
+    bw_put_byte(stream, 0);
+    bw_put_byte(stream, 0);
+    bw_put_byte(stream, 1);
+
+    int zeros_in_row = 0;
+    for (size_t k = 0; k < size; k ++) {
+        if (zeros_in_row >= 2 && rbsp[k] <= 3) {
+            bw_put_byte(stream, 3);
+            zeros_in_row = 0;
+        }
+        bw_put_byte(stream, rbsp[k]);
+        zeros_in_row = (0 == rbsp[k]) ? zeros_in_row + 1 : 0;
+    }
+}
+
+static
+void
+setup_pic_param(VAPictureParameterBufferH264 *vapp, const struct bench_params *params)
+{
+    memset(vapp, 0, sizeof(*vapp));
+    vapp->seq_fields.bits.chroma_format_idc = 1;
+    vapp->seq_fields.bits.frame_mbs_only_flag = 1;
+    vapp->seq_fields.bits.log2_max_frame_num_minus4 = 0;
+    vapp->seq_fields.bits.pic_order_cnt_type = 0;
+    vapp->seq_fields.bits.log2_max_pic_order_cnt_lsb_minus4 = 2;
+    vapp->pic_fields.bits.entropy_coding_mode_flag = 1;
+    vapp->pic_fields.bits.weighted_pred_flag = params->weighted;
+    vapp->pic_fields.bits.weighted_bipred_idc = params->weighted ? 1 : 0;
+    vapp->pic_fields.bits.deblocking_filter_control_present_flag = 1;
+    vapp->frame_num = FRAME_NUM;
+    vapp->num_ref_frames = NUM_REFERENCES;
+    vapp->CurrPic.picture_id = NUM_REFERENCES;
+    vapp->CurrPic.TopFieldOrderCnt = 2 * NUM_REFERENCES;
+    vapp->CurrPic.BottomFieldOrderCnt = 2 * NUM_REFERENCES;
+
+    for (int k = 0; k < 16; k ++)
+        reset_va_picture_h264(&vapp->ReferenceFrames[k]);
+    for (int k = 0; k < NUM_REFERENCES; k ++) {
+        VAPictureH264 *ref = &vapp->ReferenceFrames[k];
+        ref->picture_id = k;
+        ref->frame_idx = k;
+        ref->flags = VA_PICTURE_H264_SHORT_TERM_REFERENCE;
+        // two references are in the future, to make B slice lists non-trivial
+        const int poc = (k < NUM_REFERENCES / 2) ? 2 * k : 2 * (k + NUM_REFERENCES);
+        ref->TopFieldOrderCnt = ref->BottomFieldOrderCnt = poc;
+    }
+}
+
+static
+void
+write_ref_pic_list_modification(struct bit_writer *bw, int modifications)
+{
+    bw_put_bits(bw, 1, modifications > 0);  // ref_pic_list_modification_flag_lX
+    if (0 == modifications)
+        return;
+    // picNumPred goes FRAME_NUM-1, FRAME_NUM-2, FRAME_NUM-1, ..., staying within references
+    for (int k = 0; k < modifications; k ++) {
+        bw_put_ue(bw, (0 == k || 1 == k % 2) ? 0 : 1);  // modification_of_pic_nums_idc
+        bw_put_ue(bw, 0);                               // abs_diff_pic_num_minus1
+    }
+    bw_put_ue(bw, 3);
+}
+
+static
+void
+write_pred_weight_table(struct bit_writer *bw, int list_count)
+{
+    bw_put_ue(bw, 5);   // luma_log2_weight_denom
+    bw_put_ue(bw, 5);   // chroma_log2_weight_denom
+    for (int list = 0; list < list_count; list ++) {
+        for (int k = 0; k < NUM_REFERENCES; k ++) {
+            bw_put_bits(bw, 1, 1);                      // luma_weight_lX_flag
+            bw_put_se(bw, 30 + (int)(rng_next() % 5));  // luma_weight_lX
+            bw_put_se(bw, (int)(rng_next() % 9) - 4);   // luma_offset_lX
+            bw_put_bits(bw, 1, 1);                      // chroma_weight_lX_flag
+            for (int j = 0; j < 2; j ++) {
+                bw_put_se(bw, 31 + (int)(rng_next() % 3));
+                bw_put_se(bw, (int)(rng_next() % 5) - 2);
+            }
+        }
+    }
+}
+
+/** @brief Expected values of some slice header fields, used to verify parser output */
+#define SLICE_QP_DELTA(idx)     ((int)((idx) % 13) - 6)
+#define ALPHA_OFFSET(idx)       ((int)((idx) % 7) - 3)
+
+static
+void
+generate_stream(struct bit_writer *stream, const struct bench_params *params)
+{
+    struct bit_writer rbsp = { 0 };
+
+    for (int idx = 0; idx < params->slice_count; idx ++) {
+        const int slice_type = (idx % 3) ? SLICE_TYPE_B : SLICE_TYPE_P;
+        rbsp.size = 0;
+        rbsp.bit_ptr = 0;
+
+        bw_put_bits(&rbsp, 1, 0);                       // forbidden_zero_bit
+        bw_put_bits(&rbsp, 2, SLICE_TYPE_P == slice_type);  // nal_ref_idc
+        bw_put_bits(&rbsp, 5, NAL_SLICE);
+        bw_put_ue(&rbsp, (idx % 8) * 100);              // first_mb_in_slice
+        bw_put_ue(&rbsp, slice_type + 5);
+        bw_put_ue(&rbsp, 0);                            // pic_parameter_set_id
+        bw_put_bits(&rbsp, 4, FRAME_NUM);               // frame_num
+        bw_put_bits(&rbsp, 6, (2 * idx) & 63);          // pic_order_cnt_lsb
+        if (SLICE_TYPE_B == slice_type)
+            bw_put_bits(&rbsp, 1, 1);                   // direct_spatial_mv_pred_flag
+        bw_put_bits(&rbsp, 1, 1);                       // num_ref_idx_active_override_flag
+        bw_put_ue(&rbsp, NUM_REFERENCES - 1);           // num_ref_idx_l0_active_minus1
+        if (SLICE_TYPE_B == slice_type)
+            bw_put_ue(&rbsp, NUM_REFERENCES - 1);       // num_ref_idx_l1_active_minus1
+
+        write_ref_pic_list_modification(&rbsp, params->modifications);
+        if (SLICE_TYPE_B == slice_type)
+            write_ref_pic_list_modification(&rbsp, params->modifications);
+
+        if (params->weighted)
+            write_pred_weight_table(&rbsp, SLICE_TYPE_B == slice_type ? 2 : 1);
+
+        if (SLICE_TYPE_P == slice_type)
+            bw_put_bits(&rbsp, 1, 0);                   // adaptive_ref_pic_marking_mode_flag
+
+        bw_put_ue(&rbsp, idx % 3);                      // cabac_init_idc
+        bw_put_se(&rbsp, SLICE_QP_DELTA(idx));
+        bw_put_ue(&rbsp, 0);                            // disable_deblocking_filter_idc
+        bw_put_se(&rbsp, ALPHA_OFFSET(idx));            // slice_alpha_c0_offset_div2
+        bw_put_se(&rbsp, 0);                            // slice_beta_offset_div2
+
+        // cabac_alignment_one_bit
+        if (rbsp.bit_ptr > 0)
+            bw_put_bits(&rbsp, rbsp.bit_ptr, (1u << rbsp.bit_ptr) - 1);
+
+        for (int k = 0; k < params->payload_size; k ++) {
+            const int zero = (int)(rng_next() % 100) < params->zero_percent;
+            bw_put_byte(&rbsp, zero ? 0 : 1 + rng_next() % 255);
+        }
+        bw_put_byte(&rbsp, 0x80);                       // rbsp_trailing_bits
+
+        append_nal_unit(stream, rbsp.buf, rbsp.size);
+    }
+
+    free(rbsp.buf);
+}
+
+/** @brief Parse all slice headers of stream, same way decoder does. Returns slice count */
+static
+int
+parse_stream(const struct bit_writer *stream, const VAPictureParameterBufferH264 *vapp,
+             int verify)
+{
+    rbsp_state_t st_g;
+    rbsp_attach_buffer(&st_g, stream->buf, stream->size);
+    int nal_offset = rbsp_navigate_to_nal_unit(&st_g);
+    int idx = 0;
+
+    while (nal_offset >= 0) {
+        VASliceParameterBufferH264 vasp;
+        rbsp_state_t st = rbsp_copy_state(&st_g);
+        rbsp_reset_bit_counter(&st);
+        nal_offset = rbsp_navigate_to_nal_unit(&st_g);
+
+        parse_slice_header(&st, vapp, 1, 0, 0, &vasp);
+
+        if (verify && (SLICE_QP_DELTA(idx) != vasp.slice_qp_delta ||
+                       ALPHA_OFFSET(idx) != vasp.slice_alpha_c0_offset_div2 ||
+                       NUM_REFERENCES - 1 != vasp.num_ref_idx_l0_active_minus1))
+        {
+            fprintf(stderr, "slice %d: parsed values differ from generated ones\n", idx);
+            exit(1);
+        }
+        idx ++;
+    }
+    return idx;
+}
+
+/** @brief Only search for NAL unit start codes. Returns NAL unit count */
+static
+int
+scan_stream(const struct bit_writer *stream)
+{
+    rbsp_state_t st;
+    rbsp_attach_buffer(&st, stream->buf, stream->size);
+    int count = 0;
+    while (rbsp_navigate_to_nal_unit(&st) >= 0)
+        count ++;
+    return count;
+}
+
+/** @brief Read back sequence of ue(v) values. Returns their sum */
+static
+uint64_t
+read_exp_golomb(const struct bit_writer *bw, int value_count)
+{
+    rbsp_state_t st;
+    rbsp_attach_buffer(&st, bw->buf, bw->size);
+    rbsp_set_emulation_prevention(&st, 0);
+    uint64_t sum = 0;
+    for (int k = 0; k < value_count; k ++)
+        sum += rbsp_get_uev(&st);
+    return sum;
+}
+
+static
+void
+report(const char *name, double elapsed, uint64_t items, const char *item_name, uint64_t bytes)
+{
+    printf("%-16s %10.3f ms %14.0f %s/s %10.1f MB/s\n", name, elapsed * 1000.0,
+           items / elapsed, item_name, bytes / elapsed / 1.0e6);
+}
+
+static
+void
+usage(void)
+{
+    fprintf(stderr, "Usage: h264-parse-bench [-n slices] [-l loops] [-m modifications] [-w] "
+                    "[-s payload] [-z zero-percent]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_params params = {
+        .slice_count = 2000,
+        .loops = 20,
+        .modifications = 0,
+        .weighted = 0,
+        .payload_size = 1000,
+        .zero_percent = 10,
+    };
+
+    int opt;
+    while (-1 != (opt = getopt(argc, argv, "n:l:m:ws:z:"))) {
+        switch (opt) {
+        case 'n': params.slice_count = atoi(optarg); break;
+        case 'l': params.loops = atoi(optarg); break;
+        case 'm': params.modifications = atoi(optarg); break;
+        case 'w': params.weighted = 1; break;
+        case 's': params.payload_size = atoi(optarg); break;
+        case 'z': params.zero_percent = atoi(optarg); break;
+        default:  usage();
+        }
+    }
+    if (params.slice_count < 1 || params.loops < 1 || params.modifications < 0 ||
+        params.payload_size < 0 || params.zero_percent < 0 || params.zero_percent > 100)
+    {
+        usage();
+    }
+
+    VAPictureParameterBufferH264 vapp;
+    setup_pic_param(&vapp, &params);
+
+    struct bit_writer stream = { 0 };
+    generate_stream(&stream, &params);
+
+    // parser output is checked once, outside of timed loops
+    if (params.slice_count != parse_stream(&stream, &vapp, 1)) {
+        fprintf(stderr, "slice count mismatch\n");
+        return 1;
+    }
+
+    printf("%d slices, %zu bytes, %d modifications per list, weighted prediction %s, "
+           "%d%% zeros in payload\n", params.slice_count, stream.size, params.modifications,
+           params.weighted ? "on" : "off", params.zero_percent);
+
+    double t_start = get_time();
+    int nal_count = 0;
+    for (int k = 0; k < params.loops; k ++)
+        nal_count += scan_stream(&stream);
+    report("nal search", get_time() - t_start, nal_count, "NALs", stream.size * params.loops);
+
+    t_start = get_time();
+    int slice_count = 0;
+    for (int k = 0; k < params.loops; k ++)
+        slice_count += parse_stream(&stream, &vapp, 0);
+    report("slice headers", get_time() - t_start, slice_count, "headers",
+           stream.size * params.loops);
+
+    // Exp-Golomb values with lengths typical for slice headers
+    const int ue_count = 1000000;
+    struct bit_writer ue_buf = { 0 };
+    for (int k = 0; k < ue_count; k ++)
+        bw_put_ue(&ue_buf, rng_next() % ((k % 4) ? 8 : 256));
+    bw_put_byte(&ue_buf, 0xff);     // reader may peek past the last value
+
+    t_start = get_time();
+    uint64_t sum = 0;
+    for (int k = 0; k < params.loops; k ++)
+        sum += read_exp_golomb(&ue_buf, ue_count);
+    report("ue(v) read", get_time() - t_start, (uint64_t)ue_count * params.loops, "values",
+           ue_buf.size * params.loops);
+    if (0 == sum)
+        printf("\n");   // keeps reads from being optimized away
+
+    free(ue_buf.buf);
+    free(stream.buf);
+    return 0;
+}
@@ -0,0 +1,1032 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+// stub VA-API driver
+//
+// Implements configs, contexts, surfaces, buffers and images in memory, without any
+// hardware. Nothing is actually decoded, but everything submitted is recorded, so
+// decode path of libvdpau-va-gl could be benchmarked and regression-tested on machines
+// without GPU.
+//
+// Usage:
+//     LIBVA_DRIVERS_PATH=<build dir>/tools LIBVA_DRIVER_NAME=stub <application>
+//
+// If STUB_VA_LOG contains file name, one line per decoded picture is written there,
+// listing type, size and FNV-1a hash of every buffer submitted for it. Summary is
+// printed to stderr on vaTerminate.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <va/va.h>
+#include <va/va_backend.h>
+
+#define STUB_MAX_WIDTH          4096
+#define STUB_MAX_HEIGHT         4096
+#define STUB_MAX_BUFFER_TYPES   64
+
+#define CONFIG_ID_BASE          0x01000000
+#define CONTEXT_ID_BASE         0x02000000
+#define SURFACE_ID_BASE         0x03000000
+#define BUFFER_ID_BASE          0x04000000
+#define IMAGE_ID_BASE           0x05000000
+
+#define _STUB_INIT_FUNC(major, minor)   __vaDriverInit_##major##_##minor
+#define STUB_INIT_FUNC(major, minor)    _STUB_INIT_FUNC(major, minor)
+
+/** @brief table of objects of one kind, object id is base plus index */
+struct object_table {
+    void          **items;
+    unsigned int    count;
+    unsigned int    base;
+};
+
+struct stub_config {
+    VAProfile       profile;
+    VAEntrypoint    entrypoint;
+    unsigned int    rt_format;
+};
+
+struct stub_surface {
+    unsigned int    width;
+    unsigned int    height;
+    unsigned int    rt_format;
+    unsigned int    fourcc;         ///< layout of data, 0 if image can't be derived
+    unsigned int    pitch;
+    unsigned int    chroma_offset;
+    uint8_t        *data;
+    size_t          size;
+};
+
+/** @brief record of a buffer submitted with vaRenderPicture */
+struct submitted_buffer {
+    VABufferType    type;
+    size_t          size;
+    uint32_t        hash;
+};
+
+struct stub_context {
+    VAConfigID      config;
+    int             width;
+    int             height;
+    int             flag;
+    VASurfaceID     target;         ///< target of picture being decoded
+    struct submitted_buffer *submitted;
+    unsigned int    submitted_count;
+    unsigned int    submitted_allocated;
+};
+
+struct stub_buffer {
+    VABufferType    type;
+    unsigned int    size;           ///< element size
+    unsigned int    num_elements;
+    uint8_t        *data;
+    int             owns_data;      ///< 0 for buffers of derived images
+};
+
+struct stub_image {
+    VAImage         image;
+    VASurfaceID     derived_from;   ///< VA_INVALID_SURFACE if image is not derived
+};
+
+struct stub_driver_data {
+    struct object_table configs;
+    struct object_table contexts;
+    struct object_table surfaces;
+    struct object_table buffers;
+    struct object_table images;
+    FILE           *log;
+    uint64_t        pictures;
+    uint64_t        buffer_count[STUB_MAX_BUFFER_TYPES];
+    uint64_t        buffer_bytes[STUB_MAX_BUFFER_TYPES];
+};
+
+static const VAProfile supported_profiles[] = {
+    VAProfileMPEG2Simple, VAProfileMPEG2Main,
+    VAProfileMPEG4Simple, VAProfileMPEG4AdvancedSimple,
+    VAProfileH264Baseline, VAProfileH264Main, VAProfileH264High,
+    VAProfileVC1Simple, VAProfileVC1Main, VAProfileVC1Advanced,
+#if VA_CHECK_VERSION(0, 37, 0)
+    VAProfileHEVCMain, VAProfileHEVCMain10,
+#endif
+};
+
+#define SUPPORTED_PROFILE_COUNT     (sizeof(supported_profiles) / sizeof(supported_profiles[0]))
+
+static const VAImageFormat supported_image_formats[] = {
+    { VA_FOURCC_NV12, VA_LSB_FIRST, 12, 0, 0, 0, 0, 0 },
+    { VA_FOURCC_YV12, VA_LSB_FIRST, 12, 0, 0, 0, 0, 0 },
+};
+
+#define SUPPORTED_IMAGE_FORMAT_COUNT \
+    (sizeof(supported_image_formats) / sizeof(supported_image_formats[0]))
+
+#define DRIVER_DATA(ctx)    ((struct stub_driver_data *)(ctx)->pDriverData)
+
+static
+unsigned int
+table_add(struct object_table *table, void *item)
+{
+    for (unsigned int k = 0; k < table->count; k ++) {
+        if (NULL == table->items[k]) {
+            table->items[k] = item;
+            return table->base + k;
+        }
+    }
+    void **new_items = realloc(table->items, (table->count + 1) * sizeof(void *));
+    if (NULL == new_items)
+        return VA_INVALID_ID;
+    table->items = new_items;
+    table->items[table->count] = item;
+    return table->base + table->count ++;
+}
+
+static
+void *
+table_get(const struct object_table *table, unsigned int id)
+{
+    if (id < table->base || id - table->base >= table->count)
+        return NULL;
+    return table->items[id - table->base];
+}
+
+static
+void
+table_remove(struct object_table *table, unsigned int id)
+{
+    if (table_get(table, id))
+        table->items[id - table->base] = NULL;
+}
+
+static
+uint32_t
+fnv1a_hash(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t k = 0; k < size; k ++) {
+        hash ^= data[k];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static
+int
+profile_supported(VAProfile profile)
+{
+    for (unsigned int k = 0; k < SUPPORTED_PROFILE_COUNT; k ++)
+        if (supported_profiles[k] == profile)
+            return 1;
+    return 0;
+}
+
+static
+VAStatus
+stub_QueryConfigProfiles(VADriverContextP ctx, VAProfile *profile_list, int *num_profiles)
+{
+    (void)ctx;
+    for (unsigned int k = 0; k < SUPPORTED_PROFILE_COUNT; k ++)
+        profile_list[k] = supported_profiles[k];
+    *num_profiles = SUPPORTED_PROFILE_COUNT;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_QueryConfigEntrypoints(VADriverContextP ctx, VAProfile profile,
+                            VAEntrypoint *entrypoint_list, int *num_entrypoints)
+{
+    (void)ctx;
+    if (!profile_supported(profile))
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+    entrypoint_list[0] = VAEntrypointVLD;
+    *num_entrypoints = 1;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_GetConfigAttributes(VADriverContextP ctx, VAProfile profile, VAEntrypoint entrypoint,
+                         VAConfigAttrib *attrib_list, int num_attribs)
+{
+    (void)ctx;
+    if (!profile_supported(profile))
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+    if (VAEntrypointVLD != entrypoint)
+        return VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT;
+
+    for (int k = 0; k < num_attribs; k ++) {
+        switch (attrib_list[k].type) {
+        case VAConfigAttribRTFormat:
+            attrib_list[k].value = VA_RT_FORMAT_YUV420;
+#ifdef VA_RT_FORMAT_YUV420_10BPP
+            attrib_list[k].value |= VA_RT_FORMAT_YUV420_10BPP;
+#endif
+            break;
+#if VA_CHECK_VERSION(0, 37, 0)
+        case VAConfigAttribMaxPictureWidth:
+            attrib_list[k].value = STUB_MAX_WIDTH;
+            break;
+        case VAConfigAttribMaxPictureHeight:
+            attrib_list[k].value = STUB_MAX_HEIGHT;
+            break;
+#endif
+        default:
+            attrib_list[k].value = VA_ATTRIB_NOT_SUPPORTED;
+            break;
+        }
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_CreateConfig(VADriverContextP ctx, VAProfile profile, VAEntrypoint entrypoint,
+                  VAConfigAttrib *attrib_list, int num_attribs, VAConfigID *config_id)
+{
+    if (!profile_supported(profile))
+        return VA_STATUS_ERROR_UNSUPPORTED_PROFILE;
+    if (VAEntrypointVLD != entrypoint)
+        return VA_STATUS_ERROR_UNSUPPORTED_ENTRYPOINT;
+
+    struct stub_config *config = calloc(1, sizeof(struct stub_config));
+    if (NULL == config)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    config->profile = profile;
+    config->entrypoint = entrypoint;
+    config->rt_format = VA_RT_FORMAT_YUV420;
+    for (int k = 0; k < num_attribs; k ++)
+        if (VAConfigAttribRTFormat == attrib_list[k].type)
+            config->rt_format = attrib_list[k].value;
+
+    *config_id = table_add(&DRIVER_DATA(ctx)->configs, config);
+    if (VA_INVALID_ID == *config_id) {
+        free(config);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_DestroyConfig(VADriverContextP ctx, VAConfigID config_id)
+{
+    struct stub_config *config = table_get(&DRIVER_DATA(ctx)->configs, config_id);
+    if (NULL == config)
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+    table_remove(&DRIVER_DATA(ctx)->configs, config_id);
+    free(config);
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_QueryConfigAttributes(VADriverContextP ctx, VAConfigID config_id, VAProfile *profile,
+                           VAEntrypoint *entrypoint, VAConfigAttrib *attrib_list,
+                           int *num_attribs)
+{
+    struct stub_config *config = table_get(&DRIVER_DATA(ctx)->configs, config_id);
+    if (NULL == config)
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+    *profile = config->profile;
+    *entrypoint = config->entrypoint;
+    attrib_list[0].type = VAConfigAttribRTFormat;
+    attrib_list[0].value = config->rt_format;
+    *num_attribs = 1;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+void
+destroy_surface(struct stub_surface *surface)
+{
+    free(surface->data);
+    free(surface);
+}
+
+static
+VAStatus
+create_surfaces(VADriverContextP ctx, unsigned int format, unsigned int width,
+                unsigned int height, VASurfaceID *surfaces, unsigned int num_surfaces)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    if (0 == width || 0 == height || width > STUB_MAX_WIDTH || height > STUB_MAX_HEIGHT)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    // 4:2:0 surfaces are NV12 (or P010), so they could be derived. Others just get
+    // enough memory for 4:4:4 content.
+    unsigned int bytes_per_sample = 1;
+    unsigned int fourcc = VA_FOURCC_NV12;
+    size_t chroma_size_x2 = width * height;
+    switch (format) {
+    case VA_RT_FORMAT_YUV420:
+        break;
+#ifdef VA_RT_FORMAT_YUV420_10BPP
+    case VA_RT_FORMAT_YUV420_10BPP:
+        bytes_per_sample = 2;
+        fourcc = VA_FOURCC_P010;
+        break;
+#endif
+    case VA_RT_FORMAT_YUV422:
+    case VA_RT_FORMAT_YUV444:
+        fourcc = 0;
+        chroma_size_x2 = 4 * width * height;
+        break;
+    default:
+        return VA_STATUS_ERROR_UNSUPPORTED_RT_FORMAT;
+    }
+
+    for (unsigned int k = 0; k < num_surfaces; k ++) {
+        struct stub_surface *surface = calloc(1, sizeof(struct stub_surface));
+        if (NULL == surface)
+            goto error;
+        surface->width = width;
+        surface->height = height;
+        surface->rt_format = format;
+        surface->fourcc = fourcc;
+        surface->pitch = width * bytes_per_sample;
+        surface->chroma_offset = surface->pitch * height;
+        surface->size = surface->chroma_offset + chroma_size_x2 * bytes_per_sample / 2;
+        surface->data = malloc(surface->size);
+        if (NULL == surface->data) {
+            free(surface);
+            goto error;
+        }
+        // (nearly) black picture
+        memset(surface->data, 1 == bytes_per_sample ? 16 : 0, surface->chroma_offset);
+        memset(surface->data + surface->chroma_offset, 128,
+               surface->size - surface->chroma_offset);
+
+        surfaces[k] = table_add(&data->surfaces, surface);
+        if (VA_INVALID_ID == surfaces[k]) {
+            destroy_surface(surface);
+            goto error;
+        }
+        continue;
+error:
+        for (unsigned int j = 0; j < k; j ++) {
+            destroy_surface(table_get(&data->surfaces, surfaces[j]));
+            table_remove(&data->surfaces, surfaces[j]);
+        }
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_CreateSurfaces(VADriverContextP ctx, int width, int height, int format, int num_surfaces,
+                    VASurfaceID *surfaces)
+{
+    if (width < 0 || height < 0 || num_surfaces < 0)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    return create_surfaces(ctx, format, width, height, surfaces, num_surfaces);
+}
+
+#if VA_CHECK_VERSION(0, 34, 0)
+static
+VAStatus
+stub_CreateSurfaces2(VADriverContextP ctx, unsigned int format, unsigned int width,
+                     unsigned int height, VASurfaceID *surfaces, unsigned int num_surfaces,
+                     VASurfaceAttrib *attrib_list, unsigned int num_attribs)
+{
+    (void)attrib_list;
+    (void)num_attribs;
+    return create_surfaces(ctx, format, width, height, surfaces, num_surfaces);
+}
+#endif
+
+static
+VAStatus
+stub_DestroySurfaces(VADriverContextP ctx, VASurfaceID *surface_list, int num_surfaces)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    for (int k = 0; k < num_surfaces; k ++) {
+        struct stub_surface *surface = table_get(&data->surfaces, surface_list[k]);
+        if (NULL == surface)
+            return VA_STATUS_ERROR_INVALID_SURFACE;
+        table_remove(&data->surfaces, surface_list[k]);
+        destroy_surface(surface);
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_CreateContext(VADriverContextP ctx, VAConfigID config_id, int picture_width,
+                   int picture_height, int flag, VASurfaceID *render_targets,
+                   int num_render_targets, VAContextID *context_id)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    if (NULL == table_get(&data->configs, config_id))
+        return VA_STATUS_ERROR_INVALID_CONFIG;
+    for (int k = 0; k < num_render_targets; k ++)
+        if (NULL == table_get(&data->surfaces, render_targets[k]))
+            return VA_STATUS_ERROR_INVALID_SURFACE;
+
+    struct stub_context *context = calloc(1, sizeof(struct stub_context));
+    if (NULL == context)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    context->config = config_id;
+    context->width = picture_width;
+    context->height = picture_height;
+    context->flag = flag;
+    context->target = VA_INVALID_SURFACE;
+
+    *context_id = table_add(&data->contexts, context);
+    if (VA_INVALID_ID == *context_id) {
+        free(context);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_DestroyContext(VADriverContextP ctx, VAContextID context_id)
+{
+    struct stub_context *context = table_get(&DRIVER_DATA(ctx)->contexts, context_id);
+    if (NULL == context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    table_remove(&DRIVER_DATA(ctx)->contexts, context_id);
+    free(context->submitted);
+    free(context);
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+add_buffer(VADriverContextP ctx, VABufferType type, unsigned int size,
+           unsigned int num_elements, uint8_t *external_data, VABufferID *buf_id)
+{
+    struct stub_buffer *buffer = calloc(1, sizeof(struct stub_buffer));
+    if (NULL == buffer)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    buffer->type = type;
+    buffer->size = size;
+    buffer->num_elements = num_elements;
+    if (external_data) {
+        buffer->data = external_data;
+        buffer->owns_data = 0;
+    } else {
+        buffer->data = calloc(num_elements, size);
+        buffer->owns_data = 1;
+        if (NULL == buffer->data && size * num_elements > 0) {
+            free(buffer);
+            return VA_STATUS_ERROR_ALLOCATION_FAILED;
+        }
+    }
+
+    *buf_id = table_add(&DRIVER_DATA(ctx)->buffers, buffer);
+    if (VA_INVALID_ID == *buf_id) {
+        if (buffer->owns_data)
+            free(buffer->data);
+        free(buffer);
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_CreateBuffer(VADriverContextP ctx, VAContextID context, VABufferType type,
+                  unsigned int size, unsigned int num_elements, void *data, VABufferID *buf_id)
+{
+    (void)context;
+    VAStatus status = add_buffer(ctx, type, size, num_elements, NULL, buf_id);
+    if (VA_STATUS_SUCCESS != status)
+        return status;
+    if (data) {
+        struct stub_buffer *buffer = table_get(&DRIVER_DATA(ctx)->buffers, *buf_id);
+        memcpy(buffer->data, data, (size_t)size * num_elements);
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_BufferSetNumElements(VADriverContextP ctx, VABufferID buf_id, unsigned int num_elements)
+{
+    struct stub_buffer *buffer = table_get(&DRIVER_DATA(ctx)->buffers, buf_id);
+    if (NULL == buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    if (num_elements > buffer->num_elements)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    buffer->num_elements = num_elements;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_MapBuffer(VADriverContextP ctx, VABufferID buf_id, void **pbuf)
+{
+    struct stub_buffer *buffer = table_get(&DRIVER_DATA(ctx)->buffers, buf_id);
+    if (NULL == buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    *pbuf = buffer->data;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_UnmapBuffer(VADriverContextP ctx, VABufferID buf_id)
+{
+    if (NULL == table_get(&DRIVER_DATA(ctx)->buffers, buf_id))
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_DestroyBuffer(VADriverContextP ctx, VABufferID buf_id)
+{
+    struct stub_buffer *buffer = table_get(&DRIVER_DATA(ctx)->buffers, buf_id);
+    if (NULL == buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    table_remove(&DRIVER_DATA(ctx)->buffers, buf_id);
+    if (buffer->owns_data)
+        free(buffer->data);
+    free(buffer);
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_BufferInfo(VADriverContextP ctx, VABufferID buf_id, VABufferType *type,
+                unsigned int *size, unsigned int *num_elements)
+{
+    struct stub_buffer *buffer = table_get(&DRIVER_DATA(ctx)->buffers, buf_id);
+    if (NULL == buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    *type = buffer->type;
+    *size = buffer->size;
+    *num_elements = buffer->num_elements;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_BeginPicture(VADriverContextP ctx, VAContextID context_id, VASurfaceID render_target)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    struct stub_context *context = table_get(&data->contexts, context_id);
+    if (NULL == context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    if (NULL == table_get(&data->surfaces, render_target))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    context->target = render_target;
+    context->submitted_count = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_RenderPicture(VADriverContextP ctx, VAContextID context_id, VABufferID *buffers,
+                   int num_buffers)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    struct stub_context *context = table_get(&data->contexts, context_id);
+    if (NULL == context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    if (VA_INVALID_SURFACE == context->target)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    for (int k = 0; k < num_buffers; k ++) {
+        struct stub_buffer *buffer = table_get(&data->buffers, buffers[k]);
+        if (NULL == buffer)
+            return VA_STATUS_ERROR_INVALID_BUFFER;
+
+        if (context->submitted_count == context->submitted_allocated) {
+            unsigned int new_allocated = context->submitted_allocated * 2 + 16;
+            struct submitted_buffer *new_submitted =
+                realloc(context->submitted, new_allocated * sizeof(struct submitted_buffer));
+            if (NULL == new_submitted)
+                return VA_STATUS_ERROR_ALLOCATION_FAILED;
+            context->submitted = new_submitted;
+            context->submitted_allocated = new_allocated;
+        }
+
+        struct submitted_buffer *sb = &context->submitted[context->submitted_count ++];
+        sb->type = buffer->type;
+        sb->size = (size_t)buffer->size * buffer->num_elements;
+        sb->hash = fnv1a_hash(buffer->data, sb->size);
+
+        if ((unsigned int)buffer->type < STUB_MAX_BUFFER_TYPES) {
+            data->buffer_count[buffer->type] ++;
+            data->buffer_bytes[buffer->type] += sb->size;
+        }
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_EndPicture(VADriverContextP ctx, VAContextID context_id)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    struct stub_context *context = table_get(&data->contexts, context_id);
+    if (NULL == context)
+        return VA_STATUS_ERROR_INVALID_CONTEXT;
+    if (VA_INVALID_SURFACE == context->target)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    if (data->log) {
+        fprintf(data->log, "picture %llu context %#x target %#x:",
+                (unsigned long long)data->pictures, context_id, context->target);
+        for (unsigned int k = 0; k < context->submitted_count; k ++) {
+            const struct submitted_buffer *sb = &context->submitted[k];
+            fprintf(data->log, " %d/%zu/%08x", sb->type, sb->size, sb->hash);
+        }
+        fprintf(data->log, "\n");
+    }
+
+    data->pictures ++;
+    context->target = VA_INVALID_SURFACE;
+    context->submitted_count = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_SyncSurface(VADriverContextP ctx, VASurfaceID render_target)
+{
+    if (NULL == table_get(&DRIVER_DATA(ctx)->surfaces, render_target))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_QuerySurfaceStatus(VADriverContextP ctx, VASurfaceID render_target,
+                        VASurfaceStatus *status)
+{
+    if (NULL == table_get(&DRIVER_DATA(ctx)->surfaces, render_target))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    *status = VASurfaceReady;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_PutSurface(VADriverContextP ctx, VASurfaceID surface, void *draw, short srcx, short srcy,
+                unsigned short srcw, unsigned short srch, short destx, short desty,
+                unsigned short destw, unsigned short desth, VARectangle *cliprects,
+                unsigned int number_cliprects, unsigned int flags)
+{
+    (void)draw; (void)srcx; (void)srcy; (void)srcw; (void)srch; (void)destx; (void)desty;
+    (void)destw; (void)desth; (void)cliprects; (void)number_cliprects; (void)flags;
+    // there is no display, drawing is skipped
+    if (NULL == table_get(&DRIVER_DATA(ctx)->surfaces, surface))
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_QueryImageFormats(VADriverContextP ctx, VAImageFormat *format_list, int *num_formats)
+{
+    (void)ctx;
+    for (unsigned int k = 0; k < SUPPORTED_IMAGE_FORMAT_COUNT; k ++)
+        format_list[k] = supported_image_formats[k];
+    *num_formats = SUPPORTED_IMAGE_FORMAT_COUNT;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+add_image(VADriverContextP ctx, struct stub_image *img)
+{
+    img->image.image_id = table_add(&DRIVER_DATA(ctx)->images, img);
+    if (VA_INVALID_ID == img->image.image_id)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_CreateImage(VADriverContextP ctx, VAImageFormat *format, int width, int height,
+                 VAImage *image)
+{
+    if (VA_FOURCC_NV12 != format->fourcc && VA_FOURCC_YV12 != format->fourcc)
+        return VA_STATUS_ERROR_INVALID_IMAGE_FORMAT;
+    if (width <= 0 || height <= 0)
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+
+    struct stub_image *img = calloc(1, sizeof(struct stub_image));
+    if (NULL == img)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    VAImage *vi = &img->image;
+    vi->format = *format;
+    vi->width = width;
+    vi->height = height;
+    vi->pitches[0] = width;
+    vi->offsets[0] = 0;
+    if (VA_FOURCC_NV12 == format->fourcc) {
+        vi->num_planes = 2;
+        vi->pitches[1] = width;
+        vi->offsets[1] = width * height;
+    } else {
+        vi->num_planes = 3;
+        vi->pitches[1] = vi->pitches[2] = width / 2;
+        vi->offsets[1] = width * height;
+        vi->offsets[2] = width * height + (width / 2) * (height / 2);
+    }
+    vi->data_size = width * height * 3 / 2;
+    img->derived_from = VA_INVALID_SURFACE;
+
+    VAStatus status = add_buffer(ctx, VAImageBufferType, vi->data_size, 1, NULL, &vi->buf);
+    if (VA_STATUS_SUCCESS != status) {
+        free(img);
+        return status;
+    }
+    status = add_image(ctx, img);
+    if (VA_STATUS_SUCCESS != status) {
+        stub_DestroyBuffer(ctx, vi->buf);
+        free(img);
+        return status;
+    }
+    *image = *vi;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_DeriveImage(VADriverContextP ctx, VASurfaceID surface_id, VAImage *image)
+{
+    struct stub_surface *surface = table_get(&DRIVER_DATA(ctx)->surfaces, surface_id);
+    if (NULL == surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    if (0 == surface->fourcc)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+
+    struct stub_image *img = calloc(1, sizeof(struct stub_image));
+    if (NULL == img)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+
+    VAImage *vi = &img->image;
+    vi->format.fourcc = surface->fourcc;
+    vi->format.byte_order = VA_LSB_FIRST;
+    vi->format.bits_per_pixel = (VA_FOURCC_NV12 == surface->fourcc) ? 12 : 24;
+    vi->width = surface->width;
+    vi->height = surface->height;
+    vi->num_planes = 2;
+    vi->pitches[0] = vi->pitches[1] = surface->pitch;
+    vi->offsets[0] = 0;
+    vi->offsets[1] = surface->chroma_offset;
+    vi->data_size = surface->size;
+    img->derived_from = surface_id;
+
+    // image shares memory with surface
+    VAStatus status = add_buffer(ctx, VAImageBufferType, surface->size, 1, surface->data,
+                                 &vi->buf);
+    if (VA_STATUS_SUCCESS != status) {
+        free(img);
+        return status;
+    }
+    status = add_image(ctx, img);
+    if (VA_STATUS_SUCCESS != status) {
+        stub_DestroyBuffer(ctx, vi->buf);
+        free(img);
+        return status;
+    }
+    *image = *vi;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_DestroyImage(VADriverContextP ctx, VAImageID image_id)
+{
+    struct stub_image *img = table_get(&DRIVER_DATA(ctx)->images, image_id);
+    if (NULL == img)
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+    table_remove(&DRIVER_DATA(ctx)->images, image_id);
+    stub_DestroyBuffer(ctx, img->image.buf);
+    free(img);
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_GetImage(VADriverContextP ctx, VASurfaceID surface_id, int x, int y, unsigned int width,
+              unsigned int height, VAImageID image_id)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+    struct stub_surface *surface = table_get(&data->surfaces, surface_id);
+    struct stub_image *img = table_get(&data->images, image_id);
+    if (NULL == surface)
+        return VA_STATUS_ERROR_INVALID_SURFACE;
+    if (NULL == img)
+        return VA_STATUS_ERROR_INVALID_IMAGE;
+    if (VA_FOURCC_NV12 != surface->fourcc)
+        return VA_STATUS_ERROR_OPERATION_FAILED;
+    if (x < 0 || y < 0 || x + width > surface->width || y + height > surface->height ||
+        width > img->image.width || height > img->image.height)
+    {
+        return VA_STATUS_ERROR_INVALID_PARAMETER;
+    }
+
+    struct stub_buffer *buffer = table_get(&data->buffers, img->image.buf);
+    if (NULL == buffer)
+        return VA_STATUS_ERROR_INVALID_BUFFER;
+    const VAImage *vi = &img->image;
+
+    for (unsigned int row = 0; row < height; row ++) {
+        memcpy(buffer->data + vi->offsets[0] + row * vi->pitches[0],
+               surface->data + (y + row) * surface->pitch + x, width);
+    }
+    for (unsigned int row = 0; row < height / 2; row ++) {
+        const uint8_t *src = surface->data + surface->chroma_offset +
+                             (y / 2 + row) * surface->pitch + (x & ~1);
+        if (VA_FOURCC_NV12 == vi->format.fourcc) {
+            memcpy(buffer->data + vi->offsets[1] + row * vi->pitches[1], src, width & ~1);
+        } else {
+            // YV12 has V plane first
+            uint8_t *dst_v = buffer->data + vi->offsets[1] + row * vi->pitches[1];
+            uint8_t *dst_u = buffer->data + vi->offsets[2] + row * vi->pitches[2];
+            for (unsigned int col = 0; col < width / 2; col ++) {
+                dst_u[col] = src[2 * col];
+                dst_v[col] = src[2 * col + 1];
+            }
+        }
+    }
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_Unimplemented(void)
+{
+    return VA_STATUS_ERROR_UNIMPLEMENTED;
+}
+
+static
+VAStatus
+stub_QuerySubpictureFormats(VADriverContextP ctx, VAImageFormat *format_list,
+                            unsigned int *flags, unsigned int *num_formats)
+{
+    (void)ctx; (void)format_list; (void)flags;
+    *num_formats = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+VAStatus
+stub_QueryDisplayAttributes(VADriverContextP ctx, VADisplayAttribute *attr_list,
+                            int *num_attributes)
+{
+    (void)ctx; (void)attr_list;
+    *num_attributes = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+static
+void
+free_table(struct object_table *table, void (*destroy)(void *))
+{
+    for (unsigned int k = 0; k < table->count; k ++)
+        if (table->items[k])
+            destroy(table->items[k]);
+    free(table->items);
+}
+
+static
+void
+destroy_context_item(void *item)
+{
+    free(((struct stub_context *)item)->submitted);
+    free(item);
+}
+
+static
+void
+destroy_surface_item(void *item)
+{
+    destroy_surface(item);
+}
+
+static
+void
+destroy_buffer_item(void *item)
+{
+    struct stub_buffer *buffer = item;
+    if (buffer->owns_data)
+        free(buffer->data);
+    free(buffer);
+}
+
+static
+VAStatus
+stub_Terminate(VADriverContextP ctx)
+{
+    struct stub_driver_data *data = DRIVER_DATA(ctx);
+
+    fprintf(stderr, "stub VA driver: %llu pictures decoded\n",
+            (unsigned long long)data->pictures);
+    for (int k = 0; k < STUB_MAX_BUFFER_TYPES; k ++) {
+        if (0 == data->buffer_count[k])
+            continue;
+        fprintf(stderr, "stub VA driver:   buffer type %2d: %llu buffers, %llu bytes\n", k,
+                (unsigned long long)data->buffer_count[k],
+                (unsigned long long)data->buffer_bytes[k]);
+    }
+
+    free_table(&data->configs, free);
+    free_table(&data->contexts, destroy_context_item);
+    free_table(&data->images, free);
+    free_table(&data->buffers, destroy_buffer_item);
+    free_table(&data->surfaces, destroy_surface_item);
+    if (data->log)
+        fclose(data->log);
+    free(data);
+    ctx->pDriverData = NULL;
+    return VA_STATUS_SUCCESS;
+}
+
+__attribute__((visibility("default")))
+VAStatus
+STUB_INIT_FUNC(VA_MAJOR_VERSION, VA_MINOR_VERSION)(VADriverContextP ctx)
+{
+    struct stub_driver_data *data = calloc(1, sizeof(struct stub_driver_data));
+    if (NULL == data)
+        return VA_STATUS_ERROR_ALLOCATION_FAILED;
+    data->configs.base = CONFIG_ID_BASE;
+    data->contexts.base = CONTEXT_ID_BASE;
+    data->surfaces.base = SURFACE_ID_BASE;
+    data->buffers.base = BUFFER_ID_BASE;
+    data->images.base = IMAGE_ID_BASE;
+
+    const char *log_name = getenv("STUB_VA_LOG");
+    if (log_name) {
+        data->log = fopen(log_name, "w");
+        if (NULL == data->log)
+            fprintf(stderr, "stub VA driver: can't open %s\n", log_name);
+    }
+
+    ctx->pDriverData = data;
+    ctx->max_profiles = SUPPORTED_PROFILE_COUNT;
+    ctx->max_entrypoints = 1;
+    ctx->max_attributes = 4;
+    ctx->max_image_formats = SUPPORTED_IMAGE_FORMAT_COUNT;
+    ctx->max_subpic_formats = 1;
+    ctx->max_display_attributes = 1;
+    ctx->str_vendor = "libvdpau-va-gl stub driver";
+
+    struct VADriverVTable *vtable = ctx->vtable;
+    vtable->vaTerminate = stub_Terminate;
+    vtable->vaQueryConfigProfiles = stub_QueryConfigProfiles;
+    vtable->vaQueryConfigEntrypoints = stub_QueryConfigEntrypoints;
+    vtable->vaGetConfigAttributes = stub_GetConfigAttributes;
+    vtable->vaCreateConfig = stub_CreateConfig;
+    vtable->vaDestroyConfig = stub_DestroyConfig;
+    vtable->vaQueryConfigAttributes = stub_QueryConfigAttributes;
+    vtable->vaCreateSurfaces = stub_CreateSurfaces;
+#if VA_CHECK_VERSION(0, 34, 0)
+    vtable->vaCreateSurfaces2 = stub_CreateSurfaces2;
+#endif
+    vtable->vaDestroySurfaces = stub_DestroySurfaces;
+    vtable->vaCreateContext = stub_CreateContext;
+    vtable->vaDestroyContext = stub_DestroyContext;
+    vtable->vaCreateBuffer = stub_CreateBuffer;
+    vtable->vaBufferSetNumElements = stub_BufferSetNumElements;
+    vtable->vaMapBuffer = stub_MapBuffer;
+    vtable->vaUnmapBuffer = stub_UnmapBuffer;
+    vtable->vaDestroyBuffer = stub_DestroyBuffer;
+    vtable->vaBufferInfo = stub_BufferInfo;
+    vtable->vaBeginPicture = stub_BeginPicture;
+    vtable->vaRenderPicture = stub_RenderPicture;
+    vtable->vaEndPicture = stub_EndPicture;
+    vtable->vaSyncSurface = stub_SyncSurface;
+    vtable->vaQuerySurfaceStatus = stub_QuerySurfaceStatus;
+    vtable->vaPutSurface = stub_PutSurface;
+    vtable->vaQueryImageFormats = stub_QueryImageFormats;
+    vtable->vaCreateImage = stub_CreateImage;
+    vtable->vaDeriveImage = stub_DeriveImage;
+    vtable->vaDestroyImage = stub_DestroyImage;
+    vtable->vaGetImage = stub_GetImage;
+    vtable->vaQuerySubpictureFormats = stub_QuerySubpictureFormats;
+    vtable->vaQueryDisplayAttributes = stub_QueryDisplayAttributes;
+
+    // libva requires these to be present, but they are not needed for decoding
+    vtable->vaSetImagePalette = (void *)stub_Unimplemented;
+    vtable->vaPutImage = (void *)stub_Unimplemented;
+    vtable->vaCreateSubpicture = (void *)stub_Unimplemented;
+    vtable->vaDestroySubpicture = (void *)stub_Unimplemented;
+    vtable->vaSetSubpictureImage = (void *)stub_Unimplemented;
+    vtable->vaSetSubpictureChromakey = (void *)stub_Unimplemented;
+    vtable->vaSetSubpictureGlobalAlpha = (void *)stub_Unimplemented;
+    vtable->vaAssociateSubpicture = (void *)stub_Unimplemented;
+    vtable->vaDeassociateSubpicture = (void *)stub_Unimplemented;
+    vtable->vaGetDisplayAttributes = (void *)stub_Unimplemented;
+    vtable->vaSetDisplayAttributes = (void *)stub_Unimplemented;
+
+    return VA_STATUS_SUCCESS;
+}
@@ -0,0 +1,307 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#include <string.h>
+#include "va-vpp.h"
+#include "vdpau-trace.h"
+
+static
+VABufferID
+create_filter_buffer(va_vpp_t *vpp, void *params, unsigned int size)
+{
+    VABufferID buf_id;
+    VAStatus status = vaCreateBuffer(vpp->va_dpy, vpp->context_id,
+                                     VAProcFilterParameterBufferType, size, 1, params, &buf_id);
+    if (VA_STATUS_SUCCESS != status)
+        return VA_INVALID_ID;
+    return buf_id;
+}
+
+/** @brief Query range of filter with single value parameter */
+static
+int
+query_filter_range(va_vpp_t *vpp, VAProcFilterType type, VAProcFilterValueRange *range)
+{
+    VAProcFilterCap cap;
+    unsigned int num_caps = 1;
+    VAStatus status = vaQueryVideoProcFilterCaps(vpp->va_dpy, vpp->context_id, type, &cap,
+                                                 &num_caps);
+    if (VA_STATUS_SUCCESS != status || num_caps < 1)
+        return 0;
+    *range = cap.range;
+    return 1;
+}
+
+static
+void
+query_deinterlacing(va_vpp_t *vpp)
+{
+    VAProcFilterCapDeinterlacing caps[VAProcDeinterlacingCount];
+    unsigned int num_caps = VAProcDeinterlacingCount;
+    VAStatus status = vaQueryVideoProcFilterCaps(vpp->va_dpy, vpp->context_id,
+                                                 VAProcFilterDeinterlacing, caps, &num_caps);
+    if (VA_STATUS_SUCCESS != status)
+        return;
+
+    for (unsigned int k = 0; k < num_caps; k ++) {
+        if (VAProcDeinterlacingBob == caps[k].type)
+            vpp->has_bob = 1;
+        if (VAProcDeinterlacingMotionAdaptive == caps[k].type)
+            vpp->has_motion_adaptive = 1;
+    }
+    if (!vpp->has_bob && !vpp->has_motion_adaptive)
+        return;
+
+    // buffer is created once, algorithm and field flags are updated for every picture
+    VAProcFilterParameterBufferDeinterlacing deint = {
+        .type = VAProcFilterDeinterlacing,
+        .algorithm = vpp->has_motion_adaptive ? VAProcDeinterlacingMotionAdaptive
+                                              : VAProcDeinterlacingBob,
+        .flags = 0,
+    };
+    vpp->deint_buf = create_filter_buffer(vpp, &deint, sizeof(deint));
+    if (VA_INVALID_ID == vpp->deint_buf) {
+        vpp->has_bob = 0;
+        vpp->has_motion_adaptive = 0;
+        return;
+    }
+
+    if (vpp->has_motion_adaptive) {
+        VAProcPipelineCaps pipeline_caps;
+        memset(&pipeline_caps, 0, sizeof(pipeline_caps));
+        status = vaQueryVideoProcPipelineCaps(vpp->va_dpy, vpp->context_id, &vpp->deint_buf, 1,
+                                              &pipeline_caps);
+        if (VA_STATUS_SUCCESS != status) {
+            vpp->has_motion_adaptive = 0;
+            return;
+        }
+        vpp->num_forward_refs = pipeline_caps.num_forward_references;
+        vpp->num_backward_refs = pipeline_caps.num_backward_references;
+    }
+}
+
+int
+va_vpp_create(va_vpp_t *vpp, VADisplay va_dpy, uint32_t width, uint32_t height)
+{
+    memset(vpp, 0, sizeof(*vpp));
+    vpp->va_dpy = va_dpy;
+    vpp->config_id = VA_INVALID_ID;
+    vpp->context_id = VA_INVALID_ID;
+    vpp->deint_buf = VA_INVALID_ID;
+    vpp->denoise_buf = VA_INVALID_ID;
+    vpp->sharpen_buf = VA_INVALID_ID;
+    vpp->out_surf = VA_INVALID_SURFACE;
+
+    VAStatus status = vaCreateConfig(va_dpy, VAProfileNone, VAEntrypointVideoProc, NULL, 0,
+                                     &vpp->config_id);
+    if (VA_STATUS_SUCCESS != status) {
+        traceError("warning (va_vpp_create): video processing is not available\n");
+        vpp->config_id = VA_INVALID_ID;
+        return -1;
+    }
+
+    status = vaCreateContext(va_dpy, vpp->config_id, width, height, 0, NULL, 0,
+                             &vpp->context_id);
+    if (VA_STATUS_SUCCESS != status) {
+        traceError("error (va_vpp_create): can not create video processing context\n");
+        vpp->context_id = VA_INVALID_ID;
+        va_vpp_destroy(vpp);
+        return -1;
+    }
+
+    VAProcFilterType filters[VAProcFilterCount];
+    unsigned int num_filters = VAProcFilterCount;
+    status = vaQueryVideoProcFilters(va_dpy, vpp->context_id, filters, &num_filters);
+    if (VA_STATUS_SUCCESS != status)
+        num_filters = 0;
+
+    for (unsigned int k = 0; k < num_filters; k ++) {
+        switch (filters[k]) {
+        case VAProcFilterDeinterlacing:
+            query_deinterlacing(vpp);
+            break;
+        case VAProcFilterNoiseReduction:
+            vpp->has_denoise = query_filter_range(vpp, filters[k], &vpp->denoise_range);
+            break;
+        case VAProcFilterSharpening:
+            vpp->has_sharpen = query_filter_range(vpp, filters[k], &vpp->sharpen_range);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return 0;
+}
+
+void
+va_vpp_destroy(va_vpp_t *vpp)
+{
+    VABufferID *bufs[] = { &vpp->deint_buf, &vpp->denoise_buf, &vpp->sharpen_buf };
+    for (unsigned int k = 0; k < sizeof(bufs) / sizeof(bufs[0]); k ++) {
+        if (VA_INVALID_ID != *bufs[k])
+            vaDestroyBuffer(vpp->va_dpy, *bufs[k]);
+        *bufs[k] = VA_INVALID_ID;
+    }
+    if (VA_INVALID_SURFACE != vpp->out_surf)
+        vaDestroySurfaces(vpp->va_dpy, &vpp->out_surf, 1);
+    vpp->out_surf = VA_INVALID_SURFACE;
+    if (VA_INVALID_ID != vpp->context_id)
+        vaDestroyContext(vpp->va_dpy, vpp->context_id);
+    vpp->context_id = VA_INVALID_ID;
+    if (VA_INVALID_ID != vpp->config_id)
+        vaDestroyConfig(vpp->va_dpy, vpp->config_id);
+    vpp->config_id = VA_INVALID_ID;
+}
+
+/** @brief Set value of single value filter, creating its buffer on first use */
+static
+int
+update_filter_value(va_vpp_t *vpp, VAProcFilterType type, VABufferID *buf_id, float value)
+{
+    if (VA_INVALID_ID == *buf_id) {
+        VAProcFilterParameterBuffer params = { .type = type, .value = value };
+        *buf_id = create_filter_buffer(vpp, &params, sizeof(params));
+        return VA_INVALID_ID != *buf_id;
+    }
+
+    VAProcFilterParameterBuffer *params;
+    if (VA_STATUS_SUCCESS != vaMapBuffer(vpp->va_dpy, *buf_id, (void **)&params))
+        return 0;
+    params->value = value;
+    vaUnmapBuffer(vpp->va_dpy, *buf_id);
+    return 1;
+}
+
+static
+int
+update_deinterlacing(va_vpp_t *vpp, VAProcDeinterlacingType algorithm, int bottom_field)
+{
+    VAProcFilterParameterBufferDeinterlacing *deint;
+    if (VA_STATUS_SUCCESS != vaMapBuffer(vpp->va_dpy, vpp->deint_buf, (void **)&deint))
+        return 0;
+    deint->algorithm = algorithm;
+    deint->flags = bottom_field ? VA_DEINTERLACING_BOTTOM_FIELD : 0;
+    vaUnmapBuffer(vpp->va_dpy, vpp->deint_buf);
+    return 1;
+}
+
+/** @brief Make sure output surface has requested size */
+static
+int
+prepare_output(va_vpp_t *vpp, uint32_t width, uint32_t height)
+{
+    if (VA_INVALID_SURFACE != vpp->out_surf && vpp->out_width == width &&
+        vpp->out_height == height)
+    {
+        return 1;
+    }
+
+    if (VA_INVALID_SURFACE != vpp->out_surf)
+        vaDestroySurfaces(vpp->va_dpy, &vpp->out_surf, 1);
+    VAStatus status = vaCreateSurfaces(vpp->va_dpy, VA_RT_FORMAT_YUV420, width, height,
+                                       &vpp->out_surf, 1, NULL, 0);
+    if (VA_STATUS_SUCCESS != status) {
+        traceError("error (va_vpp_process): can not create output surface\n");
+        vpp->out_surf = VA_INVALID_SURFACE;
+        return 0;
+    }
+    vpp->out_width = width;
+    vpp->out_height = height;
+    return 1;
+}
+
+VASurfaceID
+va_vpp_process(va_vpp_t *vpp, const va_vpp_params_t *params)
+{
+    VABufferID filters[VAProcFilterCount];
+    uint32_t num_filters = 0;
+    VASurfaceID forward_refs[8];
+    VASurfaceID backward_refs[8];
+    uint32_t num_forward_refs = 0;
+    uint32_t num_backward_refs = 0;
+
+    if (!prepare_output(vpp, params->out_width, params->out_height))
+        return VA_INVALID_SURFACE;
+
+    if (VA_VPP_DEINTERLACE_MOTION_ADAPTIVE == params->deinterlace && vpp->has_motion_adaptive &&
+        vpp->num_forward_refs <= 8 && vpp->num_backward_refs <= 8)
+    {
+        if (!update_deinterlacing(vpp, VAProcDeinterlacingMotionAdaptive, params->bottom_field))
+            return VA_INVALID_SURFACE;
+        filters[num_filters ++] = vpp->deint_buf;
+        // missing references are substituted with current surface
+        num_forward_refs = vpp->num_forward_refs;
+        num_backward_refs = vpp->num_backward_refs;
+        for (uint32_t k = 0; k < num_forward_refs; k ++)
+            forward_refs[k] = (VA_INVALID_SURFACE != params->past) ? params->past
+                                                                   : params->surface;
+        for (uint32_t k = 0; k < num_backward_refs; k ++)
+            backward_refs[k] = (VA_INVALID_SURFACE != params->future) ? params->future
+                                                                      : params->surface;
+    } else if (VA_VPP_DEINTERLACE_NONE != params->deinterlace) {
+        if (!vpp->has_bob)
+            return VA_INVALID_SURFACE;
+        if (!update_deinterlacing(vpp, VAProcDeinterlacingBob, params->bottom_field))
+            return VA_INVALID_SURFACE;
+        filters[num_filters ++] = vpp->deint_buf;
+    }
+
+    if (vpp->has_denoise && params->denoise_level > 0.0f) {
+        const VAProcFilterValueRange *r = &vpp->denoise_range;
+        const float value = r->min_value + params->denoise_level * (r->max_value - r->min_value);
+        if (update_filter_value(vpp, VAProcFilterNoiseReduction, &vpp->denoise_buf, value))
+            filters[num_filters ++] = vpp->denoise_buf;
+    }
+
+    if (vpp->has_sharpen && 0.0f != params->sharpness_level) {
+        // VDPAU level is in [-1, 1], with 0 meaning no change. It's mapped to driver default.
+        const VAProcFilterValueRange *r = &vpp->sharpen_range;
+        const float level = params->sharpness_level;
+        const float span = (level > 0) ? r->max_value - r->default_value
+                                       : r->default_value - r->min_value;
+        const float value = r->default_value + level * span;
+        if (update_filter_value(vpp, VAProcFilterSharpening, &vpp->sharpen_buf, value))
+            filters[num_filters ++] = vpp->sharpen_buf;
+    }
+
+    VAProcPipelineParameterBuffer pipeline;
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.surface = params->surface;
+    pipeline.surface_region = &params->surface_region;
+    pipeline.output_region = NULL;
+    pipeline.output_background_color = 0xff000000;
+    pipeline.filter_flags = params->hq_scaling ? VA_FILTER_SCALING_HQ : VA_FILTER_SCALING_DEFAULT;
+    pipeline.filters = filters;
+    pipeline.num_filters = num_filters;
+    pipeline.forward_references = forward_refs;
+    pipeline.num_forward_references = num_forward_refs;
+    pipeline.backward_references = backward_refs;
+    pipeline.num_backward_references = num_backward_refs;
+
+    VABufferID pipeline_buf;
+    VAStatus status = vaCreateBuffer(vpp->va_dpy, vpp->context_id,
+                                     VAProcPipelineParameterBufferType, sizeof(pipeline), 1,
+                                     &pipeline, &pipeline_buf);
+    if (VA_STATUS_SUCCESS != status)
+        return VA_INVALID_SURFACE;
+
+    status = vaBeginPicture(vpp->va_dpy, vpp->context_id, vpp->out_surf);
+    if (VA_STATUS_SUCCESS == status)
+        status = vaRenderPicture(vpp->va_dpy, vpp->context_id, &pipeline_buf, 1);
+    if (VA_STATUS_SUCCESS == status)
+        status = vaEndPicture(vpp->va_dpy, vpp->context_id);
+    vaDestroyBuffer(vpp->va_dpy, pipeline_buf);
+
+    if (VA_STATUS_SUCCESS != status) {
+        traceError("error (va_vpp_process): processing failed, status = %d\n", status);
+        return VA_INVALID_SURFACE;
+    }
+
+    return vpp->out_surf;
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2013  Rinat Ibragimov
+ *
+ * This file is part of libvdpau-va-gl
+ *
+ * libvdpau-va-gl distributed under the terms of LGPLv3. See COPYING for details.
+ */
+
+#ifndef __VA_VPP_H
+#define __VA_VPP_H
+
+#include <stdint.h>
+#include <va/va.h>
+#include <va/va_vpp.h>
+
+/** @brief deinterlacing algorithms of video processing pipeline */
+typedef enum {
+    VA_VPP_DEINTERLACE_NONE = 0,        ///< picture is progressive
+    VA_VPP_DEINTERLACE_BOB,
+    VA_VPP_DEINTERLACE_MOTION_ADAPTIVE, ///< requires past and future references
+} va_vpp_deinterlace_t;
+
+/** @brief VA-API video processing pipeline (VAEntrypointVideoProc) state */
+typedef struct {
+    VADisplay               va_dpy;
+    VAConfigID              config_id;
+    VAContextID             context_id;
+    int                     has_bob;            ///< bob deinterlacing supported
+    int                     has_motion_adaptive;///< motion adaptive deinterlacing supported
+    int                     has_denoise;        ///< noise reduction filter supported
+    int                     has_sharpen;        ///< sharpening filter supported
+    VAProcFilterValueRange  denoise_range;
+    VAProcFilterValueRange  sharpen_range;
+    uint32_t                num_forward_refs;   ///< past references needed by motion adaptive
+    uint32_t                num_backward_refs;  ///< future references needed by motion adaptive
+    VABufferID              deint_buf;          ///< filter parameters, VA_INVALID_ID if absent
+    VABufferID              denoise_buf;
+    VABufferID              sharpen_buf;
+    VASurfaceID             out_surf;           ///< output surface, VA_INVALID_SURFACE if absent
+    uint32_t                out_width;
+    uint32_t                out_height;
+} va_vpp_t;
+
+/** @brief parameters of single picture processing */
+typedef struct {
+    VASurfaceID             surface;            ///< source surface
+    VARectangle             surface_region;     ///< part of source surface to be processed
+    uint32_t                out_width;          ///< size picture will be scaled to
+    uint32_t                out_height;
+    va_vpp_deinterlace_t    deinterlace;
+    int                     bottom_field;       ///< 1 if bottom field is current one
+    VASurfaceID             past;               ///< previous field, VA_INVALID_SURFACE if absent
+    VASurfaceID             future;             ///< next field, VA_INVALID_SURFACE if absent
+    float                   denoise_level;      ///< [0, 1], 0 disables filter
+    float                   sharpness_level;    ///< [-1, 1], 0 disables filter
+    int                     hq_scaling;         ///< 1 to request high quality scaling
+} va_vpp_params_t;
+
+/** @brief Create processing context and query filter capabilities
+ *
+ *  @param width, height    size of video to be processed. Drivers use it as a hint only.
+ *  @retval 0 on success
+ *  @retval -1 if video processing is not available
+ */
+int
+va_vpp_create(va_vpp_t *vpp, VADisplay va_dpy, uint32_t width, uint32_t height);
+
+/** @brief Free all resources allocated by va_vpp_create and va_vpp_process */
+void
+va_vpp_destroy(va_vpp_t *vpp);
+
+/** @brief Deinterlace, filter and scale picture on decoding hardware
+ *
+ *  Output surface is owned by vpp and is valid until next va_vpp_process or
+ *  va_vpp_destroy call.
+ *
+ *  @retval output surface, or VA_INVALID_SURFACE on failure
+ */
+VASurfaceID
+va_vpp_process(va_vpp_t *vpp, const va_vpp_params_t *params);
+
+#endif /* __VA_VPP_H */
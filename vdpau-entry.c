@@ -13,6 +13,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "decoder-capture.h"
 #include "handle-storage.h"
 #include "vdpau-soft.h"
 #include "vdpau-locking.h"
@@ -59,6 +60,9 @@ initialize_quirks(void)
     global.quirks.log_thread_id = 0;
     global.quirks.log_call_duration = 0;
     global.quirks.avoid_va = 0;
+    global.quirks.dump_decoder_stats = 0;
+    global.quirks.use_va_vpp = 0;
+    global.quirks.check_gl_errors = 0;
 
     const char *value = getenv("VDPAU_QUIRKS");
     if (!value)
@@ -94,6 +98,15 @@ initialize_quirks(void)
             } else
             if (!strcmp("avoidva", item_start)) {
                 global.quirks.avoid_va = 1;
+            } else
+            if (!strcmp("decoderstats", item_start)) {
+                global.quirks.dump_decoder_stats = 1;
+            } else
+            if (!strcmp("vavpp", item_start)) {
+                global.quirks.use_va_vpp = 1;
+            } else
+            if (!strcmp("checkglerrors", item_start)) {
+                global.quirks.check_gl_errors = 1;
             }
 
             item_start = ptr + 1;
@@ -144,6 +157,15 @@ library_constructor(void)
         }
         free(value_lc);
     }
+
+    global.sw_decoder_threads = 0;
+    value = getenv("VDPAU_SW_DECODER_THREADS");
+    if (value)
+        global.sw_decoder_threads = atoi(value) > 0 ? atoi(value) : 0;
+
+    value = getenv("VDPAU_DECODER_CAPTURE");
+    if (value)
+        decoder_capture_open(value);
 }
 
 __attribute__((destructor))
@@ -151,6 +173,7 @@ static
 void
 library_destructor(void)
 {
+    decoder_capture_close();
     handlestorage_destory();
 }
 
@@ -93,6 +93,18 @@ lockedVdpDecoderGetParameters(VdpDecoder decoder, VdpDecoderProfile *profile,
     return ret;
 }
 
+VdpStatus
+lockedVdpDecoderGetStatsVaGl(VdpDecoder decoder, VdpDecoderStatsVaGl *stats)
+{
+    acquire_lock();
+    traceCallHook(VDP_FUNC_ID_DECODER_GET_STATS_VA_GL, 0, NULL);
+    traceVdpDecoderGetStatsVaGl("{full}", decoder, stats);
+    VdpStatus ret = softVdpDecoderGetStatsVaGl(decoder, stats);
+    traceCallHook(VDP_FUNC_ID_DECODER_GET_STATS_VA_GL, 1, (void*)ret);
+    release_lock();
+    return ret;
+}
+
 VdpStatus
 lockedVdpDecoderRender(VdpDecoder decoder, VdpVideoSurface target,
                        VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
@@ -13,6 +13,7 @@
 #include <vdpau/vdpau_x11.h>
 #include <GL/gl.h>
 #include <GL/glx.h>
+#include "decoder-stats.h"
 #include "globals.h"
 
 VdpStatus
@@ -25,6 +26,7 @@ VdpDecoderCreate lockedVdpDecoderCreate;
 VdpDecoderDestroy lockedVdpDecoderDestroy;
 VdpDecoderGetParameters lockedVdpDecoderGetParameters;
 VdpDecoderRender lockedVdpDecoderRender;
+VdpDecoderGetStatsVaGl lockedVdpDecoderGetStatsVaGl;
 VdpOutputSurfaceQueryCapabilities lockedVdpOutputSurfaceQueryCapabilities;
 VdpOutputSurfaceQueryGetPutBitsNativeCapabilities lockedVdpOutputSurfaceQueryGetPutBitsNativeCapabilities;
 VdpOutputSurfaceQueryPutBitsIndexedCapabilities lockedVdpOutputSurfaceQueryPutBitsIndexedCapabilities;
@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <glib.h>
 #include <libswscale/swscale.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -24,8 +25,16 @@
 #include <GL/glx.h>
 #include "bitstream.h"
 #include "ctx-stack.h"
+#include "decoder-capture.h"
+#include "decoder-stats.h"
+#include "gl-state.h"
 #include "h264-parse.h"
+#include "hevc-parse.h"
+#include "mpeg4-parse.h"
 #include "reverse-constant.h"
+#include "shaders.h"
+#include "sw-decoder.h"
+#include "va-vpp.h"
 #include "handle-storage.h"
 #include "vdpau-trace.h"
 #include "vdpau-locking.h"
@@ -33,7 +42,17 @@
 #include "globals.h"
 
 #define MAX_RENDER_TARGETS          21
+#define DEFAULT_MAX_DECODER_WIDTH   2048    ///< used if VA driver can't report its limits
+#define DEFAULT_MAX_DECODER_HEIGHT  2048
 #define NUM_RENDER_TARGETS_H264     21
+#define NUM_RENDER_TARGETS_MPEG4    21
+#define NUM_RENDER_TARGETS_HEVC     21
+#define MAX_DIRTY_RECTS             4       ///< per frequently accessed bitmap surface
+
+// HEVC needs both VDPAU and VA-API headers to be recent enough
+#if defined(VDP_DECODER_PROFILE_HEVC_MAIN) && VA_CHECK_VERSION(0, 37, 0)
+#define HAVE_HEVC_DECODING
+#endif
 
 
 #define DESCRIBE(xparam, format)    fprintf(stderr, #xparam " = %" #format "\n", xparam)
@@ -48,6 +67,8 @@ typedef struct {
     int             refcount;
     Drawable        drawable;       ///< X drawable to output to
     GLXContext      glc;            ///< GL context used for output
+    int             debug_output;   ///< 1 if glc reports errors via debug callback, 0 if not,
+                                    ///< -1 if that is not known yet
 } VdpPresentationQueueTargetData;
 
 /** @brief VdpPresentationQueue object parameters */
@@ -62,6 +83,32 @@ typedef struct {
 typedef struct {
     HandleType      type;       ///< handle type
     VdpDeviceData  *device;     ///< link to parent
+    VdpColor        background_color;       ///< VDP_VIDEO_MIXER_ATTRIBUTE_BACKGROUND_COLOR
+    VdpCSCMatrix    csc_matrix;             ///< VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX
+    int             csc_matrix_is_default;  ///< 1 if csc_matrix is default BT.601 one
+    float           noise_reduction_level;
+    float           sharpness_level;
+    float           luma_key_min_luma;
+    float           luma_key_max_luma;
+    uint8_t         skip_chroma_deinterlace;
+    VdpBool         deinterlace_temporal;   ///< VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL
+    VdpBool         noise_reduction;        ///< VDP_VIDEO_MIXER_FEATURE_NOISE_REDUCTION
+    VdpBool         sharpness;              ///< VDP_VIDEO_MIXER_FEATURE_SHARPNESS
+    int             vpp_available;          ///< 1 if vpp is used for video processing
+    va_vpp_t        vpp;                    ///< VA-API video processing pipeline
+    GLuint          vpp_tex_id;             ///< texture vpp output is copied to
+    void           *vpp_va_glx;             ///< handle for VA-API/GLX interaction
+    uint32_t        vpp_tex_width;
+    uint32_t        vpp_tex_height;
+    uint32_t        hq_scaling_enables;     ///< bit k is set if HIGH_QUALITY_SCALING_L(k+1) is
+    int             hq_lanczos;             ///< 1 if weights are for Lanczos, 0 for bicubic,
+                                            ///< -1 if weights are not computed yet
+    GLuint          hq_weights_tex_id;      ///< scaler kernel, see shader_scale_separable
+    GLuint          inter_fbo_id;           ///< framebuffer for intermediate pass result, like
+                                            ///< horizontal scaling or deinterlacing
+    GLuint          inter_tex_id;
+    uint32_t        inter_tex_width;
+    uint32_t        inter_tex_height;
 } VdpVideoMixerData;
 
 /** @brief VdpOutputSurface object parameters */
@@ -93,6 +140,7 @@ typedef struct {
     VASurfaceID     va_surf;        ///< VA-API surface
     void           *va_glx;         ///< handle for VA-API/GLX interaction
     GLuint          tex_id;         ///< GL texture id (RGBA)
+    int             tex_valid;      ///< 1 if tex_id holds current content of va_surf
 } VdpVideoSurfaceData;
 
 /** @brief VdpBitmapSurface object parameters */
@@ -100,7 +148,12 @@ typedef struct {
     HandleType      type;               ///< handle type
     VdpDeviceData  *device;             ///< link to parent
     VdpRGBAFormat   rgba_format;        ///< RGBA format of data stored
-    GLuint          tex_id;             ///< GL texture id
+    GLuint          tex_id;             ///< GL texture id, either own or of atlas page
+    uint32_t        tex_width;          ///< size of GL texture
+    uint32_t        tex_height;
+    bitmap_atlas_slot_t atlas_slot;     ///< place in atlas. Page is NULL and offset is zero
+                                        ///< if surface has its own texture
+    uint32_t        batch_serial;       ///< renderer batch surface was last queued to
     uint32_t        width;
     uint32_t        height;
     VdpBool         frequently_accessed;///< 1 if surface should be optimized for frequent access
@@ -109,8 +162,9 @@ typedef struct {
     GLuint          gl_format;          ///< GL texture format: preferred external format
     GLuint          gl_type;            ///< GL texture format: pixel type
     char           *bitmap_data;        ///< system-memory buffer for frequently accessed bitmaps
-    int             dirty;              ///< dirty flag. True if system-memory buffer contains data
-                                        ///< newer than GPU texture contents
+    VdpRect         dirty_rects[MAX_DIRTY_RECTS];   ///< areas where system-memory buffer contains
+                                        ///< data newer than GPU texture contents
+    uint32_t        dirty_rect_count;   ///< 0 if texture is up to date
 } VdpBitmapSurfaceData;
 
 /** @brief VdpDecoder object parameters */
@@ -121,11 +175,20 @@ typedef struct {
     uint32_t            width;
     uint32_t            height;
     uint32_t            max_references; ///< maximum count of reference frames
+    uint32_t            h264_level;     ///< H.264 level estimated from decoder parameters
+    VAProfile           va_profile;     ///< VA-API profile actually used
     VAConfigID          config_id;      ///< VA-API config id
     VASurfaceID         render_targets[MAX_RENDER_TARGETS]; ///< spare VA surfaces
     uint32_t            num_render_targets;
     uint32_t            next_surface_idx;   ///< next free surface in render_targets
     VAContextID         context_id;     ///< VA-API context id
+    int                 mpeg4_last_anchor_vop_type; ///< coding type of last decoded I- or P-VOP
+    unsigned int        rt_format;      ///< VA-API format of surfaces in render_targets
+    int                 interlaced;     ///< 1 if VA context was created for interlaced content
+    h264_sps_t          h264_sps;       ///< last seen H.264 sequence parameter set
+    int                 h264_sps_seen;  ///< true if h264_sps was parsed from bitstream
+    sw_decoder_t       *sw_decoder;     ///< software decoder, used when VA-API is not available
+    VdpDecoderStatsVaGl stats;          ///< performance counters
 } VdpDecoderData;
 
 
@@ -137,10 +200,53 @@ chroma_storage_size_divider(VdpChromaType chroma_type)
     case VDP_CHROMA_TYPE_420: return 4;
     case VDP_CHROMA_TYPE_422: return 2;
     case VDP_CHROMA_TYPE_444: return 1;
+#ifdef VDP_CHROMA_TYPE_420_16
+    case VDP_CHROMA_TYPE_420_16: return 4;
+    case VDP_CHROMA_TYPE_422_16: return 2;
+    case VDP_CHROMA_TYPE_444_16: return 1;
+#endif
     default: return 1;
     }
 }
 
+static
+uint32_t
+chroma_bytes_per_sample(VdpChromaType chroma_type)
+{
+    switch (chroma_type) {
+#ifdef VDP_CHROMA_TYPE_420_16
+    case VDP_CHROMA_TYPE_420_16:
+    case VDP_CHROMA_TYPE_422_16:
+    case VDP_CHROMA_TYPE_444_16:
+        return 2;
+#endif
+    default:
+        return 1;
+    }
+}
+
+/** @brief VA-API render target format for given chroma type. Zero if there is no such */
+static
+unsigned int
+chroma_type_to_va_rt_format(VdpChromaType chroma_type)
+{
+    switch (chroma_type) {
+    case VDP_CHROMA_TYPE_420: return VA_RT_FORMAT_YUV420;
+    case VDP_CHROMA_TYPE_422: return VA_RT_FORMAT_YUV422;
+    case VDP_CHROMA_TYPE_444: return VA_RT_FORMAT_YUV444;
+#if defined(VDP_CHROMA_TYPE_420_16) && defined(VA_RT_FORMAT_YUV420_10BPP)
+    case VDP_CHROMA_TYPE_420_16: return VA_RT_FORMAT_YUV420_10BPP;
+#endif
+#if defined(VDP_CHROMA_TYPE_422_16) && defined(VA_RT_FORMAT_YUV422_10)
+    case VDP_CHROMA_TYPE_422_16: return VA_RT_FORMAT_YUV422_10;
+#endif
+#if defined(VDP_CHROMA_TYPE_444_16) && defined(VA_RT_FORMAT_YUV444_10)
+    case VDP_CHROMA_TYPE_444_16: return VA_RT_FORMAT_YUV444_10;
+#endif
+    default: return 0;
+    }
+}
+
 static
 const char *
 softVdpGetErrorString(VdpStatus status)
@@ -155,6 +261,77 @@ softVdpGetApiVersion(uint32_t *api_version)
     return VDP_STATUS_OK;
 }
 
+static
+const VdpVaDecoderCaps *
+find_va_decoder_caps(VdpDeviceData *deviceData, VAProfile profile)
+{
+    for (int k = 0; k < deviceData->va_decoder_caps_count; k ++)
+        if (profile == deviceData->va_decoder_caps[k].profile)
+            return &deviceData->va_decoder_caps[k];
+    return NULL;
+}
+
+/** @brief Fill VA decoder capabilities cache. Called once, on device creation */
+static
+void
+query_va_decoder_caps(VdpDeviceData *deviceData)
+{
+    VADisplay va_dpy = deviceData->va_dpy;
+    deviceData->va_decoder_caps_count = 0;
+
+    VAProfile *va_profile_list = malloc(sizeof(VAProfile) * vaMaxNumProfiles(va_dpy));
+    VAEntrypoint *entrypoint_list = malloc(sizeof(VAEntrypoint) * vaMaxNumEntrypoints(va_dpy));
+    if (NULL == va_profile_list || NULL == entrypoint_list)
+        goto quit;
+
+    int num_profiles;
+    if (VA_STATUS_SUCCESS != vaQueryConfigProfiles(va_dpy, va_profile_list, &num_profiles))
+        goto quit;
+
+    for (int k = 0; k < num_profiles; k ++) {
+        if (deviceData->va_decoder_caps_count >= MAX_VA_DECODER_PROFILES)
+            break;
+
+        int num_entrypoints;
+        int has_vld = 0;
+        VAStatus status = vaQueryConfigEntrypoints(va_dpy, va_profile_list[k], entrypoint_list,
+                                                   &num_entrypoints);
+        if (VA_STATUS_SUCCESS != status)
+            continue;
+        for (int j = 0; j < num_entrypoints; j ++)
+            if (VAEntrypointVLD == entrypoint_list[j])
+                has_vld = 1;
+        if (!has_vld)
+            continue;
+
+        VdpVaDecoderCaps *caps = &deviceData->va_decoder_caps[deviceData->va_decoder_caps_count];
+        caps->profile = va_profile_list[k];
+        caps->max_width = DEFAULT_MAX_DECODER_WIDTH;
+        caps->max_height = DEFAULT_MAX_DECODER_HEIGHT;
+
+#if VA_CHECK_VERSION(0, 37, 0)
+        VAConfigAttrib attribs[2] = {
+            { .type = VAConfigAttribMaxPictureWidth },
+            { .type = VAConfigAttribMaxPictureHeight }
+        };
+        status = vaGetConfigAttributes(va_dpy, va_profile_list[k], VAEntrypointVLD, attribs, 2);
+        if (VA_STATUS_SUCCESS == status) {
+            if (VA_ATTRIB_NOT_SUPPORTED != attribs[0].value && 0 != attribs[0].value)
+                caps->max_width = attribs[0].value;
+            if (VA_ATTRIB_NOT_SUPPORTED != attribs[1].value && 0 != attribs[1].value)
+                caps->max_height = attribs[1].value;
+        }
+#endif
+        traceInfo("VA profile %d: max picture size %dx%d\n", caps->profile, caps->max_width,
+                  caps->max_height);
+        deviceData->va_decoder_caps_count ++;
+    }
+
+quit:
+    free(va_profile_list);
+    free(entrypoint_list);
+}
+
 VdpStatus
 softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, VdpBool *is_supported,
                                 uint32_t *max_level, uint32_t *max_macroblocks,
@@ -176,21 +353,17 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
     *max_height = 0;
 
     if (! deviceData->va_available) {
-        *is_supported = 0;
+        // software decoder
+        *is_supported = sw_decoder_profile_supported(profile);
+        if (*is_supported) {
+            *max_level = VDP_DECODER_LEVEL_H264_5_1;
+            *max_width = SW_DECODER_MAX_WIDTH;
+            *max_height = SW_DECODER_MAX_HEIGHT;
+            *max_macroblocks = (*max_width / 16) * (*max_height / 16);
+        }
         return VDP_STATUS_OK;
     }
 
-    VAProfile *va_profile_list = malloc(sizeof(VAProfile) * vaMaxNumProfiles(deviceData->va_dpy));
-    if (NULL == va_profile_list)
-        return VDP_STATUS_RESOURCES;
-
-    int num_profiles;
-    VAStatus status = vaQueryConfigProfiles(deviceData->va_dpy, va_profile_list, &num_profiles);
-    if (VA_STATUS_SUCCESS != status) {
-        free(va_profile_list);
-        return VDP_STATUS_ERROR;
-    }
-
     struct {
         int mpeg2_simple;
         int mpeg2_main;
@@ -200,10 +373,14 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
         int vc1_simple;
         int vc1_main;
         int vc1_advanced;
-    } available_profiles = {0, 0, 0, 0, 0, 0, 0, 0};
-
-    for (int k = 0; k < num_profiles; k ++) {
-        switch (va_profile_list[k]) {
+        int mpeg4_simple;
+        int mpeg4_advanced_simple;
+        int hevc_main;
+        int hevc_main10;
+    } available_profiles = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+    for (int k = 0; k < deviceData->va_decoder_caps_count; k ++) {
+        switch (deviceData->va_decoder_caps[k].profile) {
         case VAProfileMPEG2Main:
             available_profiles.mpeg2_main = 0;
             /* fall through */
@@ -233,6 +410,26 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
             available_profiles.vc1_simple = 0;
             break;
 
+        case VAProfileMPEG4AdvancedSimple:
+            available_profiles.mpeg4_advanced_simple = 1;
+            /* fall through */
+        case VAProfileMPEG4Simple:
+            available_profiles.mpeg4_simple = 1;
+            /* fall through */
+        case VAProfileMPEG4Main:
+            break;
+
+#ifdef HAVE_HEVC_DECODING
+        case VAProfileHEVCMain:
+            available_profiles.hevc_main = 1;
+            break;
+        case VAProfileHEVCMain10:
+#ifdef VA_RT_FORMAT_YUV420_10BPP
+            available_profiles.hevc_main10 = 1;
+#endif
+            break;
+#endif
+
         // unhandled profiles
         case VAProfileH263Baseline:
         case VAProfileJPEGBaseline:
@@ -241,13 +438,11 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
             break;
         }
     }
-    free(va_profile_list);
+
+    // VA profiles which could be used for decoding, in order of preference
+    VAProfile va_profiles[3] = { VAProfileNone, VAProfileNone, VAProfileNone };
 
     *is_supported = 0;
-    // TODO: How to determine max width and height width libva?
-    *max_width = 2048;
-    *max_height = 2048;
-    *max_macroblocks = 16384;
     switch (profile) {
     case VDP_DECODER_PROFILE_MPEG2_SIMPLE:
         *is_supported = available_profiles.mpeg2_simple;
@@ -260,15 +455,21 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
 
     case VDP_DECODER_PROFILE_H264_BASELINE:
         *is_supported = available_profiles.h264_baseline;
+        va_profiles[0] = VAProfileH264Baseline;
+        va_profiles[1] = VAProfileH264Main;
+        va_profiles[2] = VAProfileH264High;
         // TODO: Do underlying libva really support 5.1?
         *max_level = VDP_DECODER_LEVEL_H264_5_1;
         break;
     case VDP_DECODER_PROFILE_H264_MAIN:
         *is_supported = available_profiles.h264_main;
+        va_profiles[0] = VAProfileH264Main;
+        va_profiles[1] = VAProfileH264High;
         *max_level = VDP_DECODER_LEVEL_H264_5_1;
         break;
     case VDP_DECODER_PROFILE_H264_HIGH:
         *is_supported = available_profiles.h264_high;
+        va_profiles[0] = VAProfileH264High;
         *max_level = VDP_DECODER_LEVEL_H264_5_1;
         break;
 
@@ -285,10 +486,19 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
         *max_level = VDP_DECODER_LEVEL_VC1_ADVANCED_L4;
         break;
 
-    // unsupported
-    case VDP_DECODER_PROFILE_MPEG1:
     case VDP_DECODER_PROFILE_MPEG4_PART2_SP:
+        *is_supported = available_profiles.mpeg4_simple;
+        va_profiles[0] = VAProfileMPEG4Simple;
+        va_profiles[1] = VAProfileMPEG4AdvancedSimple;
+        *max_level = VDP_DECODER_LEVEL_MPEG4_PART2_SP_L3;
+        break;
     case VDP_DECODER_PROFILE_MPEG4_PART2_ASP:
+        *is_supported = available_profiles.mpeg4_advanced_simple;
+        va_profiles[0] = VAProfileMPEG4AdvancedSimple;
+        *max_level = VDP_DECODER_LEVEL_MPEG4_PART2_ASP_L5;
+        break;
+
+    // DivX profiles are subsets of MPEG-4 Advanced Simple Profile
     case VDP_DECODER_PROFILE_DIVX4_QMOBILE:
     case VDP_DECODER_PROFILE_DIVX4_MOBILE:
     case VDP_DECODER_PROFILE_DIVX4_HOME_THEATER:
@@ -297,10 +507,128 @@ softVdpDecoderQueryCapabilities(VdpDevice device, VdpDecoderProfile profile, Vdp
     case VDP_DECODER_PROFILE_DIVX5_MOBILE:
     case VDP_DECODER_PROFILE_DIVX5_HOME_THEATER:
     case VDP_DECODER_PROFILE_DIVX5_HD_1080P:
+        *is_supported = available_profiles.mpeg4_advanced_simple;
+        va_profiles[0] = VAProfileMPEG4AdvancedSimple;
+        *max_level = VDP_DECODER_LEVEL_DIVX_NA;
+        break;
+
+#ifdef HAVE_HEVC_DECODING
+    case VDP_DECODER_PROFILE_HEVC_MAIN:
+    case VDP_DECODER_PROFILE_HEVC_MAIN_STILL:
+        *is_supported = available_profiles.hevc_main;
+        va_profiles[0] = VAProfileHEVCMain;
+        *max_level = VDP_DECODER_LEVEL_HEVC_5_1;
+        break;
+    case VDP_DECODER_PROFILE_HEVC_MAIN_10:
+        *is_supported = available_profiles.hevc_main10;
+        va_profiles[0] = VAProfileHEVCMain10;
+        *max_level = VDP_DECODER_LEVEL_HEVC_5_1;
+        break;
+#endif
+
+    // unsupported
+    case VDP_DECODER_PROFILE_MPEG1:
     default:
         break;
     }
 
+    *max_width = DEFAULT_MAX_DECODER_WIDTH;
+    *max_height = DEFAULT_MAX_DECODER_HEIGHT;
+    for (int j = 0; j < 3 && VAProfileNone != va_profiles[j]; j ++) {
+        const VdpVaDecoderCaps *caps = find_va_decoder_caps(deviceData, va_profiles[j]);
+        if (caps) {
+            *max_width = caps->max_width;
+            *max_height = caps->max_height;
+            break;
+        }
+    }
+    *max_macroblocks = (*max_width / 16) * (*max_height / 16);
+
+    return VDP_STATUS_OK;
+}
+
+/** @brief Guess H.264 level from frame size and DPB size given to VdpDecoderCreate
+ *
+ *  Lowest level from table A-1 which allows such stream is chosen.
+ */
+static
+uint32_t
+h264_level_from_decoder_params(uint32_t width, uint32_t height, uint32_t max_references)
+{
+    static const struct {
+        uint32_t level;
+        uint32_t max_fs;        ///< maximum frame size, in macroblocks
+        uint32_t max_dpb_mbs;   ///< maximum decoded picture buffer size, in macroblocks
+    } limits[] = {
+        {10, 99, 396},      {11, 396, 900},     {12, 396, 2376},    {13, 396, 2376},
+        {20, 396, 2376},    {21, 792, 4752},    {22, 1620, 8100},   {30, 1620, 8100},
+        {31, 3600, 18000},  {32, 5120, 20480},  {40, 8192, 32768},  {41, 8192, 32768},
+        {42, 8704, 34816},  {50, 22080, 110400},{51, 36864, 184320},{52, 36864, 184320},
+    };
+    const uint32_t frame_size_mbs = ((width + 15) / 16) * ((height + 15) / 16);
+
+    for (unsigned int k = 0; k < sizeof(limits) / sizeof(limits[0]); k ++) {
+        if (frame_size_mbs <= limits[k].max_fs &&
+            frame_size_mbs * max_references <= limits[k].max_dpb_mbs)
+        {
+            return limits[k].level;
+        }
+    }
+    return 52;
+}
+
+/** @brief Create pool of VA surfaces and VA context bound to them */
+static
+VAStatus
+decoder_create_va_surfaces(VdpDecoderData *data, unsigned int rt_format)
+{
+    VADisplay va_dpy = data->device->va_dpy;
+    VAStatus status;
+
+#if VA_CHECK_VERSION(0, 34, 0)
+    status = vaCreateSurfaces(va_dpy, rt_format, data->width, data->height,
+        data->render_targets, data->num_render_targets, NULL, 0);
+#else
+    status = vaCreateSurfaces(va_dpy, data->width, data->height, rt_format,
+        data->num_render_targets, data->render_targets);
+#endif
+    if (VA_STATUS_SUCCESS != status)
+        return status;
+
+    status = vaCreateContext(va_dpy, data->config_id, data->width, data->height,
+        data->interlaced ? 0 : VA_PROGRESSIVE,
+        data->render_targets, data->num_render_targets, &data->context_id);
+    if (VA_STATUS_SUCCESS != status) {
+        vaDestroySurfaces(va_dpy, data->render_targets, data->num_render_targets);
+        return status;
+    }
+
+    data->rt_format = rt_format;
+    data->next_surface_idx = 0;
+    return VA_STATUS_SUCCESS;
+}
+
+/** @brief Recreate VA context for interlaced content
+ *
+ *  Whether stream is interlaced becomes known on first VdpDecoderRender only. Surfaces
+ *  are kept, so decoded pictures already bound to video surfaces stay intact.
+ */
+static
+VdpStatus
+decoder_switch_to_interlaced(VdpDecoderData *data)
+{
+    VADisplay va_dpy = data->device->va_dpy;
+
+    vaDestroyContext(va_dpy, data->context_id);
+    VAStatus status = vaCreateContext(va_dpy, data->config_id, data->width, data->height, 0,
+        data->render_targets, data->num_render_targets, &data->context_id);
+    if (VA_STATUS_SUCCESS != status) {
+        traceError("error (softVdpDecoderRender): can't create interlaced VA context\n");
+        data->context_id = VA_INVALID_ID;
+        return VDP_STATUS_ERROR;
+    }
+
+    data->interlaced = 1;
     return VDP_STATUS_OK;
 }
 
@@ -312,10 +640,23 @@ softVdpDecoderCreate(VdpDevice device, VdpDecoderProfile profile, uint32_t width
     VdpDeviceData *deviceData = handlestorage_get(device, HANDLETYPE_DEVICE);
     if (NULL == deviceData)
         return VDP_STATUS_INVALID_HANDLE;
-    if (!deviceData->va_available)
-        return VDP_STATUS_INVALID_DECODER_PROFILE;
     VADisplay va_dpy = deviceData->va_dpy;
 
+    // limits are the same as VdpDecoderQueryCapabilities reports, so oversized decoders fail
+    // here rather than somewhere inside vaCreateContext
+    VdpBool is_supported;
+    uint32_t max_level, max_macroblocks, max_width, max_height;
+    retval = softVdpDecoderQueryCapabilities(device, profile, &is_supported, &max_level,
+                                             &max_macroblocks, &max_width, &max_height);
+    if (VDP_STATUS_OK != retval)
+        return retval;
+    if (is_supported && (width > max_width || height > max_height)) {
+        traceError("error (softVdpDecoderCreate): %ux%u exceeds maximum size %ux%u of %s\n",
+                   width, height, max_width, max_height, reverse_decoder_profile(profile));
+        return VDP_STATUS_INVALID_SIZE;
+    }
+    retval = VDP_STATUS_ERROR;
+
     VdpDecoderData *data = calloc(1, sizeof(VdpDecoderData));
     if (NULL == data)
         return VDP_STATUS_RESOURCES;
@@ -326,10 +667,34 @@ softVdpDecoderCreate(VdpDevice device, VdpDecoderProfile profile, uint32_t width
     data->width = width;
     data->height = height;
     data->max_references = max_references;
+    data->h264_level = h264_level_from_decoder_params(width, height, max_references);
     data->next_surface_idx = 0;
+    data->mpeg4_last_anchor_vop_type = VOP_TYPE_I;
+    data->h264_sps_seen = 0;
+    data->interlaced = 0;
+    data->sw_decoder = NULL;
+    decoder_stats_init(&data->stats);
+
+    if (!deviceData->va_available) {
+        // without VA-API only software H.264 decoding is possible
+        if (!sw_decoder_profile_supported(profile)) {
+            retval = VDP_STATUS_INVALID_DECODER_PROFILE;
+            goto error;
+        }
+        data->sw_decoder = sw_decoder_create(profile, width, height, data->h264_level,
+                                             global.sw_decoder_threads);
+        if (NULL == data->sw_decoder) {
+            retval = VDP_STATUS_RESOURCES;
+            goto error;
+        }
+        deviceData->refcount ++;
+        *decoder = handlestorage_add(data);
+        return VDP_STATUS_OK;
+    }
 
     VAProfile va_profile;
     VAStatus status;
+    unsigned int rt_format = VA_RT_FORMAT_YUV420;
     int final_try = 0;
     VdpDecoderProfile next_profile = profile;
 
@@ -353,6 +718,41 @@ softVdpDecoderCreate(VdpDevice device, VdpDecoderProfile profile, uint32_t width
             // there is no more advanced profile, so it's final try
             final_try = 1;
             break;
+        case VDP_DECODER_PROFILE_MPEG4_PART2_SP:
+            va_profile = VAProfileMPEG4Simple;
+            data->num_render_targets = NUM_RENDER_TARGETS_MPEG4;
+            next_profile = VDP_DECODER_PROFILE_MPEG4_PART2_ASP;
+            break;
+        case VDP_DECODER_PROFILE_MPEG4_PART2_ASP:
+        case VDP_DECODER_PROFILE_DIVX4_QMOBILE:
+        case VDP_DECODER_PROFILE_DIVX4_MOBILE:
+        case VDP_DECODER_PROFILE_DIVX4_HOME_THEATER:
+        case VDP_DECODER_PROFILE_DIVX4_HD_1080P:
+        case VDP_DECODER_PROFILE_DIVX5_QMOBILE:
+        case VDP_DECODER_PROFILE_DIVX5_MOBILE:
+        case VDP_DECODER_PROFILE_DIVX5_HOME_THEATER:
+        case VDP_DECODER_PROFILE_DIVX5_HD_1080P:
+            va_profile = VAProfileMPEG4AdvancedSimple;
+            data->num_render_targets = NUM_RENDER_TARGETS_MPEG4;
+            final_try = 1;
+            break;
+#ifdef HAVE_HEVC_DECODING
+        case VDP_DECODER_PROFILE_HEVC_MAIN:
+        case VDP_DECODER_PROFILE_HEVC_MAIN_STILL:
+            // Main10 decoder would produce 10-bit surfaces, so there is no fallback
+            va_profile = VAProfileHEVCMain;
+            data->num_render_targets = NUM_RENDER_TARGETS_HEVC;
+            final_try = 1;
+            break;
+#ifdef VA_RT_FORMAT_YUV420_10BPP
+        case VDP_DECODER_PROFILE_HEVC_MAIN_10:
+            va_profile = VAProfileHEVCMain10;
+            rt_format = VA_RT_FORMAT_YUV420_10BPP;  // P010 surfaces
+            data->num_render_targets = NUM_RENDER_TARGETS_HEVC;
+            final_try = 1;
+            break;
+#endif
+#endif
         default:
             traceError("error (softVdpDecoderCreate): decoder %s not implemented\n",
                        reverse_decoder_profile(profile));
@@ -367,25 +767,16 @@ softVdpDecoderCreate(VdpDevice device, VdpDecoderProfile profile, uint32_t width
 
     if (VA_STATUS_SUCCESS != status)
         goto error;
+    data->va_profile = va_profile;
 
     // Create surfaces. All video surfaces created here, rather than in VdpVideoSurfaceCreate.
     // VAAPI requires surfaces to be bound with context on its creation time, while VDPAU allows
     // to do it later. So here is a trick: VDP video surfaces get their va_surf dynamically in
     // DecoderRender.
 
-    // TODO: check format of surfaces created
-#if VA_CHECK_VERSION(0, 34, 0)
-    status = vaCreateSurfaces(va_dpy, VA_RT_FORMAT_YUV420, width, height,
-        data->render_targets, data->num_render_targets, NULL, 0);
-#else
-    status = vaCreateSurfaces(va_dpy, width, height, VA_RT_FORMAT_YUV420,
-        data->num_render_targets, data->render_targets);
-#endif
-    if (VA_STATUS_SUCCESS != status)
-        goto error;
-
-    status = vaCreateContext(va_dpy, data->config_id, width, height, VA_PROGRESSIVE,
-        data->render_targets, data->num_render_targets, &data->context_id);
+    // H.264 streams may need another surface format. It will be changed on first
+    // VdpDecoderRender call, when chroma type of target surface becomes known.
+    status = decoder_create_va_surfaces(data, rt_format);
     if (VA_STATUS_SUCCESS != status)
         goto error;
 
@@ -406,12 +797,16 @@ softVdpDecoderDestroy(VdpDecoder decoder)
         return VDP_STATUS_INVALID_HANDLE;
     VdpDeviceData *deviceData = decoderData->device;
 
+    if (global.quirks.dump_decoder_stats)
+        decoder_stats_dump(&decoderData->stats, decoder, decoderData->profile);
+
     if (deviceData->va_available) {
         VADisplay va_dpy = deviceData->va_dpy;
         vaDestroySurfaces(va_dpy, decoderData->render_targets, decoderData->num_render_targets);
         vaDestroyContext(va_dpy, decoderData->context_id);
         vaDestroyConfig(va_dpy, decoderData->config_id);
     }
+    sw_decoder_destroy(decoderData->sw_decoder);
 
     handlestorage_expunge(decoder);
     deviceData->refcount --;
@@ -437,20 +832,69 @@ softVdpDecoderGetParameters(VdpDecoder decoder, VdpDecoderProfile *profile,
     return VDP_STATUS_OK;
 }
 
+VdpStatus
+softVdpDecoderGetStatsVaGl(VdpDecoder decoder, VdpDecoderStatsVaGl *stats)
+{
+    VdpDecoderData *decoderData = handlestorage_get(decoder, HANDLETYPE_DECODER);
+    if (NULL == decoderData)
+        return VDP_STATUS_INVALID_HANDLE;
+
+    if (NULL == stats)
+        return VDP_STATUS_INVALID_POINTER;
+
+    *stats = decoderData->stats;
+    return VDP_STATUS_OK;
+}
+
+/** @brief Bind VA surface from decoder pool to video surface, if it haven't one yet */
 static
 VdpStatus
-h264_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData *decoderData,
-                                VAPictureParameterBufferH264 *pic_param,
-                                const VdpPictureInfoH264 *vdppi)
+decoder_bind_va_surface(VdpDecoderData *decoderData, VdpVideoSurfaceData *surfData)
 {
     // take new VA surface from buffer if needed
-    if (VA_INVALID_SURFACE == dstSurfData->va_surf) {
+    if (VA_INVALID_SURFACE == surfData->va_surf) {
         if (decoderData->next_surface_idx >= decoderData->num_render_targets)
             return VDP_STATUS_RESOURCES;
-        dstSurfData->va_surf = decoderData->render_targets[decoderData->next_surface_idx];
+        surfData->va_surf = decoderData->render_targets[decoderData->next_surface_idx];
         decoderData->next_surface_idx ++;
     }
 
+    return VDP_STATUS_OK;
+}
+
+/** @brief Concatenate all bitstream buffers into one. Caller should free result */
+static
+uint8_t *
+decoder_merge_bitstream_buffers(uint32_t bitstream_buffer_count,
+                                VdpBitstreamBuffer const *bitstream_buffers, int *total_bytes)
+{
+    int total_bitstream_bytes = 0;
+    for (unsigned int k = 0; k < bitstream_buffer_count; k ++)
+        total_bitstream_bytes += bitstream_buffers[k].bitstream_bytes;
+
+    uint8_t *merged_bitstream = malloc(total_bitstream_bytes);
+    if (NULL == merged_bitstream)
+        return NULL;
+
+    unsigned char *ptr = merged_bitstream;
+    for (unsigned int k = 0; k < bitstream_buffer_count; k ++) {
+        memcpy(ptr, bitstream_buffers[k].bitstream, bitstream_buffers[k].bitstream_bytes);
+        ptr += bitstream_buffers[k].bitstream_bytes;
+    }
+
+    *total_bytes = total_bitstream_bytes;
+    return merged_bitstream;
+}
+
+static
+VdpStatus
+h264_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData *decoderData,
+                                VAPictureParameterBufferH264 *pic_param,
+                                const VdpPictureInfoH264 *vdppi)
+{
+    if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, dstSurfData))
+        return VDP_STATUS_RESOURCES;
+
     // current frame
     pic_param->CurrPic.picture_id   = dstSurfData->va_surf;
     pic_param->CurrPic.frame_idx    = vdppi->frame_num;
@@ -462,17 +906,32 @@ h264_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData
 
     pic_param->CurrPic.TopFieldOrderCnt     = vdppi->field_order_cnt[0];
     pic_param->CurrPic.BottomFieldOrderCnt  = vdppi->field_order_cnt[1];
+    // field pictures have order count of their own parity only
+    if (vdppi->field_pic_flag) {
+        if (vdppi->bottom_field_flag)
+            pic_param->CurrPic.TopFieldOrderCnt = 0;
+        else
+            pic_param->CurrPic.BottomFieldOrderCnt = 0;
+    }
 
     // mark all pictures invalid preliminary
     for (int k = 0; k < 16; k ++)
         reset_va_picture_h264(&pic_param->ReferenceFrames[k]);
 
-    // reference frames
-    for (int k = 0; k < vdppi->num_ref_frames; k ++) {
+    // Reference frames. When decoding second field of a frame, the first one is listed
+    // here too, with the same surface as target has. Thus both fields land in one
+    // VA surface.
+    for (int k = 0; k < 16; k ++) {
         if (VDP_INVALID_HANDLE == vdppi->referenceFrames[k].surface) {
             reset_va_picture_h264(&pic_param->ReferenceFrames[k]);
             continue;
         }
+        if (!vdppi->referenceFrames[k].top_is_reference &&
+            !vdppi->referenceFrames[k].bottom_is_reference)
+        {
+            reset_va_picture_h264(&pic_param->ReferenceFrames[k]);
+            continue;
+        }
 
         VdpReferenceFrameH264 const *vdp_ref = &(vdppi->referenceFrames[k]);
         VdpVideoSurfaceData *vdpSurfData =
@@ -483,13 +942,8 @@ h264_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData
             return VDP_STATUS_ERROR;
         }
 
-        // take new VA surface from buffer if needed
-        if (VA_INVALID_SURFACE == vdpSurfData->va_surf) {
-            if (decoderData->next_surface_idx >= decoderData->num_render_targets)
-                return VDP_STATUS_RESOURCES;
-            vdpSurfData->va_surf = decoderData->render_targets[decoderData->next_surface_idx];
-            decoderData->next_surface_idx ++;
-        }
+        if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, vdpSurfData))
+            return VDP_STATUS_RESOURCES;
 
         va_ref->picture_id = vdpSurfData->va_surf;
         va_ref->frame_idx = vdp_ref->frame_idx;
@@ -515,18 +969,21 @@ h264_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData
 static
 void
 h264_translate_pic_param(VAPictureParameterBufferH264 *pic_param, uint32_t width, uint32_t height,
-                         const VdpPictureInfoH264 *vdppi, uint32_t level)
+                         const VdpPictureInfoH264 *vdppi, uint32_t level, const h264_sps_t *sps)
 {
         pic_param->picture_width_in_mbs_minus1          = (width - 1) / 16;
         pic_param->picture_height_in_mbs_minus1         = (height - 1) / 16;
-        pic_param->bit_depth_luma_minus8                = 0; // TODO: deal with more than 8 bits
-        pic_param->bit_depth_chroma_minus8              = 0; // same for luma
+        // interlaced frames consist of macroblock pairs, so height is even in macroblocks
+        if (!vdppi->frame_mbs_only_flag)
+            pic_param->picture_height_in_mbs_minus1 |= 1;
+        pic_param->bit_depth_luma_minus8                = sps->bit_depth_luma_minus8;
+        pic_param->bit_depth_chroma_minus8              = sps->bit_depth_chroma_minus8;
         pic_param->num_ref_frames                       = vdppi->num_ref_frames;
 
 #define SEQ_FIELDS(fieldname) pic_param->seq_fields.bits.fieldname
 #define PIC_FIELDS(fieldname) pic_param->pic_fields.bits.fieldname
 
-        SEQ_FIELDS(chroma_format_idc)                   = 1; // TODO: not only YUV420
+        SEQ_FIELDS(chroma_format_idc)                   = sps->chroma_format_idc;
         SEQ_FIELDS(residual_colour_transform_flag)      = 0;
         SEQ_FIELDS(gaps_in_frame_num_value_allowed_flag)= 0;
         SEQ_FIELDS(frame_mbs_only_flag)                 = vdppi->frame_mbs_only_flag;
@@ -573,185 +1030,1069 @@ h264_translate_iq_matrix(VAIQMatrixBufferH264 *iq_matrix, const VdpPictureInfoH2
             iq_matrix->ScalingList8x8[j][k] = vdppi->scaling_lists_8x8[j][k];
 }
 
+/** @brief Determine chroma format and bit depth of H.264 stream and adjust VA surfaces
+ *
+ *  VDPAU doesn't pass chroma format and bit depth to decoder, and clients usually pass slice
+ *  NAL units only, without sequence parameter sets. So format is derived from decoder profile
+ *  and chroma type of target surface. Baseline and Main profiles are 8-bit 4:2:0 only. High
+ *  profile is also used for High 10 and High 4:2:2 streams, as VDPAU has no separate profiles
+ *  for them. Sequence parameter set, if there is one, gives stream level.
+ */
+static
 VdpStatus
-softVdpDecoderRender(VdpDecoder decoder, VdpVideoSurface target,
-                     VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
-                     VdpBitstreamBuffer const *bitstream_buffers)
+h264_update_stream_format(VdpDecoderData *decoderData, VdpVideoSurfaceData *dstSurfData,
+                          const uint8_t *bitstream, int bitstream_bytes)
 {
-    VdpDecoderData *decoderData = handlestorage_get(decoder, HANDLETYPE_DECODER);
-    VdpVideoSurfaceData *dstSurfData = handlestorage_get(target, HANDLETYPE_VIDEO_SURFACE);
-    if (NULL == decoderData || NULL == dstSurfData)
-        return VDP_STATUS_INVALID_HANDLE;
-    VdpDeviceData *deviceData = decoderData->device;
-    VADisplay va_dpy = deviceData->va_dpy;
-    VAStatus status;
-    VdpStatus vs;
+    rbsp_state_t st_g;
+    rbsp_attach_buffer(&st_g, bitstream, bitstream_bytes);
+    int nal_offset;
+    while ((nal_offset = rbsp_navigate_to_nal_unit(&st_g)) >= 0) {
+        if (nal_offset >= bitstream_bytes)
+            break;
+        const int nal_unit_type = bitstream[nal_offset] & 0x1f;
+        // parameter sets come before slices, there is no need to scan slice data
+        if (NAL_SLICE == nal_unit_type || NAL_IDR_SLICE == nal_unit_type)
+            break;
+        if (NAL_SEQ_PARAM == nal_unit_type) {
+            rbsp_state_t st = rbsp_copy_state(&st_g);
+            parse_seq_parameter_set(&st, &decoderData->h264_sps);
+            decoderData->h264_sps_seen = 1;
+        }
+    }
 
-    if (VDP_DECODER_PROFILE_H264_BASELINE == decoderData->profile ||
-        VDP_DECODER_PROFILE_H264_MAIN ==     decoderData->profile ||
-        VDP_DECODER_PROFILE_H264_HIGH ==     decoderData->profile)
-    {
-        VdpPictureInfoH264 const *vdppi = (void *)picture_info;
+    const VdpChromaType chroma_type = dstSurfData->chroma_type;
+    unsigned int rt_format = chroma_type_to_va_rt_format(chroma_type);
+    if (VDP_DECODER_PROFILE_H264_HIGH != decoderData->profile && VA_RT_FORMAT_YUV420 != rt_format)
+        rt_format = 0;
+    if (0 == rt_format) {
+        traceError("error (softVdpDecoderRender): %s can't be decoded into %s surface\n",
+                   reverse_decoder_profile(decoderData->profile),
+                   reverse_chroma_type(chroma_type));
+        return VDP_STATUS_INVALID_CHROMA_TYPE;
+    }
 
-        // TODO: figure out where to get level
-        uint32_t level = 41;
+    // picture parameters follow target format, whatever sequence parameter set says
+    h264_sps_t *sps = &decoderData->h264_sps;
+    const unsigned int bit_depth_minus8 = (2 == chroma_bytes_per_sample(chroma_type)) ? 2 : 0;
+    sps->separate_colour_plane_flag = 0;
+    sps->bit_depth_luma_minus8 = bit_depth_minus8;
+    sps->bit_depth_chroma_minus8 = bit_depth_minus8;
+    switch (chroma_storage_size_divider(chroma_type)) {
+    case 2:  sps->chroma_format_idc = 2; break;
+    case 1:  sps->chroma_format_idc = 3; break;
+    default: sps->chroma_format_idc = 1; break;
+    }
 
-        // preparing picture parameters
-        VABufferID pic_param_buf;
-        VAPictureParameterBufferH264 *pic_param;
+    if (rt_format == decoderData->rt_format)
+        return VDP_STATUS_OK;
 
-        status = vaCreateBuffer(va_dpy, decoderData->context_id, VAPictureParameterBufferType,
-            sizeof(VAPictureParameterBufferH264), 1, NULL, &pic_param_buf);
-        if (VA_STATUS_SUCCESS != status)
-            goto error;
+    // VA surfaces could only be replaced before any of them was given to video surfaces
+    if (decoderData->next_surface_idx > 0) {
+        traceError("error (softVdpDecoderRender): H.264 stream format changed mid-stream\n");
+        return VDP_STATUS_ERROR;
+    }
 
-        status = vaMapBuffer(va_dpy, pic_param_buf, (void **)&pic_param);
+    VADisplay va_dpy = decoderData->device->va_dpy;
+    const unsigned int rt_formats[2] = { rt_format, decoderData->rt_format };
+    vaDestroyContext(va_dpy, decoderData->context_id);
+    vaDestroySurfaces(va_dpy, decoderData->render_targets, decoderData->num_render_targets);
+    vaDestroyConfig(va_dpy, decoderData->config_id);
+
+    // try new format, and on failure get back to the previous one
+    for (int k = 0; k < 2; k ++) {
+        VAConfigAttrib attrib = { .type = VAConfigAttribRTFormat, .value = rt_formats[k] };
+        VAStatus status = vaCreateConfig(va_dpy, decoderData->va_profile, VAEntrypointVLD,
+                                         &attrib, 1, &decoderData->config_id);
         if (VA_STATUS_SUCCESS != status)
-            goto error;
+            continue;
+        if (VA_STATUS_SUCCESS == decoder_create_va_surfaces(decoderData, rt_formats[k]))
+            return (0 == k) ? VDP_STATUS_OK : VDP_STATUS_NO_IMPLEMENTATION;
+        vaDestroyConfig(va_dpy, decoderData->config_id);
+    }
+
+    traceError("error (softVdpDecoderRender): can't recreate VA surfaces\n");
+    return VDP_STATUS_RESOURCES;
+}
 
-        vs = h264_translate_reference_frames(dstSurfData, decoderData, pic_param, vdppi);
-        if (VDP_STATUS_RESOURCES == vs)
-            goto error_no_surfaces_left;
+static
+VdpStatus
+softVdpDecoderRender_h264(VdpDecoderData *decoderData, VdpVideoSurfaceData *dstSurfData,
+                          VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+                          VdpBitstreamBuffer const *bitstream_buffers)
+{
+    VdpDeviceData *deviceData = decoderData->device;
+    VADisplay va_dpy = deviceData->va_dpy;
+    VAStatus status;
+    VdpStatus vs;
+    VdpPictureInfoH264 const *vdppi = (void *)picture_info;
+    uint64_t t_start, parse_ns = 0, buffers_ns = 0;
+    uint32_t slice_count = 0;
+    uint8_t *merged_bitstream = NULL;
+    VABufferID pic_param_buf = VA_INVALID_ID;
+    VABufferID iq_matrix_buf = VA_INVALID_ID;
+    VABufferID slice_parameters_buf = VA_INVALID_ID;
+    VABufferID slice_buf = VA_INVALID_ID;
+
+    // merge bitstream buffers
+    int total_bitstream_bytes;
+    t_start = decoder_stats_timestamp();
+    merged_bitstream = decoder_merge_bitstream_buffers(bitstream_buffer_count, bitstream_buffers,
+                                                       &total_bitstream_bytes);
+    if (NULL == merged_bitstream)
+        goto error_resources;
+    decoder_stats_add_time(&decoderData->stats, VDP_DECODER_STAGE_MERGE,
+                           decoder_stats_timestamp() - t_start);
+
+    vs = h264_update_stream_format(decoderData, dstSurfData, merged_bitstream,
+                                   total_bitstream_bytes);
+    if (VDP_STATUS_OK != vs)
+        goto cleanup;
+
+    if (!vdppi->frame_mbs_only_flag && !decoderData->interlaced) {
+        vs = decoder_switch_to_interlaced(decoderData);
         if (VDP_STATUS_OK != vs)
-            goto error;
+            goto cleanup;
+    }
 
-        h264_translate_pic_param(pic_param, decoderData->width, decoderData->height, vdppi, level);
-        vaUnmapBuffer(va_dpy, pic_param_buf);
+    // level signalled in stream is preferred over estimated one
+    const uint32_t level = decoderData->h264_sps_seen ? (uint32_t)decoderData->h264_sps.level_idc
+                                                      : decoderData->h264_level;
 
-        //  IQ Matrix
-        VABufferID iq_matrix_buf;
-        VAIQMatrixBufferH264 *iq_matrix;
+    // preparing picture parameters
+    VAPictureParameterBufferH264 *pic_param;
 
-        status = vaCreateBuffer(va_dpy, decoderData->context_id, VAIQMatrixBufferType,
-            sizeof(VAIQMatrixBufferH264), 1, NULL, &iq_matrix_buf);
-        if (VA_STATUS_SUCCESS != status)
-            goto error;
+    t_start = decoder_stats_timestamp();
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VAPictureParameterBufferType,
+        sizeof(VAPictureParameterBufferH264), 1, NULL, &pic_param_buf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
 
-        status = vaMapBuffer(va_dpy, iq_matrix_buf, (void **)&iq_matrix);
-        if (VA_STATUS_SUCCESS != status)
-            goto error;
+    status = vaMapBuffer(va_dpy, pic_param_buf, (void **)&pic_param);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
 
-        h264_translate_iq_matrix(iq_matrix, vdppi);
-        vaUnmapBuffer(va_dpy, iq_matrix_buf);
+    vs = h264_translate_reference_frames(dstSurfData, decoderData, pic_param, vdppi);
+    if (VDP_STATUS_RESOURCES == vs)
+        goto error_no_surfaces_left;
+    if (VDP_STATUS_OK != vs)
+        goto error;
 
-        // send data to decoding hardware
-        status = vaBeginPicture(va_dpy, decoderData->context_id, dstSurfData->va_surf);
-        if (VA_STATUS_SUCCESS != status)
-            goto error;
-        status = vaRenderPicture(va_dpy, decoderData->context_id, &pic_param_buf, 1);
-        if (VA_STATUS_SUCCESS != status)
-            goto error;
-        status = vaRenderPicture(va_dpy, decoderData->context_id, &iq_matrix_buf, 1);
+    h264_translate_pic_param(pic_param, decoderData->width, decoderData->height, vdppi, level,
+                             &decoderData->h264_sps);
+    const int ChromaArrayType = decoderData->h264_sps.separate_colour_plane_flag
+                                ? 0 : decoderData->h264_sps.chroma_format_idc;
+    vaUnmapBuffer(va_dpy, pic_param_buf);
+
+    //  IQ Matrix
+    VAIQMatrixBufferH264 *iq_matrix;
+
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VAIQMatrixBufferType,
+        sizeof(VAIQMatrixBufferH264), 1, NULL, &iq_matrix_buf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    status = vaMapBuffer(va_dpy, iq_matrix_buf, (void **)&iq_matrix);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    h264_translate_iq_matrix(iq_matrix, vdppi);
+    vaUnmapBuffer(va_dpy, iq_matrix_buf);
+    buffers_ns += decoder_stats_timestamp() - t_start;
+
+    // send data to decoding hardware
+    const uint64_t t_submit = decoder_stats_timestamp();
+    status = vaBeginPicture(va_dpy, decoderData->context_id, dstSurfData->va_surf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &pic_param_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &iq_matrix_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    vaDestroyBuffer(va_dpy, pic_param_buf);
+    vaDestroyBuffer(va_dpy, iq_matrix_buf);
+    pic_param_buf = VA_INVALID_ID;
+    iq_matrix_buf = VA_INVALID_ID;
+
+    // Slice parameters
+
+    // All slice data have been merged into one continuous buffer. But we must supply
+    // slices one by one to the hardware decoder, so we need to delimit them. VDPAU
+    // requires bitstream buffers to include slice start code (0x00 0x00 0x01). Those
+    // will be used to calculate offsets and sizes of slice data in code below.
+
+    rbsp_state_t st_g;      // reference, global state
+    rbsp_attach_buffer(&st_g, merged_bitstream, total_bitstream_bytes);
+    int nal_offset = rbsp_navigate_to_nal_unit(&st_g);
+    if (nal_offset < 0)
+        goto error_no_nal_header;
+
+    do {
+        VASliceParameterBufferH264 sp_h264;
+        memset(&sp_h264, 0, sizeof(VASliceParameterBufferH264));
+
+        // make a copy of global rbsp state for using in slice header parser
+        rbsp_state_t st = rbsp_copy_state(&st_g);
+        rbsp_reset_bit_counter(&st);
+        int nal_offset_next = rbsp_navigate_to_nal_unit(&st_g);
+
+        // only coded slices go to hardware, parameter sets and SEI are skipped
+        const int nal_unit_type = merged_bitstream[nal_offset] & 0x1f;
+        if (NAL_SLICE != nal_unit_type && NAL_IDR_SLICE != nal_unit_type) {
+            if (nal_offset_next < 0)
+                break;
+            nal_offset = nal_offset_next;
+            continue;
+        }
+
+        // calculate end of current slice. Note (-3). It's slice start code length.
+        const unsigned int end_pos = (nal_offset_next > 0) ? (nal_offset_next - 3)
+                                                           : total_bitstream_bytes;
+        sp_h264.slice_data_size     = end_pos - nal_offset;
+        sp_h264.slice_data_offset   = 0;
+        sp_h264.slice_data_flag     = VA_SLICE_DATA_FLAG_ALL;
+
+        // parse slice header and use its data to fill slice parameter buffer
+        t_start = decoder_stats_timestamp();
+        parse_slice_header(&st, pic_param, ChromaArrayType, vdppi->num_ref_idx_l0_active_minus1,
+                           vdppi->num_ref_idx_l1_active_minus1, &sp_h264);
+        parse_ns += decoder_stats_timestamp() - t_start;
+
+        t_start = decoder_stats_timestamp();
+        status = vaCreateBuffer(va_dpy, decoderData->context_id, VASliceParameterBufferType,
+            sizeof(VASliceParameterBufferH264), 1, &sp_h264, &slice_parameters_buf);
         if (VA_STATUS_SUCCESS != status)
             goto error;
+        status = vaCreateBuffer(va_dpy, decoderData->context_id, VASliceDataBufferType,
+            sp_h264.slice_data_size, 1, merged_bitstream + nal_offset, &slice_buf);
+        if (VA_STATUS_SUCCESS != status)
+            goto error;
+        buffers_ns += decoder_stats_timestamp() - t_start;
+        slice_count ++;
 
-        vaDestroyBuffer(va_dpy, pic_param_buf);
-        vaDestroyBuffer(va_dpy, iq_matrix_buf);
+        status = vaRenderPicture(va_dpy, decoderData->context_id, &slice_parameters_buf, 1);
+        if (VA_STATUS_SUCCESS != status)
+            goto error;
 
-        // merge bitstream buffers
-        int total_bitstream_bytes = 0;
-        for (unsigned int k = 0; k < bitstream_buffer_count; k ++)
-            total_bitstream_bytes += bitstream_buffers[k].bitstream_bytes;
+        status = vaRenderPicture(va_dpy, decoderData->context_id, &slice_buf, 1);
+        if (VA_STATUS_SUCCESS != status)
+            goto error;
 
-        uint8_t *merged_bitstream = malloc(total_bitstream_bytes);
-        if (NULL == merged_bitstream)
-            goto error_resources;
+        vaDestroyBuffer(va_dpy, slice_parameters_buf);
+        vaDestroyBuffer(va_dpy, slice_buf);
+        slice_parameters_buf = VA_INVALID_ID;
+        slice_buf = VA_INVALID_ID;
 
-        do {
-            unsigned char *ptr = merged_bitstream;
-            for (unsigned int k = 0; k < bitstream_buffer_count; k ++) {
-                memcpy(ptr, bitstream_buffers[k].bitstream, bitstream_buffers[k].bitstream_bytes);
-                ptr += bitstream_buffers[k].bitstream_bytes;
-            }
-        } while(0);
+        if (nal_offset_next < 0)        // nal_offset_next equals -1 when there is no slice
+            break;                      // start code found. Thus that was the final slice.
+        nal_offset = nal_offset_next;
+    } while (1);
 
-        // Slice parameters
+    status = vaEndPicture(va_dpy, decoderData->context_id);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
 
-        // All slice data have been merged into one continuous buffer. But we must supply
-        // slices one by one to the hardware decoder, so we need to delimit them. VDPAU
-        // requires bitstream buffers to include slice start code (0x00 0x00 0x01). Those
-        // will be used to calculate offsets and sizes of slice data in code below.
+    VdpDecoderStatsVaGl *stats = &decoderData->stats;
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_SUBMIT, decoder_stats_timestamp() - t_submit);
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_PARSE, parse_ns);
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_BUFFERS, buffers_ns);
+    decoder_stats_add_slices(stats, slice_count);
 
-        rbsp_state_t st_g;      // reference, global state
-        rbsp_attach_buffer(&st_g, merged_bitstream, total_bitstream_bytes);
-        int nal_offset = rbsp_navigate_to_nal_unit(&st_g);
-        if (nal_offset < 0)
-            goto error_no_nal_header;
+    vs = VDP_STATUS_OK;
+    goto cleanup;
 
-        do {
-            VASliceParameterBufferH264 sp_h264;
-            memset(&sp_h264, 0, sizeof(VASliceParameterBufferH264));
+error:
+    traceError("error (softVdpDecoderRender): something gone wrong\n");
+    vs = VDP_STATUS_ERROR;
+    goto cleanup;
+error_no_nal_header:
+    traceError("error (softVdpDecoderRender): no NAL header\n");
+    vs = VDP_STATUS_ERROR;
+    goto cleanup;
+error_resources:
+    vs = VDP_STATUS_RESOURCES;
+    goto cleanup;
+error_no_surfaces_left:
+    traceError("error (softVdpDecoderRender): no surfaces left in buffer\n");
+    vs = VDP_STATUS_ERROR;
+cleanup:
+    if (VA_INVALID_ID != pic_param_buf) vaDestroyBuffer(va_dpy, pic_param_buf);
+    if (VA_INVALID_ID != iq_matrix_buf) vaDestroyBuffer(va_dpy, iq_matrix_buf);
+    if (VA_INVALID_ID != slice_parameters_buf) vaDestroyBuffer(va_dpy, slice_parameters_buf);
+    if (VA_INVALID_ID != slice_buf) vaDestroyBuffer(va_dpy, slice_buf);
+    free(merged_bitstream);
+    return vs;
+}
 
-            // make a copy of global rbsp state for using in slice header parser
-            rbsp_state_t st = rbsp_copy_state(&st_g);
-            rbsp_reset_bit_counter(&st);
-            int nal_offset_next = rbsp_navigate_to_nal_unit(&st_g);
-
-            // calculate end of current slice. Note (-3). It's slice start code length.
-            const unsigned int end_pos = (nal_offset_next > 0) ? (nal_offset_next - 3)
-                                                               : total_bitstream_bytes;
-            sp_h264.slice_data_size     = end_pos - nal_offset;
-            sp_h264.slice_data_offset   = 0;
-            sp_h264.slice_data_flag     = VA_SLICE_DATA_FLAG_ALL;
-
-            // TODO: this may be not entirely true for YUV444
-            // but if we limiting to YUV420, that's ok
-            int ChromaArrayType = pic_param->seq_fields.bits.chroma_format_idc;
-
-            // parse slice header and use its data to fill slice parameter buffer
-            parse_slice_header(&st, pic_param, ChromaArrayType, vdppi->num_ref_idx_l0_active_minus1,
-                               vdppi->num_ref_idx_l1_active_minus1, &sp_h264);
-
-            VABufferID slice_parameters_buf;
-            status = vaCreateBuffer(va_dpy, decoderData->context_id, VASliceParameterBufferType,
-                sizeof(VASliceParameterBufferH264), 1, &sp_h264, &slice_parameters_buf);
-            if (VA_STATUS_SUCCESS != status)
-                goto error;
-            status = vaRenderPicture(va_dpy, decoderData->context_id, &slice_parameters_buf, 1);
-            if (VA_STATUS_SUCCESS != status)
-                goto error;
-
-            VABufferID slice_buf;
-            status = vaCreateBuffer(va_dpy, decoderData->context_id, VASliceDataBufferType,
-                sp_h264.slice_data_size, 1, merged_bitstream + nal_offset, &slice_buf);
-            if (VA_STATUS_SUCCESS != status)
-                goto error;
-
-            status = vaRenderPicture(va_dpy, decoderData->context_id, &slice_buf, 1);
-            if (VA_STATUS_SUCCESS != status)
-                goto error;
-
-            vaDestroyBuffer(va_dpy, slice_parameters_buf);
-            vaDestroyBuffer(va_dpy, slice_buf);
-
-            if (nal_offset_next < 0)        // nal_offset_next equals -1 when there is no slice
-                break;                      // start code found. Thus that was the final slice.
-            nal_offset = nal_offset_next;
-        } while (1);
+static
+VdpStatus
+mpeg4_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData *decoderData,
+                                 VAPictureParameterBufferMPEG4 *pic_param,
+                                 const VdpPictureInfoMPEG4Part2 *vdppi)
+{
+    if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, dstSurfData))
+        return VDP_STATUS_RESOURCES;
 
-        status = vaEndPicture(va_dpy, decoderData->context_id);
-        if (VA_STATUS_SUCCESS != status)
-            goto error;
+    pic_param->forward_reference_picture = VA_INVALID_SURFACE;
+    pic_param->backward_reference_picture = VA_INVALID_SURFACE;
 
-        free(merged_bitstream);
-    } else {
-        traceError("error (softVdpDecoderRender): no implementation for profile %s\n",
-                   reverse_decoder_profile(decoderData->profile));
+    if (VDP_INVALID_HANDLE != vdppi->forward_reference) {
+        VdpVideoSurfaceData *surfData =
+            handlestorage_get(vdppi->forward_reference, HANDLETYPE_VIDEO_SURFACE);
+        if (NULL == surfData) {
+            traceError("error (mpeg4_translate_reference_frames): NULL == surfData");
+            return VDP_STATUS_ERROR;
+        }
+        if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, surfData))
+            return VDP_STATUS_RESOURCES;
+        pic_param->forward_reference_picture = surfData->va_surf;
+    }
+
+    if (VDP_INVALID_HANDLE != vdppi->backward_reference) {
+        VdpVideoSurfaceData *surfData =
+            handlestorage_get(vdppi->backward_reference, HANDLETYPE_VIDEO_SURFACE);
+        if (NULL == surfData) {
+            traceError("error (mpeg4_translate_reference_frames): NULL == surfData");
+            return VDP_STATUS_ERROR;
+        }
+        if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, surfData))
+            return VDP_STATUS_RESOURCES;
+        pic_param->backward_reference_picture = surfData->va_surf;
+    }
+
+    return VDP_STATUS_OK;
+}
+
+static
+void
+mpeg4_translate_pic_param(VAPictureParameterBufferMPEG4 *pic_param, uint32_t width, uint32_t height,
+                          const VdpPictureInfoMPEG4Part2 *vdppi, int backward_reference_vop_type)
+{
+    pic_param->vop_width                            = width;
+    pic_param->vop_height                           = height;
+
+#define VOL_FIELDS(fieldname) pic_param->vol_fields.bits.fieldname
+#define VOP_FIELDS(fieldname) pic_param->vop_fields.bits.fieldname
+
+    VOL_FIELDS(short_video_header)                  = vdppi->short_video_header;
+    VOL_FIELDS(chroma_format)                       = 1; // 4:2:0 is the only one allowed
+    VOL_FIELDS(interlaced)                          = vdppi->interlaced;
+    VOL_FIELDS(obmc_disable)                        = 1;
+    VOL_FIELDS(sprite_enable)                       = 0; // VDPAU have no sprite parameters
+    VOL_FIELDS(sprite_warping_accuracy)             = 0;
+    VOL_FIELDS(quant_type)                          = vdppi->quant_type;
+    VOL_FIELDS(quarter_sample)                      = vdppi->quarter_sample;
+    VOL_FIELDS(data_partitioned)                    = 0; // VDPAU have no such flag
+    VOL_FIELDS(reversible_vlc)                      = 0; // same
+    VOL_FIELDS(resync_marker_disable)               = vdppi->resync_marker_disable;
+    pic_param->no_of_sprite_warping_points          = 0;
+    pic_param->quant_precision                      = 5; // not_8_bit is not supported
+    VOP_FIELDS(vop_coding_type)                     = vdppi->vop_coding_type;
+    VOP_FIELDS(backward_reference_vop_coding_type)  = backward_reference_vop_type;
+    VOP_FIELDS(vop_rounding_type)                   = vdppi->rounding_control;
+    VOP_FIELDS(intra_dc_vlc_thr)                    = 0; // will be filled by VOP header parser
+    VOP_FIELDS(top_field_first)                     = vdppi->top_field_first;
+    VOP_FIELDS(alternate_vertical_scan_flag)        = vdppi->alternate_vertical_scan_flag;
+    pic_param->vop_fcode_forward                    = vdppi->vop_fcode_forward;
+    pic_param->vop_fcode_backward                   = vdppi->vop_fcode_backward;
+    pic_param->vop_time_increment_resolution        = vdppi->vop_time_increment_resolution;
+    pic_param->num_macroblocks_in_gob               = (width + 15) / 16;
+    pic_param->num_gobs_in_vop                      = (height + 15) / 16;
+    pic_param->TRB                                  = vdppi->trb[0];
+    pic_param->TRD                                  = vdppi->trd[0];
+#undef VOL_FIELDS
+#undef VOP_FIELDS
+}
+
+static
+void
+mpeg4_translate_iq_matrix(VAIQMatrixBufferMPEG4 *iq_matrix, const VdpPictureInfoMPEG4Part2 *vdppi)
+{
+    // VDPAU passes matrices in raster order, while VA-API expects them in zigzag scan order
+    static const uint8_t zigzag_scan[64] = {
+         0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+        12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+        35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+        58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+    };
+
+    // matrices are used by MPEG quantization method only
+    iq_matrix->load_intra_quant_mat = vdppi->quant_type;
+    iq_matrix->load_non_intra_quant_mat = vdppi->quant_type;
+    for (int k = 0; k < 64; k ++) {
+        iq_matrix->intra_quant_mat[k] = vdppi->intra_quant_mat[zigzag_scan[k]];
+        iq_matrix->non_intra_quant_mat[k] = vdppi->non_intra_quant_mat[zigzag_scan[k]];
+    }
+}
+
+static
+VdpStatus
+softVdpDecoderRender_mpeg4(VdpDecoderData *decoderData, VdpVideoSurfaceData *dstSurfData,
+                           VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+                           VdpBitstreamBuffer const *bitstream_buffers)
+{
+    VdpDeviceData *deviceData = decoderData->device;
+    VADisplay va_dpy = deviceData->va_dpy;
+    VAStatus status;
+    VdpStatus vs;
+    VdpPictureInfoMPEG4Part2 const *vdppi = (void *)picture_info;
+    uint8_t *merged_bitstream = NULL;
+    VABufferID pic_param_buf = VA_INVALID_ID;
+    VABufferID iq_matrix_buf = VA_INVALID_ID;
+    VABufferID slice_parameters_buf = VA_INVALID_ID;
+    VABufferID slice_buf = VA_INVALID_ID;
+    VdpDecoderStatsVaGl *stats = &decoderData->stats;
+    uint64_t t_start;
+
+    if (vdppi->short_video_header) {
+        traceError("error (softVdpDecoderRender): MPEG-4 short video header is not supported\n");
         return VDP_STATUS_NO_IMPLEMENTATION;
     }
 
+    VAPictureParameterBufferMPEG4 pic_param;
+    VAIQMatrixBufferMPEG4 iq_matrix;
+    VASliceParameterBufferMPEG4 sp_mpeg4;
+    memset(&pic_param, 0, sizeof(pic_param));
+    memset(&iq_matrix, 0, sizeof(iq_matrix));
+    memset(&sp_mpeg4, 0, sizeof(sp_mpeg4));
+
+    vs = mpeg4_translate_reference_frames(dstSurfData, decoderData, &pic_param, vdppi);
+    if (VDP_STATUS_RESOURCES == vs)
+        goto error_no_surfaces_left;
+    if (VDP_STATUS_OK != vs)
+        goto error;
+
+    mpeg4_translate_pic_param(&pic_param, decoderData->width, decoderData->height, vdppi,
+                              decoderData->mpeg4_last_anchor_vop_type);
+    mpeg4_translate_iq_matrix(&iq_matrix, vdppi);
+
+    int total_bitstream_bytes;
+    t_start = decoder_stats_timestamp();
+    merged_bitstream = decoder_merge_bitstream_buffers(bitstream_buffer_count, bitstream_buffers,
+                                                       &total_bitstream_bytes);
+    if (NULL == merged_bitstream)
+        goto error_resources;
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_MERGE, decoder_stats_timestamp() - t_start);
+
+    // VDPAU passes whole VOP, including its start code and header. VA-API wants only
+    // macroblock data, with values VDPAU lacks taken from the header. There could be VOL,
+    // GOV or user data headers before VOP, skip them. MPEG-4 have no emulation prevention.
+    t_start = decoder_stats_timestamp();
+    rbsp_state_t st;
+    rbsp_attach_buffer(&st, merged_bitstream, total_bitstream_bytes);
+    rbsp_set_emulation_prevention(&st, 0);
+    int vop_offset;
+    do {
+        vop_offset = rbsp_navigate_to_nal_unit(&st);
+        if (vop_offset < 0 || vop_offset >= total_bitstream_bytes)
+            goto error_no_vop_header;
+    } while (MPEG4_VOP_START_CODE != merged_bitstream[vop_offset]);
+
+    rbsp_get_u(&st, 8);     // start code value
+    rbsp_reset_bit_counter(&st);
+    const int vop_coded = parse_vop_header(&st, &pic_param, &sp_mpeg4);
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_PARSE, decoder_stats_timestamp() - t_start);
+    if (!vop_coded) {
+        // not coded VOP, there is nothing to decode
+        decoder_stats_add_slices(stats, 0);
+        free(merged_bitstream);
+        return VDP_STATUS_OK;
+    }
+
+    const int mb_data_offset = vop_offset + 1 + st.bits_eaten / 8;
+    sp_mpeg4.slice_data_size    = total_bitstream_bytes - mb_data_offset;
+    sp_mpeg4.slice_data_offset  = 0;
+    sp_mpeg4.slice_data_flag    = VA_SLICE_DATA_FLAG_ALL;
+    sp_mpeg4.macroblock_offset  = st.bits_eaten % 8;
+    sp_mpeg4.macroblock_number  = 0;
+
+    t_start = decoder_stats_timestamp();
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VAPictureParameterBufferType,
+        sizeof(VAPictureParameterBufferMPEG4), 1, &pic_param, &pic_param_buf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VAIQMatrixBufferType,
+        sizeof(VAIQMatrixBufferMPEG4), 1, &iq_matrix, &iq_matrix_buf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VASliceParameterBufferType,
+        sizeof(VASliceParameterBufferMPEG4), 1, &sp_mpeg4, &slice_parameters_buf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VASliceDataBufferType,
+        sp_mpeg4.slice_data_size, 1, merged_bitstream + mb_data_offset, &slice_buf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_BUFFERS, decoder_stats_timestamp() - t_start);
+
+    // send data to decoding hardware, whole VOP is one slice
+    t_start = decoder_stats_timestamp();
+    status = vaBeginPicture(va_dpy, decoderData->context_id, dstSurfData->va_surf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &pic_param_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &iq_matrix_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &slice_parameters_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &slice_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaEndPicture(va_dpy, decoderData->context_id);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_SUBMIT, decoder_stats_timestamp() - t_start);
+    decoder_stats_add_slices(stats, 1);
+
+    // B-VOPs are never used as reference, so only I- and P-VOPs are remembered
+    if (VOP_TYPE_B != pic_param.vop_fields.bits.vop_coding_type)
+        decoderData->mpeg4_last_anchor_vop_type = pic_param.vop_fields.bits.vop_coding_type;
+
+    vaDestroyBuffer(va_dpy, pic_param_buf);
+    vaDestroyBuffer(va_dpy, iq_matrix_buf);
+    vaDestroyBuffer(va_dpy, slice_parameters_buf);
+    vaDestroyBuffer(va_dpy, slice_buf);
+    free(merged_bitstream);
     return VDP_STATUS_OK;
+
 error:
     traceError("error (softVdpDecoderRender): something gone wrong\n");
-    return VDP_STATUS_ERROR;
+    vs = VDP_STATUS_ERROR;
+    goto cleanup;
+error_no_vop_header:
+    traceError("error (softVdpDecoderRender): no VOP header\n");
+    vs = VDP_STATUS_ERROR;
+    goto cleanup;
+error_resources:
+    vs = VDP_STATUS_RESOURCES;
+    goto cleanup;
+error_no_surfaces_left:
+    traceError("error (softVdpDecoderRender): no surfaces left in buffer\n");
+    vs = VDP_STATUS_ERROR;
+cleanup:
+    if (VA_INVALID_ID != pic_param_buf) vaDestroyBuffer(va_dpy, pic_param_buf);
+    if (VA_INVALID_ID != iq_matrix_buf) vaDestroyBuffer(va_dpy, iq_matrix_buf);
+    if (VA_INVALID_ID != slice_parameters_buf) vaDestroyBuffer(va_dpy, slice_parameters_buf);
+    if (VA_INVALID_ID != slice_buf) vaDestroyBuffer(va_dpy, slice_buf);
+    free(merged_bitstream);
+    return vs;
+}
+
+#ifdef HAVE_HEVC_DECODING
+/** @brief Translate reference picture set entries from VDPAU to VA-API indices
+ *
+ *  @retval 0 on success
+ *  @retval -1 if some entry refers to no picture
+ */
+static
+int
+hevc_translate_rps_entries(int *dst, const uint8_t *src, int count, const int va_index[16])
+{
+    for (int k = 0; k < count; k ++) {
+        if (src[k] >= 16 || va_index[src[k]] < 0)
+            return -1;
+        dst[k] = va_index[src[k]];
+    }
+    return 0;
+}
+
+static
+VdpStatus
+hevc_translate_reference_frames(VdpVideoSurfaceData *dstSurfData, VdpDecoderData *decoderData,
+                                VAPictureParameterBufferHEVC *pic_param,
+                                hevc_ref_pic_set_t *rps, const VdpPictureInfoHEVC *vdppi)
+{
+    if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, dstSurfData))
+        return VDP_STATUS_RESOURCES;
+
+    pic_param->CurrPic.picture_id       = dstSurfData->va_surf;
+    pic_param->CurrPic.pic_order_cnt    = vdppi->CurrPicOrderCntVal;
+    pic_param->CurrPic.flags            = 0;
+
+    for (int k = 0; k < 15; k ++) {
+        VAPictureHEVC *va_ref = &pic_param->ReferenceFrames[k];
+        va_ref->picture_id = VA_INVALID_SURFACE;
+        va_ref->pic_order_cnt = 0;
+        va_ref->flags = VA_PICTURE_HEVC_INVALID;
+    }
+
+    // VA-API have one entry less than VDPAU, as current picture is never in the list. There
+    // are at most 15 references anyway, so used entries are packed, and reference picture
+    // set indices are translated through va_index.
+    int va_index[16];
+    int ref_count = 0;
+    for (int k = 0; k < 16; k ++) {
+        va_index[k] = -1;
+        if (VDP_INVALID_HANDLE == vdppi->RefPics[k])
+            continue;
+
+        VdpVideoSurfaceData *vdpSurfData =
+            handlestorage_get(vdppi->RefPics[k], HANDLETYPE_VIDEO_SURFACE);
+        if (NULL == vdpSurfData) {
+            traceError("error (hevc_translate_reference_frames): NULL == vdpSurfData");
+            return VDP_STATUS_ERROR;
+        }
+        if (ref_count >= 15) {
+            traceError("error (hevc_translate_reference_frames): too many references\n");
+            return VDP_STATUS_ERROR;
+        }
+        if (VDP_STATUS_OK != decoder_bind_va_surface(decoderData, vdpSurfData))
+            return VDP_STATUS_RESOURCES;
+
+        VAPictureHEVC *va_ref = &pic_param->ReferenceFrames[ref_count];
+        va_ref->picture_id = vdpSurfData->va_surf;
+        va_ref->pic_order_cnt = vdppi->PicOrderCntVal[k];
+        va_ref->flags = vdppi->IsLongTerm[k] ? VA_PICTURE_HEVC_LONG_TERM_REFERENCE : 0;
+        va_index[k] = ref_count ++;
+    }
+
+    // reference picture set data is also required by slice header parser
+    rps->NumPocTotalCurr = vdppi->NumPocTotalCurr;
+    rps->NumShortTermPictureSliceHeaderBits = vdppi->NumShortTermPictureSliceHeaderBits;
+    rps->NumLongTermPictureSliceHeaderBits = vdppi->NumLongTermPictureSliceHeaderBits;
+    rps->NumPocStCurrBefore = MIN(vdppi->NumPocStCurrBefore, 8);
+    rps->NumPocStCurrAfter = MIN(vdppi->NumPocStCurrAfter, 8);
+    rps->NumPocLtCurr = MIN(vdppi->NumPocLtCurr, 8);
+    if (0 != hevc_translate_rps_entries(rps->RefPicSetStCurrBefore,
+                                        vdppi->RefPicSetStCurrBefore, rps->NumPocStCurrBefore,
+                                        va_index) ||
+        0 != hevc_translate_rps_entries(rps->RefPicSetStCurrAfter,
+                                        vdppi->RefPicSetStCurrAfter, rps->NumPocStCurrAfter,
+                                        va_index) ||
+        0 != hevc_translate_rps_entries(rps->RefPicSetLtCurr, vdppi->RefPicSetLtCurr,
+                                        rps->NumPocLtCurr, va_index))
+    {
+        traceError("error (hevc_translate_reference_frames): reference picture set refers "
+                   "to missing picture\n");
+        return VDP_STATUS_ERROR;
+    }
+
+    for (int k = 0; k < rps->NumPocStCurrBefore; k ++)
+        pic_param->ReferenceFrames[rps->RefPicSetStCurrBefore[k]].flags |=
+            VA_PICTURE_HEVC_RPS_ST_CURR_BEFORE;
+    for (int k = 0; k < rps->NumPocStCurrAfter; k ++)
+        pic_param->ReferenceFrames[rps->RefPicSetStCurrAfter[k]].flags |=
+            VA_PICTURE_HEVC_RPS_ST_CURR_AFTER;
+    for (int k = 0; k < rps->NumPocLtCurr; k ++)
+        pic_param->ReferenceFrames[rps->RefPicSetLtCurr[k]].flags |=
+            VA_PICTURE_HEVC_RPS_LT_CURR;
+
+    return VDP_STATUS_OK;
+}
+
+static
+void
+hevc_translate_pic_param(VAPictureParameterBufferHEVC *pic_param, const VdpPictureInfoHEVC *vdppi)
+{
+    pic_param->pic_width_in_luma_samples            = vdppi->pic_width_in_luma_samples;
+    pic_param->pic_height_in_luma_samples           = vdppi->pic_height_in_luma_samples;
+
+#define PIC_FIELDS(fieldname) pic_param->pic_fields.bits.fieldname
+#define SLICE_PARSING_FIELDS(fieldname) pic_param->slice_parsing_fields.bits.fieldname
+
+    PIC_FIELDS(chroma_format_idc)                   = vdppi->chroma_format_idc;
+    PIC_FIELDS(separate_colour_plane_flag)          = vdppi->separate_colour_plane_flag;
+    PIC_FIELDS(pcm_enabled_flag)                    = vdppi->pcm_enabled_flag;
+    PIC_FIELDS(scaling_list_enabled_flag)           = vdppi->scaling_list_enabled_flag;
+    PIC_FIELDS(transform_skip_enabled_flag)         = vdppi->transform_skip_enabled_flag;
+    PIC_FIELDS(amp_enabled_flag)                    = vdppi->amp_enabled_flag;
+    PIC_FIELDS(strong_intra_smoothing_enabled_flag) = vdppi->strong_intra_smoothing_enabled_flag;
+    PIC_FIELDS(sign_data_hiding_enabled_flag)       = vdppi->sign_data_hiding_enabled_flag;
+    PIC_FIELDS(constrained_intra_pred_flag)         = vdppi->constrained_intra_pred_flag;
+    PIC_FIELDS(cu_qp_delta_enabled_flag)            = vdppi->cu_qp_delta_enabled_flag;
+    PIC_FIELDS(weighted_pred_flag)                  = vdppi->weighted_pred_flag;
+    PIC_FIELDS(weighted_bipred_flag)                = vdppi->weighted_bipred_flag;
+    PIC_FIELDS(transquant_bypass_enabled_flag)      = vdppi->transquant_bypass_enabled_flag;
+    PIC_FIELDS(tiles_enabled_flag)                  = vdppi->tiles_enabled_flag;
+    PIC_FIELDS(entropy_coding_sync_enabled_flag)    = vdppi->entropy_coding_sync_enabled_flag;
+    PIC_FIELDS(pps_loop_filter_across_slices_enabled_flag) =
+                                                vdppi->pps_loop_filter_across_slices_enabled_flag;
+    PIC_FIELDS(loop_filter_across_tiles_enabled_flag) = vdppi->loop_filter_across_tiles_enabled_flag;
+    PIC_FIELDS(pcm_loop_filter_disabled_flag)       = vdppi->pcm_loop_filter_disabled_flag;
+    PIC_FIELDS(NoPicReorderingFlag)                 = 0; // VDPAU have no such information
+    PIC_FIELDS(NoBiPredFlag)                        = 0; // same
+
+    pic_param->sps_max_dec_pic_buffering_minus1     = vdppi->sps_max_dec_pic_buffering_minus1;
+    pic_param->bit_depth_luma_minus8                = vdppi->bit_depth_luma_minus8;
+    pic_param->bit_depth_chroma_minus8              = vdppi->bit_depth_chroma_minus8;
+    pic_param->pcm_sample_bit_depth_luma_minus1     = vdppi->pcm_sample_bit_depth_luma_minus1;
+    pic_param->pcm_sample_bit_depth_chroma_minus1   = vdppi->pcm_sample_bit_depth_chroma_minus1;
+    pic_param->log2_min_luma_coding_block_size_minus3 = vdppi->log2_min_luma_coding_block_size_minus3;
+    pic_param->log2_diff_max_min_luma_coding_block_size =
+                                                vdppi->log2_diff_max_min_luma_coding_block_size;
+    pic_param->log2_min_transform_block_size_minus2 = vdppi->log2_min_transform_block_size_minus2;
+    pic_param->log2_diff_max_min_transform_block_size = vdppi->log2_diff_max_min_transform_block_size;
+    pic_param->log2_min_pcm_luma_coding_block_size_minus3 =
+                                                vdppi->log2_min_pcm_luma_coding_block_size_minus3;
+    pic_param->log2_diff_max_min_pcm_luma_coding_block_size =
+                                                vdppi->log2_diff_max_min_pcm_luma_coding_block_size;
+    pic_param->max_transform_hierarchy_depth_intra  = vdppi->max_transform_hierarchy_depth_intra;
+    pic_param->max_transform_hierarchy_depth_inter  = vdppi->max_transform_hierarchy_depth_inter;
+    pic_param->init_qp_minus26                      = vdppi->init_qp_minus26;
+    pic_param->diff_cu_qp_delta_depth               = vdppi->diff_cu_qp_delta_depth;
+    pic_param->pps_cb_qp_offset                     = vdppi->pps_cb_qp_offset;
+    pic_param->pps_cr_qp_offset                     = vdppi->pps_cr_qp_offset;
+    pic_param->log2_parallel_merge_level_minus2     = vdppi->log2_parallel_merge_level_minus2;
+    pic_param->num_tile_columns_minus1              = vdppi->num_tile_columns_minus1;
+    pic_param->num_tile_rows_minus1                 = vdppi->num_tile_rows_minus1;
+
+    if (vdppi->tiles_enabled_flag && vdppi->uniform_spacing_flag) {
+        // 6.5.1, widths and heights of uniformly spaced tiles are not transmitted
+        const int ctb_size = 1 << (vdppi->log2_min_luma_coding_block_size_minus3 + 3 +
+                                   vdppi->log2_diff_max_min_luma_coding_block_size);
+        const int width_in_ctbs = (vdppi->pic_width_in_luma_samples + ctb_size - 1) / ctb_size;
+        const int height_in_ctbs = (vdppi->pic_height_in_luma_samples + ctb_size - 1) / ctb_size;
+        const int columns = vdppi->num_tile_columns_minus1 + 1;
+        const int rows = vdppi->num_tile_rows_minus1 + 1;
+
+        for (int k = 0; k < columns && k < 19; k ++) {
+            pic_param->column_width_minus1[k] =
+                ((k + 1) * width_in_ctbs) / columns - (k * width_in_ctbs) / columns - 1;
+        }
+        for (int k = 0; k < rows && k < 21; k ++) {
+            pic_param->row_height_minus1[k] =
+                ((k + 1) * height_in_ctbs) / rows - (k * height_in_ctbs) / rows - 1;
+        }
+    } else {
+        for (int k = 0; k < 19; k ++)
+            pic_param->column_width_minus1[k] = vdppi->column_width_minus1[k];
+        for (int k = 0; k < 21; k ++)
+            pic_param->row_height_minus1[k] = vdppi->row_height_minus1[k];
+    }
+
+    SLICE_PARSING_FIELDS(lists_modification_present_flag) = vdppi->lists_modification_present_flag;
+    SLICE_PARSING_FIELDS(long_term_ref_pics_present_flag) = vdppi->long_term_ref_pics_present_flag;
+    SLICE_PARSING_FIELDS(sps_temporal_mvp_enabled_flag) = vdppi->sps_temporal_mvp_enabled_flag;
+    SLICE_PARSING_FIELDS(cabac_init_present_flag)   = vdppi->cabac_init_present_flag;
+    SLICE_PARSING_FIELDS(output_flag_present_flag)  = vdppi->output_flag_present_flag;
+    SLICE_PARSING_FIELDS(dependent_slice_segments_enabled_flag) =
+                                                vdppi->dependent_slice_segments_enabled_flag;
+    SLICE_PARSING_FIELDS(pps_slice_chroma_qp_offsets_present_flag) =
+                                                vdppi->pps_slice_chroma_qp_offsets_present_flag;
+    SLICE_PARSING_FIELDS(sample_adaptive_offset_enabled_flag) =
+                                                vdppi->sample_adaptive_offset_enabled_flag;
+    SLICE_PARSING_FIELDS(deblocking_filter_override_enabled_flag) =
+                                                vdppi->deblocking_filter_override_enabled_flag;
+    SLICE_PARSING_FIELDS(pps_disable_deblocking_filter_flag) =
+                                                vdppi->pps_deblocking_filter_disabled_flag;
+    SLICE_PARSING_FIELDS(slice_segment_header_extension_present_flag) =
+                                                vdppi->slice_segment_header_extension_present_flag;
+    SLICE_PARSING_FIELDS(RapPicFlag)                = vdppi->RAPPicFlag;
+    SLICE_PARSING_FIELDS(IdrPicFlag)                = vdppi->IDRPicFlag;
+    SLICE_PARSING_FIELDS(IntraPicFlag)              = vdppi->RAPPicFlag; // IRAP pictures are intra
+
+    pic_param->log2_max_pic_order_cnt_lsb_minus4    = vdppi->log2_max_pic_order_cnt_lsb_minus4;
+    pic_param->num_short_term_ref_pic_sets          = vdppi->num_short_term_ref_pic_sets;
+    pic_param->num_long_term_ref_pic_sps            = vdppi->num_long_term_ref_pics_sps;
+    pic_param->num_ref_idx_l0_default_active_minus1 = vdppi->num_ref_idx_l0_default_active_minus1;
+    pic_param->num_ref_idx_l1_default_active_minus1 = vdppi->num_ref_idx_l1_default_active_minus1;
+    pic_param->pps_beta_offset_div2                 = vdppi->pps_beta_offset_div2;
+    pic_param->pps_tc_offset_div2                   = vdppi->pps_tc_offset_div2;
+    pic_param->num_extra_slice_header_bits          = vdppi->num_extra_slice_header_bits;
+    pic_param->st_rps_bits                          = vdppi->NumShortTermPictureSliceHeaderBits;
+#undef PIC_FIELDS
+#undef SLICE_PARSING_FIELDS
+}
+
+static
+void
+hevc_translate_iq_matrix(VAIQMatrixBufferHEVC *iq_matrix, const VdpPictureInfoHEVC *vdppi)
+{
+    // both VDPAU and VA-API keep scaling lists in up-right diagonal scan order
+    memcpy(iq_matrix->ScalingList4x4, vdppi->ScalingList4x4, sizeof(iq_matrix->ScalingList4x4));
+    memcpy(iq_matrix->ScalingList8x8, vdppi->ScalingList8x8, sizeof(iq_matrix->ScalingList8x8));
+    memcpy(iq_matrix->ScalingList16x16, vdppi->ScalingList16x16,
+           sizeof(iq_matrix->ScalingList16x16));
+    memcpy(iq_matrix->ScalingList32x32, vdppi->ScalingList32x32,
+           sizeof(iq_matrix->ScalingList32x32));
+    memcpy(iq_matrix->ScalingListDC16x16, vdppi->ScalingListDCCoeff16x16,
+           sizeof(iq_matrix->ScalingListDC16x16));
+    memcpy(iq_matrix->ScalingListDC32x32, vdppi->ScalingListDCCoeff32x32,
+           sizeof(iq_matrix->ScalingListDC32x32));
+}
+
+/** @brief Submit slice parameters and data. Time spent on buffer creation is added to
+ *  buffers_ns */
+static
+VAStatus
+hevc_render_slice(VADisplay va_dpy, VAContextID context_id, VASliceParameterBufferHEVC *sp_hevc,
+                  const uint8_t *slice_data, uint64_t *buffers_ns)
+{
+    VABufferID slice_parameters_buf = VA_INVALID_ID;
+    VABufferID slice_buf = VA_INVALID_ID;
+    VAStatus status;
+
+    uint64_t t_start = decoder_stats_timestamp();
+    status = vaCreateBuffer(va_dpy, context_id, VASliceParameterBufferType,
+        sizeof(VASliceParameterBufferHEVC), 1, sp_hevc, &slice_parameters_buf);
+    *buffers_ns += decoder_stats_timestamp() - t_start;
+    if (VA_STATUS_SUCCESS != status)
+        goto cleanup;
+    status = vaRenderPicture(va_dpy, context_id, &slice_parameters_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto cleanup;
+
+    t_start = decoder_stats_timestamp();
+    status = vaCreateBuffer(va_dpy, context_id, VASliceDataBufferType,
+        sp_hevc->slice_data_size, 1, (void *)slice_data, &slice_buf);
+    *buffers_ns += decoder_stats_timestamp() - t_start;
+    if (VA_STATUS_SUCCESS != status)
+        goto cleanup;
+    status = vaRenderPicture(va_dpy, context_id, &slice_buf, 1);
+
+cleanup:
+    if (VA_INVALID_ID != slice_parameters_buf) vaDestroyBuffer(va_dpy, slice_parameters_buf);
+    if (VA_INVALID_ID != slice_buf) vaDestroyBuffer(va_dpy, slice_buf);
+    return status;
+}
+
+static
+VdpStatus
+softVdpDecoderRender_hevc(VdpDecoderData *decoderData, VdpVideoSurfaceData *dstSurfData,
+                          VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+                          VdpBitstreamBuffer const *bitstream_buffers)
+{
+    VdpDeviceData *deviceData = decoderData->device;
+    VADisplay va_dpy = deviceData->va_dpy;
+    VAStatus status;
+    VdpStatus vs;
+    VdpPictureInfoHEVC const *vdppi = (void *)picture_info;
+    uint8_t *merged_bitstream = NULL;
+    VABufferID pic_param_buf = VA_INVALID_ID;
+    VABufferID iq_matrix_buf = VA_INVALID_ID;
+    uint64_t t_start, parse_ns = 0, buffers_ns = 0;
+    uint32_t slice_count = 0;
+
+    VAPictureParameterBufferHEVC pic_param;
+    hevc_ref_pic_set_t rps;
+    memset(&pic_param, 0, sizeof(pic_param));
+    memset(&rps, 0, sizeof(rps));
+    vs = hevc_translate_reference_frames(dstSurfData, decoderData, &pic_param, &rps, vdppi);
+    if (VDP_STATUS_RESOURCES == vs)
+        goto error_no_surfaces_left;
+    if (VDP_STATUS_OK != vs)
+        goto error;
+    hevc_translate_pic_param(&pic_param, vdppi);
+
+    const uint64_t t_submit = decoder_stats_timestamp();
+    status = vaBeginPicture(va_dpy, decoderData->context_id, dstSurfData->va_surf);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    t_start = decoder_stats_timestamp();
+    status = vaCreateBuffer(va_dpy, decoderData->context_id, VAPictureParameterBufferType,
+        sizeof(VAPictureParameterBufferHEVC), 1, &pic_param, &pic_param_buf);
+    buffers_ns += decoder_stats_timestamp() - t_start;
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+    status = vaRenderPicture(va_dpy, decoderData->context_id, &pic_param_buf, 1);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    if (vdppi->scaling_list_enabled_flag) {
+        VAIQMatrixBufferHEVC iq_matrix;
+        hevc_translate_iq_matrix(&iq_matrix, vdppi);
+        t_start = decoder_stats_timestamp();
+        status = vaCreateBuffer(va_dpy, decoderData->context_id, VAIQMatrixBufferType,
+            sizeof(VAIQMatrixBufferHEVC), 1, &iq_matrix, &iq_matrix_buf);
+        buffers_ns += decoder_stats_timestamp() - t_start;
+        if (VA_STATUS_SUCCESS != status)
+            goto error;
+        status = vaRenderPicture(va_dpy, decoderData->context_id, &iq_matrix_buf, 1);
+        if (VA_STATUS_SUCCESS != status)
+            goto error;
+    }
+
+    int total_bitstream_bytes;
+    t_start = decoder_stats_timestamp();
+    merged_bitstream = decoder_merge_bitstream_buffers(bitstream_buffer_count, bitstream_buffers,
+                                                       &total_bitstream_bytes);
+    if (NULL == merged_bitstream)
+        goto error_resources;
+    decoder_stats_add_time(&decoderData->stats, VDP_DECODER_STAGE_MERGE,
+                           decoder_stats_timestamp() - t_start);
+
+    rbsp_state_t st_g;      // reference, global state
+    rbsp_attach_buffer(&st_g, merged_bitstream, total_bitstream_bytes);
+    int nal_offset = rbsp_navigate_to_nal_unit(&st_g);
+    if (nal_offset < 0)
+        goto error_no_nal_header;
+
+    // Slice parameters of previous slice segment are kept in sp_hevc, as dependent slice
+    // segments inherit them. Every slice is submitted one iteration later, when it's known
+    // whether it was the last one.
+    VASliceParameterBufferHEVC sp_hevc;
+    VASliceParameterBufferHEVC sp_pending;
+    const uint8_t *pending_data = NULL;
+    memset(&sp_hevc, 0, sizeof(sp_hevc));
+
+    do {
+        rbsp_state_t st = rbsp_copy_state(&st_g);
+        int nal_offset_next = rbsp_navigate_to_nal_unit(&st_g);
+        const unsigned int end_pos = (nal_offset_next > 0) ? (nal_offset_next - 3)
+                                                           : total_bitstream_bytes;
+        const int nal_unit_type = (merged_bitstream[nal_offset] >> 1) & 0x3f;
+
+        if (nal_unit_type < HEVC_NAL_VPS) {     // skip non-VCL NAL units
+            t_start = decoder_stats_timestamp();
+            parse_slice_segment_header(&st, &pic_param, &rps, &sp_hevc);
+            parse_ns += decoder_stats_timestamp() - t_start;
+            sp_hevc.slice_data_size         = end_pos - nal_offset;
+            sp_hevc.slice_data_offset       = 0;
+            sp_hevc.slice_data_flag         = VA_SLICE_DATA_FLAG_ALL;
+            sp_hevc.slice_data_byte_offset  = st.cur_ptr - (merged_bitstream + nal_offset);
+            sp_hevc.LongSliceFlags.fields.LastSliceOfPic = 0;
+
+            if (NULL != pending_data) {
+                status = hevc_render_slice(va_dpy, decoderData->context_id, &sp_pending,
+                                           pending_data, &buffers_ns);
+                if (VA_STATUS_SUCCESS != status)
+                    goto error;
+                slice_count ++;
+            }
+            sp_pending = sp_hevc;
+            pending_data = merged_bitstream + nal_offset;
+        }
+
+        if (nal_offset_next < 0)
+            break;
+        nal_offset = nal_offset_next;
+    } while (1);
+
+    if (NULL != pending_data) {
+        sp_pending.LongSliceFlags.fields.LastSliceOfPic = 1;
+        status = hevc_render_slice(va_dpy, decoderData->context_id, &sp_pending, pending_data,
+                                   &buffers_ns);
+        if (VA_STATUS_SUCCESS != status)
+            goto error;
+        slice_count ++;
+    }
+
+    status = vaEndPicture(va_dpy, decoderData->context_id);
+    if (VA_STATUS_SUCCESS != status)
+        goto error;
+
+    VdpDecoderStatsVaGl *stats = &decoderData->stats;
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_SUBMIT, decoder_stats_timestamp() - t_submit);
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_PARSE, parse_ns);
+    decoder_stats_add_time(stats, VDP_DECODER_STAGE_BUFFERS, buffers_ns);
+    decoder_stats_add_slices(stats, slice_count);
+
+    vs = VDP_STATUS_OK;
+    goto cleanup;
+
+error:
+    traceError("error (softVdpDecoderRender): something gone wrong\n");
+    vs = VDP_STATUS_ERROR;
+    goto cleanup;
 error_no_nal_header:
     traceError("error (softVdpDecoderRender): no NAL header\n");
-    return VDP_STATUS_ERROR;
+    vs = VDP_STATUS_ERROR;
+    goto cleanup;
 error_resources:
-    return VDP_STATUS_RESOURCES;
+    vs = VDP_STATUS_RESOURCES;
+    goto cleanup;
 error_no_surfaces_left:
     traceError("error (softVdpDecoderRender): no surfaces left in buffer\n");
-    return VDP_STATUS_ERROR;
+    vs = VDP_STATUS_ERROR;
+cleanup:
+    if (VA_INVALID_ID != pic_param_buf) vaDestroyBuffer(va_dpy, pic_param_buf);
+    if (VA_INVALID_ID != iq_matrix_buf) vaDestroyBuffer(va_dpy, iq_matrix_buf);
+    free(merged_bitstream);
+    return vs;
+}
+#endif
+
+static
+VdpStatus
+decoder_render(VdpDecoderData *decoderData, VdpVideoSurfaceData *dstSurfData,
+               VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+               VdpBitstreamBuffer const *bitstream_buffers)
+{
+    if (decoderData->sw_decoder) {
+        if (dstSurfData->width != decoderData->width || dstSurfData->height != decoderData->height)
+            return VDP_STATUS_INVALID_SIZE;
+        if (VDP_CHROMA_TYPE_420 != dstSurfData->chroma_type)
+            return VDP_STATUS_INVALID_CHROMA_TYPE;
+        uint8_t *const planes[3] = { dstSurfData->y_plane, dstSurfData->u_plane,
+                                     dstSurfData->v_plane };
+        const uint32_t pitches[3] = { dstSurfData->stride, dstSurfData->stride / 2,
+                                      dstSurfData->stride / 2 };
+        return sw_decoder_render_h264(decoderData->sw_decoder,
+                                      (const VdpPictureInfoH264 *)picture_info,
+                                      bitstream_buffer_count, bitstream_buffers, planes, pitches,
+                                      &decoderData->stats);
+    }
+
+    switch (decoderData->profile) {
+    case VDP_DECODER_PROFILE_H264_BASELINE:
+    case VDP_DECODER_PROFILE_H264_MAIN:
+    case VDP_DECODER_PROFILE_H264_HIGH:
+        return softVdpDecoderRender_h264(decoderData, dstSurfData, picture_info,
+                                         bitstream_buffer_count, bitstream_buffers);
+
+    case VDP_DECODER_PROFILE_MPEG4_PART2_SP:
+    case VDP_DECODER_PROFILE_MPEG4_PART2_ASP:
+    case VDP_DECODER_PROFILE_DIVX4_QMOBILE:
+    case VDP_DECODER_PROFILE_DIVX4_MOBILE:
+    case VDP_DECODER_PROFILE_DIVX4_HOME_THEATER:
+    case VDP_DECODER_PROFILE_DIVX4_HD_1080P:
+    case VDP_DECODER_PROFILE_DIVX5_QMOBILE:
+    case VDP_DECODER_PROFILE_DIVX5_MOBILE:
+    case VDP_DECODER_PROFILE_DIVX5_HOME_THEATER:
+    case VDP_DECODER_PROFILE_DIVX5_HD_1080P:
+        return softVdpDecoderRender_mpeg4(decoderData, dstSurfData, picture_info,
+                                          bitstream_buffer_count, bitstream_buffers);
+
+#ifdef HAVE_HEVC_DECODING
+    case VDP_DECODER_PROFILE_HEVC_MAIN:
+    case VDP_DECODER_PROFILE_HEVC_MAIN_10:
+    case VDP_DECODER_PROFILE_HEVC_MAIN_STILL:
+        return softVdpDecoderRender_hevc(decoderData, dstSurfData, picture_info,
+                                         bitstream_buffer_count, bitstream_buffers);
+#endif
+
+    default:
+        traceError("error (softVdpDecoderRender): no implementation for profile %s\n",
+                   reverse_decoder_profile(decoderData->profile));
+        return VDP_STATUS_NO_IMPLEMENTATION;
+    }
+}
+
+VdpStatus
+softVdpDecoderRender(VdpDecoder decoder, VdpVideoSurface target,
+                     VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
+                     VdpBitstreamBuffer const *bitstream_buffers)
+{
+    VdpDecoderData *decoderData = handlestorage_get(decoder, HANDLETYPE_DECODER);
+    VdpVideoSurfaceData *dstSurfData = handlestorage_get(target, HANDLETYPE_VIDEO_SURFACE);
+    if (NULL == decoderData || NULL == dstSurfData)
+        return VDP_STATUS_INVALID_HANDLE;
+
+    decoder_capture_render(decoder, decoderData->profile, decoderData->width,
+                           decoderData->height, decoderData->max_references, target,
+                           picture_info, bitstream_buffer_count, bitstream_buffers);
+
+    // texture copy of surface becomes stale
+    dstSurfData->tex_valid = 0;
+
+    const uint64_t t_start = decoder_stats_timestamp();
+    VdpStatus ret = decoder_render(decoderData, dstSurfData, picture_info,
+                                   bitstream_buffer_count, bitstream_buffers);
+    if (VDP_STATUS_OK == ret) {
+        decoder_stats_add_time(&decoderData->stats, VDP_DECODER_STAGE_TOTAL,
+                               decoder_stats_timestamp() - t_start);
+        decoder_stats_add_frame(&decoderData->stats, bitstream_buffer_count,
+                                bitstream_buffers);
+    }
+    return ret;
 }
 
 VdpStatus
@@ -780,9 +2121,11 @@ softVdpOutputSurfaceQueryCapabilities(VdpDevice device, VdpRGBAFormat surface_rg
     }
 
     GLint max_texture_size;
+    glx_context_push_thread_local(deviceData);
+    glx_context_clear_errors();
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
-
     GLenum gl_error = glGetError();
+    glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpOutputSurfaceQueryCapabilities): gl error %d\n", gl_error);
         return VDP_STATUS_ERROR;
@@ -867,7 +2210,9 @@ softVdpOutputSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
         data->bytes_per_pixel = 4;
         break;
     case VDP_RGBA_FORMAT_A8:
-        data->gl_internal_format = GL_RGBA;
+        // single channel is enough. Sampled as {a, 0, 0, 1} and drawn to through red
+        // channel, same as when it was kept in GL_RGBA texture
+        data->gl_internal_format = GL_R8;
         data->gl_format = GL_RED;
         data->gl_type = GL_UNSIGNED_BYTE;
         data->bytes_per_pixel = 1;
@@ -886,8 +2231,9 @@ softVdpOutputSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
     data->rgba_format = rgba_format;
 
     glx_context_push_thread_local(deviceData);
+    glx_context_clear_errors();
     glGenTextures(1, &data->tex_id);
-    glBindTexture(GL_TEXTURE_2D, data->tex_id);
+    gl_state_bind_texture(data->tex_id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -897,7 +2243,7 @@ softVdpOutputSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
                  data->gl_type, NULL);
 
     glGenFramebuffers(1, &data->fbo_id);
-    glBindFramebuffer(GL_FRAMEBUFFER, data->fbo_id);
+    gl_state_bind_framebuffer(data->fbo_id);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, data->tex_id, 0);
     GLenum gl_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (GL_FRAMEBUFFER_COMPLETE != gl_status) {
@@ -933,10 +2279,11 @@ softVdpOutputSurfaceDestroy(VdpOutputSurface surface)
     VdpDeviceData *deviceData = data->device;
 
     glx_context_push_thread_local(deviceData);
-    glDeleteTextures(1, &data->tex_id);
-    glDeleteFramebuffers(1, &data->fbo_id);
+    renderer_flush_texture(&deviceData->renderer, data->tex_id);
+    gl_state_delete_textures(1, &data->tex_id);
+    gl_state_delete_framebuffers(1, &data->fbo_id);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpOutputSurfaceDestroy): gl error %d\n", gl_error);
@@ -982,18 +2329,19 @@ softVdpOutputSurfaceGetBitsNative(VdpOutputSurface surface, VdpRect const *sourc
         srcRect = *source_rect;
 
     glx_context_push_thread_local(deviceData);
-    glBindFramebuffer(GL_FRAMEBUFFER, srcSurfData->fbo_id);
+    renderer_flush_texture(&deviceData->renderer, srcSurfData->tex_id);
+    gl_state_bind_framebuffer(srcSurfData->fbo_id);
     glReadBuffer(GL_COLOR_ATTACHMENT0);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, destination_pitches[0] / srcSurfData->bytes_per_pixel);
+    glPixelStorei(GL_PACK_ROW_LENGTH, destination_pitches[0] / srcSurfData->bytes_per_pixel);
     if (4 != srcSurfData->bytes_per_pixel)
         glPixelStorei(GL_PACK_ALIGNMENT, 1);
     glReadPixels(srcRect.x0, srcRect.y0, srcRect.x1 - srcRect.x0, srcRect.y1 - srcRect.y0,
                  srcSurfData->gl_format, srcSurfData->gl_type, destination_data[0]);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_PACK_ROW_LENGTH, 0);
     if (4 != srcSurfData->bytes_per_pixel)
         glPixelStorei(GL_PACK_ALIGNMENT, 4);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpOutputSurfaceGetBitsNative): gl error %d\n", gl_error);
@@ -1017,7 +2365,8 @@ softVdpOutputSurfacePutBitsNative(VdpOutputSurface surface, void const *const *s
         dstRect = *destination_rect;
 
     glx_context_push_thread_local(deviceData);
-    glBindTexture(GL_TEXTURE_2D, dstSurfData->tex_id);
+    renderer_flush_texture(&deviceData->renderer, dstSurfData->tex_id);
+    gl_state_bind_texture(dstSurfData->tex_id);
 
     glPixelStorei(GL_UNPACK_ROW_LENGTH, source_pitches[0] / dstSurfData->bytes_per_pixel);
     if (4 != dstSurfData->bytes_per_pixel)
@@ -1029,7 +2378,7 @@ softVdpOutputSurfacePutBitsNative(VdpOutputSurface surface, void const *const *s
     if (4 != dstSurfData->bytes_per_pixel)
         glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpOutputSurfacePutBitsNative): gl error %d\n", gl_error);
@@ -1060,6 +2409,7 @@ softVdpOutputSurfacePutBitsIndexed(VdpOutputSurface surface, VdpIndexedFormat so
     const uint32_t *color_table32 = color_table;
 
     glx_context_push_thread_local(deviceData);
+    renderer_flush_texture(&deviceData->renderer, surfData->tex_id);
 
     switch (source_indexed_format) {
     case VDP_INDEXED_FORMAT_I8A8:
@@ -1082,13 +2432,13 @@ softVdpOutputSurfacePutBitsIndexed(VdpOutputSurface surface, VdpIndexedFormat so
                 }
             }
 
-            glBindTexture(GL_TEXTURE_2D, surfData->tex_id);
+            gl_state_bind_texture(surfData->tex_id);
             glTexSubImage2D(GL_TEXTURE_2D, 0, dstRect.x0, dstRect.y0,
                             dstRect.x1 - dstRect.x0, dstRect.y1 - dstRect.y0,
                             GL_BGRA, GL_UNSIGNED_BYTE, unpacked_buf);
             free(unpacked_buf);
 
-            GLenum gl_error = glGetError();
+            GLenum gl_error = glx_context_check_error();
             glx_context_pop();
             if (GL_NO_ERROR != gl_error) {
                 traceError("error (VdpOutputSurfacePutBitsIndexed): gl error %d\n", gl_error);
@@ -1110,17 +2460,245 @@ softVdpOutputSurfacePutBitsYCbCr(VdpOutputSurface surface, VdpYCbCrFormat source
                                  void const *const *source_data, uint32_t const *source_pitches,
                                  VdpRect const *destination_rect, VdpCSCMatrix const *csc_matrix)
 {
-    (void)surface; (void)source_ycbcr_format; (void)source_data; (void)source_pitches;
-    (void)destination_rect; (void)csc_matrix;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    (void)surface; (void)source_ycbcr_format; (void)source_data; (void)source_pitches;
+    (void)destination_rect; (void)csc_matrix;
+    return VDP_STATUS_NO_IMPLEMENTATION;
+}
+
+/** @brief Build CSC matrix for color standard, with procamp adjustments applied
+ *
+ *  Resulting matrix converts (Y, Cb, Cr, 1) in [0, 1] range to RGB in the same range, so
+ *  offsets are normalized, as VDPAU applications expect.
+ */
+static
+VdpStatus
+generate_csc_matrix(const VdpProcamp *procamp, VdpColorStandard standard,
+                    VdpCSCMatrix *csc_matrix)
+{
+    // luma and chroma coefficients for limited range input, without offsets
+    static const float bt601[3][3] = {
+        { 1.16438f,  0.0f,      1.59603f },
+        { 1.16438f, -0.39176f, -0.81297f },
+        { 1.16438f,  2.01723f,  0.0f     },
+    };
+    static const float bt709[3][3] = {
+        { 1.16438f,  0.0f,      1.79274f },
+        { 1.16438f, -0.21325f, -0.53291f },
+        { 1.16438f,  2.11240f,  0.0f     },
+    };
+    static const float smpte240m[3][3] = {
+        { 1.16438f,  0.0f,      1.79411f },
+        { 1.16438f, -0.25798f, -0.54258f },
+        { 1.16438f,  2.07871f,  0.0f     },
+    };
+
+    const float (*cstd)[3];
+    switch (standard) {
+    case VDP_COLOR_STANDARD_ITUR_BT_601:    cstd = bt601;       break;
+    case VDP_COLOR_STANDARD_ITUR_BT_709:    cstd = bt709;       break;
+    case VDP_COLOR_STANDARD_SMPTE_240M:     cstd = smpte240m;   break;
+    default:
+        return VDP_STATUS_INVALID_COLOR_STANDARD;
+    }
+
+    // Contrast scales luma around black level, brightness shifts it. Saturation and hue
+    // scale and rotate chroma vector.
+    const float b = procamp->brightness;
+    const float c = procamp->contrast;
+    const float uv_cos = procamp->saturation * cosf(procamp->hue);
+    const float uv_sin = procamp->saturation * sinf(procamp->hue);
+    const float y_bias = -16.0f / 255.0f;
+    const float uv_bias = -128.0f / 255.0f;
+
+    for (int k = 0; k < 3; k ++) {
+        (*csc_matrix)[k][0] = c * cstd[k][0];
+        (*csc_matrix)[k][1] = c * (cstd[k][1] * uv_cos - cstd[k][2] * uv_sin);
+        (*csc_matrix)[k][2] = c * (cstd[k][2] * uv_cos + cstd[k][1] * uv_sin);
+        (*csc_matrix)[k][3] = cstd[k][0] * (b + c * y_bias) +
+                              cstd[k][1] * c * uv_bias * (uv_cos + uv_sin) +
+                              cstd[k][2] * c * uv_bias * (uv_cos - uv_sin);
+    }
+
+    return VDP_STATUS_OK;
+}
+
+/** @brief CSC matrix used by video mixer unless application sets another one */
+static
+void
+default_csc_matrix(VdpCSCMatrix *csc_matrix)
+{
+    const VdpProcamp procamp = { VDP_PROCAMP_VERSION, 0.0f, 1.0f, 1.0f, 0.0f };
+    generate_csc_matrix(&procamp, VDP_COLOR_STANDARD_ITUR_BT_601, csc_matrix);
+}
+
+/** @brief Highest enabled HIGH_QUALITY_SCALING_Lx level, or 0 if none is enabled */
+static
+int
+mixer_hq_scaling_level(const VdpVideoMixerData *mixerData)
+{
+    for (int level = 9; level > 0; level --)
+        if (mixerData->hq_scaling_enables & (1u << (level - 1)))
+            return level;
+    return 0;
+}
+
+/** @brief Scaling kernel: Catmull-Rom bicubic or Lanczos-3 */
+static
+float
+hq_scaling_kernel(int lanczos, float x)
+{
+    x = fabsf(x);
+    if (lanczos) {
+        if (x < 1e-5f)
+            return 1.0f;
+        if (x >= 3.0f)
+            return 0.0f;
+        const float px = M_PI * x;
+        return 3.0f * sinf(px) * sinf(px / 3.0f) / (px * px);
+    }
+
+    if (x < 1.0f)
+        return 1.5f * x * x * x - 2.5f * x * x + 1.0f;
+    if (x < 2.0f)
+        return -0.5f * x * x * x + 2.5f * x * x - 4.0f * x + 2.0f;
+    return 0.0f;
+}
+
+/** @brief Kernel stretch factor for scaling src_size pixels into dst_size ones
+ *
+ *  Kernel is widened by the downscaling ratio, so all source pixels contribute to the
+ *  result. Ratio is limited, to keep number of taps within shader_scale_separable loop.
+ */
+static
+float
+hq_scaling_ratio(uint32_t src_size, uint32_t dst_size)
+{
+    const float ratio = (float)src_size / dst_size;
+    return MIN(MAX(ratio, 1.0f), 4.0f);
+}
+
+/** @brief Prepare intermediate framebuffer of given size
+ *
+ *  @retval 1 on success
+ *  @retval 0 if framebuffer can't be created
+ */
+static
+int
+mixer_intermediate_prepare(VdpVideoMixerData *mixerData, uint32_t width, uint32_t height)
+{
+    // exact size is kept, so edge clamping works for filter taps outside of picture
+    if (mixerData->inter_tex_id && mixerData->inter_tex_width == width &&
+        mixerData->inter_tex_height == height)
+    {
+        return 1;
+    }
+
+    if (0 == mixerData->inter_tex_id) {
+        glGenTextures(1, &mixerData->inter_tex_id);
+        gl_state_bind_texture(mixerData->inter_tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glGenFramebuffers(1, &mixerData->inter_fbo_id);
+    }
+    gl_state_bind_texture(mixerData->inter_tex_id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+    mixerData->inter_tex_width = width;
+    mixerData->inter_tex_height = height;
+
+    gl_state_bind_framebuffer(mixerData->inter_fbo_id);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           mixerData->inter_tex_id, 0);
+    const GLenum fb_status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    gl_state_bind_framebuffer(0);
+    if (GL_FRAMEBUFFER_COMPLETE != fb_status) {
+        traceError("error (mixer_intermediate_prepare): framebuffer not ready, %d\n", fb_status);
+        return 0;
+    }
+    return 1;
+}
+
+/** @brief Prepare weights texture and intermediate framebuffer of given size
+ *
+ *  @retval 1 if high quality scaling may be done
+ *  @retval 0 if framebuffer can't be created
+ */
+static
+int
+mixer_hq_prepare(VdpVideoMixerData *mixerData, uint32_t width, uint32_t height)
+{
+    const int lanczos = mixer_hq_scaling_level(mixerData) >= 2;
+    if (0 == mixerData->hq_weights_tex_id) {
+        glGenTextures(1, &mixerData->hq_weights_tex_id);
+        gl_state_bind_texture(mixerData->hq_weights_tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        mixerData->hq_lanczos = -1;
+    }
+
+    if (mixerData->hq_lanczos != lanczos) {
+        // kernel values for distances 0..3, shader normalizes sum of tap weights itself
+        GLfloat weights[256][4];
+        memset(weights, 0, sizeof(weights));
+        for (int k = 0; k < 256; k ++)
+            weights[k][0] = hq_scaling_kernel(lanczos, k * 3.0f / 255.0f);
+        gl_state_bind_texture(mixerData->hq_weights_tex_id);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, 256, 1, 0, GL_RGBA, GL_FLOAT, weights);
+        mixerData->hq_lanczos = lanczos;
+    }
+
+    return mixer_intermediate_prepare(mixerData, width, height);
+}
+
+/** @brief Check if mixer feature could be done on device
+ *
+ *  Features are done either by VA-API video processing or by shaders over VA-API output.
+ *  Shaders are compiled at device creation, so failed compilation makes feature unsupported.
+ *  YCbCr shader used without VA-API does bilinear scaling only.
+ */
+static
+int
+mixer_feature_supported(VdpDeviceData *deviceData, VdpVideoMixerFeature feature)
+{
+    if (!deviceData->va_available)
+        return 0;
+
+    switch (feature) {
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L1:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L2:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L3:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L4:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L5:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L6:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L7:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L8:
+    case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L9:
+        return 0 != deviceData->scaler_shader.program;
+    case VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL:
+        return 0 != deviceData->temporal_shader.program;
+    case VDP_VIDEO_MIXER_FEATURE_NOISE_REDUCTION:
+    case VDP_VIDEO_MIXER_FEATURE_SHARPNESS:
+        return 0 != deviceData->filter_shader.program;
+    default:
+        return 0;
+    }
 }
 
 VdpStatus
 softVdpVideoMixerQueryFeatureSupport(VdpDevice device, VdpVideoMixerFeature feature,
                                      VdpBool *is_supported)
 {
-    (void)device; (void)feature; (void)is_supported;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    VdpDeviceData *deviceData = handlestorage_get(device, HANDLETYPE_DEVICE);
+    if (NULL == deviceData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (NULL == is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+
+    *is_supported = mixer_feature_supported(deviceData, feature);
+    return VDP_STATUS_OK;
 }
 
 VdpStatus
@@ -1135,8 +2713,29 @@ VdpStatus
 softVdpVideoMixerQueryAttributeSupport(VdpDevice device, VdpVideoMixerAttribute attribute,
                                        VdpBool *is_supported)
 {
-    (void)device; (void)attribute; (void)is_supported;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    VdpDeviceData *deviceData = handlestorage_get(device, HANDLETYPE_DEVICE);
+    if (NULL == deviceData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (NULL == is_supported)
+        return VDP_STATUS_INVALID_POINTER;
+
+    switch (attribute) {
+    case VDP_VIDEO_MIXER_ATTRIBUTE_BACKGROUND_COLOR:
+    case VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX:
+        *is_supported = 1;
+        break;
+    case VDP_VIDEO_MIXER_ATTRIBUTE_NOISE_REDUCTION_LEVEL:
+        *is_supported =
+            mixer_feature_supported(deviceData, VDP_VIDEO_MIXER_FEATURE_NOISE_REDUCTION);
+        break;
+    case VDP_VIDEO_MIXER_ATTRIBUTE_SHARPNESS_LEVEL:
+        *is_supported = mixer_feature_supported(deviceData, VDP_VIDEO_MIXER_FEATURE_SHARPNESS);
+        break;
+    default:
+        *is_supported = 0;
+        break;
+    }
+    return VDP_STATUS_OK;
 }
 
 VdpStatus
@@ -1151,8 +2750,30 @@ VdpStatus
 softVdpVideoMixerQueryAttributeValueRange(VdpDevice device, VdpVideoMixerAttribute attribute,
                                           void *min_value, void *max_value)
 {
-    (void)device; (void)attribute; (void)min_value; (void)max_value;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    VdpDeviceData *deviceData = handlestorage_get(device, HANDLETYPE_DEVICE);
+    if (NULL == deviceData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (NULL == min_value || NULL == max_value)
+        return VDP_STATUS_INVALID_POINTER;
+
+    switch (attribute) {
+    case VDP_VIDEO_MIXER_ATTRIBUTE_NOISE_REDUCTION_LEVEL:
+    case VDP_VIDEO_MIXER_ATTRIBUTE_LUMA_KEY_MIN_LUMA:
+    case VDP_VIDEO_MIXER_ATTRIBUTE_LUMA_KEY_MAX_LUMA:
+        *(float *)min_value = 0.0f;
+        *(float *)max_value = 1.0f;
+        return VDP_STATUS_OK;
+    case VDP_VIDEO_MIXER_ATTRIBUTE_SHARPNESS_LEVEL:
+        *(float *)min_value = -1.0f;
+        *(float *)max_value = 1.0f;
+        return VDP_STATUS_OK;
+    case VDP_VIDEO_MIXER_ATTRIBUTE_SKIP_CHROMA_DEINTERLACE:
+        *(uint8_t *)min_value = 0;
+        *(uint8_t *)max_value = 1;
+        return VDP_STATUS_OK;
+    default:
+        return VDP_STATUS_INVALID_VIDEO_MIXER_ATTRIBUTE;
+    }
 }
 
 VdpStatus
@@ -1161,18 +2782,54 @@ softVdpVideoMixerCreate(VdpDevice device, uint32_t feature_count,
                         VdpVideoMixerParameter const *parameters,
                         void const *const *parameter_values, VdpVideoMixer *mixer)
 {
-    (void)feature_count; (void)features;    // TODO: mixer features
-    (void)parameter_count; (void)parameters; (void)parameter_values;    // TODO: mixer parameters
     VdpDeviceData *deviceData = handlestorage_get(device, HANDLETYPE_DEVICE);
     if (NULL == deviceData)
         return VDP_STATUS_INVALID_HANDLE;
 
+    // video size is only a hint for VA-API video processing, so some default is fine
+    uint32_t video_width = 1920;
+    uint32_t video_height = 1080;
+    for (uint32_t k = 0; k < parameter_count; k ++) {
+        if (NULL == parameters || NULL == parameter_values || NULL == parameter_values[k])
+            return VDP_STATUS_INVALID_POINTER;
+        switch (parameters[k]) {
+        case VDP_VIDEO_MIXER_PARAMETER_VIDEO_SURFACE_WIDTH:
+            video_width = *(const uint32_t *)parameter_values[k];
+            break;
+        case VDP_VIDEO_MIXER_PARAMETER_VIDEO_SURFACE_HEIGHT:
+            video_height = *(const uint32_t *)parameter_values[k];
+            break;
+        default:
+            break;  // TODO: other mixer parameters
+        }
+    }
+
     VdpVideoMixerData *data = (VdpVideoMixerData *)calloc(1, sizeof(VdpVideoMixerData));
     if (NULL == data)
         return VDP_STATUS_RESOURCES;
 
     data->type = HANDLETYPE_VIDEO_MIXER;
     data->device = deviceData;
+    data->background_color = (VdpColor){ 0.0f, 0.0f, 0.0f, 1.0f };
+    default_csc_matrix(&data->csc_matrix);
+    data->csc_matrix_is_default = 1;
+    data->noise_reduction_level = 0.0f;
+    data->sharpness_level = 0.0f;
+    data->luma_key_min_luma = 0.0f;
+    data->luma_key_max_luma = 1.0f;
+    data->skip_chroma_deinterlace = 0;
+    data->deinterlace_temporal = 0;
+
+    // Features are accepted regardless of support, as they are enabled only explicitly.
+    // Resources for high quality scaling depend on destination size, so they are allocated
+    // on first use.
+    data->hq_lanczos = -1;
+
+    data->vpp_available = 0;
+    if (deviceData->va_available && global.quirks.use_va_vpp) {
+        if (0 == va_vpp_create(&data->vpp, deviceData->va_dpy, video_width, video_height))
+            data->vpp_available = 1;
+    }
 
     deviceData->refcount ++;
     *mixer = handlestorage_add(data);
@@ -1184,7 +2841,47 @@ softVdpVideoMixerSetFeatureEnables(VdpVideoMixer mixer, uint32_t feature_count,
                                    VdpVideoMixerFeature const *features,
                                    VdpBool const *feature_enables)
 {
-    (void)mixer; (void)feature_count; (void)features; (void)feature_enables;
+    VdpVideoMixerData *mixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == mixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (feature_count > 0 && (NULL == features || NULL == feature_enables))
+        return VDP_STATUS_INVALID_POINTER;
+
+    for (uint32_t k = 0; k < feature_count; k ++) {
+        switch (features[k]) {
+        case VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL:
+            mixerData->deinterlace_temporal = feature_enables[k];
+            break;
+        case VDP_VIDEO_MIXER_FEATURE_NOISE_REDUCTION:
+            mixerData->noise_reduction = feature_enables[k];
+            break;
+        case VDP_VIDEO_MIXER_FEATURE_SHARPNESS:
+            mixerData->sharpness = feature_enables[k];
+            break;
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L1:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L2:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L3:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L4:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L5:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L6:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L7:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L8:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L9:
+            do {
+                const uint32_t bit =
+                    1u << (features[k] - VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L1);
+                if (feature_enables[k])
+                    mixerData->hq_scaling_enables |= bit;
+                else
+                    mixerData->hq_scaling_enables &= ~bit;
+            } while (0);
+            break;
+        default:
+            // unsupported features are silently ignored, as they always were
+            break;
+        }
+    }
+
     return VDP_STATUS_OK;
 }
 
@@ -1193,7 +2890,58 @@ softVdpVideoMixerSetAttributeValues(VdpVideoMixer mixer, uint32_t attribute_coun
                                     VdpVideoMixerAttribute const *attributes,
                                     void const *const *attribute_values)
 {
-    (void)mixer; (void)attribute_count; (void)attributes; (void)attribute_values;
+    VdpVideoMixerData *mixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == mixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (attribute_count > 0 && (NULL == attributes || NULL == attribute_values))
+        return VDP_STATUS_INVALID_POINTER;
+
+    for (uint32_t k = 0; k < attribute_count; k ++) {
+        const void *value = attribute_values[k];
+        // only CSC matrix could be reset to default by passing NULL
+        if (NULL == value && VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX != attributes[k])
+            return VDP_STATUS_INVALID_POINTER;
+
+        switch (attributes[k]) {
+        case VDP_VIDEO_MIXER_ATTRIBUTE_BACKGROUND_COLOR:
+            mixerData->background_color = *(const VdpColor *)value;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX:
+            do {
+                VdpCSCMatrix default_matrix;
+                default_csc_matrix(&default_matrix);
+                if (value)
+                    memcpy(mixerData->csc_matrix, value, sizeof(VdpCSCMatrix));
+                else
+                    memcpy(mixerData->csc_matrix, default_matrix, sizeof(VdpCSCMatrix));
+                mixerData->csc_matrix_is_default =
+                    !memcmp(mixerData->csc_matrix, default_matrix, sizeof(VdpCSCMatrix));
+            } while (0);
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_NOISE_REDUCTION_LEVEL:
+            if (*(const float *)value < 0.0f || *(const float *)value > 1.0f)
+                return VDP_STATUS_INVALID_VALUE;
+            mixerData->noise_reduction_level = *(const float *)value;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_SHARPNESS_LEVEL:
+            if (*(const float *)value < -1.0f || *(const float *)value > 1.0f)
+                return VDP_STATUS_INVALID_VALUE;
+            mixerData->sharpness_level = *(const float *)value;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_LUMA_KEY_MIN_LUMA:
+            mixerData->luma_key_min_luma = *(const float *)value;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_LUMA_KEY_MAX_LUMA:
+            mixerData->luma_key_max_luma = *(const float *)value;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_SKIP_CHROMA_DEINTERLACE:
+            mixerData->skip_chroma_deinterlace = *(const uint8_t *)value;
+            break;
+        default:
+            return VDP_STATUS_INVALID_VIDEO_MIXER_ATTRIBUTE;
+        }
+    }
+
     return VDP_STATUS_OK;
 }
 
@@ -1201,16 +2949,58 @@ VdpStatus
 softVdpVideoMixerGetFeatureSupport(VdpVideoMixer mixer, uint32_t feature_count,
                                    VdpVideoMixerFeature const *features, VdpBool *feature_supports)
 {
-    (void)mixer; (void)feature_count; (void)features; (void)feature_supports;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    VdpVideoMixerData *mixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == mixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (feature_count > 0 && (NULL == features || NULL == feature_supports))
+        return VDP_STATUS_INVALID_POINTER;
+
+    for (uint32_t k = 0; k < feature_count; k ++)
+        feature_supports[k] = mixer_feature_supported(mixerData->device, features[k]);
+
+    return VDP_STATUS_OK;
 }
 
 VdpStatus
 softVdpVideoMixerGetFeatureEnables(VdpVideoMixer mixer, uint32_t feature_count,
                                    VdpVideoMixerFeature const *features, VdpBool *feature_enables)
 {
-    (void)mixer; (void)feature_count; (void)features; (void)feature_enables;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    VdpVideoMixerData *mixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == mixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (feature_count > 0 && (NULL == features || NULL == feature_enables))
+        return VDP_STATUS_INVALID_POINTER;
+
+    for (uint32_t k = 0; k < feature_count; k ++) {
+        switch (features[k]) {
+        case VDP_VIDEO_MIXER_FEATURE_DEINTERLACE_TEMPORAL:
+            feature_enables[k] = mixerData->deinterlace_temporal;
+            break;
+        case VDP_VIDEO_MIXER_FEATURE_NOISE_REDUCTION:
+            feature_enables[k] = mixerData->noise_reduction;
+            break;
+        case VDP_VIDEO_MIXER_FEATURE_SHARPNESS:
+            feature_enables[k] = mixerData->sharpness;
+            break;
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L1:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L2:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L3:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L4:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L5:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L6:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L7:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L8:
+        case VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L9:
+            feature_enables[k] = !!(mixerData->hq_scaling_enables &
+                (1u << (features[k] - VDP_VIDEO_MIXER_FEATURE_HIGH_QUALITY_SCALING_L1)));
+            break;
+        default:
+            feature_enables[k] = 0;
+            break;
+        }
+    }
+
+    return VDP_STATUS_OK;
 }
 
 VdpStatus
@@ -1218,31 +3008,663 @@ softVdpVideoMixerGetParameterValues(VdpVideoMixer mixer, uint32_t parameter_coun
                                     VdpVideoMixerParameter const *parameters,
                                     void *const *parameter_values)
 {
-    (void)mixer; (void)parameter_count; (void)parameters; (void)parameter_values;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    (void)mixer; (void)parameter_count; (void)parameters; (void)parameter_values;
+    return VDP_STATUS_NO_IMPLEMENTATION;
+}
+
+VdpStatus
+softVdpVideoMixerGetAttributeValues(VdpVideoMixer mixer, uint32_t attribute_count,
+                                    VdpVideoMixerAttribute const *attributes,
+                                    void *const *attribute_values)
+{
+    VdpVideoMixerData *mixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == mixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (attribute_count > 0 && (NULL == attributes || NULL == attribute_values))
+        return VDP_STATUS_INVALID_POINTER;
+
+    for (uint32_t k = 0; k < attribute_count; k ++) {
+        void *value = attribute_values[k];
+        if (NULL == value)
+            return VDP_STATUS_INVALID_POINTER;
+
+        switch (attributes[k]) {
+        case VDP_VIDEO_MIXER_ATTRIBUTE_BACKGROUND_COLOR:
+            *(VdpColor *)value = mixerData->background_color;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_CSC_MATRIX:
+            memcpy(value, mixerData->csc_matrix, sizeof(VdpCSCMatrix));
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_NOISE_REDUCTION_LEVEL:
+            *(float *)value = mixerData->noise_reduction_level;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_SHARPNESS_LEVEL:
+            *(float *)value = mixerData->sharpness_level;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_LUMA_KEY_MIN_LUMA:
+            *(float *)value = mixerData->luma_key_min_luma;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_LUMA_KEY_MAX_LUMA:
+            *(float *)value = mixerData->luma_key_max_luma;
+            break;
+        case VDP_VIDEO_MIXER_ATTRIBUTE_SKIP_CHROMA_DEINTERLACE:
+            *(uint8_t *)value = mixerData->skip_chroma_deinterlace;
+            break;
+        default:
+            return VDP_STATUS_INVALID_VIDEO_MIXER_ATTRIBUTE;
+        }
+    }
+
+    return VDP_STATUS_OK;
+}
+
+VdpStatus
+softVdpVideoMixerDestroy(VdpVideoMixer mixer)
+{
+    VdpVideoMixerData *videoMixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == videoMixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    VdpDeviceData *deviceData = videoMixerData->device;
+
+    glx_context_push_thread_local(deviceData);
+    if (videoMixerData->vpp_va_glx) {
+        vaDestroySurfaceGLX(deviceData->va_dpy, videoMixerData->vpp_va_glx);
+        gl_state_invalidate_current();
+    }
+    if (videoMixerData->vpp_tex_id)
+        gl_state_delete_textures(1, &videoMixerData->vpp_tex_id);
+    if (videoMixerData->hq_weights_tex_id)
+        gl_state_delete_textures(1, &videoMixerData->hq_weights_tex_id);
+    if (videoMixerData->inter_tex_id) {
+        gl_state_delete_framebuffers(1, &videoMixerData->inter_fbo_id);
+        gl_state_delete_textures(1, &videoMixerData->inter_tex_id);
+    }
+    glx_context_pop();
+    if (videoMixerData->vpp_available)
+        va_vpp_destroy(&videoMixerData->vpp);
+
+    free(videoMixerData);
+    deviceData->refcount --;
+    handlestorage_expunge(mixer);
+    return VDP_STATUS_OK;
+}
+
+/** @brief What video mixer fills destination rectangle with before drawing video */
+struct mixer_background {
+    const VdpColor         *color;          ///< used if there is no surface
+    VdpOutputSurfaceData   *surface;        ///< background surface, may be NULL
+    VdpRect                 source_rect;    ///< part of surface to be used
+};
+
+/** @brief Bind destination surface FBO and fill dstRect with background
+ *
+ *  Renderer is left set up for tex_width x tex_height video texture.
+ */
+static
+void
+mixer_prepare_destination(VdpDeviceData *deviceData, VdpOutputSurfaceData *dstSurfData,
+                          uint32_t tex_width, uint32_t tex_height, const VdpRect *dstRect,
+                          const struct mixer_background *background)
+{
+    renderer_t *renderer = &deviceData->renderer;
+    renderer_set_target(renderer, dstSurfData->fbo_id, dstSurfData->width, dstSurfData->height,
+                        0);
+    gl_state_blend(0);
+
+    // Clear dstRect area
+    if (background->surface) {
+        gl_state_use_program(renderer->textured_program);
+        gl_state_bind_texture(background->surface->tex_id);
+        renderer_set_texture_size(renderer, background->surface->width,
+                                  background->surface->height);
+        renderer_draw_quad(renderer, &background->source_rect, dstRect, NULL);
+    } else {
+        gl_state_use_program(renderer->solid_program);
+        renderer_draw_quad(renderer, NULL, dstRect, background->color);
+    }
+    gl_state_use_program(0);
+
+    renderer_set_texture_size(renderer, tex_width, tex_height);
+}
+
+/** @brief Blend layers over destination, which should be already bound by
+ *  mixer_prepare_destination
+ *
+ *  Layers are expected to be validated by caller.
+ */
+static
+void
+mixer_draw_layers(VdpDeviceData *deviceData, VdpOutputSurfaceData *dstSurfData,
+                  uint32_t layer_count, VdpLayer const *layers)
+{
+    if (0 == layer_count)
+        return;
+
+    renderer_t *renderer = &deviceData->renderer;
+    gl_state_use_program(renderer->textured_program);
+    gl_state_blend(1);
+    gl_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    gl_state_blend_equation(GL_FUNC_ADD, GL_FUNC_ADD);
+
+    for (uint32_t k = 0; k < layer_count; k ++) {
+        VdpOutputSurfaceData *layerSurfData =
+            handlestorage_get(layers[k].source_surface, HANDLETYPE_OUTPUT_SURFACE);
+        VdpRect s_rect = {0, 0, layerSurfData->width, layerSurfData->height};
+        VdpRect d_rect = {0, 0, dstSurfData->width, dstSurfData->height};
+        if (layers[k].source_rect)
+            s_rect = *layers[k].source_rect;
+        if (layers[k].destination_rect)
+            d_rect = *layers[k].destination_rect;
+
+        gl_state_bind_texture(layerSurfData->tex_id);
+        renderer_set_texture_size(renderer, layerSurfData->width, layerSurfData->height);
+        renderer_draw_quad(renderer, &s_rect, &d_rect, NULL);
+    }
+
+    gl_state_blend(0);
+    gl_state_bind_texture(0);
+    gl_state_use_program(0);
+}
+
+/** @brief Create shader program and plane textures for GPU YCbCr to RGB conversion
+ *
+ *  @retval 1 if shader is ready to use
+ *  @retval 0 if shaders are not supported. Creation is not retried in that case.
+ */
+static
+int
+ycbcr_shader_prepare(VdpDeviceData *deviceData)
+{
+    VdpYCbCrShader *shader = &deviceData->ycbcr_shader;
+    if (shader->program)
+        return 1;
+    if (shader->unavailable)
+        return 0;
+
+    shader->program = shader_program_create("ycbcr_to_rgb", shader_ycbcr_to_rgb);
+    if (0 == shader->program) {
+        traceError("warning (ycbcr_shader_prepare): falling back to software color space "
+                   "conversion\n");
+        shader->unavailable = 1;
+        return 0;
+    }
+
+    gl_state_use_program(shader->program);
+    glUniform1i(glGetUniformLocation(shader->program, "tex_y"), 0);
+    glUniform1i(glGetUniformLocation(shader->program, "tex_cb"), 1);
+    glUniform1i(glGetUniformLocation(shader->program, "tex_cr"), 2);
+    shader->csc_location = glGetUniformLocation(shader->program, "csc");
+    gl_state_use_program(0);
+
+    glGenTextures(3, shader->tex_id);
+    for (int k = 0; k < 3; k ++) {
+        gl_state_bind_texture(shader->tex_id[k]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        shader->tex_width[k] = 0;
+        shader->tex_height[k] = 0;
+    }
+    shader->tex_type = GL_UNSIGNED_BYTE;
+
+    return 1;
+}
+
+/** @brief Upload Y, Cb and Cr planes of software video surface into texture units 0, 1, 2 */
+static
+void
+ycbcr_shader_upload_planes(VdpYCbCrShader *shader, VdpVideoSurfaceData *srcSurfData)
+{
+    const uint32_t divider = chroma_storage_size_divider(srcSurfData->chroma_type);
+    const uint32_t chroma_width  = (1 == divider) ? srcSurfData->width : srcSurfData->width / 2;
+    const uint32_t chroma_height = (4 == divider) ? srcSurfData->height / 2 : srcSurfData->height;
+    const uint32_t chroma_stride = (1 == divider) ? srcSurfData->stride : srcSurfData->stride / 2;
+    const GLenum type = (2 == chroma_bytes_per_sample(srcSurfData->chroma_type))
+                        ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+
+    const void *planes[3] = { srcSurfData->y_plane, srcSurfData->u_plane, srcSurfData->v_plane };
+    const uint32_t widths[3] = { srcSurfData->width, chroma_width, chroma_width };
+    const uint32_t heights[3] = { srcSurfData->height, chroma_height, chroma_height };
+    const uint32_t strides[3] = { srcSurfData->stride, chroma_stride, chroma_stride };
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int k = 0; k < 3; k ++) {
+        gl_state_active_texture(GL_TEXTURE0 + k);
+        gl_state_bind_texture(shader->tex_id[k]);
+        if (shader->tex_width[k] != widths[k] || shader->tex_height[k] != heights[k] ||
+            shader->tex_type != type)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, (GL_UNSIGNED_SHORT == type) ? GL_R16 : GL_R8,
+                         widths[k], heights[k], 0, GL_RED, type, NULL);
+            shader->tex_width[k] = widths[k];
+            shader->tex_height[k] = heights[k];
+        }
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, strides[k]);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, widths[k], heights[k], GL_RED, type, planes[k]);
+    }
+    shader->tex_type = type;
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+/** @brief Unbind textures of units 0, 1, 2, leaving texture unit 0 active */
+static
+void
+mixer_unbind_textures(void)
+{
+    for (int k = 2; k >= 0; k --) {
+        gl_state_active_texture(GL_TEXTURE0 + k);
+        gl_state_bind_texture(0);
+    }
+}
+
+/** @brief Pass VDPAU CSC matrix to shader */
+static
+void
+ycbcr_shader_set_csc(VdpYCbCrShader *shader, VdpCSCMatrix const *csc_matrix)
+{
+    glUniform4fv(shader->csc_location, 3, &(*csc_matrix)[0][0]);
+}
+
+/** @brief Create shader program for processing of RGB textures
+ *
+ *  Current, past and future textures are expected in texture units 0, 1 and 2. Scaler
+ *  weights are expected in texture unit 1.
+ *
+ *  @retval 1 if shader is ready to use
+ *  @retval 0 if shaders are not supported. Creation is not retried in that case.
+ */
+static
+int
+rgb_shader_prepare(VdpRGBShader *shader, const char *name, const char *source)
+{
+    if (shader->program)
+        return 1;
+    if (shader->unavailable)
+        return 0;
+
+    shader->program = shader_program_create(name, source);
+    if (0 == shader->program) {
+        traceError("warning (rgb_shader_prepare): %s will not be done\n", name);
+        shader->unavailable = 1;
+        return 0;
+    }
+
+    gl_state_use_program(shader->program);
+    glUniform1i(glGetUniformLocation(shader->program, "tex"), 0);
+    glUniform1i(glGetUniformLocation(shader->program, "tex_past"), 1);
+    glUniform1i(glGetUniformLocation(shader->program, "tex_future"), 2);
+    glUniform1i(glGetUniformLocation(shader->program, "weights"), 1);
+    shader->transform_location = glGetUniformLocation(shader->program, "transform");
+    shader->tex_height_location = glGetUniformLocation(shader->program, "tex_height");
+    shader->field_location = glGetUniformLocation(shader->program, "field");
+    shader->tex_size_location = glGetUniformLocation(shader->program, "tex_size");
+    shader->direction_location = glGetUniformLocation(shader->program, "direction");
+    shader->support_location = glGetUniformLocation(shader->program, "support");
+    shader->scale_location = glGetUniformLocation(shader->program, "scale");
+    shader->denoise_location = glGetUniformLocation(shader->program, "denoise");
+    shader->sharpness_location = glGetUniformLocation(shader->program, "sharpness");
+    gl_state_use_program(0);
+    return 1;
+}
+
+/** @brief Make sure video surface texture holds current content of its VA surface
+ *
+ *  Copy is skipped if texture is still valid, so surfaces used as past and future
+ *  references are copied only once.
+ */
+static
+VdpStatus
+video_surface_sync_texture(VdpDeviceData *deviceData, VdpVideoSurfaceData *surfData)
+{
+    if (surfData->tex_valid || VA_INVALID_SURFACE == surfData->va_surf)
+        return VDP_STATUS_OK;
+
+    VAStatus status;
+    if (NULL == surfData->va_glx) {
+        status = vaCreateSurfaceGLX(deviceData->va_dpy, GL_TEXTURE_2D, surfData->tex_id,
+                                    &surfData->va_glx);
+        gl_state_invalidate_current();
+        if (VA_STATUS_SUCCESS != status)
+            return VDP_STATUS_ERROR;
+    }
+
+    status = vaCopySurfaceGLX(deviceData->va_dpy, surfData->va_glx, surfData->va_surf, 0);
+    // VA-API draws with GL on its own
+    gl_state_invalidate_current();
+    if (VA_STATUS_SUCCESS == status)
+        surfData->tex_valid = 1;
+    return VDP_STATUS_OK;
+}
+
+/** @brief Get video surface to be used as temporal reference, or NULL if it's not usable */
+static
+VdpVideoSurfaceData *
+mixer_get_reference(VdpDeviceData *deviceData, uint32_t count, VdpVideoSurface const *surfaces)
+{
+    if (0 == count || NULL == surfaces)
+        return NULL;
+    VdpVideoSurfaceData *surfData = handlestorage_get(surfaces[0], HANDLETYPE_VIDEO_SURFACE);
+    if (NULL == surfData || surfData->device != deviceData)
+        return NULL;
+    if (VDP_STATUS_OK != video_surface_sync_texture(deviceData, surfData))
+        return NULL;
+    return surfData;
+}
+
+/** @brief Compute RGB transform, which turns RGB converted with default CSC matrix into
+ *  RGB converted with given one
+ *
+ *  If default conversion is rgb = A1 * ycbcr + o1, and desired one is A2 * ycbcr + o2, then
+ *  desired rgb = A2 * inv(A1) * (rgb - o1) + o2.
+ */
+static
+void
+csc_rgb_transform(VdpCSCMatrix const *csc_matrix, GLfloat rows[3][4])
+{
+    VdpCSCMatrix m1;
+    default_csc_matrix(&m1);
+
+    // inverse of default matrix 3x3 part, via cofactors
+    float inv[3][3];
+    inv[0][0] = m1[1][1] * m1[2][2] - m1[1][2] * m1[2][1];
+    inv[0][1] = m1[0][2] * m1[2][1] - m1[0][1] * m1[2][2];
+    inv[0][2] = m1[0][1] * m1[1][2] - m1[0][2] * m1[1][1];
+    inv[1][0] = m1[1][2] * m1[2][0] - m1[1][0] * m1[2][2];
+    inv[1][1] = m1[0][0] * m1[2][2] - m1[0][2] * m1[2][0];
+    inv[1][2] = m1[0][2] * m1[1][0] - m1[0][0] * m1[1][2];
+    inv[2][0] = m1[1][0] * m1[2][1] - m1[1][1] * m1[2][0];
+    inv[2][1] = m1[0][1] * m1[2][0] - m1[0][0] * m1[2][1];
+    inv[2][2] = m1[0][0] * m1[1][1] - m1[0][1] * m1[1][0];
+    const float det = m1[0][0] * inv[0][0] + m1[0][1] * inv[1][0] + m1[0][2] * inv[2][0];
+    for (int j = 0; j < 3; j ++)
+        for (int k = 0; k < 3; k ++)
+            inv[j][k] /= det;
+
+    for (int j = 0; j < 3; j ++) {
+        float offset = (*csc_matrix)[j][3];
+        for (int k = 0; k < 3; k ++) {
+            const float a = (*csc_matrix)[j][0] * inv[0][k] + (*csc_matrix)[j][1] * inv[1][k] +
+                            (*csc_matrix)[j][2] * inv[2][k];
+            rows[j][k] = a;
+            offset -= a * m1[k][3];
+        }
+        rows[j][3] = offset;
+    }
+}
+
+/** @brief Pass RGB transform for given CSC matrix to shader, see csc_rgb_transform */
+static
+void
+rgb_shader_set_csc(VdpRGBShader *shader, VdpCSCMatrix const *csc_matrix)
+{
+    GLfloat rows[3][4];
+    csc_rgb_transform(csc_matrix, rows);
+    glUniform4fv(shader->transform_location, 3, &rows[0][0]);
+}
+
+/** @brief Apply RGB transform for given CSC matrix to BGRA image in system memory
+ *
+ *  Used by software conversion, which always converts with default matrix.
+ */
+static
+void
+csc_apply_to_bgra(VdpCSCMatrix const *csc_matrix, uint8_t *img, uint32_t stride,
+                  uint32_t width, uint32_t height)
+{
+    GLfloat t[3][4];
+    csc_rgb_transform(csc_matrix, t);
+    for (int k = 0; k < 3; k ++)
+        t[k][3] *= 255.0f;
+
+    for (uint32_t y = 0; y < height; y ++) {
+        uint8_t *p = img + y * stride * 4;
+        for (uint32_t x = 0; x < width; x ++, p += 4) {
+            const float rgb[3] = { p[2], p[1], p[0] };
+            for (int k = 0; k < 3; k ++) {
+                float v = t[k][0] * rgb[0] + t[k][1] * rgb[1] + t[k][2] * rgb[2] + t[k][3];
+                v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+                p[2 - k] = (uint8_t)(v + 0.5f);
+            }
+        }
+    }
+}
+
+/** @brief Get VA surface of video surface given by handle, or VA_INVALID_SURFACE */
+static
+VASurfaceID
+mixer_get_va_reference(VdpDeviceData *deviceData, uint32_t count, VdpVideoSurface const *surfaces)
+{
+    if (0 == count || NULL == surfaces)
+        return VA_INVALID_SURFACE;
+    VdpVideoSurfaceData *surfData = handlestorage_get(surfaces[0], HANDLETYPE_VIDEO_SURFACE);
+    if (NULL == surfData || surfData->device != deviceData)
+        return VA_INVALID_SURFACE;
+    return surfData->va_surf;
+}
+
+/** @brief Deinterlace, filter and scale video with VA-API video processing, and copy result
+ *  to mixer texture
+ *
+ *  Result occupies whole vpp_tex_width x vpp_tex_height texture.
+ *
+ *  @retval 1 if picture is ready
+ *  @retval 0 if video processing can't handle this picture, so GL path should be used instead
+ */
+static
+int
+mixer_process_vpp(VdpDeviceData *deviceData, VdpVideoMixerData *mixerData,
+                  VdpVideoSurfaceData *srcSurfData, VdpVideoMixerPictureStructure structure,
+                  uint32_t video_surface_past_count, VdpVideoSurface const *video_surface_past,
+                  uint32_t video_surface_future_count, VdpVideoSurface const *video_surface_future,
+                  const VdpRect *srcVideoRect, const VdpRect *dstVideoRect)
+{
+    va_vpp_t *vpp = &mixerData->vpp;
+    if (VA_INVALID_SURFACE == srcSurfData->va_surf)
+        return 0;
+
+    // destination rectangle may be flipped, flipping is left for GL stage
+    const int dst_x0 = dstVideoRect->x0, dst_x1 = dstVideoRect->x1;
+    const int dst_y0 = dstVideoRect->y0, dst_y1 = dstVideoRect->y1;
+    const uint32_t out_width = (dst_x1 > dst_x0) ? dst_x1 - dst_x0 : dst_x0 - dst_x1;
+    const uint32_t out_height = (dst_y1 > dst_y0) ? dst_y1 - dst_y0 : dst_y0 - dst_y1;
+    if (0 == out_width || 0 == out_height)
+        return 0;
+
+    va_vpp_params_t params;
+    memset(&params, 0, sizeof(params));
+    params.surface = srcSurfData->va_surf;
+    params.surface_region.x = MIN(srcVideoRect->x0, srcVideoRect->x1);
+    params.surface_region.y = MIN(srcVideoRect->y0, srcVideoRect->y1);
+    params.surface_region.width = MAX(srcVideoRect->x0, srcVideoRect->x1) -
+                                  params.surface_region.x;
+    params.surface_region.height = MAX(srcVideoRect->y0, srcVideoRect->y1) -
+                                   params.surface_region.y;
+    params.out_width = out_width;
+    params.out_height = out_height;
+    params.bottom_field = (VDP_VIDEO_MIXER_PICTURE_STRUCTURE_BOTTOM_FIELD == structure);
+    params.past = VA_INVALID_SURFACE;
+    params.future = VA_INVALID_SURFACE;
+
+    if (VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME == structure) {
+        params.deinterlace = VA_VPP_DEINTERLACE_NONE;
+    } else if (vpp->has_motion_adaptive && (mixerData->deinterlace_temporal || !vpp->has_bob)) {
+        params.deinterlace = VA_VPP_DEINTERLACE_MOTION_ADAPTIVE;
+        params.past = mixer_get_va_reference(deviceData, video_surface_past_count,
+                                             video_surface_past);
+        params.future = mixer_get_va_reference(deviceData, video_surface_future_count,
+                                               video_surface_future);
+    } else if (vpp->has_bob) {
+        params.deinterlace = VA_VPP_DEINTERLACE_BOB;
+    } else {
+        // no deinterlacing in driver, shaders will do it
+        return 0;
+    }
+
+    params.denoise_level = mixerData->noise_reduction ? mixerData->noise_reduction_level : 0.0f;
+    params.sharpness_level = mixerData->sharpness ? mixerData->sharpness_level : 0.0f;
+    params.hq_scaling = mixer_hq_scaling_level(mixerData) > 0;
+
+    VASurfaceID out_surf = va_vpp_process(vpp, &params);
+    if (VA_INVALID_SURFACE == out_surf)
+        return 0;
+
+    if (0 == mixerData->vpp_tex_id || mixerData->vpp_tex_width != out_width ||
+        mixerData->vpp_tex_height != out_height)
+    {
+        if (mixerData->vpp_va_glx) {
+            vaDestroySurfaceGLX(deviceData->va_dpy, mixerData->vpp_va_glx);
+            mixerData->vpp_va_glx = NULL;
+            gl_state_invalidate_current();
+        }
+        if (0 == mixerData->vpp_tex_id)
+            glGenTextures(1, &mixerData->vpp_tex_id);
+        gl_state_bind_texture(mixerData->vpp_tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, out_width, out_height, 0, GL_BGRA,
+                     GL_UNSIGNED_BYTE, NULL);
+        mixerData->vpp_tex_width = out_width;
+        mixerData->vpp_tex_height = out_height;
+
+        VAStatus status = vaCreateSurfaceGLX(deviceData->va_dpy, GL_TEXTURE_2D,
+                                             mixerData->vpp_tex_id, &mixerData->vpp_va_glx);
+        gl_state_invalidate_current();
+        if (VA_STATUS_SUCCESS != status) {
+            mixerData->vpp_va_glx = NULL;
+            return 0;
+        }
+    }
+
+    VAStatus status = vaCopySurfaceGLX(deviceData->va_dpy, mixerData->vpp_va_glx, out_surf, 0);
+    gl_state_invalidate_current();
+    return VA_STATUS_SUCCESS == status;
 }
 
-VdpStatus
-softVdpVideoMixerGetAttributeValues(VdpVideoMixer mixer, uint32_t attribute_count,
-                                    VdpVideoMixerAttribute const *attributes,
-                                    void *const *attribute_values)
+/** @brief Scale RGB texture into destination with two passes of separable scaler
+ *
+ *  Horizontal pass writes into intermediate framebuffer, vertical one into destination
+ *  surface. CSC correction is applied in vertical pass, as it commutes with filtering.
+ *
+ *  @retval 1 if picture is drawn
+ *  @retval 0 if high quality scaling is not available, so plain drawing should be done
+ */
+static
+int
+mixer_render_hq_scaled(VdpDeviceData *deviceData, VdpVideoMixerData *mixerData,
+                       VdpOutputSurfaceData *dstSurfData, GLuint tex_id, uint32_t tex_width,
+                       uint32_t tex_height, const VdpRect *texRect, const VdpRect *dstRect,
+                       const VdpRect *dstVideoRect, const struct mixer_background *background)
 {
-    (void)mixer; (void)attribute_count; (void)attributes; (void)attribute_values;
-    return VDP_STATUS_NO_IMPLEMENTATION;
+    VdpRGBShader *shader = &deviceData->scaler_shader;
+    const int dst_x0 = dstVideoRect->x0, dst_x1 = dstVideoRect->x1;
+    const int dst_y0 = dstVideoRect->y0, dst_y1 = dstVideoRect->y1;
+    const int src_x0 = texRect->x0, src_x1 = texRect->x1;
+    const int src_y0 = texRect->y0, src_y1 = texRect->y1;
+    const uint32_t inter_width = (dst_x1 > dst_x0) ? dst_x1 - dst_x0 : dst_x0 - dst_x1;
+    const uint32_t inter_height = (src_y1 > src_y0) ? src_y1 - src_y0 : src_y0 - src_y1;
+    const uint32_t src_width = (src_x1 > src_x0) ? src_x1 - src_x0 : src_x0 - src_x1;
+    const uint32_t dst_height = (dst_y1 > dst_y0) ? dst_y1 - dst_y0 : dst_y0 - dst_y1;
+    if (0 == inter_width || 0 == inter_height || 0 == dst_height)
+        return 0;
+    if (!rgb_shader_prepare(shader, "high quality scaling", shader_scale_separable))
+        return 0;
+    if (!mixer_hq_prepare(mixerData, inter_width, inter_height))
+        return 0;
+
+    static const GLfloat identity[3][4] = { {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0} };
+    const VdpRect interRect = {0, 0, inter_width, inter_height};
+
+    // horizontal pass, source rows are kept as is
+    renderer_t *renderer = &deviceData->renderer;
+    renderer_set_target(renderer, mixerData->inter_fbo_id, mixerData->inter_tex_width,
+                        mixerData->inter_tex_height, 0);
+    gl_state_blend(0);
+    renderer_set_texture_size(renderer, tex_width, tex_height);
+
+    gl_state_use_program(shader->program);
+    glUniform4fv(shader->transform_location, 3, &identity[0][0]);
+    glUniform2f(shader->tex_size_location, tex_width, tex_height);
+    glUniform2f(shader->direction_location, 1.0f, 0.0f);
+    glUniform1f(shader->support_location, mixerData->hq_lanczos ? 3.0f : 2.0f);
+    glUniform1f(shader->scale_location, hq_scaling_ratio(src_width, inter_width));
+    gl_state_active_texture(GL_TEXTURE1);
+    gl_state_bind_texture(mixerData->hq_weights_tex_id);
+    gl_state_active_texture(GL_TEXTURE0);
+    gl_state_bind_texture(tex_id);
+    renderer_draw_quad(renderer, texRect, &interRect, NULL);
+
+    // vertical pass
+    gl_state_use_program(0);
+    mixer_prepare_destination(deviceData, dstSurfData, mixerData->inter_tex_width,
+                              mixerData->inter_tex_height, dstRect, background);
+    gl_state_use_program(shader->program);
+    rgb_shader_set_csc(shader, &mixerData->csc_matrix);
+    glUniform2f(shader->tex_size_location, mixerData->inter_tex_width, mixerData->inter_tex_height);
+    glUniform2f(shader->direction_location, 0.0f, 1.0f);
+    glUniform1f(shader->scale_location, hq_scaling_ratio(inter_height, dst_height));
+    gl_state_bind_texture(mixerData->inter_tex_id);
+    renderer_draw_quad(renderer, &interRect, dstVideoRect, NULL);
+
+    gl_state_use_program(0);
+    mixer_unbind_textures();
+    return 1;
 }
 
-VdpStatus
-softVdpVideoMixerDestroy(VdpVideoMixer mixer)
+/** @brief Deinterlace texRect area of texture into intermediate framebuffer
+ *
+ *  Used when deinterlaced picture is to be filtered, as filter taps need neighbouring rows
+ *  of the whole frame. CSC matrix is left to the filtering pass.
+ *
+ *  @retval 1 if picture is deinterlaced into intermediate texture
+ *  @retval 0 if framebuffer can't be created
+ */
+static
+int
+mixer_deinterlace_to_intermediate(VdpDeviceData *deviceData, VdpVideoMixerData *mixerData,
+                                  VdpRGBShader *shader, float field, GLuint tex_id,
+                                  uint32_t tex_width, uint32_t tex_height, const VdpRect *texRect,
+                                  VdpVideoSurfaceData *pastSurfData,
+                                  VdpVideoSurfaceData *futureSurfData)
 {
-    VdpVideoMixerData *videoMixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
-    if (NULL == videoMixerData)
-        return VDP_STATUS_INVALID_HANDLE;
-    VdpDeviceData *deviceData = videoMixerData->device;
+    const int src_x0 = texRect->x0, src_x1 = texRect->x1;
+    const int src_y0 = texRect->y0, src_y1 = texRect->y1;
+    const uint32_t inter_width = (src_x1 > src_x0) ? src_x1 - src_x0 : src_x0 - src_x1;
+    const uint32_t inter_height = (src_y1 > src_y0) ? src_y1 - src_y0 : src_y0 - src_y1;
+    if (0 == inter_width || 0 == inter_height)
+        return 0;
+    if (!mixer_intermediate_prepare(mixerData, inter_width, inter_height))
+        return 0;
+
+    static const GLfloat identity[3][4] = { {1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0} };
+    const VdpRect interRect = {0, 0, inter_width, inter_height};
+
+    renderer_t *renderer = &deviceData->renderer;
+    renderer_set_target(renderer, mixerData->inter_fbo_id, mixerData->inter_tex_width,
+                        mixerData->inter_tex_height, 0);
+    gl_state_blend(0);
+    renderer_set_texture_size(renderer, tex_width, tex_height);
+
+    gl_state_use_program(shader->program);
+    glUniform4fv(shader->transform_location, 3, &identity[0][0]);
+    glUniform1f(shader->tex_height_location, tex_height);
+    glUniform1f(shader->field_location, field);
+    if (pastSurfData && futureSurfData) {
+        gl_state_active_texture(GL_TEXTURE1);
+        gl_state_bind_texture(pastSurfData->tex_id);
+        gl_state_active_texture(GL_TEXTURE2);
+        gl_state_bind_texture(futureSurfData->tex_id);
+        gl_state_active_texture(GL_TEXTURE0);
+    }
+    gl_state_bind_texture(tex_id);
+    renderer_draw_quad(renderer, texRect, &interRect, NULL);
 
-    free(videoMixerData);
-    deviceData->refcount --;
-    handlestorage_expunge(mixer);
-    return VDP_STATUS_OK;
+    gl_state_use_program(0);
+    mixer_unbind_textures();
+    return 1;
 }
 
 VdpStatus
@@ -1257,16 +3679,7 @@ softVdpVideoMixerRender(VdpVideoMixer mixer, VdpOutputSurface background_surface
                         VdpRect const *destination_rect, VdpRect const *destination_video_rect,
                         uint32_t layer_count, VdpLayer const *layers)
 {
-    (void)mixer;    // TODO: mixer should be used to get mixing parameters
-    // TODO: current implementation ignores previous and future surfaces, using only current.
-    // Is that acceptable for interlaced video? Will VAAPI handle deinterlacing?
-
-    (void)background_surface;   // TODO: background_surface. Is it safe to just ignore it?
-    (void)background_source_rect;
-    (void)current_picture_structure;
-    (void)video_surface_past_count; (void)video_surface_past;
-    (void)video_surface_future_count; (void)video_surface_future;
-    (void)layer_count; (void)layers;
+    // TODO: deinterlacing is done for VA-API surfaces only
 
     VdpVideoSurfaceData *srcSurfData =
         handlestorage_get(video_surface_current, HANDLETYPE_VIDEO_SURFACE);
@@ -1277,6 +3690,39 @@ softVdpVideoMixerRender(VdpVideoMixer mixer, VdpOutputSurface background_surface
     if (srcSurfData->device != dstSurfData->device)
         return VDP_STATUS_HANDLE_DEVICE_MISMATCH;
     VdpDeviceData *deviceData = srcSurfData->device;
+    VdpVideoMixerData *mixerData = handlestorage_get(mixer, HANDLETYPE_VIDEO_MIXER);
+    if (NULL == mixerData)
+        return VDP_STATUS_INVALID_HANDLE;
+    if (mixerData->device != deviceData)
+        return VDP_STATUS_HANDLE_DEVICE_MISMATCH;
+
+    // Background, video and layers are all drawn into destination while its framebuffer
+    // is bound, so everything is validated beforehand
+    struct mixer_background background = { &mixerData->background_color, NULL, {0, 0, 0, 0} };
+    if (VDP_INVALID_HANDLE != background_surface) {
+        background.surface = handlestorage_get(background_surface, HANDLETYPE_OUTPUT_SURFACE);
+        if (NULL == background.surface)
+            return VDP_STATUS_INVALID_HANDLE;
+        if (background.surface->device != deviceData)
+            return VDP_STATUS_HANDLE_DEVICE_MISMATCH;
+        background.source_rect =
+            (VdpRect){0, 0, background.surface->width, background.surface->height};
+        if (background_source_rect)
+            background.source_rect = *background_source_rect;
+    }
+
+    if (layer_count > 0 && NULL == layers)
+        return VDP_STATUS_INVALID_POINTER;
+    for (uint32_t k = 0; k < layer_count; k ++) {
+        if (VDP_LAYER_VERSION != layers[k].struct_version)
+            return VDP_STATUS_INVALID_STRUCT_VERSION;
+        VdpOutputSurfaceData *layerSurfData =
+            handlestorage_get(layers[k].source_surface, HANDLETYPE_OUTPUT_SURFACE);
+        if (NULL == layerSurfData)
+            return VDP_STATUS_INVALID_HANDLE;
+        if (layerSurfData->device != deviceData)
+            return VDP_STATUS_HANDLE_DEVICE_MISMATCH;
+    }
 
     VdpRect srcVideoRect = {0, 0, srcSurfData->width, srcSurfData->height};
     if (video_source_rect)
@@ -1293,66 +3739,163 @@ softVdpVideoMixerRender(VdpVideoMixer mixer, VdpOutputSurface background_surface
     // TODO: dstRect should clip dstVideoRect
 
     glx_context_push_thread_local(deviceData);
+    // destination, background and layers may have pending quads
+    renderer_flush(&deviceData->renderer);
 
     if (deviceData->va_available) {
-        VAStatus status;
-        if (NULL == srcSurfData->va_glx) {
-            status = vaCreateSurfaceGLX(deviceData->va_dpy, GL_TEXTURE_2D, srcSurfData->tex_id,
-                                        &srcSurfData->va_glx);
-            if (VA_STATUS_SUCCESS != status) {
-                glx_context_pop();
-                return VDP_STATUS_ERROR;
+        // With video processing available, VA-API does everything but CSC matrix application,
+        // leaving plain copy to GL.
+        const int vpp_done = mixerData->vpp_available &&
+            mixer_process_vpp(deviceData, mixerData, srcSurfData, current_picture_structure,
+                              video_surface_past_count, video_surface_past,
+                              video_surface_future_count, video_surface_future,
+                              &srcVideoRect, &dstVideoRect);
+
+        GLuint tex_id = srcSurfData->tex_id;
+        uint32_t tex_width = srcSurfData->width;
+        uint32_t tex_height = srcSurfData->height;
+        VdpRect texRect = srcVideoRect;
+        if (vpp_done) {
+            tex_id = mixerData->vpp_tex_id;
+            tex_width = mixerData->vpp_tex_width;
+            tex_height = mixerData->vpp_tex_height;
+            texRect = (VdpRect){0, 0, tex_width, tex_height};
+        } else if (VDP_STATUS_OK != video_surface_sync_texture(deviceData, srcSurfData)) {
+            glx_context_pop();
+            return VDP_STATUS_ERROR;
+        }
+
+        // VA-API converts to RGB by itself, presumably with BT.601 matrix. Non-default
+        // CSC matrix is applied as RGB correction while drawing, in the same pass as
+        // deinterlacing, if any.
+        const int interlaced = !vpp_done &&
+                               VDP_VIDEO_MIXER_PICTURE_STRUCTURE_FRAME != current_picture_structure;
+        // Noise reduction and sharpening not done by VA-API video processing are fused into
+        // drawing pass, which follows deinterlacing pass for interlaced pictures
+        const float denoise =
+            (mixerData->noise_reduction && !(vpp_done && mixerData->vpp.has_denoise))
+            ? mixerData->noise_reduction_level : 0.0f;
+        const float sharpness =
+            (mixerData->sharpness && !(vpp_done && mixerData->vpp.has_sharpen))
+            ? mixerData->sharpness_level : 0.0f;
+        const int filter = (0.0f != denoise || 0.0f != sharpness);
+
+        // VA-API video processing does high quality scaling by itself. Deinterlacing and
+        // filtering shaders do scaling at the same pass, so plain bilinear scaling is used
+        // in that case.
+        const int hq_done = !vpp_done && !interlaced && !filter &&
+            mixer_hq_scaling_level(mixerData) > 0 &&
+            mixer_render_hq_scaled(deviceData, mixerData, dstSurfData, tex_id, tex_width,
+                                   tex_height, &texRect, &dstRect, &dstVideoRect, &background);
+        if (!hq_done) {
+            VdpVideoSurfaceData *pastSurfData = NULL;
+            VdpVideoSurfaceData *futureSurfData = NULL;
+            VdpRGBShader *shader = NULL;
+            if (interlaced && mixerData->deinterlace_temporal) {
+                // Both neighbouring fields are needed. Without them, as at the beginning or
+                // the end of stream, pictures are bob deinterlaced instead.
+                pastSurfData = mixer_get_reference(deviceData, video_surface_past_count,
+                                                   video_surface_past);
+                futureSurfData = mixer_get_reference(deviceData, video_surface_future_count,
+                                                     video_surface_future);
+                if (NULL == pastSurfData || NULL == futureSurfData ||
+                    !rgb_shader_prepare(&deviceData->temporal_shader, "temporal deinterlacing",
+                                        shader_deinterlace_temporal))
+                {
+                    pastSurfData = NULL;
+                    futureSurfData = NULL;
+                }
+            }
+            if (pastSurfData && futureSurfData) {
+                shader = &deviceData->temporal_shader;
+            } else if (interlaced &&
+                       rgb_shader_prepare(&deviceData->bob_shader, "bob deinterlacing",
+                                          shader_deinterlace_bob))
+            {
+                shader = &deviceData->bob_shader;
+            } else if (filter &&
+                       rgb_shader_prepare(&deviceData->filter_shader,
+                                          "noise reduction and sharpening", shader_rgb_filter))
+            {
+                shader = &deviceData->filter_shader;
+            } else if (!mixerData->csc_matrix_is_default &&
+                       rgb_shader_prepare(&deviceData->rgb_shader, "CSC matrix application",
+                                          shader_rgb_transform))
+            {
+                shader = &deviceData->rgb_shader;
+            }
+
+            // Filters are applied to deinterlaced frame in a separate pass. Picture is left
+            // unfiltered if that pass can't be done.
+            const float field =
+                (VDP_VIDEO_MIXER_PICTURE_STRUCTURE_BOTTOM_FIELD == current_picture_structure)
+                ? 1.0f : 0.0f;
+            const int deinterlacing = (&deviceData->temporal_shader == shader ||
+                                       &deviceData->bob_shader == shader);
+            if (deinterlacing && filter &&
+                rgb_shader_prepare(&deviceData->filter_shader, "noise reduction and sharpening",
+                                   shader_rgb_filter) &&
+                mixer_deinterlace_to_intermediate(deviceData, mixerData, shader, field, tex_id,
+                                                  tex_width, tex_height, &texRect, pastSurfData,
+                                                  futureSurfData))
+            {
+                shader = &deviceData->filter_shader;
+                pastSurfData = NULL;
+                futureSurfData = NULL;
+                tex_id = mixerData->inter_tex_id;
+                tex_width = mixerData->inter_tex_width;
+                tex_height = mixerData->inter_tex_height;
+                texRect = (VdpRect){0, 0, tex_width, tex_height};
+            }
+
+            mixer_prepare_destination(deviceData, dstSurfData, tex_width, tex_height, &dstRect,
+                                      &background);
+
+            if (shader) {
+                gl_state_use_program(shader->program);
+                rgb_shader_set_csc(shader, &mixerData->csc_matrix);
+                glUniform1f(shader->tex_height_location, tex_height);
+                glUniform1f(shader->field_location, field);
+                glUniform2f(shader->tex_size_location, tex_width, tex_height);
+                glUniform1f(shader->denoise_location, denoise);
+                glUniform1f(shader->sharpness_location, sharpness);
+            }
+            if (pastSurfData && futureSurfData) {
+                gl_state_active_texture(GL_TEXTURE1);
+                gl_state_bind_texture(pastSurfData->tex_id);
+                gl_state_active_texture(GL_TEXTURE2);
+                gl_state_bind_texture(futureSurfData->tex_id);
+                gl_state_active_texture(GL_TEXTURE0);
             }
+
+            // Render (maybe scaled) data from video surface
+            if (NULL == shader)
+                gl_state_use_program(deviceData->renderer.textured_program);
+            gl_state_bind_texture(tex_id);
+            renderer_draw_quad(&deviceData->renderer, &texRect, &dstVideoRect, NULL);
+
+            if (pastSurfData && futureSurfData)
+                mixer_unbind_textures();
+            gl_state_use_program(0);
         }
 
-        status = vaCopySurfaceGLX(deviceData->va_dpy, srcSurfData->va_glx, srcSurfData->va_surf, 0);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, dstSurfData->fbo_id);
-        glMatrixMode(GL_PROJECTION);
-        glLoadIdentity();
-        glOrtho(0, dstSurfData->width, 0, dstSurfData->height, -1.0f, 1.0f);
-        glViewport(0, 0, dstSurfData->width, dstSurfData->height);
-        glDisable(GL_BLEND);
-
-        glMatrixMode(GL_MODELVIEW);
-        glLoadIdentity();
-
-        glMatrixMode(GL_TEXTURE);
-        glLoadIdentity();
-        glScalef(1.0f/srcSurfData->width, 1.0f/srcSurfData->height, 1.0f);
-
-        // Clear dstRect area
-        glDisable(GL_TEXTURE_2D);
-        glColor4f(0, 0, 0, 1);
-        glBegin(GL_QUADS);
-            glVertex2f(dstRect.x0, dstRect.y0);
-            glVertex2f(dstRect.x1, dstRect.y0);
-            glVertex2f(dstRect.x1, dstRect.y1);
-            glVertex2f(dstRect.x0, dstRect.y1);
-        glEnd();
-
-        // Render (maybe scaled) data from video surface
-        glEnable(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, srcSurfData->tex_id);
-        glColor4f(1, 1, 1, 1);
-        glBegin(GL_QUADS);
-            glTexCoord2i(srcVideoRect.x0, srcVideoRect.y0);
-            glVertex2f(dstVideoRect.x0, dstVideoRect.y0);
-
-            glTexCoord2i(srcVideoRect.x1, srcVideoRect.y0);
-            glVertex2f(dstVideoRect.x1, dstVideoRect.y0);
-
-            glTexCoord2i(srcVideoRect.x1, srcVideoRect.y1);
-            glVertex2f(dstVideoRect.x1, dstVideoRect.y1);
-
-            glTexCoord2i(srcVideoRect.x0, srcVideoRect.y1);
-            glVertex2f(dstVideoRect.x0, dstVideoRect.y1);
-        glEnd();
+    } else if (ycbcr_shader_prepare(deviceData)) {
+        // convert and scale on GPU, only planes themselves are uploaded
+        VdpYCbCrShader *shader = &deviceData->ycbcr_shader;
+
+        mixer_prepare_destination(deviceData, dstSurfData, srcSurfData->width,
+                                  srcSurfData->height, &dstRect, &background);
+        ycbcr_shader_upload_planes(shader, srcSurfData);
+        gl_state_use_program(shader->program);
+        ycbcr_shader_set_csc(shader, &mixerData->csc_matrix);
+        renderer_draw_quad(&deviceData->renderer, &srcVideoRect, &dstVideoRect, NULL);
+        gl_state_use_program(0);
+        mixer_unbind_textures();
 
     } else {
-        // fall back to software convertion
+        // fall back to software convertion, if shaders are not available. libswscale
+        // converts with default matrix, other ones are applied afterwards
         // TODO: make sure not to do scaling in software, only colorspace conversion
-        // TODO: use GL shaders to do colorspace conversion job
         // TODO: handle all three kind of rectangles and clipping
         const uint32_t dstVideoWidth  = dstVideoRect.x1 - dstVideoRect.x0;
         const uint32_t dstVideoHeight = dstVideoRect.y1 - dstVideoRect.y0;
@@ -1360,12 +3903,20 @@ softVdpVideoMixerRender(VdpVideoMixer mixer, VdpOutputSurface background_surface
         const uint32_t dstVideoStride = (dstVideoWidth & 3) ? (dstVideoWidth & ~3u) + 4
                                                             : dstVideoWidth;
         uint8_t *img_buf = malloc(dstVideoStride * dstVideoHeight * 4);
-        if (NULL == img_buf) return VDP_STATUS_RESOURCES;
+        if (NULL == img_buf) {
+            glx_context_pop();
+            return VDP_STATUS_RESOURCES;
+        }
 
         struct SwsContext *sws_ctx =
-            sws_getContext(srcSurfData->width, srcSurfData->height, PIX_FMT_YUV420P,
-                dstVideoWidth, dstVideoHeight,
-                PIX_FMT_RGBA, SWS_POINT, NULL, NULL, NULL);
+            sws_cache_get(&deviceData->sws_cache, srcSurfData->width, srcSurfData->height,
+                          PIX_FMT_YUV420P, dstVideoWidth, dstVideoHeight, PIX_FMT_RGBA, SWS_POINT);
+        if (NULL == sws_ctx) {
+            traceError("error (softVdpVideoMixerRender): can not create SwsContext\n");
+            free(img_buf);
+            glx_context_pop();
+            return VDP_STATUS_RESOURCES;
+        }
 
         uint8_t const * const src_planes[] =
             { srcSurfData->y_plane, srcSurfData->v_plane, srcSurfData->u_plane, NULL };
@@ -1376,16 +3927,22 @@ softVdpVideoMixerRender(VdpVideoMixer mixer, VdpOutputSurface background_surface
         int res = sws_scale(sws_ctx,
                             src_planes, src_strides, 0, srcSurfData->height,
                             dst_planes, dst_strides);
-        sws_freeContext(sws_ctx);
         if (res != (int)dstVideoHeight) {
             traceError("error (softVdpVideoMixerRender): libswscale scaling failed\n");
+            free(img_buf);
             glx_context_pop();
             return VDP_STATUS_ERROR;
         }
+        if (!mixerData->csc_matrix_is_default) {
+            csc_apply_to_bgra(&mixerData->csc_matrix, img_buf, dstVideoStride, dstVideoWidth,
+                              dstVideoHeight);
+        }
 
-        // copy converted image to texture
+        // copy converted image to texture, over background
+        mixer_prepare_destination(deviceData, dstSurfData, dstSurfData->width,
+                                  dstSurfData->height, &dstRect, &background);
         glPixelStorei(GL_UNPACK_ROW_LENGTH, dstVideoStride);
-        glBindTexture(GL_TEXTURE_2D, dstSurfData->tex_id);
+        gl_state_bind_texture(dstSurfData->tex_id);
         glTexSubImage2D(GL_TEXTURE_2D, 0,
             dstVideoRect.x0, dstVideoRect.y0,
             dstVideoRect.x1 - dstVideoRect.x0, dstVideoRect.y1 - dstVideoRect.y0,
@@ -1394,7 +3951,9 @@ softVdpVideoMixerRender(VdpVideoMixer mixer, VdpOutputSurface background_surface
         free(img_buf);
     }
 
-    GLenum gl_error = glGetError();
+    mixer_draw_layers(deviceData, dstSurfData, layer_count, layers);
+
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpVideoMixerRender): gl error %d\n", gl_error);
@@ -1423,7 +3982,7 @@ softVdpPresentationQueueTargetDestroy(VdpPresentationQueueTarget presentation_qu
     glx_context_push_thread_local(deviceData);
     glXDestroyContext(deviceData->display, pqTargetData->glc);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpPresentationQueueTargetDestroy): gl error %d\n", gl_error);
@@ -1548,63 +4107,51 @@ softVdpPresentationQueueDisplay(VdpPresentationQueue presentation_queue, VdpOutp
         return VDP_STATUS_HANDLE_DEVICE_MISMATCH;
     VdpDeviceData *deviceData = surfData->device;
 
+    if (deviceData->renderer.batch_count > 0) {
+        // framebuffers are not shared between contexts, so pending quads are drawn in
+        // the same context they would be drawn otherwise
+        glx_context_push_thread_local(deviceData);
+        renderer_flush(&deviceData->renderer);
+        glx_context_pop();
+    }
+
     glx_context_push_global(deviceData->display, pqueueData->target->drawable, pqueueData->target->glc);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (pqueueData->target->debug_output < 0)
+        pqueueData->target->debug_output = glx_context_enable_debug_output();
+    glx_context_set_debug_output(pqueueData->target->debug_output);
 
     const uint32_t target_width  = (clip_width > 0)  ? clip_width  : surfData->width;
     const uint32_t target_height = (clip_height > 0) ? clip_height : surfData->height;
+    const VdpRect targetRect = {0, 0, target_width, target_height};
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, target_width, target_height, 0, -1.0, 1.0);
-    glViewport(0, 0, target_width, target_height);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    glMatrixMode(GL_TEXTURE);
-    glLoadIdentity();
-    glScalef(1.0f/surfData->width, 1.0f/surfData->height, 1.0f);
-
-    glEnable(GL_TEXTURE_2D);
-    glDisable(GL_BLEND);
-    glBindTexture(GL_TEXTURE_2D, surfData->tex_id);
-    glColor4f(1, 1, 1, 1);
-    glBegin(GL_QUADS);
-        glTexCoord2i(0, 0);                        glVertex2i(0, 0);
-        glTexCoord2i(target_width, 0);             glVertex2i(target_width, 0);
-        glTexCoord2i(target_width, target_height); glVertex2i(target_width, target_height);
-        glTexCoord2i(0, target_height);            glVertex2i(0, target_height);
-    glEnd();
-
-    if (global.quirks.show_watermark) {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glBlendEquation(GL_FUNC_ADD);
-        glBindTexture(GL_TEXTURE_2D, deviceData->watermark_tex_id);
-
-        glMatrixMode(GL_TEXTURE);
-        glLoadIdentity();
-
-        glColor3f(0.8, 0.08, 0.35);
-        glBegin(GL_QUADS);
-            glTexCoord2i(0, 0);
-            glVertex2i(target_width - watermark_width, target_height - watermark_height);
+    renderer_t *renderer = &deviceData->renderer;
+    renderer_set_target(renderer, 0, target_width, target_height, 1);
+    renderer_set_texture_size(renderer, surfData->width, surfData->height);
 
-            glTexCoord2i(1, 0);
-            glVertex2i(target_width, target_height - watermark_height);
+    gl_state_use_program(renderer->textured_program);
+    gl_state_blend(0);
+    gl_state_bind_texture(surfData->tex_id);
+    renderer_draw_quad(renderer, &targetRect, &targetRect, NULL);
 
-            glTexCoord2i(1, 1);
-            glVertex2i(target_width, target_height);
-
-            glTexCoord2i(0, 1);
-            glVertex2i(target_width - watermark_width, target_height);
-        glEnd();
+    if (global.quirks.show_watermark) {
+        const VdpRect watermarkTexRect = {0, 0, 1, 1};
+        const VdpRect watermarkRect = {target_width - watermark_width,
+                                       target_height - watermark_height,
+                                       target_width, target_height};
+        const VdpColor watermark_color = {0.8, 0.08, 0.35, 1.0};
+        gl_state_blend(1);
+        gl_state_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA,
+                            GL_ONE_MINUS_SRC_ALPHA);
+        gl_state_blend_equation(GL_FUNC_ADD, GL_FUNC_ADD);
+        gl_state_bind_texture(deviceData->watermark_tex_id);
+        renderer_set_texture_size(renderer, 1, 1);
+        renderer_draw_quad(renderer, &watermarkTexRect, &watermarkRect, &watermark_color);
     }
+    gl_state_use_program(0);
 
     locked_glXSwapBuffers(deviceData->display, pqueueData->target->drawable);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpPresentationQueueDisplay): gl error %d\n", gl_error);
@@ -1648,11 +4195,42 @@ softVdpVideoSurfaceQueryCapabilities(VdpDevice device, VdpChromaType surface_chr
                                      VdpBool *is_supported, uint32_t *max_width,
                                      uint32_t *max_height)
 {
-    (void)device; (void)surface_chroma_type;
-    // TODO: implement
-    *is_supported = 1;
-    *max_width = 1920;
-    *max_height = 1080;
+    VdpDeviceData *deviceData = handlestorage_get(device, HANDLETYPE_DEVICE);
+    if (NULL == deviceData)
+        return VDP_STATUS_INVALID_HANDLE;
+
+    if (NULL == is_supported || NULL == max_width || NULL == max_height)
+        return VDP_STATUS_INVALID_POINTER;
+
+    *is_supported = !deviceData->va_available ||
+                    0 != chroma_type_to_va_rt_format(surface_chroma_type);
+
+    // every video surface have GL texture attached
+    GLint max_texture_size;
+    glx_context_push_thread_local(deviceData);
+    glx_context_clear_errors();
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+    GLenum gl_error = glGetError();
+    glx_context_pop();
+    if (GL_NO_ERROR != gl_error) {
+        traceError("error (VdpVideoSurfaceQueryCapabilities): gl error %d\n", gl_error);
+        return VDP_STATUS_ERROR;
+    }
+    *max_width = max_texture_size;
+    *max_height = max_texture_size;
+
+    // and if decoding is done through VA-API, it's limited by decoder capabilities too
+    if (deviceData->va_available && deviceData->va_decoder_caps_count > 0) {
+        uint32_t va_max_width = 0;
+        uint32_t va_max_height = 0;
+        for (int k = 0; k < deviceData->va_decoder_caps_count; k ++) {
+            const VdpVaDecoderCaps *caps = &deviceData->va_decoder_caps[k];
+            if (caps->max_width > va_max_width) va_max_width = caps->max_width;
+            if (caps->max_height > va_max_height) va_max_height = caps->max_height;
+        }
+        if (va_max_width < *max_width) *max_width = va_max_width;
+        if (va_max_height < *max_height) *max_height = va_max_height;
+    }
 
     return VDP_STATUS_OK;
 }
@@ -1676,6 +4254,10 @@ softVdpVideoSurfaceCreate(VdpDevice device, VdpChromaType chroma_type, uint32_t
     if (NULL == deviceData)
         return VDP_STATUS_INVALID_HANDLE;
 
+    // decoder should be able to create VA surfaces of the same format
+    if (deviceData->va_available && 0 == chroma_type_to_va_rt_format(chroma_type))
+        return VDP_STATUS_INVALID_CHROMA_TYPE;
+
     VdpVideoSurfaceData *data = (VdpVideoSurfaceData *)calloc(1, sizeof(VdpVideoSurfaceData));
     if (NULL == data)
         return VDP_STATUS_RESOURCES;
@@ -1692,8 +4274,9 @@ softVdpVideoSurfaceCreate(VdpDevice device, VdpChromaType chroma_type, uint32_t
     data->tex_id = 0;
 
     glx_context_push_thread_local(deviceData);
+    glx_context_clear_errors();
     glGenTextures(1, &data->tex_id);
-    glBindTexture(GL_TEXTURE_2D, data->tex_id);
+    gl_state_bind_texture(data->tex_id);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -1716,10 +4299,10 @@ softVdpVideoSurfaceCreate(VdpDevice device, VdpChromaType chroma_type, uint32_t
         data->v_plane = NULL;
         data->u_plane = NULL;
     } else {
-        //TODO: find valid storage size for chroma_type
-        data->y_plane = malloc(stride * height);
-        data->v_plane = malloc(stride * height / chroma_storage_size_divider(chroma_type));
-        data->u_plane = malloc(stride * height / chroma_storage_size_divider(chroma_type));
+        const uint32_t plane_size = stride * height * chroma_bytes_per_sample(chroma_type);
+        data->y_plane = malloc(plane_size);
+        data->v_plane = malloc(plane_size / chroma_storage_size_divider(chroma_type));
+        data->u_plane = malloc(plane_size / chroma_storage_size_divider(chroma_type));
         if (NULL == data->y_plane || NULL == data->v_plane || NULL == data->u_plane) {
             if (data->y_plane) free(data->y_plane);
             if (data->v_plane) free(data->v_plane);
@@ -1744,9 +4327,9 @@ softVdpVideoSurfaceDestroy(VdpVideoSurface surface)
     VdpDeviceData *deviceData = videoSurfData->device;
 
     glx_context_push_thread_local(deviceData);
-    glDeleteTextures(1, &videoSurfData->tex_id);
+    gl_state_delete_textures(1, &videoSurfData->tex_id);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
 
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpVideoSurfaceDestroy): gl error %d\n", gl_error);
@@ -1756,6 +4339,7 @@ softVdpVideoSurfaceDestroy(VdpVideoSurface surface)
 
     if (videoSurfData->va_glx) {
         vaDestroySurfaceGLX(deviceData->va_dpy, videoSurfData->va_glx);
+        gl_state_invalidate_current();
     }
 
     if (deviceData->va_available) {
@@ -1791,6 +4375,85 @@ softVdpVideoSurfaceGetParameters(VdpVideoSurface surface, VdpChromaType *chroma_
     return VDP_STATUS_OK;
 }
 
+/** @brief Check if derived image is one of 4:2:2 layouts va_image_to_packed_422 handles */
+static
+int
+va_image_is_422(const VAImage *q)
+{
+    switch (q->format.fourcc) {
+    case VA_FOURCC('Y', 'U', 'Y', '2'):
+    case VA_FOURCC('U', 'Y', 'V', 'Y'):
+    case VA_FOURCC('4', '2', '2', 'H'):
+    case VA_FOURCC('Y', '2', '1', '0'):
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/** @brief Convert derived image of 4:2:2 surface into packed YUYV or UYVY
+ *
+ *  Drivers give 4:2:2 surfaces as packed 8-bit (YUY2, UYVY), planar 8-bit (422H) or packed
+ *  10-bit (Y210) images. Y210 keeps samples in most significant bits, so taking high byte
+ *  is enough.
+ */
+static
+void
+va_image_to_packed_422(const VAImage *q, const uint8_t *img_data, int uyvy, uint8_t *dst_data,
+                       uint32_t dst_pitch)
+{
+    // destination byte offsets of Y0, Cb, Y1 and Cr in each pair of pixels
+    const int y0 = uyvy ? 1 : 0;
+    const int cb = uyvy ? 0 : 1;
+    const int y1 = uyvy ? 3 : 2;
+    const int cr = uyvy ? 2 : 3;
+
+    for (unsigned int y = 0; y < q->height; y ++) {
+        uint8_t *dst = dst_data + y * dst_pitch;
+        switch (q->format.fourcc) {
+        case VA_FOURCC('Y', 'U', 'Y', '2'):
+        case VA_FOURCC('U', 'Y', 'V', 'Y'):
+            {
+                const uint8_t *src = img_data + q->offsets[0] + y * q->pitches[0];
+                if ((VA_FOURCC('U', 'Y', 'V', 'Y') == q->format.fourcc) == !!uyvy) {
+                    memcpy(dst, src, q->width * 2);
+                    break;
+                }
+                // YUYV and UYVY differ by order of bytes in each pair
+                for (unsigned int x = 0; x < q->width * 2; x += 2) {
+                    dst[x] = src[x + 1];
+                    dst[x + 1] = src[x];
+                }
+            }
+            break;
+        case VA_FOURCC('4', '2', '2', 'H'):
+            {
+                const uint8_t *src_y = img_data + q->offsets[0] + y * q->pitches[0];
+                const uint8_t *src_u = img_data + q->offsets[1] + y * q->pitches[1];
+                const uint8_t *src_v = img_data + q->offsets[2] + y * q->pitches[2];
+                for (unsigned int x = 0; x < q->width / 2; x ++) {
+                    dst[4 * x + y0] = src_y[2 * x];
+                    dst[4 * x + cb] = src_u[x];
+                    dst[4 * x + y1] = src_y[2 * x + 1];
+                    dst[4 * x + cr] = src_v[x];
+                }
+            }
+            break;
+        case VA_FOURCC('Y', '2', '1', '0'):
+            {
+                const uint16_t *src = (const void *)(img_data + q->offsets[0] + y * q->pitches[0]);
+                for (unsigned int x = 0; x < q->width / 2; x ++) {
+                    dst[4 * x + y0] = src[4 * x] >> 8;
+                    dst[4 * x + cb] = src[4 * x + 1] >> 8;
+                    dst[4 * x + y1] = src[4 * x + 2] >> 8;
+                    dst[4 * x + cr] = src[4 * x + 3] >> 8;
+                }
+            }
+            break;
+        }
+    }
+}
+
 VdpStatus
 softVdpVideoSurfaceGetBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat destination_ycbcr_format,
                                 void *const *destination_data, uint32_t const *destination_pitches)
@@ -1861,6 +4524,60 @@ softVdpVideoSurfaceGetBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat destinat
                 }
             }
 
+            vaUnmapBuffer(va_dpy, q.buf);
+        } else if ((VDP_YCBCR_FORMAT_YUYV == destination_ycbcr_format ||
+                    VDP_YCBCR_FORMAT_UYVY == destination_ycbcr_format) &&
+                   va_image_is_422(&q))
+        {
+            uint8_t *img_data;
+            vaMapBuffer(va_dpy, q.buf, (void **)&img_data);
+            va_image_to_packed_422(&q, img_data,
+                                   VDP_YCBCR_FORMAT_UYVY == destination_ycbcr_format,
+                                   destination_data[0], destination_pitches[0]);
+            vaUnmapBuffer(va_dpy, q.buf);
+#ifdef VDP_YCBCR_FORMAT_P010
+        } else if (VA_FOURCC('P', '0', '1', '0') == q.format.fourcc &&
+                   VDP_YCBCR_FORMAT_P010 == destination_ycbcr_format)
+        {
+            uint8_t *img_data;
+            vaMapBuffer(va_dpy, q.buf, (void **)&img_data);
+
+            // same layout as NV12, but with two bytes per sample
+            uint8_t *src = img_data + q.offsets[0];
+            uint8_t *dst = destination_data[0];
+            for (unsigned int y = 0; y < q.height; y ++) {  // Y plane
+                memcpy(dst, src, q.width * 2);
+                src += q.pitches[0];
+                dst += destination_pitches[0];
+            }
+            src = img_data + q.offsets[1];
+            dst = destination_data[1];
+            for (unsigned int y = 0; y < q.height / 2; y ++) {  // UV plane
+                memcpy(dst, src, q.width * 2);
+                src += q.pitches[1];
+                dst += destination_pitches[1];
+            }
+            vaUnmapBuffer(va_dpy, q.buf);
+#endif
+        } else if (VA_FOURCC('P', '0', '1', '0') == q.format.fourcc &&
+                   VDP_YCBCR_FORMAT_NV12 == destination_ycbcr_format)
+        {
+            uint8_t *img_data;
+            vaMapBuffer(va_dpy, q.buf, (void **)&img_data);
+
+            // P010 keeps samples in most significant bits, so taking high byte is enough
+            for (unsigned int y = 0; y < q.height; y ++) {
+                const uint16_t *src = (void *)(img_data + q.offsets[0] + y * q.pitches[0]);
+                uint8_t *dst = (uint8_t *)destination_data[0] + y * destination_pitches[0];
+                for (unsigned int x = 0; x < q.width; x ++)
+                    dst[x] = src[x] >> 8;
+            }
+            for (unsigned int y = 0; y < q.height / 2; y ++) {
+                const uint16_t *src = (void *)(img_data + q.offsets[1] + y * q.pitches[1]);
+                uint8_t *dst = (uint8_t *)destination_data[1] + y * destination_pitches[1];
+                for (unsigned int x = 0; x < q.width; x ++)
+                    dst[x] = src[x] >> 8;
+            }
             vaUnmapBuffer(va_dpy, q.buf);
         } else {
             const char *c = (const char *)&q.format.fourcc;
@@ -1877,7 +4594,7 @@ softVdpVideoSurfaceGetBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat destinat
         return VDP_STATUS_ERROR;
     }
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpVideoSurfaceGetBitsYCbCr): gl error %d\n", gl_error);
         return VDP_STATUS_ERROR;
@@ -1914,9 +4631,9 @@ softVdpVideoSurfacePutBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat source_y
 
         // TODO: other source formats
         struct SwsContext *sws_ctx =
-            sws_getContext(dstSurfData->width, dstSurfData->height, PIX_FMT_YUV420P,
-                           dstSurfData->width, dstSurfData->height, PIX_FMT_BGRA,
-                           SWS_FAST_BILINEAR, NULL, NULL, NULL);
+            sws_cache_get(&deviceData->sws_cache, dstSurfData->width, dstSurfData->height,
+                          PIX_FMT_YUV420P, dstSurfData->width, dstSurfData->height, PIX_FMT_BGRA,
+                          SWS_FAST_BILINEAR);
         if (NULL == sws_ctx) {
             traceError("error (softVdpVideoSurfacePutBitsYCbCr): can not create SwsContext\n");
             free(bgra_buf);
@@ -1932,14 +4649,13 @@ softVdpVideoSurfacePutBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat source_y
             traceError("error (softVdpVideoSurfacePutBitsYCbCr): sws_scale returned %d while "
                        "%d expected\n", res, dstSurfData->height);
             free(bgra_buf);
-            sws_freeContext(sws_ctx);
             return VDP_STATUS_ERROR;
         }
-        sws_freeContext(sws_ctx);
 
-        glBindTexture(GL_TEXTURE_2D, dstSurfData->tex_id);
+        gl_state_bind_texture(dstSurfData->tex_id);
         glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, dstSurfData->width, dstSurfData->height,
                         GL_BGRA, GL_UNSIGNED_BYTE, bgra_buf);
+        dstSurfData->tex_valid = 1;
         free(bgra_buf);
     } else {
         if (VDP_YCBCR_FORMAT_YV12 != source_ycbcr_format) {
@@ -1972,7 +4688,7 @@ softVdpVideoSurfacePutBitsYCbCr(VdpVideoSurface surface, VdpYCbCrFormat source_y
         }
     }
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpVideoSurfacePutBitsYCbCr): gl error %d\n", gl_error);
@@ -2008,9 +4724,11 @@ softVdpBitmapSurfaceQueryCapabilities(VdpDevice device, VdpRGBAFormat surface_rg
     }
 
     GLint max_texture_size;
+    glx_context_push_thread_local(deviceData);
+    glx_context_clear_errors();
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
-
     GLenum gl_error = glGetError();
+    glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpBitmapSurfaceQueryCapabilities): gl error %d\n", gl_error);
         return VDP_STATUS_ERROR;
@@ -2060,7 +4778,8 @@ softVdpBitmapSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
         data->bytes_per_pixel = 4;
         break;
     case VDP_RGBA_FORMAT_A8:
-        data->gl_internal_format = GL_RGBA;
+        // single channel, turned into alpha by swizzle below
+        data->gl_internal_format = GL_R8;
         data->gl_format = GL_RED;
         data->gl_type = GL_UNSIGNED_BYTE;
         data->bytes_per_pixel = 1;
@@ -2080,7 +4799,7 @@ softVdpBitmapSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
     data->frequently_accessed = frequently_accessed;
 
     // Frequently accessed bitmaps reside in system memory rather that in GPU texture.
-    data->dirty = 0;
+    data->dirty_rect_count = 0;
     if (frequently_accessed) {
         data->bitmap_data = (char *)calloc(width * height, data->bytes_per_pixel);
         if (NULL == data->bitmap_data) {
@@ -2093,22 +4812,42 @@ softVdpBitmapSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
     }
 
     glx_context_push_thread_local(deviceData);
-    glGenTextures(1, &data->tex_id);
-    glBindTexture(GL_TEXTURE_2D, data->tex_id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, data->gl_internal_format, width, height, 0,
-                 data->gl_format, data->gl_type, NULL);
-    GLuint gl_error = glGetError();
-    if (GL_NO_ERROR != gl_error) {
-        // Requested RGBA format was wrong
-        traceError("error (VdpBitmapSurfaceCreate): texture failure, gl error (%d, %s)\n", gl_error,
-                   gluErrorString(gl_error));
-        free(data);
-        glx_context_pop();
-        return VDP_STATUS_ERROR;
+    glx_context_clear_errors();
+    data->batch_serial = deviceData->renderer.batch_serial - 1;
+
+    // Small bitmaps, like glyphs, share atlas textures. Larger ones get their own
+    if (0 == bitmap_atlas_alloc(&deviceData->bitmap_atlas, rgba_format,
+                                data->gl_internal_format, data->gl_format, data->gl_type,
+                                width, height, &data->atlas_slot))
+    {
+        data->tex_id = data->atlas_slot.page->tex_id;
+        data->tex_width = BITMAP_ATLAS_PAGE_SIZE;
+        data->tex_height = BITMAP_ATLAS_PAGE_SIZE;
+        gl_state_bind_texture(data->tex_id);
+    } else {
+        data->atlas_slot.page = NULL;
+        data->atlas_slot.x = 0;
+        data->atlas_slot.y = 0;
+        data->tex_width = width;
+        data->tex_height = height;
+        glGenTextures(1, &data->tex_id);
+        gl_state_bind_texture(data->tex_id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, data->gl_internal_format, width, height, 0,
+                     data->gl_format, data->gl_type, NULL);
+        GLuint gl_error = glGetError();
+        if (GL_NO_ERROR != gl_error) {
+            // Requested RGBA format was wrong
+            traceError("error (VdpBitmapSurfaceCreate): texture failure, gl error (%d, %s)\n",
+                       gl_error, gluErrorString(gl_error));
+            free(data->bitmap_data);
+            free(data);
+            glx_context_pop();
+            return VDP_STATUS_ERROR;
+        }
     }
     if (VDP_RGBA_FORMAT_A8 == rgba_format) {
         // map red channel to alpha
@@ -2116,13 +4855,19 @@ softVdpBitmapSurfaceCreate(VdpDevice device, VdpRGBAFormat rgba_format, uint32_t
         glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle_mask);
     }
 
-    gl_error = glGetError();
-    glx_context_pop();
+    GLuint gl_error = glGetError();
     if (GL_NO_ERROR != gl_error) {
+        if (data->atlas_slot.page)
+            bitmap_atlas_free(&deviceData->bitmap_atlas, &data->atlas_slot);
+        else
+            gl_state_delete_textures(1, &data->tex_id);
+        glx_context_pop();
+        free(data->bitmap_data);
         free(data);
         traceError("error (VdpBitmapSurfaceCreate): gl error %d\n", gl_error);
         return VDP_STATUS_ERROR;
     }
+    glx_context_pop();
 
     deviceData->refcount ++;
     *surface = handlestorage_add(data);
@@ -2143,9 +4888,16 @@ softVdpBitmapSurfaceDestroy(VdpBitmapSurface surface)
     }
 
     glx_context_push_thread_local(deviceData);
-    glDeleteTextures(1, &data->tex_id);
+    // pending quads could read freed part of atlas page after it was given to another bitmap
+    renderer_flush_serial(&deviceData->renderer, data->batch_serial);
+    if (data->atlas_slot.page) {
+        bitmap_atlas_free(&deviceData->bitmap_atlas, &data->atlas_slot);
+    } else {
+        renderer_flush_texture(&deviceData->renderer, data->tex_id);
+        gl_state_delete_textures(1, &data->tex_id);
+    }
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpBitmapSurfaceDestroy): gl error %d\n", gl_error);
@@ -2177,6 +4929,68 @@ softVdpBitmapSurfaceGetParameters(VdpBitmapSurface surface, VdpRGBAFormat *rgba_
     return VDP_STATUS_OK;
 }
 
+static
+VdpRect
+rect_union(VdpRect a, VdpRect b)
+{
+    VdpRect r = {
+        .x0 = a.x0 < b.x0 ? a.x0 : b.x0, .y0 = a.y0 < b.y0 ? a.y0 : b.y0,
+        .x1 = a.x1 > b.x1 ? a.x1 : b.x1, .y1 = a.y1 > b.y1 ? a.y1 : b.y1,
+    };
+    return r;
+}
+
+static
+uint64_t
+rect_area(VdpRect r)
+{
+    return (uint64_t)(r.x1 - r.x0) * (r.y1 - r.y0);
+}
+
+/** @brief Add rect to areas of bitmap to be uploaded
+ *
+ *  Touching or overlapping rectangles are merged. If list is full, rect is merged with
+ *  the one whose area grows least, so distant changes, like two subtitle lines at the
+ *  top and bottom of screen, don't turn into upload of everything between them.
+ */
+static
+void
+bitmap_surface_add_dirty_rect(VdpBitmapSurfaceData *data, VdpRect rect)
+{
+    if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1)
+        return;
+
+    uint32_t k = 0;
+    while (k < data->dirty_rect_count) {
+        const VdpRect *r = &data->dirty_rects[k];
+        if (r->x0 <= rect.x1 && rect.x0 <= r->x1 && r->y0 <= rect.y1 && rect.y0 <= r->y1) {
+            // merged rectangle could touch ones already checked, so start over
+            rect = rect_union(rect, *r);
+            data->dirty_rects[k] = data->dirty_rects[-- data->dirty_rect_count];
+            k = 0;
+        } else {
+            k ++;
+        }
+    }
+
+    if (MAX_DIRTY_RECTS == data->dirty_rect_count) {
+        uint32_t best = 0;
+        uint64_t best_growth = UINT64_MAX;
+        for (k = 0; k < data->dirty_rect_count; k ++) {
+            const VdpRect *r = &data->dirty_rects[k];
+            const uint64_t growth = rect_area(rect_union(rect, *r)) - rect_area(*r);
+            if (growth < best_growth) {
+                best = k;
+                best_growth = growth;
+            }
+        }
+        rect = rect_union(rect, data->dirty_rects[best]);
+        data->dirty_rects[best] = data->dirty_rects[-- data->dirty_rect_count];
+    }
+
+    data->dirty_rects[data->dirty_rect_count ++] = rect;
+}
+
 VdpStatus
 softVdpBitmapSurfacePutBitsNative(VdpBitmapSurface surface, void const *const *source_data,
                                   uint32_t const *source_pitches, VdpRect const *destination_rect)
@@ -2190,6 +5004,13 @@ softVdpBitmapSurfacePutBitsNative(VdpBitmapSurface surface, void const *const *s
     if (destination_rect)
         d_rect = *destination_rect;
 
+    // writes outside of surface would go to neighbours in atlas page or past bitmap_data
+    if (d_rect.x0 > d_rect.x1 || d_rect.y0 > d_rect.y1 ||
+        d_rect.x1 > dstSurfData->width || d_rect.y1 > dstSurfData->height)
+    {
+        return VDP_STATUS_INVALID_VALUE;
+    }
+
     if (dstSurfData->frequently_accessed) {
         if (0 == d_rect.x0 && dstSurfData->width == d_rect.x1 && source_pitches[0] == d_rect.x1) {
             // full width
@@ -2207,22 +5028,24 @@ softVdpBitmapSurfacePutBitsNative(VdpBitmapSurface surface, void const *const *s
                        bytes_in_line);
             }
         }
-        dstSurfData->dirty = 1;
+        bitmap_surface_add_dirty_rect(dstSurfData, d_rect);
     } else {
         glx_context_push_thread_local(deviceData);
+        renderer_flush_serial(&deviceData->renderer, dstSurfData->batch_serial);
 
-        glBindTexture(GL_TEXTURE_2D, dstSurfData->tex_id);
+        gl_state_bind_texture(dstSurfData->tex_id);
         glPixelStorei(GL_UNPACK_ROW_LENGTH, source_pitches[0]/dstSurfData->bytes_per_pixel);
         if (4 != dstSurfData->bytes_per_pixel)
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, d_rect.x0, d_rect.y0,
+        glTexSubImage2D(GL_TEXTURE_2D, 0, dstSurfData->atlas_slot.x + d_rect.x0,
+            dstSurfData->atlas_slot.y + d_rect.y0,
             d_rect.x1 - d_rect.x0, d_rect.y1 - d_rect.y0,
             dstSurfData->gl_format, dstSurfData->gl_type, source_data[0]);
         glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
         if (4 != dstSurfData->bytes_per_pixel)
             glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-        GLenum gl_error = glGetError();
+        GLenum gl_error = glx_context_check_error();
         glx_context_pop();
         if (GL_NO_ERROR != gl_error) {
             traceError("error (VdpBitmapSurfacePutBitsNative): gl error %d\n", gl_error);
@@ -2325,15 +5148,37 @@ softVdpDeviceDestroy(VdpDevice device)
         return VDP_STATUS_ERROR;
     }
 
+    traceInfo("GL state cache: %llu redundant state changes skipped\n",
+              (unsigned long long)gl_state_get_skipped_calls());
+
     // cleaup libva
     if (data->va_available)
         vaTerminate(data->va_dpy);
 
+    sws_cache_clear(&data->sws_cache);
+
     XLockDisplay(data->display);
 
     glx_context_push_thread_local(data);
-    glDeleteTextures(1, &data->watermark_tex_id);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glx_context_clear_errors();
+    gl_state_delete_textures(1, &data->watermark_tex_id);
+    renderer_destroy(&data->renderer);
+    bitmap_atlas_destroy(&data->bitmap_atlas);
+    if (data->ycbcr_shader.program) {
+        glDeleteProgram(data->ycbcr_shader.program);
+        gl_state_delete_textures(3, data->ycbcr_shader.tex_id);
+    }
+    if (data->rgb_shader.program)
+        glDeleteProgram(data->rgb_shader.program);
+    if (data->filter_shader.program)
+        glDeleteProgram(data->filter_shader.program);
+    if (data->scaler_shader.program)
+        glDeleteProgram(data->scaler_shader.program);
+    if (data->bob_shader.program)
+        glDeleteProgram(data->bob_shader.program);
+    if (data->temporal_shader.program)
+        glDeleteProgram(data->temporal_shader.program);
+    gl_state_bind_framebuffer(0);
     glx_context_pop();
 
     locked_glXMakeCurrent(data->display, None, NULL);
@@ -2370,28 +5215,7 @@ softVdpGenerateCSCMatrix(VdpProcamp *procamp, VdpColorStandard standard, VdpCSCM
     if (VDP_PROCAMP_VERSION != procamp->struct_version)
         return VDP_STATUS_INVALID_VALUE;
 
-    VdpCSCMatrix *m = csc_matrix;
-    switch (standard) {
-    case VDP_COLOR_STANDARD_ITUR_BT_601:
-        (*m)[0][0] = 1.16438f; (*m)[0][1] =  0.0f;     (*m)[0][2] =  1.59603f; (*m)[0][3] = -222.921f;
-        (*m)[1][0] = 1.16438f; (*m)[1][1] = -0.39176f; (*m)[1][2] = -0.81297f; (*m)[1][3] =  135.576f;
-        (*m)[2][0] = 1.16438f; (*m)[2][1] =  2.01723f; (*m)[2][2] =  0.0f;     (*m)[2][3] = -276.836f;
-        break;
-    case VDP_COLOR_STANDARD_ITUR_BT_709:
-        (*m)[0][0] =  1.0f; (*m)[0][1] =  0.0f;     (*m)[0][2] =  1.402f;   (*m)[0][3] = -179.456f;
-        (*m)[1][0] =  1.0f; (*m)[1][1] = -0.34414f; (*m)[1][2] = -0.71414f; (*m)[1][3] =  135.460f;
-        (*m)[2][0] =  1.0f; (*m)[2][1] =  1.772f;   (*m)[2][2] =  0.0f;     (*m)[2][3] = -226.816f;
-        break;
-    case VDP_COLOR_STANDARD_SMPTE_240M:
-        (*m)[0][0] =  0.58139f; (*m)[0][1] = -0.76437f; (*m)[0][2] =  1.5760f;  (*m)[0][3] = 0.0f;
-        (*m)[1][0] =  0.58140f; (*m)[1][1] = -0.99101f; (*m)[1][2] = -0.47663f; (*m)[1][3] = 0.0f;
-        (*m)[2][0] =  0.58139f; (*m)[2][1] =  1.0616f;  (*m)[2][2] =  0.00000f; (*m)[2][3] = 0.0f;
-        break;
-    default:
-        return VDP_STATUS_INVALID_COLOR_STANDARD;
-    }
-
-    return VDP_STATUS_OK;
+    return generate_csc_matrix(procamp, standard, csc_matrix);
 }
 
 static
@@ -2502,6 +5326,26 @@ vdpBlendStateToGLBlendState(VdpOutputSurfaceRenderBlendState const *blend_state)
     return bs;
 }
 
+/** @brief Make destination alpha factors read value of A8 destination
+ *
+ *  A8 output surfaces are stored in GL_R8 textures, so their value is in red channel, while
+ *  destination alpha reads as one. Factors using destination alpha are replaced with ones
+ *  using destination color, which is that value.
+ */
+static
+void
+blend_state_for_a8_destination(struct blend_state_struct *bs)
+{
+    GLuint *funcs[4] = { &bs->srcFuncRGB, &bs->srcFuncAlpha,
+                         &bs->dstFuncRGB, &bs->dstFuncAlpha };
+    for (int k = 0; k < 4; k ++) {
+        if (GL_DST_ALPHA == *funcs[k])
+            *funcs[k] = GL_DST_COLOR;
+        else if (GL_ONE_MINUS_DST_ALPHA == *funcs[k])
+            *funcs[k] = GL_ONE_MINUS_DST_COLOR;
+    }
+}
+
 VdpStatus
 softVdpOutputSurfaceRenderOutputSurface(VdpOutputSurface destination_surface,
                                         VdpRect const *destination_rect,
@@ -2545,46 +5389,27 @@ softVdpOutputSurfaceRenderOutputSurface(VdpOutputSurface destination_surface,
         return VDP_STATUS_INVALID_BLEND_FACTOR;
     if (bs.invalid_eq)
         return VDP_STATUS_INVALID_BLEND_EQUATION;
+    if (VDP_RGBA_FORMAT_A8 == dstSurfData->rgba_format)
+        blend_state_for_a8_destination(&bs);
 
     glx_context_push_thread_local(deviceData);
-    glBindFramebuffer(GL_FRAMEBUFFER, dstSurfData->fbo_id);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, dstWidth, 0, dstHeight, -1.0f, 1.0f);
-    glViewport(0, 0, dstWidth, dstHeight);
-    glEnable(GL_TEXTURE_2D);
-    glEnable(GL_BLEND);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
 
-    // paint source surface over
-    glBindTexture(GL_TEXTURE_2D, srcSurfData->tex_id);
-
-    glMatrixMode(GL_TEXTURE);
-    glLoadIdentity();
-    glScalef(1.0f/srcWidth, 1.0f/srcHeight, 1.0f);
-
-    // blend
-    glBlendFuncSeparate(bs.srcFuncRGB, bs.dstFuncRGB, bs.srcFuncAlpha, bs.dstFuncAlpha);
-    glBlendEquationSeparate(bs.modeRGB, bs.modeAlpha);
+    // paint source surface over. Drawing is deferred, so consecutive calls with the same
+    // surfaces and blending are drawn at once
+    renderer_batch_state_t state = {
+        .fbo = dstSurfData->fbo_id, .dst_tex_id = dstSurfData->tex_id,
+        .dst_width = dstWidth, .dst_height = dstHeight,
+        .tex_id = srcSurfData->tex_id, .tex_width = srcWidth, .tex_height = srcHeight,
+        .blend_src_rgb = bs.srcFuncRGB, .blend_dst_rgb = bs.dstFuncRGB,
+        .blend_src_alpha = bs.srcFuncAlpha, .blend_dst_alpha = bs.dstFuncAlpha,
+        .blend_eq_rgb = bs.modeRGB, .blend_eq_alpha = bs.modeAlpha,
+    };
 
     // TODO: handle colors for every corner
     // TODO: handle rotation (flags)
-    glColor4f(1, 1, 1, 1);
-    if (colors)
-        glColor4f(colors[0].red, colors[0].green, colors[0].blue, colors[0].alpha);
-
-    glBegin(GL_QUADS);
-    glTexCoord2i(s_rect.x0, s_rect.y0); glVertex2f(d_rect.x0, d_rect.y0);
-    glTexCoord2i(s_rect.x1, s_rect.y0); glVertex2f(d_rect.x1, d_rect.y0);
-    glTexCoord2i(s_rect.x1, s_rect.y1); glVertex2f(d_rect.x1, d_rect.y1);
-    glTexCoord2i(s_rect.x0, s_rect.y1); glVertex2f(d_rect.x0, d_rect.y1);
-    glEnd();
-
-    glColor4f(1, 1, 1, 1);
+    renderer_batch_quad(&deviceData->renderer, &state, &s_rect, 0.0f, &d_rect, colors);
 
-    GLenum gl_error = glGetError();
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpOutputSurfaceRenderOutputSurface): gl error %d\n", gl_error);
@@ -2631,55 +5456,74 @@ softVdpOutputSurfaceRenderBitmapSurface(VdpOutputSurface destination_surface,
         return VDP_STATUS_INVALID_BLEND_FACTOR;
     if (bs.invalid_eq)
         return VDP_STATUS_INVALID_BLEND_EQUATION;
+    if (VDP_RGBA_FORMAT_A8 == dstSurfData->rgba_format)
+        blend_state_for_a8_destination(&bs);
 
     glx_context_push_thread_local(deviceData);
-    glBindFramebuffer(GL_FRAMEBUFFER, dstSurfData->fbo_id);
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    glOrtho(0, dstSurfData->width, 0, dstSurfData->height, -1.0f, 1.0f);
-    glViewport(0, 0, dstSurfData->width, dstSurfData->height);
-    glEnable(GL_TEXTURE_2D);
-    glEnable(GL_BLEND);
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    // paint source surface over
-    glBindTexture(GL_TEXTURE_2D, srcSurfData->tex_id);
-    if (srcSurfData->dirty) {
+
+    if (srcSurfData->dirty_rect_count > 0) {
+        // upload only changed areas, picking them from system-memory buffer
+        renderer_flush_serial(&deviceData->renderer, srcSurfData->batch_serial);
+        gl_state_bind_texture(srcSurfData->tex_id);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, srcSurfData->width);
         if (4 != srcSurfData->bytes_per_pixel)
             glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, srcSurfData->width, srcSurfData->height,
-                        srcSurfData->gl_format, srcSurfData->gl_type, srcSurfData->bitmap_data);
+        for (uint32_t k = 0; k < srcSurfData->dirty_rect_count; k ++) {
+            const VdpRect *r = &srcSurfData->dirty_rects[k];
+            glPixelStorei(GL_UNPACK_SKIP_PIXELS, r->x0);
+            glPixelStorei(GL_UNPACK_SKIP_ROWS, r->y0);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, srcSurfData->atlas_slot.x + r->x0,
+                            srcSurfData->atlas_slot.y + r->y0, r->x1 - r->x0, r->y1 - r->y0,
+                            srcSurfData->gl_format, srcSurfData->gl_type,
+                            srcSurfData->bitmap_data);
+        }
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
         if (4 != srcSurfData->bytes_per_pixel)
             glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-        srcSurfData->dirty = 0;
+        srcSurfData->dirty_rect_count = 0;
     }
 
-    glMatrixMode(GL_TEXTURE);
-    glLoadIdentity();
-    glScalef(1.0f/srcSurfData->width, 1.0f/srcSurfData->height, 1.0f);
-
-    // blend
-    glBlendFuncSeparate(bs.srcFuncRGB, bs.dstFuncRGB, bs.srcFuncAlpha, bs.dstFuncAlpha);
-    glBlendEquationSeparate(bs.modeRGB, bs.modeAlpha);
+    // paint source surface over. Drawing is deferred, so glyphs and boxes drawn one by one
+    // end up in a single draw call. Glyphs from the same atlas page share texture, so they
+    // don't break batch
+    renderer_batch_state_t state = {
+        .fbo = dstSurfData->fbo_id, .dst_tex_id = dstSurfData->tex_id,
+        .dst_width = dstSurfData->width, .dst_height = dstSurfData->height,
+        .tex_id = srcSurfData->tex_id,
+        .tex_width = srcSurfData->tex_width, .tex_height = srcSurfData->tex_height,
+        .blend_src_rgb = bs.srcFuncRGB, .blend_dst_rgb = bs.dstFuncRGB,
+        .blend_src_alpha = bs.srcFuncAlpha, .blend_dst_alpha = bs.dstFuncAlpha,
+        .blend_eq_rgb = bs.modeRGB, .blend_eq_alpha = bs.modeAlpha,
+    };
 
     // TODO: handle colors for every corner
     // TODO: handle rotation (flags)
-    glColor4f(1, 1, 1, 1);
-    if (colors)
-        glColor4f(colors[0].red, colors[0].green, colors[0].blue, colors[0].alpha);
-
-    glBegin(GL_QUADS);
-    glTexCoord2i(srcRect.x0, srcRect.y0);   glVertex2f(dstRect.x0, dstRect.y0);
-    glTexCoord2i(srcRect.x1, srcRect.y0);   glVertex2f(dstRect.x1, dstRect.y0);
-    glTexCoord2i(srcRect.x1, srcRect.y1);   glVertex2f(dstRect.x1, dstRect.y1);
-    glTexCoord2i(srcRect.x0, srcRect.y1);   glVertex2f(dstRect.x0, dstRect.y1);
-    glEnd();
-
-    glColor4f(1, 1, 1, 1);
-
-    GLenum gl_error = glGetError();
+    GLfloat src_inset = 0.0f;
+    if (srcSurfData->atlas_slot.page) {
+        // Atlas page edges are not bitmap edges, so GL_CLAMP_TO_EDGE doesn't apply. Source
+        // rectangle is kept inside bitmap, and when scaled, texture coordinates are moved
+        // half a texel inwards, so linear filter doesn't sample gap or neighbours
+        srcRect.x0 = MIN(srcRect.x0, srcSurfData->width);
+        srcRect.x1 = MIN(srcRect.x1, srcSurfData->width);
+        srcRect.y0 = MIN(srcRect.y0, srcSurfData->height);
+        srcRect.y1 = MIN(srcRect.y1, srcSurfData->height);
+        const int src_w = ABS((int)srcRect.x1 - (int)srcRect.x0);
+        const int src_h = ABS((int)srcRect.y1 - (int)srcRect.y0);
+        const int dst_w = ABS((int)dstRect.x1 - (int)dstRect.x0);
+        const int dst_h = ABS((int)dstRect.y1 - (int)dstRect.y0);
+        if (src_w != dst_w || src_h != dst_h)
+            src_inset = 0.5f;
+    }
+    srcRect.x0 += srcSurfData->atlas_slot.x;
+    srcRect.x1 += srcSurfData->atlas_slot.x;
+    srcRect.y0 += srcSurfData->atlas_slot.y;
+    srcRect.y1 += srcSurfData->atlas_slot.y;
+    renderer_batch_quad(&deviceData->renderer, &state, &srcRect, src_inset, &dstRect, colors);
+    srcSurfData->batch_serial = deviceData->renderer.batch_serial;
+
+    GLenum gl_error = glx_context_check_error();
     glx_context_pop();
     if (GL_NO_ERROR != gl_error) {
         traceError("error (VdpOutputSurfaceRenderBitmapSurface): gl error %d\n", gl_error);
@@ -2726,6 +5570,7 @@ softVdpPresentationQueueTargetCreateX11(VdpDevice device, Drawable drawable,
     // create context for dislaying result (can share display lists with deviceData->glc
     XLockDisplay(deviceData->display);
     data->glc = glXCreateContext(deviceData->display, vi, deviceData->root_glc, GL_TRUE);
+    data->debug_output = -1;
     XUnlockDisplay(deviceData->display);
 
     deviceData->refcount ++;
@@ -2927,6 +5772,9 @@ softVdpGetProcAddress(VdpDevice device, VdpFuncId function_id, void **function_p
     case VDP_FUNC_ID_BASE_WINSYS:
         *function_pointer = &lockedVdpPresentationQueueTargetCreateX11;
         break;
+    case VDP_FUNC_ID_DECODER_GET_STATS_VA_GL:
+        *function_pointer = &lockedVdpDecoderGetStatsVaGl;
+        break;
     default:
         *function_pointer = NULL;
         break;
@@ -2973,14 +5821,20 @@ softVdpDeviceCreateX11(Display *display_orig, int screen, VdpDevice *device,
     data->root_glc = glx_context_get_root_context();
 
     glx_context_push_thread_local(data);
+    glx_context_clear_errors();
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    if (0 != renderer_init(&data->renderer)) {
+        // reason was already reported by renderer_init
+        traceError("error (VdpDeviceCreateX11): GL renderer initialization failed\n");
+        glx_context_pop();
+        glx_context_unref_glc_hash_table(display);
+        XUnlockDisplay(display);
+        handlestorage_xdpy_copy_unref(display_orig);
+        free(data);
+        return VDP_STATUS_ERROR;
+    }
 
     // initialize VAAPI
     if (global.quirks.avoid_va) {
@@ -2996,6 +5850,15 @@ softVdpDeviceCreateX11(Display *display_orig, int screen, VdpDevice *device,
             data->va_available = 1;
             traceInfo("libva (version %d.%d) library initialized\n",
                       data->va_version_major, data->va_version_minor);
+            query_va_decoder_caps(data);
+
+            // mixer features are reported supported only if their shaders could be built
+            rgb_shader_prepare(&data->temporal_shader, "temporal deinterlacing",
+                               shader_deinterlace_temporal);
+            rgb_shader_prepare(&data->scaler_shader, "high quality scaling",
+                               shader_scale_separable);
+            rgb_shader_prepare(&data->filter_shader, "noise reduction and sharpening",
+                               shader_rgb_filter);
         } else {
             data->va_available = 0;
             traceInfo("warning: failed to initialize libva. "
@@ -3004,7 +5867,7 @@ softVdpDeviceCreateX11(Display *display_orig, int screen, VdpDevice *device,
     }
 
     glGenTextures(1, &data->watermark_tex_id);
-    glBindTexture(GL_TEXTURE_2D, data->watermark_tex_id);
+    gl_state_bind_texture(data->watermark_tex_id);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -3016,7 +5879,7 @@ softVdpDeviceCreateX11(Display *display_orig, int screen, VdpDevice *device,
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_ONE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_RED);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, watermark_width, watermark_height, 0, GL_RED,
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, watermark_width, watermark_height, 0, GL_RED,
                  GL_UNSIGNED_BYTE, watermark_data);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
@@ -12,7 +12,47 @@
 #include <GL/glx.h>
 #include <vdpau/vdpau.h>
 #include <va/va.h>
+#include "bitmap-atlas.h"
+#include "decoder-stats.h"
 #include "handle-storage.h"
+#include "renderer.h"
+#include "sws-cache.h"
+
+#define MAX_VA_DECODER_PROFILES     32
+
+/** @brief VA-API decoder limits for one profile */
+typedef struct {
+    VAProfile   profile;
+    uint32_t    max_width;
+    uint32_t    max_height;
+} VdpVaDecoderCaps;
+
+/** @brief GPU color space conversion of software-decoded video surfaces */
+typedef struct {
+    GLuint      program;            ///< shader program, 0 if not created yet
+    int         unavailable;        ///< 1 if shader program can't be created
+    GLint       csc_location;       ///< location of csc uniform
+    GLuint      tex_id[3];          ///< Y, Cb and Cr plane textures
+    uint32_t    tex_width[3];
+    uint32_t    tex_height[3];
+    GLenum      tex_type;           ///< pixel type of plane textures
+} VdpYCbCrShader;
+
+/** @brief GPU processing of RGB video surfaces, filled by VA-API: color adjustment and
+ *  deinterlacing */
+typedef struct {
+    GLuint      program;            ///< shader program, 0 if not created yet
+    int         unavailable;        ///< 1 if shader program can't be created
+    GLint       transform_location; ///< location of transform uniform
+    GLint       tex_height_location;///< location of tex_height uniform, deinterlacers only
+    GLint       field_location;     ///< location of field uniform, deinterlacers only
+    GLint       tex_size_location;  ///< location of tex_size uniform, scaler only
+    GLint       direction_location; ///< location of direction uniform, scaler only
+    GLint       support_location;   ///< location of support uniform, scaler only
+    GLint       scale_location;     ///< location of scale uniform, scaler only
+    GLint       denoise_location;   ///< location of denoise uniform, filter only
+    GLint       sharpness_location; ///< location of sharpness uniform, filter only
+} VdpRGBShader;
 
 /** @brief VdpDevice object parameters */
 typedef struct {
@@ -28,7 +68,18 @@ typedef struct {
     int         va_available;       ///< 1 if VA-API available
     int         va_version_major;
     int         va_version_minor;
+    VdpVaDecoderCaps va_decoder_caps[MAX_VA_DECODER_PROFILES]; ///< profiles having VLD entrypoint
+    int         va_decoder_caps_count;
     GLuint      watermark_tex_id;   ///< GL texture id for watermark
+    renderer_t  renderer;           ///< quad drawing shared by all render functions
+    bitmap_atlas_t bitmap_atlas;    ///< shared textures for small bitmap surfaces
+    sws_cache_t sws_cache;          ///< libswscale contexts for software conversions
+    VdpYCbCrShader ycbcr_shader;    ///< used by video mixer if VA-API is not available
+    VdpRGBShader rgb_shader;        ///< used by video mixer to apply CSC matrix to VA output
+    VdpRGBShader bob_shader;        ///< used by video mixer for bob deinterlacing
+    VdpRGBShader temporal_shader;   ///< used by video mixer for temporal deinterlacing
+    VdpRGBShader scaler_shader;     ///< used by video mixer for high quality scaling
+    VdpRGBShader filter_shader;     ///< used by video mixer for noise reduction and sharpening
 } VdpDeviceData;
 
 
@@ -42,6 +93,7 @@ VdpDecoderCreate softVdpDecoderCreate;
 VdpDecoderDestroy softVdpDecoderDestroy;
 VdpDecoderGetParameters softVdpDecoderGetParameters;
 VdpDecoderRender softVdpDecoderRender;
+VdpDecoderGetStatsVaGl softVdpDecoderGetStatsVaGl;
 VdpOutputSurfaceQueryCapabilities softVdpOutputSurfaceQueryCapabilities;
 VdpOutputSurfaceQueryGetPutBitsNativeCapabilities softVdpOutputSurfaceQueryGetPutBitsNativeCapabilities;
 VdpOutputSurfaceQueryPutBitsIndexedCapabilities softVdpOutputSurfaceQueryPutBitsIndexedCapabilities;
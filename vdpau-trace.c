@@ -159,6 +159,15 @@ traceVdpDecoderGetParameters(const char *impl_state, VdpDecoder decoder,
     fprintf(tlog, "%s%s VdpDecoderGetParameters decoder=%d\n", trace_header, impl_state, decoder);
 }
 
+void
+traceVdpDecoderGetStatsVaGl(const char *impl_state, VdpDecoder decoder,
+                            VdpDecoderStatsVaGl *stats)
+{
+    (void)stats;
+    if (!enabled) return;
+    fprintf(tlog, "%s%s VdpDecoderGetStatsVaGl decoder=%d\n", trace_header, impl_state, decoder);
+}
+
 void
 traceVdpDecoderRender(const char *impl_state, VdpDecoder decoder, VdpVideoSurface target,
                       VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,
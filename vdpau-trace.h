@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <vdpau/vdpau.h>
 #include <vdpau/vdpau_x11.h>
+#include "decoder-stats.h"
 #include "reverse-constant.h"
 
 void
@@ -59,6 +60,10 @@ void
 traceVdpDecoderGetParameters(const char *impl_state, VdpDecoder decoder,
                              VdpDecoderProfile *profile, uint32_t *width, uint32_t *height);
 
+void
+traceVdpDecoderGetStatsVaGl(const char *impl_state, VdpDecoder decoder,
+                            VdpDecoderStatsVaGl *stats);
+
 void
 traceVdpDecoderRender(const char *impl_state, VdpDecoder decoder, VdpVideoSurface target,
                       VdpPictureInfo const *picture_info, uint32_t bitstream_buffer_count,